@@ -1,2 +1,7 @@
+/* Needed for GNU extensions like pthread_setaffinity_np(). This must come before any system headers. */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #define C89THREAD_IMPLEMENTATION
 #include "c89thread.h"
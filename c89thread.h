@@ -30,6 +30,8 @@ In addition to types defined by the C11 standard, c89thread also implements the
     +----------------+-------------+
     | c89sem_t       | Semaphore   |
     | c89evnt_t      | Event       |
+    | c89barrier_t   | Barrier     |
+    | c89latch_t     | Latch       |
     +----------------+-------------+
 
 The C11 threading library uses the timespec function for specifying times, however this is not well
@@ -49,7 +51,9 @@ global level with `c89thread_set_allocation_callbacks()`. This is not thread saf
 from any thread so long as you do your own synchronization. Threads can be created with an extended
 function called `c89thrd_create_ex()` which takes a pointer to a structure containing custom allocation
 callbacks which will be used instead of the global callbacks if specified. This function is specific to
-c89thread and is not usable if you require strict C11 compatibility.
+c89thread and is not usable if you require strict C11 compatibility. For more control there is
+`c89thrd_create_ex2()` which takes a `c89thrd_attr` structure, initialized with `c89thrd_attr_init()`,
+that can also be used to pin the new thread to a set of CPUs.
 
 This is still work-in-progress and not much testing has been done. Use at your own risk.
 
@@ -106,6 +110,14 @@ typedef unsigned int c89thread_uint32;
 #endif
 typedef void* c89thread_handle;
 
+/*
+Used for padding out members of synchronization primitives that are written to by many threads so they
+don't share a cache line with members that are being spun on.
+*/
+#ifndef C89THREAD_CACHE_LINE_SIZE
+#define C89THREAD_CACHE_LINE_SIZE   64
+#endif
+
 #if defined(_WIN32) && !defined(C89THREAD_USE_PTHREAD)
     /* Win32. Do *not* include windows.h here. It will be included in the implementation section. */
     #define C89THREAD_WIN32
@@ -193,6 +205,11 @@ void  c89thread_free(void* p, const c89thread_allocation_callbacks* pCallbacks);
 #define TIME_UTC    1
 #endif
 
+/* Only used with c89timespec_get() and c89thrd_sleep_until(). Same as c89timespec_now_monotonic(). */
+#ifndef TIME_MONOTONIC
+#define TIME_MONOTONIC  2
+#endif
+
 #if (defined(_MSC_VER) && _MSC_VER < 1900) || defined(__DMC__)  /* 1900 = Visual Studio 2015 */
 struct timespec
 {
@@ -203,6 +220,13 @@ struct timespec
 
 int c89timespec_get(struct timespec* ts, int base);
 struct timespec c89timespec_now(void);
+
+/*
+Retrieves the time of a clock that only ever moves forward at a steady rate. Unlike c89timespec_now()
+it is not affected by changes to the system time, such as an NTP step. The epoch is unspecified so it
+should only be used for measuring intervals and as the time point of the `_monotonic` waits.
+*/
+struct timespec c89timespec_now_monotonic(void);
 struct timespec c89timespec_nanoseconds(time_t nanoseconds);
 struct timespec c89timespec_milliseconds(time_t milliseconds);
 struct timespec c89timespec_seconds(time_t seconds);
@@ -212,6 +236,29 @@ int c89timespec_cmp(struct timespec tsA, struct timespec tsB);
 /* END c89thread_timespec.h */
 
 
+/* BEG c89thread_cpu_set.h */
+/*
+A set of logical CPUs, used for thread affinity. CPUs are identified by the number the OS uses for them,
+which is the same as the `id` member of c89thread_cpu_info. CPUs numbered C89THREAD_MAX_CPUS and above
+cannot be represented and are ignored.
+*/
+#ifndef C89THREAD_MAX_CPUS
+#define C89THREAD_MAX_CPUS  1024
+#endif
+
+typedef struct
+{
+    c89thread_uint32 bits[(C89THREAD_MAX_CPUS + 31) / 32];
+} c89thread_cpu_set;
+
+void c89thread_cpu_set_zero(c89thread_cpu_set* pSet);
+void c89thread_cpu_set_add(c89thread_cpu_set* pSet, unsigned int cpu);
+void c89thread_cpu_set_remove(c89thread_cpu_set* pSet, unsigned int cpu);
+int c89thread_cpu_set_contains(const c89thread_cpu_set* pSet, unsigned int cpu);
+unsigned int c89thread_cpu_set_count(const c89thread_cpu_set* pSet);
+/* END c89thread_cpu_set.h */
+
+
 /* BEG c89thread_types.h */
 /* c89thrd_t */
 #if defined(C89THREAD_WIN32)
@@ -224,6 +271,29 @@ typedef struct
 typedef c89thread_pthread_t c89thrd_t;
 #endif
 
+/* The OS's own thread object. HANDLE on Windows, pthread_t otherwise. */
+#if defined(C89THREAD_WIN32)
+typedef c89thread_handle c89thrd_native_handle_t;
+#else
+typedef c89thread_pthread_t c89thrd_native_handle_t;
+#endif
+
+/* Scheduling policies for c89thrd_attr::schedPolicy and c89thrd_set_priority(). */
+enum
+{
+    c89thrd_sched_inherit = 0,  /* Use the policy of the creating thread. Only valid with c89thrd_attr. */
+    c89thrd_sched_other   = 1,  /* The normal time sharing policy. SCHED_OTHER. */
+    c89thrd_sched_batch   = 2,  /* For CPU bound background work. SCHED_BATCH. */
+    c89thrd_sched_idle    = 3,  /* Only runs when nothing else wants the CPU. SCHED_IDLE. */
+    c89thrd_sched_fifo    = 4,  /* Real time, first in first out. SCHED_FIFO. */
+    c89thrd_sched_rr      = 5   /* Real time, round robin. SCHED_RR. */
+};
+
+/* Names longer than this, including the null terminator, are truncated. Linux truncates further to 15 characters. */
+#ifndef C89THREAD_MAX_THREAD_NAME_LENGTH
+#define C89THREAD_MAX_THREAD_NAME_LENGTH    64
+#endif
+
 typedef int (* c89thrd_start_t)(void*);
 
 typedef void (* c89thrd_on_entry_t)(void*);
@@ -236,6 +306,64 @@ typedef struct
     c89thrd_on_exit_t onExit;
 } c89thread_entry_exit_callbacks;
 
+/*
+Optional attributes for creating a thread with c89thrd_create_ex2(). Initialize this with
+c89thrd_attr_init() and then set the members you care about. Any pointers only need to remain valid for
+the duration of the call to c89thrd_create_ex2().
+
+When `pAffinity` is set, the thread is restricted to those CPUs before it runs any code so that it never
+starts on, and touches memory from, a CPU it's not supposed to be running on. On Linux, affinity
+requires the implementation to be compiled with `_GNU_SOURCE` defined before any system headers are
+included. When it's not available, creating a thread with an affinity mask will fail with
+`c89thrd_error`. On Windows only the first 64 CPUs can be used.
+
+`stackSize` is the size of the thread's stack in bytes. When zero, the system default is used which is
+typically 8MB with pthreads and 1MB with Windows. A small stack is useful when creating a large number of
+threads that don't need much stack space since each stack reserves its own range of address space. With
+pthreads it will be rounded up to PTHREAD_STACK_MIN. On Windows it's used as the reservation size.
+
+`guardSize` is the size of the inaccessible region at the end of the stack that catches overflows. Zero
+uses the system default. This is ignored on Windows where the guard page is managed by the OS.
+
+`pStack` is an optional buffer of `stackSize` bytes to use for the stack instead of letting the system
+allocate one. You can allocate this with your own allocation callbacks. It's owned by the caller and must
+remain valid until the thread has been joined, or has terminated if it's detached. It should be aligned
+to the page size. glibc places the thread's thread local storage at the top of the stack so leave room
+for it. No guard region is set up in this case. This is not supported on Windows.
+
+`pName` is the name to give the thread. It's set from the new thread itself before any of your code,
+including the entry callback, is run so that it's named for its entire lifetime. See c89thrd_set_name().
+
+`schedPolicy` and `schedPriority` set the scheduling policy of the thread. See c89thrd_set_priority()
+for their meaning. `nice` is the nice value of the thread, from -20 (highest priority) to 19 (lowest
+priority), with zero leaving it unchanged. Nice values are per-thread only on Linux so this will fail on
+other pthread platforms. These are applied before the thread runs any of your code and if any of them
+fail, which is normally due to a lack of permission, thread creation fails with `c89thrd_error`.
+
+Normally the data needed to start the thread is allocated from the heap by the creating thread and freed
+by the new thread. When `noAlloc` is set it's instead placed on the creating thread's stack, and
+c89thrd_create_ex2() waits for the new thread to pick it up before returning. Nothing is allocated in
+this case, not even with `pAllocationCallbacks`, at the expense of the creating thread blocking until the
+new thread has been scheduled.
+*/
+typedef struct
+{
+    const c89thread_entry_exit_callbacks* pEntryExitCallbacks;
+    const c89thread_allocation_callbacks* pAllocationCallbacks;
+    const c89thread_cpu_set* pAffinity;     /* Set to NULL to inherit the affinity of the calling thread. */
+    size_t stackSize;                       /* Set to 0 to use the default. */
+    size_t guardSize;                       /* Set to 0 to use the default. */
+    void* pStack;                           /* Optional. Must be `stackSize` bytes. */
+    const char* pName;                      /* Optional. */
+    int schedPolicy;                        /* c89thrd_sched_*. Set to c89thrd_sched_inherit to use the policy of the calling thread. */
+    int schedPriority;                      /* Only used with c89thrd_sched_fifo and c89thrd_sched_rr. */
+    int nice;                               /* Set to 0 to leave it unchanged. */
+    int noAlloc;                            /* Set to true to avoid allocating any memory when creating the thread. */
+} c89thrd_attr;
+
+c89thrd_attr c89thrd_attr_init(void);
+
+int c89thrd_create_ex2(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thrd_attr* pAttr);
 int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks, const c89thread_allocation_callbacks* pAllocationCallbacks);
 int c89thrd_create(c89thrd_t* thr, c89thrd_start_t func, void* arg);
 int c89thrd_equal(c89thrd_t lhs, c89thrd_t rhs);
@@ -246,13 +374,118 @@ void c89thrd_exit(int res);
 int c89thrd_detach(c89thrd_t thr);
 int c89thrd_join(c89thrd_t thr, int* res);
 
+/*
+Like c89thrd_join(), except c89thrd_timedjoin() gives up with c89thrd_timedout once `time_point` (TIME_UTC)
+has passed and c89thrd_tryjoin() returns c89thrd_busy straight away if the thread is still running. In
+both cases the thread has not been joined and still needs to be joined or detached at some point.
+
+With glibc and _GNU_SOURCE these use pthread_timedjoin_np() and pthread_tryjoin_np(). On other pthread
+platforms each thread created by c89thread records its completion so it can be waited on. Threads created
+with c89thrd_attr::noAlloc do not have a completion record in this case and will return c89thrd_error.
+*/
+int c89thrd_timedjoin(c89thrd_t thr, int* res, const struct timespec* time_point);
+int c89thrd_tryjoin(c89thrd_t thr, int* res);
+
+int c89thrd_set_affinity(c89thrd_t thr, const c89thread_cpu_set* pAffinity);
+int c89thrd_get_affinity(c89thrd_t thr, c89thread_cpu_set* pAffinity);
+
+/*
+Thread names show up in debuggers and profilers, and on Linux in /proc/<pid>/task/<tid>/comm. With
+pthreads this uses pthread_setname_np() which on Linux limits names to 15 characters, with anything
+longer being truncated. On macOS a thread can only name itself so `thr` must be the calling thread. On
+Windows this uses SetThreadDescription() and GetThreadDescription() which require Windows 10 version
+1607. When naming is not supported, c89thrd_error is returned.
+*/
+int c89thrd_set_name(c89thrd_t thr, const char* pName);
+int c89thrd_get_name(c89thrd_t thr, char* pName, size_t nameSize);
+
+/*
+Changes the scheduling policy of a thread. `policy` is one of the c89thrd_sched_* values, except for
+c89thrd_sched_inherit. `priority` is the static priority used with the real time policies
+c89thrd_sched_fifo and c89thrd_sched_rr, which is 1 to 99 on Linux, and must be 0 otherwise. The real time
+policies normally require elevated privileges. c89thrd_sched_batch and c89thrd_sched_idle are Linux
+specific.
+
+On Windows the policy is mapped to a thread priority. c89thrd_sched_idle is THREAD_PRIORITY_IDLE,
+c89thrd_sched_batch is THREAD_PRIORITY_BELOW_NORMAL, c89thrd_sched_other is THREAD_PRIORITY_NORMAL and the
+real time policies are THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST or
+THREAD_PRIORITY_TIME_CRITICAL depending on `priority`.
+
+Returns c89thrd_error if the policy is not supported or the caller doesn't have permission.
+*/
+int c89thrd_set_priority(c89thrd_t thr, int policy, int priority);
+int c89thrd_get_priority(c89thrd_t thr, int* pPolicy, int* pPriority);
+
+/* Retrieves the underlying OS thread for use with platform specific APIs. */
+c89thrd_native_handle_t c89thrd_native_handle(c89thrd_t thr);
+
+
+/* BEG c89thread_thread_cache.h */
+/*
+An optional cache of OS threads that sits behind c89thrd_create(). This is for code that creates and
+joins a thread for each small piece of work, where the cost of creating and tearing down the OS thread
+dominates.
+
+When enabled, a thread whose start function has returned is parked rather than exiting. A later call to
+c89thrd_create() hands the new function to a parked thread instead of creating a new OS thread. Parked
+threads exit once they've been idle for `idleTimeoutMilliseconds`. c89thrd_join(), c89thrd_detach() and
+c89thrd_exit() behave the same as they do without the cache, and the result of a thread is still
+retrieved with c89thrd_join(). `capacity` is the maximum number of threads managed by the cache. When all
+of them are busy, threads are created normally.
+
+Only threads created without any attributes other than the entry/exit and allocation callbacks go through
+the cache. Anything that changes the OS thread itself, such as the stack size, affinity, name or
+scheduling policy, requires a fresh OS thread. Thread local variables are not reset between functions
+run on the same cached thread.
+
+c89thrd_cache_init() and c89thrd_cache_uninit() are not thread safe and must not be called while threads
+are being created. c89thrd_cache_uninit() waits for parked threads to exit. All threads created through
+the cache must have returned and been joined or detached before calling it.
+
+This is only supported with pthreads. On Windows c89thrd_cache_init() returns c89thrd_error.
+*/
+typedef struct
+{
+    unsigned int capacity;
+    unsigned int idleTimeoutMilliseconds;
+} c89thrd_cache_config;
+
+c89thrd_cache_config c89thrd_cache_config_init(unsigned int capacity, unsigned int idleTimeoutMilliseconds);
+
+int c89thrd_cache_init(const c89thrd_cache_config* pConfig, const c89thread_allocation_callbacks* pAllocationCallbacks);
+void c89thrd_cache_uninit(void);
+/* END c89thread_thread_cache.h */
+
 
 /* BEG c89thread_mtx.h */
+#if defined(C89THREAD_PROFILE)
+    /* Contention statistics attached to each mutex when profiling. Times are in c89thread_ticks() units. */
+    typedef struct c89mtx_profile c89mtx_profile;
+    struct c89mtx_profile
+    {
+        c89mtx_profile* pNext;
+        c89mtx_profile* pPrev;
+        const char* pFile;
+        int line;
+        unsigned int lockDepth;     /* Hold time is measured from the outermost lock of a recursive mutex. */
+        c89thread_uint64 acquireTicks;
+        c89thread_uint64 acquisitionCount;
+        c89thread_uint64 contendedCount;
+        c89thread_uint64 totalWaitTicks;
+        c89thread_uint64 maxWaitTicks;
+        c89thread_uint64 totalHoldTicks;
+        c89thread_uint64 maxHoldTicks;
+    };
+#endif
+
 #if defined(C89THREAD_WIN32)
     typedef struct
     {
         c89thread_handle handle;    /* HANDLE, CreateMutex(), CreateEvent() */
         int type;
+    #if defined(C89THREAD_PROFILE)
+        c89mtx_profile profile;
+    #endif
     } c89mtx_t;
 #else
     /*
@@ -278,6 +511,16 @@ int c89thrd_join(c89thrd_t thr, int* res);
             c89thread_pthread_t owner;
             int recursionCount;
             int type;
+        #if defined(C89THREAD_PROFILE)
+            c89mtx_profile profile;
+        #endif
+        } c89mtx_t;
+    #elif defined(C89THREAD_PROFILE)
+        /* The pthread mutex must stay the first member so the object can still be used as a pthread_mutex_t. */
+        typedef struct
+        {
+            c89thread_pthread_mutex_t mutex;
+            c89mtx_profile profile;
         } c89mtx_t;
     #else
         typedef c89thread_pthread_mutex_t c89mtx_t;
@@ -295,8 +538,15 @@ int c89mtx_init(c89mtx_t* mutex, int type);
 void c89mtx_destroy(c89mtx_t* mutex);
 int c89mtx_lock(c89mtx_t* mutex);
 int c89mtx_timedlock(c89mtx_t* mutex, const struct timespec* time_point);
+int c89mtx_timedlock_monotonic(c89mtx_t* mutex, const struct timespec* time_point);
+int c89mtx_timedlock_for(c89mtx_t* mutex, const struct timespec* duration);
 int c89mtx_trylock(c89mtx_t* mutex);
 int c89mtx_unlock(c89mtx_t* mutex);
+
+#if defined(C89THREAD_PROFILE)
+int c89mtx_init_tagged(c89mtx_t* mutex, int type, const char* pFile, int line);
+#define c89mtx_init(mutex, type) c89mtx_init_tagged(mutex, type, __FILE__, __LINE__)
+#endif
 /* END c89thread_mtx.h */
 
 
@@ -314,6 +564,8 @@ int c89cnd_signal(c89cnd_t* cnd);
 int c89cnd_broadcast(c89cnd_t* cnd);
 int c89cnd_wait(c89cnd_t* cnd, c89mtx_t* mtx);
 int c89cnd_timedwait(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point);
+int c89cnd_timedwait_monotonic(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point);
+int c89cnd_timedwait_for(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* duration);
 
 
 /* c89sem_t (not part of C11) */
@@ -333,6 +585,8 @@ int c89sem_init(c89sem_t* sem, int value, int valueMax);
 void c89sem_destroy(c89sem_t* sem);
 int c89sem_wait(c89sem_t* sem);
 int c89sem_timedwait(c89sem_t* sem, const struct timespec* time_point);
+int c89sem_timedwait_monotonic(c89sem_t* sem, const struct timespec* time_point);
+int c89sem_timedwait_for(c89sem_t* sem, const struct timespec* duration);
 int c89sem_post(c89sem_t* sem);
 
 
@@ -352,1023 +606,1338 @@ int c89evnt_init(c89evnt_t* evnt);
 void c89evnt_destroy(c89evnt_t* evnt);
 int c89evnt_wait(c89evnt_t* evnt);
 int c89evnt_timedwait(c89evnt_t* evnt, const struct timespec* time_point);
+int c89evnt_timedwait_monotonic(c89evnt_t* evnt, const struct timespec* time_point);
+int c89evnt_timedwait_for(c89evnt_t* evnt, const struct timespec* duration);
 int c89evnt_signal(c89evnt_t* evnt);
+
+/*
+The `_monotonic` variants of the timed functions above take a time point relative to
+c89timespec_now_monotonic() instead of TIME_UTC. Use these when the deadline needs to be immune to
+changes in the system time.
+
+With glibc 2.30 and newer (and _GNU_SOURCE) these use pthread_cond_clockwait() and
+pthread_mutex_clocklock(). Other pthread platforms convert the deadline to TIME_UTC each time the
+thread goes to sleep, so a change in system time while already asleep can still shift the wakeup.
+ThreadSanitizer doesn't understand the clockwait functions, so builds with it always take the
+conversion path. Sanitizer runs therefore never exercise the clockwait path.
+
+The `_for` variants take a relative duration instead of a time point, which saves building the time
+point yourself. On Win32 the duration is rounded up to whole milliseconds and passed straight to the
+wait. Only the raw tick counter is read beforehand, and it's only converted to a time if the wait
+times out, to catch a timeout that came early.
+pthread only has absolute waits so the time point is built internally, against the monotonic clock
+where pthread supports it. Condition variables are not supported on Win32.
+*/
 /* END c89thread_types.h */
 
 
-/* BEG c89thread_sleep.h */
-int c89thrd_sleep_timespec(struct timespec ts);
-int c89thrd_sleep_milliseconds(int milliseconds);
-/* END c89thread_sleep.h */
+/* BEG c89thread_profile.h */
+/*
+Define C89THREAD_PROFILE to collect lock contention statistics for every c89mtx_t. When it's not
+defined none of this exists and mutexes are unchanged.
+
+Each mutex records how many times it was acquired, how many of those had to wait because another
+thread held it, the total and longest wait, and the total and longest time it was held. Contention is
+detected with a trylock before blocking. Timed locks that time out are not counted. The mutex is
+considered released while a thread waits on it in c89cnd_wait() and friends, and reacquiring it when
+the wait returns counts as an uncontended acquisition.
+
+Mutexes are tagged with the file and line of the c89mtx_init() call that created them. In this mode
+c89mtx_init() is a macro which passes __FILE__ and __LINE__ to c89mtx_init_tagged(). Wrappers around
+c89mtx_init() can call c89mtx_init_tagged() directly to pass through their own caller's location.
+
+Statistics are updated by the thread that holds the mutex. c89mtx_get_profile_stats() and
+c89thread_profile_dump() read them without locking the mutex, so they're only exact when the mutex is
+not in use. c89thread_profile_dump() writes a report of all mutexes that have not been destroyed,
+sorted by total wait time, to the given file, or stderr if it's NULL.
+
+Profiling also records how long threads block in c89sem_wait(), c89evnt_wait(), c89cnd_wait() and
+their timed variants. Only waits that succeed are recorded. Timeouts and errors are not. Each wait goes
+into a log-linear histogram of nanoseconds with 8 buckets per power of two, which gives a relative error
+of at most 12.5%. Values up to 7ns get exact buckets and anything over about four hours goes into the
+last bucket. Condition variable waits are attributed to the condition variable, not the mutex.
+
+Histograms are kept per thread and per object and are only written by the thread that waited, so
+recording never contends with other threads. Each thread tracks up to 16 objects. Waits on any further
+objects are recorded in a single overflow histogram which is reported with a NULL object. Objects whose
+histograms have been emptied by a reset free up their slot. A thread's histograms are handed to the next
+thread that needs them when it exits through c89thrd_exit() or by returning from its start routine.
+
+Use c89thread_profile_set_name() to give an object a name. Histograms of objects with the same name are
+merged, so a name can cover a whole family of objects like the events in a pool. Set the name to NULL
+to remove it. Names are copied and truncated to C89THREAD_WAIT_HISTOGRAM_MAX_NAME_LENGTH-1 characters.
+Remove an object's name before destroying it or its memory could be reused by an unrelated object.
+
+c89thread_wait_histogram_snapshot() merges every thread's histograms into `pHistograms` and returns
+how many were written. It never writes more than `capacity` histograms. Anything beyond that is not
+reported and, if `reset` is true, not reset either. Resetting subtracts what was reported, so waits
+recorded while the snapshot is taken are kept for the next one. c89thread_wait_histogram_percentile()
+returns the upper bound of the bucket holding the given percentile, where `percentile` is between 0 and
+100, and c89thread_wait_histogram_bucket_bound() returns the smallest value that goes into a bucket.
+*/
+#if defined(C89THREAD_PROFILE)
+#include <stdio.h>  /* For FILE. */
 
+typedef struct
+{
+    const char* pFile;
+    int line;
+    c89thread_uint64 acquisitionCount;
+    c89thread_uint64 contendedCount;
+    c89thread_uint64 totalWaitNanoseconds;
+    c89thread_uint64 maxWaitNanoseconds;
+    c89thread_uint64 totalHoldNanoseconds;
+    c89thread_uint64 maxHoldNanoseconds;
+} c89mtx_profile_stats;
+
+int c89mtx_get_profile_stats(const c89mtx_t* mutex, c89mtx_profile_stats* pStats);
+void c89thread_profile_dump(FILE* pFile);
+
+#define C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT       336
+#define C89THREAD_WAIT_HISTOGRAM_MAX_NAME_LENGTH    64
 
-/* BEG c89thread_cpu_count.h */
-int c89thread_get_logical_cpu_count(void);
-/* END c89thread_cpu_count.h */
+typedef struct
+{
+    char name[C89THREAD_WAIT_HISTOGRAM_MAX_NAME_LENGTH];   /* Empty if the object has no name. */
+    const void* pObject;                                    /* NULL for named histograms and the overflow histogram. */
+    c89thread_uint64 count;
+    c89thread_uint64 buckets[C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT];
+} c89thread_wait_histogram;
+
+int c89thread_profile_set_name(const void* pObject, const char* pName);
+size_t c89thread_wait_histogram_snapshot(c89thread_wait_histogram* pHistograms, size_t capacity, int reset);
+c89thread_uint64 c89thread_wait_histogram_percentile(const c89thread_wait_histogram* pHistogram, double percentile);
+c89thread_uint64 c89thread_wait_histogram_bucket_bound(size_t index);
+#endif
+/* END c89thread_profile.h */
 
 
-#if defined(__cplusplus)
-}
+/* BEG c89thread_hooks.h */
+/*
+Define C89THREAD_ENABLE_HOOKS to have the library call back into your own code at its blocking points
+and when threads start and finish. This is for plugging in tracing and metrics. Without it none of
+this exists and nothing extra is done anywhere.
+
+onBeforeBlock and onAfterBlock are called around the slow path of anything that can block: locking a
+mutex that a trylock found to be held, and waiting on a condition variable, semaphore, event, barrier
+or latch. Barriers call them once spinning has given up, and latches only if they are not already
+open. Semaphores and events have no fast path so every wait is reported. `result` is what the wait
+returned.
+
+onAcquired and onReleased are called whenever a mutex is locked or unlocked, including trylocks and
+recursive locks. A condition variable wait reports its mutex as released before it blocks and as
+acquired again once it wakes up.
+
+onThreadCreated is called on a new thread before its start routine runs, and onThreadExited on the
+same thread once it has finished, whether it returned or called c89thrd_exit(). Threads from the
+thread cache report every function they run as a separate thread.
+
+Callbacks can be NULL. Calls to c89thread functions from inside a callback do not trigger the hooks
+again. Set the hooks once at startup before any other threads are created. As with allocation
+callbacks, it is up to the caller to ensure nothing else is using the library while they change. Pass
+NULL to remove them.
+*/
+#if defined(C89THREAD_ENABLE_HOOKS) || defined(C89THREAD_ENABLE_TRACE) || defined(C89THREAD_ENABLE_USDT)
+/* Object types passed to the hooks. */
+enum
+{
+    c89thread_object_mtx     = 1,
+    c89thread_object_cnd     = 2,
+    c89thread_object_sem     = 3,
+    c89thread_object_evnt    = 4,
+    c89thread_object_barrier = 5,
+    c89thread_object_latch   = 6
+};
 #endif
-#endif  /* c89thread_h */
-
 
-/**************************************************************************************************
+#if defined(C89THREAD_ENABLE_HOOKS)
 
-Implementation
+typedef struct
+{
+    void* pUserData;
+    void (* onBeforeBlock  )(void* pUserData, int objectType, const void* pObject);
+    void (* onAfterBlock   )(void* pUserData, int objectType, const void* pObject, int result);
+    void (* onAcquired     )(void* pUserData, int objectType, const void* pObject);
+    void (* onReleased     )(void* pUserData, int objectType, const void* pObject);
+    void (* onThreadCreated)(void* pUserData);
+    void (* onThreadExited )(void* pUserData);
+} c89thread_hooks;
+
+void c89thread_set_hooks(const c89thread_hooks* pHooks);
+#endif
+/* END c89thread_hooks.h */
 
-**************************************************************************************************/
-#if defined(C89THREAD_IMPLEMENTATION)
-#ifndef c89thread_c
-#define c89thread_c
 
-/* BEG c89thread_types.c */
-/* Win32 */
-#if defined(C89THREAD_WIN32)
-#include <windows.h>
-#include <limits.h> /* For LONG_MAX */
+/* BEG c89thread_trace.h */
+/*
+Define C89THREAD_ENABLE_TRACE to record a timeline of what every thread is doing and write it out in
+the Chrome trace event format with c89thread_trace_dump(). Open the result in Perfetto
+(ui.perfetto.dev) or chrome://tracing. Without it none of this exists.
+
+The trace is recorded at the same points as the hooks described above, whether or not
+C89THREAD_ENABLE_HOOKS is defined, and contains:
+
+  - Thread start and exit, for threads created with c89thrd_create() and friends.
+  - Waits on mutexes, condition variables, semaphores, events, barriers and latches. Mutex waits
+    only appear when the mutex was contended.
+  - How long each mutex was held. Up to 16 mutexes held at once are tracked per thread.
+  - Functions run on cached threads and timer callbacks.
+
+Each thread records into its own ring buffer of C89THREAD_TRACE_BUFFER_SIZE events, which must be a
+power of two. Recording doesn't take any locks. Once a buffer is full the oldest events are dropped.
+Buffers of threads that have exited are kept until they have been written out by
+c89thread_trace_dump() at least once and are then reused by new threads.
+
+c89thread_trace_dump() can be called at any time. Events being recorded while it runs may or may not
+be included. It returns c89thrd_error if the file is NULL or writing fails.
+*/
+#if defined(C89THREAD_ENABLE_TRACE)
+#include <stdio.h>  /* For FILE. */
 
-#ifndef C89THREAD_UINT64_MAX
-#define C89THREAD_UINT64_MAX (~(c89thread_uint64)0)
+#ifndef C89THREAD_TRACE_BUFFER_SIZE
+#define C89THREAD_TRACE_BUFFER_SIZE 4096
 #endif
 
-#ifndef C89THREAD_MALLOC
-#define C89THREAD_MALLOC(sz)        HeapAlloc(GetProcessHeap(), 0, (sz))
+int c89thread_trace_dump(FILE* pFile);
 #endif
+/* END c89thread_trace.h */
 
-#ifndef C89THREAD_REALLOC
-#define C89THREAD_REALLOC(p, sz)    (((sz) > 0) ? ((p) ? HeapReAlloc(GetProcessHeap(), 0, (p), (sz)) : HeapAlloc(GetProcessHeap(), 0, (sz))) : ((VOID*)(size_t)(HeapFree(GetProcessHeap(), 0, (p)) & 0)))
-#endif
 
-#ifndef C89THREAD_FREE
-#define C89THREAD_FREE(p)           HeapFree(GetProcessHeap(), 0, (p))
-#endif
+/* BEG c89thread_usdt.h */
+/*
+Define C89THREAD_ENABLE_USDT to compile in USDT (user statically defined tracing) probes for tools
+like bpftrace, perf and SystemTap. This needs <sys/sdt.h>, which comes from the systemtap-sdt-dev or
+systemtap-sdt-devel package on Linux. It's ignored on Windows.
 
-static C89THREAD_THREAD_LOCAL c89thread_entry_exit_callbacks g_c89threadEntryExitCallbacks;
+A probe is a single nop until a tracer attaches to it, so they can stay enabled in production builds.
+They live under the "c89thread" provider and are fired at the same points as the hooks:
 
-static void c89thrd_run_exit_callback_win32(void)
-{
-    c89thrd_on_exit_t onExit;
-    void* pUserData;
+  mutex_contended(mutex)                A trylock failed and the thread is about to block.
+  mutex_acquired(mutex)                 Any successful lock, contended or not.
+  cond_wait_begin(cnd)                  Before blocking on a condition variable.
+  cond_wait_end(cnd, result)            After waking up, with what the wait returned.
+  sem_wait_begin(sem)                   Before waiting on a semaphore.
+  sem_wait_end(sem, result)             After the semaphore wait has returned.
+  thread_start()                        On a new thread before its start routine runs.
+  thread_exit()                         On a thread once it has finished.
 
-    onExit    = g_c89threadEntryExitCallbacks.onExit;
-    pUserData = g_c89threadEntryExitCallbacks.pUserData;
+For example, this counts contended locks by mutex address:
 
-    g_c89threadEntryExitCallbacks.onExit    = NULL;
-    g_c89threadEntryExitCallbacks.pUserData = NULL;
+    bpftrace -e 'usdt:./app:c89thread:mutex_contended { @[arg0] = count(); }'
+*/
+/* END c89thread_usdt.h */
 
-    if (onExit != NULL) {
-        onExit(pUserData);
-    }
-}
 
-/* BEG c89thrd_result_from_GetLastError.c */
-static int c89thrd_result_from_GetLastError(void)
+/* BEG c89thread_barrier.h */
+/*
+A reusable barrier. Threads calling c89barrier_wait() will block until `count` threads have arrived,
+at which point all of them are released and the barrier resets itself for the next phase. Waiting
+threads will spin for a short time before going to sleep so that tightly synchronized phases don't
+pay for a round trip through the kernel. You can control the default spin count with
+C89THREAD_BARRIER_SPIN_COUNT, or per barrier with c89barrier_config.
+
+Exactly one thread per phase will have c89barrier_serial_thread returned from c89barrier_wait(). All
+other threads will have c89thrd_success returned. This is equivalent to PTHREAD_BARRIER_SERIAL_THREAD.
+
+There are two implementations which share the same API. The flat barrier has every thread decrement a
+single counter. With lots of threads that counter becomes a hot spot, so for larger counts there is a
+combining tree barrier where threads arrive at a small leaf node and only the last thread at each node
+continues up to its parent. Use c89barrier_init_ex() with a c89barrier_config to choose between them.
+The tree barrier needs to allocate memory for its nodes. c89barrier_init() will pick the tree barrier
+when `count` is larger than C89THREAD_BARRIER_TREE_THRESHOLD.
+*/
+enum
 {
-    switch (GetLastError())
-    {
-        case ERROR_SUCCESS:             return c89thrd_success;
-        case ERROR_NOT_ENOUGH_MEMORY:   return c89thrd_nomem;
-        case ERROR_SEM_TIMEOUT:         return c89thrd_timedout;
-        case ERROR_BUSY:                return c89thrd_busy;
-        default: break;
-    }
-
-    return c89thrd_error;
-}
-/* END c89thrd_result_from_GetLastError.c */
+    c89barrier_type_flat = 0,
+    c89barrier_type_tree = 1
+};
 
-static c89thread_uint64 c89timespec_to_milliseconds(const struct timespec ts)
+typedef struct
 {
-    c89thread_uint64 milliseconds;
-
-    /*
-    A 64-bit time_t can technically overflow, but it would require a timeout of millions of years so
-    it's not worth addressing this. A 32-bit time_t cannot specify a value large enough to cause an
-    overflow.
-    */
-    milliseconds = (((c89thread_uint64)ts.tv_sec * 1000) + ((c89thread_uint64)ts.tv_nsec / 1000000));
-    if ((ts.tv_nsec % 1000000) != 0) {
-        milliseconds += 1; /* We truncated a sub-millisecond amount of time. Add an extra millisecond to meet the minimum duration requirement. */
-    }
+    int type;                   /* c89barrier_type_flat or c89barrier_type_tree. */
+    unsigned int count;         /* The number of threads that need to arrive before a phase is released. */
+    unsigned int fanIn;         /* Tree only. The maximum number of arrivals per node. Set to 0 to choose automatically. */
+    unsigned int spinCount;     /* The number of times to check for release before going to sleep. */
+} c89barrier_config;
 
-    return milliseconds;
-}
+c89barrier_config c89barrier_config_init(unsigned int count);
 
-static c89thread_uint64 c89timespec_diff_milliseconds(const struct timespec tsA, const struct timespec tsB)
+#if defined(C89THREAD_WIN32)
+typedef struct
 {
-    return c89timespec_to_milliseconds(c89timespec_diff(tsA, tsB));
-}
+    volatile c89thread_uint32 counter;      /* The number of threads yet to arrive in the current phase. Flat only. */
+    char padding0[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint32)];
+    volatile c89thread_uint32 sense;        /* Flipped by the last thread to arrive which is what releases the phase. */
+    char padding1[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint32)];
+    int type;
+    c89thread_uint32 count;
+    c89thread_uint32 spinCount;
+    c89thread_uint32 nodeCount;             /* Tree only. */
+    c89thread_uint32 leafCount;             /* Tree only. */
+    void* pNodes;                           /* Tree only. */
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+    c89thread_handle events[2];             /* HANDLE, CreateEvent(). Manual reset, one for each sense. */
+} c89barrier_t;
+#else
+typedef struct
+{
+    volatile c89thread_uint32 counter;      /* The number of threads yet to arrive in the current phase. Flat only. */
+    char padding0[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint32)];
+    volatile c89thread_uint32 sense;        /* Flipped by the last thread to arrive which is what releases the phase. */
+    volatile c89thread_uint32 sleepers;     /* The number of threads that have given up spinning and are waiting on the condition variable. */
+    char padding1[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint32)*2];
+    int type;
+    c89thread_uint32 count;
+    c89thread_uint32 spinCount;
+    c89thread_uint32 nodeCount;             /* Tree only. */
+    c89thread_uint32 leafCount;             /* Tree only. */
+    void* pNodes;                           /* Tree only. */
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+    c89thread_pthread_mutex_t lock;
+    c89thread_pthread_cond_t cond;
+} c89barrier_t;
+#endif
 
-/* Calculates `floor((multiplicand * multiplier) / divisor)` without overflow. */
-static int c89thread_mul_div_u64(c89thread_uint64 multiplicand, c89thread_uint64 multiplier, c89thread_uint64 divisor, c89thread_uint64* pResult)
+enum
 {
-    c89thread_uint64 whole;
-    c89thread_uint64 quotient;
-    c89thread_uint64 remainder;
-    c89thread_uint64 bit;
+    c89barrier_serial_thread = 1
+};
 
-    if (divisor == 0 || pResult == NULL) {
-        return 0;
-    }
+int c89barrier_init_ex(c89barrier_t* barrier, const c89barrier_config* pConfig, const c89thread_allocation_callbacks* pAllocationCallbacks);
+int c89barrier_init(c89barrier_t* barrier, unsigned int count);
+void c89barrier_destroy(c89barrier_t* barrier);
+int c89barrier_wait(c89barrier_t* barrier);
+/* END c89thread_barrier.h */
 
-    *pResult = 0;
 
-    if (multiplier == 0) {
-        return 1;
-    }
+/* BEG c89thread_latch.h */
+/*
+A one-shot countdown latch, equivalent to C++20's std::latch. The latch is initialized with a count
+and threads can wait for it to reach zero. Counting down is a single atomic operation, and only the
+final count down will wake up waiting threads. A latch cannot be reset.
 
-    whole = multiplicand / divisor;
-    if (whole > C89THREAD_UINT64_MAX / multiplier) {
-        return 0;
-    }
+Counting down by more than the remaining count is a bug, as it is with std::latch. It's detected and
+returns c89thrd_error, and the count is put back. Until it has been put back, other threads see a
+wrapped count, so an over-count that races with another one can go undetected.
 
-    multiplicand %= divisor;
-    quotient = 0;
-    remainder = 0;
-    bit = 1;
+c89latch_try_wait() returns c89thrd_success if the count has reached zero, or c89thrd_busy otherwise.
+*/
+#if defined(C89THREAD_WIN32)
+typedef struct
+{
+    volatile c89thread_uint32 counter;
+    c89thread_handle event;     /* HANDLE, CreateEvent(). Manual reset. Signaled when the counter reaches zero. */
+} c89latch_t;
+#else
+typedef struct
+{
+    volatile c89thread_uint32 counter;
+    volatile c89thread_uint32 sleepers;     /* The number of threads waiting on the condition variable. */
+    c89thread_pthread_mutex_t lock;
+    c89thread_pthread_cond_t cond;
+} c89latch_t;
+#endif
 
-    while (bit <= multiplier / 2) {
-        bit <<= 1;
-    }
+int c89latch_init(c89latch_t* latch, unsigned int count);
+void c89latch_destroy(c89latch_t* latch);
+int c89latch_count_down(c89latch_t* latch, unsigned int n);
+int c89latch_try_wait(c89latch_t* latch);
+int c89latch_wait(c89latch_t* latch);
+int c89latch_timedwait(c89latch_t* latch, const struct timespec* time_point);
+int c89latch_timedwait_monotonic(c89latch_t* latch, const struct timespec* time_point);
+int c89latch_arrive_and_wait(c89latch_t* latch, unsigned int n);
+/* END c89thread_latch.h */
 
-    while (bit != 0) {
-        quotient <<= 1;
 
-        if (remainder >= divisor - remainder) {
-            remainder -= divisor - remainder;
-            quotient += 1;
-        } else {
-            remainder += remainder;
-        }
+/* BEG c89thread_sleep.h */
+int c89thrd_sleep_timespec(struct timespec ts);
+int c89thrd_sleep_milliseconds(int milliseconds);
 
-        if ((multiplier & bit) != 0) {
-            if (remainder >= divisor - multiplicand) {
-                remainder -= divisor - multiplicand;
-                quotient += 1;
-            } else {
-                remainder += multiplicand;
-            }
-        }
+/*
+Sleeps for `duration` with much tighter precision than c89thrd_sleep(). The OS is only used to sleep
+until the deadline is within the spin threshold, after which the thread spins for the remainder with a
+pause hint. Unlike c89thrd_sleep(), this is not cut short by signals.
+
+The spin threshold is the amount of time the OS is expected to oversleep by. It defaults to
+C89THREAD_SLEEP_SPIN_THRESHOLD_IN_NANOSECONDS, but the real value depends on the system and its load so
+call c89thrd_sleep_calibrate() once at startup to measure it. Calibration takes a few tens of
+milliseconds and applies to all threads. Rare wakeups that are later than the 90th percentile are not
+accounted for, so the precise sleep can still overshoot on a heavily loaded system. The measured
+threshold is returned in `pSpinThreshold` if it's not NULL.
+
+On Linux the timer slack of the calling thread is reduced to 1 nanosecond with PR_SET_TIMERSLACK the
+first time either function is called on that thread. This stays in effect for the life of the thread.
+*/
+int c89thrd_sleep_precise(const struct timespec* duration);
+int c89thrd_sleep_calibrate(struct timespec* pSpinThreshold);
 
-        bit >>= 1;
-    }
+/*
+Sleeps until `time_point`, which is measured against `base`. This must be either TIME_UTC or
+TIME_MONOTONIC. Use this instead of c89thrd_sleep() for periodic work so the time spent doing the work
+doesn't accumulate as drift. Signals do not cut the sleep short. Returns immediately if the time point
+has already passed.
+*/
+int c89thrd_sleep_until(const struct timespec* time_point, int base);
+/* END c89thread_sleep.h */
 
-    whole *= multiplier;
-    if (whole > C89THREAD_UINT64_MAX - quotient) {
-        return 0;
-    }
 
-    *pResult = whole + quotient;
-    return 1;
-}
+/* BEG c89thread_periodic.h */
+/*
+Tracks the deadlines of a loop that needs to run at a fixed rate. Each call to c89periodic_wait() sleeps
+until the next deadline, which is always a whole number of periods after the first one, so the loop
+will not drift.
 
-static DWORD c89wait_for_single_object_until(HANDLE handle, const struct timespec* time_point)
-{
-    for (;;) {
-        struct timespec tsNow;
-        c89thread_uint64 timeoutMilliseconds;
-        DWORD timeout;
-        DWORD result;
-
-        tsNow = c89timespec_now();
-        if (c89timespec_cmp(tsNow, *time_point) > 0) {
-            timeoutMilliseconds = 0;
-            timeout = 0;
-        } else {
-            timeoutMilliseconds = c89timespec_diff_milliseconds(*time_point, tsNow);
-            if (timeoutMilliseconds >= INFINITE) {
-                timeout = INFINITE - 1;
-            } else {
-                timeout = (DWORD)timeoutMilliseconds;
-            }
-        }
-
-        result = WaitForSingleObject(handle, timeout);
-        if (result != WAIT_TIMEOUT || timeoutMilliseconds < INFINITE) {
-            return result;
-        }
-    }
-}
+When the work takes longer than the period, c89periodic_wait() returns straight away and reports the
+number of deadlines that had already passed in `pOverruns`. Deadlines that were missed entirely are
+skipped rather than run back to back. The `overruns` member keeps a running total.
 
+With c89periodic_precise, the sleep is done with the same method as c89thrd_sleep_precise().
+*/
+enum
+{
+    c89periodic_precise = 0x00000001
+};
 
 typedef struct
 {
-    c89thrd_start_t func;
-    void* arg;
-    c89thread_entry_exit_callbacks entryExitCallbacks;
-    c89thread_allocation_callbacks allocationCallbacks;
-    int usingCustomAllocator;
-} c89thrd_start_data_win32;
+    struct timespec period;
+    struct timespec next;       /* The next deadline, relative to c89timespec_now_monotonic(). */
+    c89thread_uint64 overruns;
+    unsigned int flags;
+} c89periodic_t;
 
-static unsigned long WINAPI c89thrd_start_win32(void* pUserData)
-{
-    c89thrd_start_data_win32* pStartData = (c89thrd_start_data_win32*)pUserData;
-    c89thread_entry_exit_callbacks entryExitCallbacks;
-    c89thrd_start_t func;
-    void* arg;
-    unsigned long result;
+int c89periodic_init(c89periodic_t* periodic, const struct timespec* period, unsigned int flags);
+int c89periodic_wait(c89periodic_t* periodic, unsigned int* pOverruns);
+/* END c89thread_periodic.h */
 
-    entryExitCallbacks = pStartData->entryExitCallbacks;
-    func = pStartData->func;
-    arg  = pStartData->arg;
 
-    /* Free the start data before calling user code. */
-    c89thread_free(pStartData, (pStartData->usingCustomAllocator) ? &pStartData->allocationCallbacks : NULL);
+/* BEG c89thread_ticks.h */
+/*
+A cheap monotonic counter for measuring short intervals in hot paths. Take the difference of two calls
+to c89thread_ticks() and convert it with c89thread_ticks_to_ns(). The unit of a tick is unspecified and
+the counter is only comparable within the same process.
+
+On x86 with GCC or Clang this reads the TSC directly when the CPU reports an invariant TSC. The TSC is
+calibrated against CLOCK_MONOTONIC the first time either function is called, which takes about 10
+milliseconds. Call c89thread_ticks() once at startup if that matters. On Windows this is
+QueryPerformanceCounter(), which already uses the invariant TSC where possible. Everywhere else a tick
+is a nanosecond of CLOCK_MONOTONIC_RAW, or CLOCK_MONOTONIC if that is unavailable.
+*/
+c89thread_uint64 c89thread_ticks(void);
+c89thread_uint64 c89thread_ticks_to_ns(c89thread_uint64 ticks);
+/* END c89thread_ticks.h */
 
-    g_c89threadEntryExitCallbacks = entryExitCallbacks;
 
-    if (entryExitCallbacks.onEntry != NULL) {
-        entryExitCallbacks.onEntry(entryExitCallbacks.pUserData);
-    }
+/* BEG c89thread_coarse_clock.h */
+/*
+Cheaper, lower resolution versions of c89timespec_now() and c89timespec_now_monotonic() for when a
+deadline only needs to be roughly right. On Linux these use CLOCK_REALTIME_COARSE and
+CLOCK_MONOTONIC_COARSE which typically have a resolution of a few milliseconds. Elsewhere they're the
+same as the normal clocks.
+*/
+struct timespec c89timespec_now_coarse(void);
+struct timespec c89timespec_now_monotonic_coarse(void);
 
-    result = (unsigned long)func(arg);
+/*
+An optional background thread which publishes the current time every `interval`. While it's running,
+c89timespec_now_cached() and c89timespec_now_monotonic_cached() are a single atomic load of a value
+that lives on its own cache line. When it's not running they fall back to the coarse clocks.
 
-    c89thrd_run_exit_callback_win32();
+The cached time can be up to `interval` behind, plus however late the ticker thread is scheduled.
+c89timespec_ticker_init() returns c89thrd_busy if the ticker is already running, and c89thrd_error if
+the interval is not positive. Starting and stopping the ticker is not thread-safe.
+*/
+int c89timespec_ticker_init(const struct timespec* interval);
+void c89timespec_ticker_uninit(void);
+struct timespec c89timespec_now_cached(void);
+struct timespec c89timespec_now_monotonic_cached(void);
+/* END c89thread_coarse_clock.h */
 
-    return result;
-}
+/* BEG c89thread_timer.h */
+/*
+A timer service for scheduling large numbers of callbacks, such as per-connection timeouts, without a
+thread per timer. Timers live in a hierarchical timing wheel so scheduling, rescheduling and cancelling
+are O(1) regardless of how many timers are pending. A single service thread sleeps until the next
+non-empty bucket and runs callbacks as they come due.
+
+Timers are measured against the monotonic clock and rounded up to the service's resolution, which
+defaults to 1 millisecond. Callbacks are never run early, but can run up to one tick late plus however
+late the service thread is scheduled. Callbacks run on the service thread one at a time and should be
+short. Anything long running should be handed off to another thread.
+
+A c89timer_t is owned by the caller and must stay valid while it's scheduled. The service does not
+allocate memory per timer. Initialize it with c89timer_init() before first use. Scheduling a timer that
+is already pending moves it to the new deadline.
+
+c89timer_schedule_at() and c89timer_schedule_at_monotonic() take an absolute deadline against TIME_UTC
+and TIME_MONOTONIC respectively. A deadline that has already passed fires on the next tick. A UTC
+deadline is converted to a distance from now when it's scheduled, so later changes to the system clock
+do not move it.
+
+A one-shot timer is not touched by the service once its callback has started, so the callback can free
+or reschedule it. A periodic timer is rescheduled after its callback returns, so it must be cancelled
+before its memory is released, and it cannot be freed from inside its own callback.
+
+c89timer_cancel() returns c89thrd_success if the timer was pending and has been removed, or if it's a
+periodic timer that has now been stopped. It returns c89thrd_error if the timer was not scheduled. When
+the timer's callback is running on the service thread, c89timer_cancel() waits for it to return unless
+it's called from that callback.
+
+c89timer_service_uninit() stops the service thread, waiting for any running callback. Timers that are
+still pending are dropped without their callbacks being run, and c89timer_cancel() returns c89thrd_error
+for them afterwards. Timers that had already fired must not be cancelled once the service is gone.
+*/
+#define C89TIMER_WHEEL_LEVELS   4
+#define C89TIMER_WHEEL_BITS     8
+#define C89TIMER_WHEEL_SLOTS    (1 << C89TIMER_WHEEL_BITS)
 
-int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks, const c89thread_allocation_callbacks* pAllocationCallbacks)
+typedef void (* c89timer_proc)(void* pUserData);
+
+typedef struct c89timer_t c89timer_t;
+struct c89timer_t
 {
-    HANDLE hThread;
-    DWORD threadID;
-    c89thrd_start_data_win32* pData;    /* <-- Needs to be allocated on the heap to ensure the data doesn't get trashed before the thread is entered. */
+    c89timer_t* pNext;
+    c89timer_t* pPrev;
+    struct c89timer_service* pService;
+    c89timer_proc proc;
+    void* pUserData;
+    c89thread_uint64 expiry;    /* In ticks. */
+    c89thread_uint64 period;    /* In ticks. Zero for one-shot timers. */
+    unsigned int slot;          /* Index into the service's list heads. Only valid while pending. */
+    int isPending;
+};
 
-    if (thr == NULL) {
-        return c89thrd_error;
-    }
+typedef struct
+{
+    struct timespec resolution;
+} c89timer_service_config;
 
-    memset(thr, 0, sizeof(*thr));
+c89timer_service_config c89timer_service_config_init(void);
 
-    if (func == NULL) {
-        return c89thrd_error;
-    }
+typedef struct c89timer_service
+{
+    c89mtx_t lock;
+    c89evnt_t wakeEvent;
+    c89evnt_t callbackEvent;            /* Signaled when a callback returns and somebody is waiting for it in c89timer_cancel(). */
+    c89thrd_t thread;
+    struct timespec startTime;
+    c89thread_uint64 resolution;        /* In nanoseconds. */
+    c89thread_uint64 currentTick;       /* The last tick that has been processed. */
+    c89thread_uint64 wakeTick;          /* The tick the service thread is sleeping until. */
+    c89timer_t* pRunning;               /* The timer whose callback is currently running. Only used for comparisons. */
+    c89thread_uint64 callbackGeneration;    /* Incremented every time a callback returns. */
+    int isRunningCancelled;
+    unsigned int cancelWaiterCount;
+    size_t pendingCount;
+    int isShuttingDown;
+    c89timer_t* pSlots[C89TIMER_WHEEL_LEVELS*C89TIMER_WHEEL_SLOTS + 1];  /* The extra list holds timers that have expired and are waiting for their callback. */
+} c89timer_service;
+
+int c89timer_service_init(c89timer_service* pService, const c89timer_service_config* pConfig);
+void c89timer_service_uninit(c89timer_service* pService);
+
+void c89timer_init(c89timer_t* pTimer);
+int c89timer_schedule(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* delay, c89timer_proc proc, void* pUserData);
+int c89timer_schedule_periodic(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* delay, const struct timespec* period, c89timer_proc proc, void* pUserData);
+int c89timer_schedule_at(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* time_point, c89timer_proc proc, void* pUserData);
+int c89timer_schedule_at_monotonic(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* time_point, c89timer_proc proc, void* pUserData);
+int c89timer_cancel(c89timer_t* pTimer);
+/* END c89thread_timer.h */
 
-    pData = (c89thrd_start_data_win32*)c89thread_malloc(sizeof(*pData), pAllocationCallbacks);   /* <-- This will be freed when c89thrd_start_win32() is entered. */
-    if (pData == NULL) {
-        return c89thrd_nomem;
-    }
 
-    pData->func = func;
-    pData->arg  = arg;
+/* BEG c89thread_cpu_count.h */
+int c89thread_get_logical_cpu_count(void);
 
-    if (pEntryExitCallbacks != NULL) {
-        pData->entryExitCallbacks = *pEntryExitCallbacks;
-    } else {
-        pData->entryExitCallbacks.onEntry   = NULL;
-        pData->entryExitCallbacks.onExit    = NULL;
-        pData->entryExitCallbacks.pUserData = NULL;
-    }
+/*
+The number of CPUs this process can actually make use of. Use this instead of the logical CPU count
+when sizing a pool of worker threads.
 
-    if (pAllocationCallbacks != NULL) {
-        pData->allocationCallbacks  = *pAllocationCallbacks;
-        pData->usingCustomAllocator = 1;
-    } else {
-        pData->allocationCallbacks.onMalloc  = NULL;
-        pData->allocationCallbacks.onRealloc = NULL;
-        pData->allocationCallbacks.onFree    = NULL;
-        pData->allocationCallbacks.pUserData = NULL;
-        pData->usingCustomAllocator = 0;
-    }
+This is the smaller of the number of CPUs in the process' affinity mask and the CPU quota of the
+cgroup the process belongs to, rounded up. Inside a container the logical CPU count is typically that
+of the host, whereas this will reflect the limits placed on the container. Both cgroup v1
+(cpu.cfs_quota_us / cpu.cfs_period_us) and cgroup v2 (cpu.max) are supported, and the quotas of
+parent cgroups are taken into account.
 
-    hThread = CreateThread(NULL, 0, c89thrd_start_win32, pData, 0, &threadID);
-    if (hThread == NULL) {
-        int result = c89thrd_result_from_GetLastError();
-        c89thread_free(pData, pAllocationCallbacks);
-        return result;
-    }
+On Windows only the process affinity mask is considered. Platforms without an affinity mask or
+cgroups will return the logical CPU count. The returned value is always at least 1.
 
-    thr->handle = (c89thread_handle)hThread;
-    thr->id     = threadID;
+c89thread_get_usable_cpu_count_from_root() does the same thing, except /proc and /sys are read
+relative to `pRoot` rather than the real root. This is mainly useful for testing. When `pRoot` is not
+empty, the affinity mask is read from `<pRoot>/proc/self/status` rather than being queried from the OS.
+*/
+int c89thread_get_usable_cpu_count(void);
+int c89thread_get_usable_cpu_count_from_root(const char* pRoot);
+/* END c89thread_cpu_count.h */
 
-    return c89thrd_success;
-}
 
-int c89thrd_create(c89thrd_t* thr, c89thrd_start_t func, void* arg)
+/* BEG c89thread_topology.h */
+/*
+The layout of the logical CPUs in the system. This can be used for things like pinning one worker to
+each physical core, or grouping workers by the cache they share.
+
+There is one c89thread_cpu_info for each online logical CPU. The `id` member is the number the OS uses
+for the CPU, which is what you would use with affinity masks. Every other member is a zero based index
+into a group. CPUs with the same `coreIndex` are SMT siblings (hyperthreads) of the same physical core,
+CPUs with the same `l3Index` share an L3 cache, and so on. `numaNode` is the OS's NUMA node number.
+
+On Linux this is read from /sys/devices/system/cpu and /sys/devices/system/node. On Windows it comes
+from GetLogicalProcessorInformation() and is limited to the first 64 logical CPUs. Anywhere else, or
+when that information is unavailable, each logical CPU is reported as its own core in a single package
+with a single NUMA node.
+
+Free the topology with c89thread_free_topology() when you're done with it.
+*/
+typedef struct
 {
-    return c89thrd_create_ex(thr, func, arg, NULL, NULL);
-}
+    unsigned int id;            /* The OS's logical CPU number. */
+    unsigned int packageIndex;  /* The physical package (socket). */
+    unsigned int coreIndex;     /* The physical core. Unique across packages. */
+    unsigned int smtIndex;      /* The position of this CPU amongst its SMT siblings. 0 for the first hardware thread on each core. */
+    unsigned int l2Index;       /* CPUs with the same L2 index share an L2 cache. */
+    unsigned int l3Index;       /* CPUs with the same L3 index share an L3 cache. */
+    unsigned int numaNode;      /* The OS's NUMA node number. */
+} c89thread_cpu_info;
 
-int c89thrd_equal(c89thrd_t lhs, c89thrd_t rhs)
+typedef struct
 {
-    /* We just compare thread IDs. */
-    return lhs.id == rhs.id;
+    c89thread_cpu_info* pCPUs;
+    unsigned int cpuCount;
+    unsigned int packageCount;
+    unsigned int coreCount;
+    unsigned int l2Count;
+    unsigned int l3Count;
+    unsigned int numaNodeCount;
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+} c89thread_topology;
+
+int c89thread_get_topology(c89thread_topology* pTopology, const c89thread_allocation_callbacks* pAllocationCallbacks);
+void c89thread_free_topology(c89thread_topology* pTopology);
+/* END c89thread_topology.h */
+
+
+#if defined(__cplusplus)
 }
+#endif
+#endif  /* c89thread_h */
 
-c89thrd_t c89thrd_current(void)
+
+/**************************************************************************************************
+
+Implementation
+
+**************************************************************************************************/
+#if defined(C89THREAD_IMPLEMENTATION)
+#ifndef c89thread_c
+#define c89thread_c
+
+#ifndef C89THREAD_UINT64_MAX
+#define C89THREAD_UINT64_MAX (~(c89thread_uint64)0)
+#endif
+
+/* BEG c89thread_string.c */
+/* Copies a string, truncating it if necessary. The output is always null terminated. */
+static void c89thread_copy_string(char* pDst, size_t dstSize, const char* pSrc)
 {
-    c89thrd_t thr;
+    size_t i;
 
-    thr.handle = (c89thread_handle)GetCurrentThread();
-    thr.id     = GetCurrentThreadId();
+    if (dstSize == 0) {
+        return;
+    }
 
-    return thr;
+    for (i = 0; i < dstSize - 1 && pSrc[i] != '\0'; i += 1) {
+        pDst[i] = pSrc[i];
+    }
+
+    pDst[i] = '\0';
 }
+/* END c89thread_string.c */
 
-int c89thrd_sleep(const struct timespec* duration, struct timespec* remaining)
-{
-    /*
-    Sleeping is annoyingly complicated in C11. Nothing crazy or anything, but it's not just a simple
-    millisecond sleep. These are the rules:
-    
-        * On success, return 0
-        * When the sleep is interupted due to a signal, return -1
-        * When any other error occurs, return some other negative value.
-        * When the sleep is interupted, the `remaining` output parameter needs to be filled out with
-          the remaining time.
+/* BEG c89thread_hooks.c */
+/*
+These are called at every instrumentation point. They forward to the USDT probes, the trace recorder
+and the user's hooks, whichever are enabled.
+*/
+#if defined(C89THREAD_ENABLE_USDT) && !defined(C89THREAD_WIN32)
+#include <sys/sdt.h>
+#define C89THREAD_HAS_USDT
+#endif
 
-    In order to detect a signal, we can use SleepEx(). This only has a resolution of 1 millisecond,
-    however (this is true for everything on Windows). SleepEx() will return WAIT_IO_COMPLETION if
-    some I/O completion event occurs. This is the best we'll get on Windows, I think.
+#if defined(C89THREAD_ENABLE_HOOKS) || defined(C89THREAD_ENABLE_TRACE) || defined(C89THREAD_HAS_USDT)
+#define C89THREAD_HAS_INSTRUMENTATION
+#endif
 
-    In order to calculate the value to place into `remaining`, we need to get the time before sleeping
-    and then get the time after the sleeping. We'll then have enough information to calculate the
-    difference which will be our remining. This is only required when the `remaining` parameter is not
-    NULL. Unfortunately we cannot use timespec_get() here because it doesn't have good support with
-    MinGW. We'll instead use Windows' high resolution performance counter which is supported back to
-    Windows 2000.
-    */
-    LARGE_INTEGER frequency;
-    LARGE_INTEGER start;
-    DWORD sleepResult;
-    c89thread_uint64 sleepMilliseconds;
+#if defined(C89THREAD_ENABLE_TRACE)
+static void c89thread_trace_before_block(void);
+static void c89thread_trace_after_block(int objectType, const void* pObject);
+static void c89thread_trace_acquired(const void* pObject);
+static void c89thread_trace_released(const void* pObject);
+static void c89thread_trace_thread_created(void);
+static void c89thread_trace_thread_exited(void);
+
+#define C89THREAD_TRACE_TASK_CACHED_THREAD  1
+#define C89THREAD_TRACE_TASK_TIMER          2
+static void c89thread_trace_task(c89thread_uint32 taskType, c89thread_uint64 function, c89thread_uint64 startTicks);
+#endif
 
-    if (duration == NULL || duration->tv_sec < 0 || duration->tv_nsec < 0 || duration->tv_nsec >= 1000000000) {
-        return c89thrd_error;
-    }
+#if defined(C89THREAD_ENABLE_HOOKS)
+#include <string.h> /* For memset(). */
 
-    frequency.QuadPart = 0;
-    start.QuadPart = 0;
+static c89thread_hooks g_c89threadHooks;
+static C89THREAD_THREAD_LOCAL int g_c89threadIsInHook = 0;    /* Stops hooks that use the library from calling themselves. */
 
-    if (remaining != NULL) {
-        if (QueryPerformanceFrequency(&frequency) == FALSE) {
-            return c89thrd_error;
-        }
+void c89thread_set_hooks(const c89thread_hooks* pHooks)
+{
+    if (pHooks != NULL) {
+        g_c89threadHooks = *pHooks;
+    } else {
+        memset(&g_c89threadHooks, 0, sizeof(g_c89threadHooks));
+    }
+}
+#endif
 
-        if (QueryPerformanceCounter(&start) == FALSE) {
-            return c89thrd_error;   /* Failed to retrieve the start time. */
+#if defined(C89THREAD_HAS_INSTRUMENTATION)
+static void c89thread_hook_before_block(int objectType, const void* pObject)
+{
+    #if defined(C89THREAD_HAS_USDT)
+    {
+        if (objectType == c89thread_object_mtx) {
+            DTRACE_PROBE1(c89thread, mutex_contended, pObject);
+        } else if (objectType == c89thread_object_cnd) {
+            DTRACE_PROBE1(c89thread, cond_wait_begin, pObject);
+        } else if (objectType == c89thread_object_sem) {
+            DTRACE_PROBE1(c89thread, sem_wait_begin, pObject);
         }
     }
+    #endif
 
-    /*
-    A 64-bit time_t can technically overflow, but it would require a timeout of millions of years so
-    it's not worth addressing this. A 32-bit time_t cannot specify a value large enough to cause an
-    overflow.
-    */
-    sleepMilliseconds = (((c89thread_uint64)duration->tv_sec * 1000) + ((c89thread_uint64)duration->tv_nsec / 1000000));
-
-    /*
-    A small, but important detail here. The C11 spec states that thrd_sleep() should sleep for a
-    *minimum* of the specified duration. In the above calculation we converted nanoseconds to
-    milliseconds, however this requires a division which may truncate a non-zero sub-millisecond
-    amount of time. We need to add an extra millisecond to meet the minimum duration requirement if
-    indeed we truncated.
-    */
-    if ((duration->tv_nsec % 1000000) != 0) {
-        sleepMilliseconds += 1; /* We truncated a sub-millisecond amount of time. Add an extra millisecond to meet the minimum duration requirement. */
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_before_block();
     }
-    
-    for (;;) {
-        DWORD sleepChunk;
+    #endif
 
-        if (sleepMilliseconds >= INFINITE) {
-            sleepChunk = INFINITE - 1;
-        } else {
-            sleepChunk = (DWORD)sleepMilliseconds;
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onBeforeBlock != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onBeforeBlock(g_c89threadHooks.pUserData, objectType, pObject);
+            g_c89threadIsInHook = 0;
         }
+    }
+    #else
+    {
+        (void)objectType;
+        (void)pObject;
+    }
+    #endif
+}
 
-        sleepResult = SleepEx(sleepChunk, TRUE); /* <-- Make this sleep alertable so we can detect WAIT_IO_COMPLETION and return -1. */
-        if (sleepResult != 0 || sleepMilliseconds <= sleepChunk) {
-            break;
+static void c89thread_hook_after_block(int objectType, const void* pObject, int result)
+{
+    #if defined(C89THREAD_HAS_USDT)
+    {
+        if (objectType == c89thread_object_cnd) {
+            DTRACE_PROBE2(c89thread, cond_wait_end, pObject, result);
+        } else if (objectType == c89thread_object_sem) {
+            DTRACE_PROBE2(c89thread, sem_wait_end, pObject, result);
         }
+    }
+    #endif
 
-        sleepMilliseconds -= sleepChunk;
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_after_block(objectType, pObject);
     }
+    #endif
 
-    if (sleepResult == 0) {
-        if (remaining != NULL) {
-            remaining->tv_sec  = 0;
-            remaining->tv_nsec = 0;
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onAfterBlock != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onAfterBlock(g_c89threadHooks.pUserData, objectType, pObject, result);
+            g_c89threadIsInHook = 0;
         }
+    }
+    #else
+    {
+        (void)result;
+    }
+    #endif
+}
 
-        return c89thrd_success;
+static void c89thread_hook_acquired(int objectType, const void* pObject)
+{
+    #if defined(C89THREAD_HAS_USDT)
+    {
+        DTRACE_PROBE1(c89thread, mutex_acquired, pObject);
     }
+    #endif
 
-    /*
-    Getting here means we didn't sleep for the specified amount of time. We need to fill `remaining`.
-    To do this, we need to find out out much time has elapsed and then offset that will the requested
-    duration. This is the hard part of the process because we need to convert to and from timespec.
-    */
-    if (remaining != NULL) {
-        LARGE_INTEGER end;
-        if (QueryPerformanceCounter(&end)) {
-            LARGE_INTEGER elapsed;
-            elapsed.QuadPart = end.QuadPart - start.QuadPart;
-
-            /*
-            Convert the elapsed counter to a timespec, then subtract it from the requested duration.
-            Use overflow-safe integer arithmetic for the fractional second.
-            */
-            {
-                struct timespec elapsedTime;
-                c89thread_uint64 elapsedNanoseconds;
-                LONGLONG elapsedSeconds;
-
-                elapsedSeconds = elapsed.QuadPart / frequency.QuadPart;
-                if (elapsed.QuadPart < 0) {
-                    *remaining = *duration;
-                } else if (elapsedSeconds > (LONGLONG)duration->tv_sec) {
-                    remaining->tv_sec  = 0;
-                    remaining->tv_nsec = 0;
-                } else {
-                    elapsedTime.tv_sec  = (time_t)elapsedSeconds;
-                    if (!c89thread_mul_div_u64((c89thread_uint64)(elapsed.QuadPart % frequency.QuadPart), 1000000000, (c89thread_uint64)frequency.QuadPart, &elapsedNanoseconds)) {
-                        remaining->tv_sec  = 0;
-                        remaining->tv_nsec = 0;
-                    } else {
-                        elapsedTime.tv_nsec = (long)elapsedNanoseconds;
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_acquired(pObject);
+    }
+    #endif
 
-                        if (c89timespec_cmp(elapsedTime, *duration) < 0) {
-                            *remaining = c89timespec_diff(*duration, elapsedTime);
-                        } else {
-                            remaining->tv_sec  = 0;
-                            remaining->tv_nsec = 0;
-                        }
-                    }
-                }
-            }
-        } else {
-            remaining->tv_sec  = 0; /* Just for safety. */
-            remaining->tv_nsec = 0;
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onAcquired != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onAcquired(g_c89threadHooks.pUserData, objectType, pObject);
+            g_c89threadIsInHook = 0;
         }
     }
-
-    if (sleepResult == WAIT_IO_COMPLETION) {
-        return c89thrd_signal;  /* -1 */
-    } else {
-        return c89thrd_error;   /* "other negative value if an error occurred." */
+    #else
+    {
+        (void)objectType;
     }
+    #endif
 }
 
-void c89thrd_yield(void)
+static void c89thread_hook_released(int objectType, const void* pObject)
 {
-    Sleep(0);
-}
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_released(pObject);
+    }
+    #endif
 
-void c89thrd_exit(int res)
-{
-    c89thrd_run_exit_callback_win32();
-    ExitThread((DWORD)res);
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onReleased != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onReleased(g_c89threadHooks.pUserData, objectType, pObject);
+            g_c89threadIsInHook = 0;
+        }
+    }
+    #else
+    {
+        (void)objectType;
+        (void)pObject;
+    }
+    #endif
 }
 
-int c89thrd_detach(c89thrd_t thr)
+static void c89thread_hook_thread_created(void)
 {
-    /*
-    The documentation for thrd_detach() says explicitly that any error should return thrd_error.
-    We'll do the same, so make sure c89thrd_result_from_GetLastError() is not used here.
-    */
-    BOOL result;
+    #if defined(C89THREAD_HAS_USDT)
+    {
+        DTRACE_PROBE(c89thread, thread_start);
+    }
+    #endif
 
-    result = CloseHandle((HANDLE)thr.handle);
-    if (!result) {
-        return c89thrd_error;
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_thread_created();
     }
+    #endif
 
-    return c89thrd_success;
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onThreadCreated != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onThreadCreated(g_c89threadHooks.pUserData);
+            g_c89threadIsInHook = 0;
+        }
+    }
+    #endif
 }
 
-int c89thrd_join(c89thrd_t thr, int* res)
+static void c89thread_hook_thread_exited(void)
 {
-    /*
-    Like thrd_detach(), the documentation for thrd_join() says to return thrd_success or thrd_error.
-    Therefore, make sure c89thrd_result_from_GetLastError() is not used here.
-
-    In Win32, waiting for the thread to complete and retrieving the result is done as two separate
-    steps.
-    */
+    #if defined(C89THREAD_HAS_USDT)
+    {
+        DTRACE_PROBE(c89thread, thread_exit);
+    }
+    #endif
 
-    /* Wait for the thread. */
-    if (WaitForSingleObject((HANDLE)thr.handle, INFINITE) == WAIT_FAILED) {
-        return c89thrd_error;   /* Wait failed. */
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        c89thread_trace_thread_exited();
     }
+    #endif
 
-    /* Retrieve the result code if required. */
-    if (res != NULL) {
-        DWORD exitCode;
-        if (GetExitCodeThread((HANDLE)thr.handle, &exitCode) == FALSE) {
-            c89thrd_detach(thr);
-            return c89thrd_error;
+    #if defined(C89THREAD_ENABLE_HOOKS)
+    {
+        if (g_c89threadHooks.onThreadExited != NULL && !g_c89threadIsInHook) {
+            g_c89threadIsInHook = 1;
+            g_c89threadHooks.onThreadExited(g_c89threadHooks.pUserData);
+            g_c89threadIsInHook = 0;
         }
-
-        *res = (int)exitCode;
     }
-
-    /*
-    It's not entirely clear from the documentation for thrd_join() as to whether or not the thread
-    handle should be closed at this point. I think it makes sense to close it here, as I don't recall
-    ever seeing a pattern or joining a thread, and then explicitly closing the thread handle. I think
-    joining should be an implicit detach.
-    */
-    return c89thrd_detach(thr);
+    #endif
 }
+#endif
+/* END c89thread_hooks.c */
 
 
-/* BEG c89mtx_win32.c */
-int c89mtx_init(c89mtx_t* mutex, int type)
+/* BEG c89thread_types.c */
+/* Win32 */
+#if defined(C89THREAD_WIN32)
+#include <windows.h>
+#include <limits.h> /* For LONG_MAX */
+
+#ifndef C89THREAD_MALLOC
+#define C89THREAD_MALLOC(sz)        HeapAlloc(GetProcessHeap(), 0, (sz))
+#endif
+
+#ifndef C89THREAD_REALLOC
+#define C89THREAD_REALLOC(p, sz)    (((sz) > 0) ? ((p) ? HeapReAlloc(GetProcessHeap(), 0, (p), (sz)) : HeapAlloc(GetProcessHeap(), 0, (sz))) : ((VOID*)(size_t)(HeapFree(GetProcessHeap(), 0, (p)) & 0)))
+#endif
+
+#ifndef C89THREAD_FREE
+#define C89THREAD_FREE(p)           HeapFree(GetProcessHeap(), 0, (p))
+#endif
+
+static C89THREAD_THREAD_LOCAL c89thread_entry_exit_callbacks g_c89threadEntryExitCallbacks;
+
+#if defined(C89THREAD_PROFILE)
+static void c89thread_wait_profile_release(void);
+#endif
+
+static void c89thrd_run_exit_callback_win32(void)
 {
-    HANDLE hMutex;
+    c89thrd_on_exit_t onExit;
+    void* pUserData;
 
-    if (mutex == NULL) {
-        return c89thrd_error;
-    }
+    onExit    = g_c89threadEntryExitCallbacks.onExit;
+    pUserData = g_c89threadEntryExitCallbacks.pUserData;
 
-    /* Initialize the object to zero for safety. */
-    mutex->handle = NULL;
-    mutex->type   = 0;
+    g_c89threadEntryExitCallbacks.onExit    = NULL;
+    g_c89threadEntryExitCallbacks.pUserData = NULL;
 
-    /*
-    CreateMutex() will create a thread-aware mutex (allowing recursiveness), whereas an auto-reset
-    event (CreateEvent()) is not thread-aware and will deadlock (will not allow recursiveness). In
-    Win32 I'm making all mutex's timeable.
-    */
-    if ((type & c89mtx_recursive) != 0) {
-        hMutex = CreateMutexA(NULL, FALSE, NULL);
-    } else {
-        hMutex = CreateEventA(NULL, FALSE, TRUE, NULL);
+    if (onExit != NULL) {
+        onExit(pUserData);
     }
 
-    if (hMutex == NULL) {
-        return c89thrd_result_from_GetLastError();
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_thread_exited();
     }
+    #endif
 
-    mutex->handle = (c89thread_handle)hMutex;
-    mutex->type   = type;
-
-    return c89thrd_success;
+    #if defined(C89THREAD_PROFILE)
+    {
+        c89thread_wait_profile_release();
+    }
+    #endif
 }
 
-void c89mtx_destroy(c89mtx_t* mutex)
+/* BEG c89thrd_result_from_GetLastError.c */
+static int c89thrd_result_from_GetLastError(void)
 {
-    if (mutex == NULL) {
-        return;
+    switch (GetLastError())
+    {
+        case ERROR_SUCCESS:             return c89thrd_success;
+        case ERROR_NOT_ENOUGH_MEMORY:   return c89thrd_nomem;
+        case ERROR_SEM_TIMEOUT:         return c89thrd_timedout;
+        case ERROR_BUSY:                return c89thrd_busy;
+        default: break;
     }
 
-    CloseHandle((HANDLE)mutex->handle);
+    return c89thrd_error;
 }
+/* END c89thrd_result_from_GetLastError.c */
 
-int c89mtx_lock(c89mtx_t* mutex)
+static c89thread_uint64 c89timespec_to_milliseconds(const struct timespec ts)
 {
-    DWORD result;
+    c89thread_uint64 milliseconds;
 
-    if (mutex == NULL) {
-        return c89thrd_error;
+    /*
+    A 64-bit time_t can technically overflow, but it would require a timeout of millions of years so
+    it's not worth addressing this. A 32-bit time_t cannot specify a value large enough to cause an
+    overflow.
+    */
+    milliseconds = (((c89thread_uint64)ts.tv_sec * 1000) + ((c89thread_uint64)ts.tv_nsec / 1000000));
+    if ((ts.tv_nsec % 1000000) != 0) {
+        milliseconds += 1; /* We truncated a sub-millisecond amount of time. Add an extra millisecond to meet the minimum duration requirement. */
     }
 
-    result = WaitForSingleObject((HANDLE)mutex->handle, INFINITE);
-    if (result == WAIT_ABANDONED) {
-        ReleaseMutex((HANDLE)mutex->handle);
-        return c89thrd_error;
-    }
-    if (result != WAIT_OBJECT_0) {
-        return c89thrd_error;
-    }
+    return milliseconds;
+}
 
-    return c89thrd_success;
+static c89thread_uint64 c89timespec_diff_milliseconds(const struct timespec tsA, const struct timespec tsB)
+{
+    return c89timespec_to_milliseconds(c89timespec_diff(tsA, tsB));
 }
 
-/* BEG c89mtx_timedlock_win32.c */
-int c89mtx_timedlock(c89mtx_t* mutex, const struct timespec* time_point)
+/* Calculates `floor((multiplicand * multiplier) / divisor)` without overflow. */
+static int c89thread_mul_div_u64(c89thread_uint64 multiplicand, c89thread_uint64 multiplier, c89thread_uint64 divisor, c89thread_uint64* pResult)
 {
-    DWORD result;
+    c89thread_uint64 whole;
+    c89thread_uint64 quotient;
+    c89thread_uint64 remainder;
+    c89thread_uint64 bit;
 
-    if (mutex == NULL || time_point == NULL) {
-        return c89thrd_error;
+    if (divisor == 0 || pResult == NULL) {
+        return 0;
     }
 
-    result = c89wait_for_single_object_until((HANDLE)mutex->handle, time_point);
-    if (result == WAIT_ABANDONED) {
-        ReleaseMutex((HANDLE)mutex->handle);
-        return c89thrd_error;
+    *pResult = 0;
+
+    if (multiplier == 0) {
+        return 1;
     }
-    if (result != WAIT_OBJECT_0) {
-        if (result == WAIT_TIMEOUT) {
-            return c89thrd_timedout;
-        }
 
-        return c89thrd_error;
+    whole = multiplicand / divisor;
+    if (whole > C89THREAD_UINT64_MAX / multiplier) {
+        return 0;
     }
 
-    return c89thrd_success;
-}
-/* END c89mtx_timedlock_win32.c */
-
-/* BEG c89mtx_trylock_win32.c */
-int c89mtx_trylock(c89mtx_t* mutex)
-{
-    DWORD result;
-
-    if (mutex == NULL) {
-        return c89thrd_error;
-    }
+    multiplicand %= divisor;
+    quotient = 0;
+    remainder = 0;
+    bit = 1;
 
-    result = WaitForSingleObject((HANDLE)mutex->handle, 0);
-    if (result == WAIT_ABANDONED) {
-        ReleaseMutex((HANDLE)mutex->handle);
-        return c89thrd_error;
-    }
-    if (result == WAIT_TIMEOUT) {
-        return c89thrd_busy;
-    }
-    if (result != WAIT_OBJECT_0) {
-        return c89thrd_error;
+    while (bit <= multiplier / 2) {
+        bit <<= 1;
     }
 
-    return c89thrd_success;
-}
-/* END c89mtx_trylock_win32.c */
+    while (bit != 0) {
+        quotient <<= 1;
 
-int c89mtx_unlock(c89mtx_t* mutex)
-{
-    BOOL result;
+        if (remainder >= divisor - remainder) {
+            remainder -= divisor - remainder;
+            quotient += 1;
+        } else {
+            remainder += remainder;
+        }
 
-    if (mutex == NULL) {
-        return c89thrd_error;
-    }
+        if ((multiplier & bit) != 0) {
+            if (remainder >= divisor - multiplicand) {
+                remainder -= divisor - multiplicand;
+                quotient += 1;
+            } else {
+                remainder += multiplicand;
+            }
+        }
 
-    if ((mutex->type & c89mtx_recursive) != 0) {
-        result = ReleaseMutex((HANDLE)mutex->handle);
-    } else {
-        result = SetEvent((HANDLE)mutex->handle);
+        bit >>= 1;
     }
 
-    if (!result) {
-        return c89thrd_error;
+    whole *= multiplier;
+    if (whole > C89THREAD_UINT64_MAX - quotient) {
+        return 0;
     }
 
-    return c89thrd_success;
+    *pResult = whole + quotient;
+    return 1;
 }
-/* END c89mtx_win32.c */
 
-
-/* BEG c89cnd_win32.c */
-int c89cnd_init(c89cnd_t* cnd)
+static DWORD c89wait_for_single_object_until_ex(HANDLE handle, const struct timespec* time_point, int isMonotonic)
 {
-    if (cnd == NULL) {
-        return c89thrd_error;
-    }
-
-    /* Not supporting condition variables on Win32. */
-    return c89thrd_error;
-}
+    for (;;) {
+        struct timespec tsNow;
+        c89thread_uint64 timeoutMilliseconds;
+        DWORD timeout;
+        DWORD result;
 
-void c89cnd_destroy(c89cnd_t* cnd)
-{
-    if (cnd == NULL) {
-        return;
-    }
+        if (isMonotonic) {
+            tsNow = c89timespec_now_monotonic();
+        } else {
+            tsNow = c89timespec_now();
+        }
 
-    /* Not supporting condition variables on Win32. */
-}
+        if (c89timespec_cmp(tsNow, *time_point) > 0) {
+            timeoutMilliseconds = 0;
+            timeout = 0;
+        } else {
+            timeoutMilliseconds = c89timespec_diff_milliseconds(*time_point, tsNow);
+            if (timeoutMilliseconds >= INFINITE) {
+                timeout = INFINITE - 1;
+            } else {
+                timeout = (DWORD)timeoutMilliseconds;
+            }
+        }
 
-int c89cnd_signal(c89cnd_t* cnd)
-{
-    if (cnd == NULL) {
-        return c89thrd_error;
+        /*
+        WaitForSingleObject() can time out a little early because of the timer resolution, so keep
+        waiting until the time point has actually passed. A zero timeout means it already has.
+        */
+        result = WaitForSingleObject(handle, timeout);
+        if (result != WAIT_TIMEOUT || timeout == 0) {
+            return result;
+        }
     }
-
-    /* Not supporting condition variables on Win32. */
-    return c89thrd_error;
 }
 
-int c89cnd_broadcast(c89cnd_t* cnd)
+static DWORD c89wait_for_single_object_until(HANDLE handle, const struct timespec* time_point)
 {
-    if (cnd == NULL) {
-        return c89thrd_error;
-    }
-
-    /* Not supporting condition variables on Win32. */
-    return c89thrd_error;
+    return c89wait_for_single_object_until_ex(handle, time_point, 0);
 }
 
-int c89cnd_wait(c89cnd_t* cnd, c89mtx_t* mtx)
+static DWORD c89wait_for_single_object_for(HANDLE handle, const struct timespec* duration)
 {
-    if (cnd == NULL) {
-        return c89thrd_error;
+    c89thread_uint64 startTicks;
+    c89thread_uint64 durationNanoseconds;
+    c89thread_uint64 elapsedNanoseconds;
+    c89thread_uint64 timeoutMilliseconds;
+    DWORD result;
+
+    /* Only an exact zero or negative duration polls. Anything else is rounded up to whole milliseconds by c89timespec_to_milliseconds(). */
+    if (duration->tv_sec < 0 || (duration->tv_sec == 0 && duration->tv_nsec <= 0)) {
+        return WaitForSingleObject(handle, 0);
     }
 
-    (void)mtx;
+    timeoutMilliseconds = c89timespec_to_milliseconds(*duration);
 
-    /* Not supporting condition variables on Win32. */
-    return c89thrd_error;
-}
+    /*
+    The duration is passed straight to the wait. The raw counter is read so that a timeout can be
+    checked, but it's only converted to a time if the wait actually times out.
+    */
+    startTicks = c89thread_ticks();
 
-int c89cnd_timedwait(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
-{
-    if (cnd == NULL) {
-        return c89thrd_error;
-    }
+    for (;;) {
+        result = WaitForSingleObject(handle, (timeoutMilliseconds >= INFINITE) ? (INFINITE - 1) : (DWORD)timeoutMilliseconds);
+        if (result != WAIT_TIMEOUT) {
+            return result;
+        }
 
-    (void)mtx;
-    (void)time_point;
+        /* WaitForSingleObject() can time out a little early because of the timer resolution. Wait out whatever is left. */
+        durationNanoseconds = ((c89thread_uint64)duration->tv_sec * 1000000000) + (c89thread_uint64)duration->tv_nsec;
+        elapsedNanoseconds  = c89thread_ticks_to_ns(c89thread_ticks() - startTicks);
+        if (elapsedNanoseconds >= durationNanoseconds) {
+            return WAIT_TIMEOUT;
+        }
 
-    /* Not supporting condition variables on Win32. */
-    return c89thrd_error;
+        timeoutMilliseconds = ((durationNanoseconds - elapsedNanoseconds) + 999999) / 1000000;
+    }
 }
-/* END c89cnd_win32.c */
 
 
-int c89sem_init(c89sem_t* sem, int value, int valueMax)
+typedef struct
 {
-    HANDLE hSemaphore;
+    c89thrd_start_t func;
+    void* arg;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+    char name[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    HANDLE hStarted;    /* Only set when the start data is on the creating thread's stack, in which case it'll be signalled once it's no longer needed. */
+} c89thrd_start_data_win32;
 
-    if (sem == NULL || valueMax == 0 || value > valueMax) {
+static int c89thrd_priority_from_policy_win32(int policy, int priority, int* pThreadPriority)
+{
+    /* Like pthreads, the priority is only meaningful for the real time policies. */
+    if (policy != c89thrd_sched_fifo && policy != c89thrd_sched_rr && priority != 0) {
         return c89thrd_error;
     }
 
-    *sem = NULL;
+    switch (policy)
+    {
+        case c89thrd_sched_other: *pThreadPriority = THREAD_PRIORITY_NORMAL;       return c89thrd_success;
+        case c89thrd_sched_batch: *pThreadPriority = THREAD_PRIORITY_BELOW_NORMAL; return c89thrd_success;
+        case c89thrd_sched_idle:  *pThreadPriority = THREAD_PRIORITY_IDLE;         return c89thrd_success;
+        case c89thrd_sched_fifo:
+        case c89thrd_sched_rr:
+        {
+            /* Spread the 1..99 range used by pthreads over the priorities above normal. */
+            if (priority < 1 || priority > 99) {
+                return c89thrd_error;
+            }
 
-    hSemaphore = CreateSemaphore(NULL, value, valueMax, NULL);
-    if (hSemaphore == NULL) {
-        return c89thrd_error;
+            if (priority <= 33) {
+                *pThreadPriority = THREAD_PRIORITY_ABOVE_NORMAL;
+            } else if (priority <= 66) {
+                *pThreadPriority = THREAD_PRIORITY_HIGHEST;
+            } else {
+                *pThreadPriority = THREAD_PRIORITY_TIME_CRITICAL;
+            }
+
+            return c89thrd_success;
+        }
+        default: break;
     }
 
-    *sem = hSemaphore;
+    return c89thrd_error;
+}
 
-    return c89thrd_success;
+static int c89thrd_priority_from_nice_win32(int nice)
+{
+    if (nice <= -10) {
+        return THREAD_PRIORITY_HIGHEST;
+    } else if (nice < 0) {
+        return THREAD_PRIORITY_ABOVE_NORMAL;
+    } else if (nice == 0) {
+        return THREAD_PRIORITY_NORMAL;
+    } else if (nice < 10) {
+        return THREAD_PRIORITY_BELOW_NORMAL;
+    } else {
+        return THREAD_PRIORITY_LOWEST;
+    }
 }
 
-void c89sem_destroy(c89sem_t* sem)
+static DWORD_PTR c89thread_cpu_set_to_mask_win32(const c89thread_cpu_set* pSet)
 {
-    if (sem == NULL) {
-        return;
+    DWORD_PTR mask = 0;
+    unsigned int iCPU;
+
+    for (iCPU = 0; iCPU < sizeof(DWORD_PTR) * 8 && iCPU < C89THREAD_MAX_CPUS; iCPU += 1) {
+        if (c89thread_cpu_set_contains(pSet, iCPU)) {
+            mask |= ((DWORD_PTR)1 << iCPU);
+        }
     }
 
-    CloseHandle((HANDLE)*sem);
+    return mask;
 }
 
-int c89sem_wait(c89sem_t* sem)
+static void c89thread_cpu_set_from_mask_win32(c89thread_cpu_set* pSet, DWORD_PTR mask)
 {
-    DWORD result;
+    unsigned int iCPU;
 
-    if (sem == NULL) {
-        return c89thrd_error;
-    }
+    c89thread_cpu_set_zero(pSet);
 
-    result = WaitForSingleObject((HANDLE)*sem, INFINITE);
-    if (result != WAIT_OBJECT_0) {
-        return c89thrd_error;
+    for (iCPU = 0; iCPU < sizeof(DWORD_PTR) * 8 && iCPU < C89THREAD_MAX_CPUS; iCPU += 1) {
+        if ((mask & ((DWORD_PTR)1 << iCPU)) != 0) {
+            c89thread_cpu_set_add(pSet, iCPU);
+        }
     }
-
-    return c89thrd_success;
 }
 
-int c89sem_timedwait(c89sem_t* sem, const struct timespec* time_point)
+static unsigned long WINAPI c89thrd_start_win32(void* pUserData)
 {
-    DWORD result;
+    c89thrd_start_data_win32* pStartData = (c89thrd_start_data_win32*)pUserData;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thrd_start_t func;
+    void* arg;
+    HANDLE hStarted;
+    unsigned long result;
 
-    if (sem == NULL || time_point == NULL) {
-        return c89thrd_error;
-    }
+    entryExitCallbacks = pStartData->entryExitCallbacks;
+    func     = pStartData->func;
+    arg      = pStartData->arg;
+    hStarted = pStartData->hStarted;
 
-    result = c89wait_for_single_object_until((HANDLE)*sem, time_point);
-    if (result != WAIT_OBJECT_0) {
-        if (result == WAIT_TIMEOUT) {
-            return c89thrd_timedout;
+    /* A NULL function means thread creation failed after the thread was created suspended. The creating thread is not waiting on hStarted in this case. */
+    if (func == NULL) {
+        if (hStarted == NULL) {
+            c89thread_free(pStartData, (pStartData->usingCustomAllocator) ? &pStartData->allocationCallbacks : NULL);
         }
 
-        return c89thrd_error;
+        return 0;
     }
 
-    return c89thrd_success;
-}
+    /* The name is set here rather than by the creating thread so it's in place before any user code is run. */
+    if (pStartData->name[0] != '\0') {
+        c89thrd_set_name(c89thrd_current(), pStartData->name);
+    }
 
-int c89sem_post(c89sem_t* sem)
-{
-    BOOL result;
+    /* Release the start data before calling user code. If it's on the creating thread's stack it must not be touched after signalling. */
+    if (hStarted != NULL) {
+        SetEvent(hStarted);
+    } else {
+        c89thread_free(pStartData, (pStartData->usingCustomAllocator) ? &pStartData->allocationCallbacks : NULL);
+    }
 
-    if (sem == NULL) {
-        return c89thrd_error;
+    g_c89threadEntryExitCallbacks = entryExitCallbacks;
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_thread_created();
     }
+    #endif
 
-    result = ReleaseSemaphore((HANDLE)*sem, 1, NULL);
-    if (!result) {
-        return c89thrd_error;
+    if (entryExitCallbacks.onEntry != NULL) {
+        entryExitCallbacks.onEntry(entryExitCallbacks.pUserData);
     }
 
-    return c89thrd_success;
-}
+    result = (unsigned long)func(arg);
 
+    c89thrd_run_exit_callback_win32();
 
+    return result;
+}
 
-int c89evnt_init(c89evnt_t* evnt)
+int c89thrd_create_ex2(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thrd_attr* pAttr)
 {
-    HANDLE hEvent;
+    HANDLE hThread;
+    DWORD threadID;
+    DWORD creationFlags = 0;
+    DWORD stackSize = 0;
+    DWORD_PTR affinityMask = 0;
+    int threadPriority = THREAD_PRIORITY_NORMAL;
+    c89thrd_start_data_win32* pData;    /* <-- Needs to be allocated on the heap to ensure the data doesn't get trashed before the thread is entered, unless we wait for the thread to start. */
+    c89thrd_start_data_win32 dataOnStack;
+    const c89thread_entry_exit_callbacks* pEntryExitCallbacks = NULL;
+    const c89thread_allocation_callbacks* pAllocationCallbacks = NULL;
 
-    if (evnt == NULL) {
+    if (thr == NULL) {
         return c89thrd_error;
     }
 
-    *evnt = NULL;
+    memset(thr, 0, sizeof(*thr));
 
-    hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
-    if (hEvent == NULL) {
+    if (func == NULL) {
         return c89thrd_error;
     }
 
-    *evnt = hEvent;
+    if (pAttr != NULL) {
+        pEntryExitCallbacks  = pAttr->pEntryExitCallbacks;
+        pAllocationCallbacks = pAttr->pAllocationCallbacks;
 
-    return c89thrd_success;
-}
+        if (pAttr->pStack != NULL) {
+            return c89thrd_error;   /* Not supported with CreateThread(). */
+        }
 
-void c89evnt_destroy(c89evnt_t* evnt)
-{
-    if (evnt == NULL) {
-        return;
-    }
-
-    CloseHandle((HANDLE)*evnt);
-}
-
-int c89evnt_wait(c89evnt_t* evnt)
-{
-    DWORD result;
-
-    if (evnt == NULL) {
-        return c89thrd_error;
-    }
-
-    result = WaitForSingleObject((HANDLE)*evnt, INFINITE);
-    if (result != WAIT_OBJECT_0) {
-        return c89thrd_error;
-    }
-
-    return c89thrd_success;
-}
-
-int c89evnt_timedwait(c89evnt_t* evnt, const struct timespec* time_point)
-{
-    DWORD result;
-
-    if (evnt == NULL || time_point == NULL) {
-        return c89thrd_error;
-    }
+        if (pAttr->stackSize > 0) {
+            if ((size_t)(DWORD)pAttr->stackSize != pAttr->stackSize) {
+                return c89thrd_error;
+            }
 
-    result = c89wait_for_single_object_until((HANDLE)*evnt, time_point);
-    if (result != WAIT_OBJECT_0) {
-        if (result == WAIT_TIMEOUT) {
-            return c89thrd_timedout;
+            /* We want the size to be the amount of address space that's reserved rather than the initially committed size. */
+            stackSize = (DWORD)pAttr->stackSize;
+            creationFlags |= STACK_SIZE_PARAM_IS_A_RESERVATION;
         }
 
-        return c89thrd_error;
-    }
-
-    return c89thrd_success;
-}
-
-int c89evnt_signal(c89evnt_t* evnt)
-{
-    BOOL result;
-
-    if (evnt == NULL) {
-        return c89thrd_error;
-    }
-
-    result = SetEvent((HANDLE)*evnt);
-    if (!result) {
-        return c89thrd_error;
-    }
-
-    return c89thrd_success;
-}
-#endif
-
-/* POSIX */
-#if defined(C89THREAD_POSIX)
-#include <pthread.h>
-#include <stdlib.h>     /* For malloc(), realloc(), free(). */
-#include <errno.h>      /* For errno_t. */
-#include <limits.h>     /* For INT_MAX. */
-#include <sys/time.h>   /* For timeval. */
-
-#ifndef C89THREAD_MALLOC
-#define C89THREAD_MALLOC(sz)        malloc(sz)
-#endif
-
-#ifndef C89THREAD_REALLOC
-#define C89THREAD_REALLOC(p, sz)    realloc(p, sz)
-#endif
-
-#ifndef C89THREAD_FREE
-#define C89THREAD_FREE(p)           free(p)
-#endif
-
-static C89THREAD_THREAD_LOCAL c89thread_entry_exit_callbacks g_c89threadEntryExitCallbacks;
-
-static void c89thrd_run_exit_callback_posix(void)
-{
-    c89thrd_on_exit_t onExit;
-    void* pUserData;
-
-    onExit    = g_c89threadEntryExitCallbacks.onExit;
-    pUserData = g_c89threadEntryExitCallbacks.pUserData;
+        if (pAttr->pAffinity != NULL) {
+            affinityMask = c89thread_cpu_set_to_mask_win32(pAttr->pAffinity);
+            if (affinityMask == 0) {
+                return c89thrd_error;   /* None of the CPUs in the set are usable. */
+            }
 
-    g_c89threadEntryExitCallbacks.onExit    = NULL;
-    g_c89threadEntryExitCallbacks.pUserData = NULL;
+            /* The thread is created suspended so the affinity can be set before it runs anything. */
+            creationFlags |= CREATE_SUSPENDED;
+        }
 
-    if (onExit != NULL) {
-        onExit(pUserData);
-    }
-}
+        if (pAttr->schedPolicy != c89thrd_sched_inherit) {
+            if (c89thrd_priority_from_policy_win32(pAttr->schedPolicy, pAttr->schedPriority, &threadPriority) != c89thrd_success) {
+                return c89thrd_error;
+            }
 
-/* BEG c89thrd_result_from_errno.c */
-static int c89thrd_result_from_errno(int e)
-{
-    switch (e)
-    {
-        case 0:         return c89thrd_success;
-        case ENOMEM:    return c89thrd_nomem;
-        #ifdef ETIME
-        case ETIME:     return c89thrd_timedout;
-        #endif
-        case ETIMEDOUT: return c89thrd_timedout;
-        case EBUSY:     return c89thrd_busy;
+            creationFlags |= CREATE_SUSPENDED;
+        } else if (pAttr->nice != 0) {
+            threadPriority = c89thrd_priority_from_nice_win32(pAttr->nice);
+            creationFlags |= CREATE_SUSPENDED;
+        }
     }
 
-    return c89thrd_error;
-}
-/* END c89thrd_result_from_errno.c */
-
-/* BEG c89thrd_result_from_pthread.c */
-static int c89thrd_result_from_pthread(int e)
-{
-    if (e == 0) {
-        return c89thrd_success;
+    if (pAttr != NULL && pAttr->noAlloc) {
+        pData = &dataOnStack;
+        pData->hStarted = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (pData->hStarted == NULL) {
+            return c89thrd_result_from_GetLastError();
+        }
     } else {
-        return c89thrd_result_from_errno(e);
-    }
-}
-/* END c89thrd_result_from_pthread.c */
-
-typedef struct
-{
-    c89thrd_start_t func;
-    void* arg;
-    c89thread_entry_exit_callbacks entryExitCallbacks;
-    c89thread_allocation_callbacks allocationCallbacks;
-    int usingCustomAllocator;
-} c89thrd_start_data_posix;
-
-static void* c89thrd_start_posix(void* pUserData)
-{
-    c89thrd_start_data_posix* pStartData = (c89thrd_start_data_posix*)pUserData;
-    c89thread_entry_exit_callbacks entryExitCallbacks;
-    c89thrd_start_t func;
-    void* arg;
-    void* result;
-
-    entryExitCallbacks = pStartData->entryExitCallbacks;
-    func = pStartData->func;
-    arg  = pStartData->arg;
-
-    /* Free the start data before calling user code. */
-    c89thread_free(pStartData, (pStartData->usingCustomAllocator) ? &pStartData->allocationCallbacks : NULL);
-
-    g_c89threadEntryExitCallbacks = entryExitCallbacks;
-
-    if (entryExitCallbacks.onEntry != NULL) {
-        entryExitCallbacks.onEntry(entryExitCallbacks.pUserData);
-    }
-
-    result = (void*)(c89thread_intptr)func(arg);
-
-    c89thrd_run_exit_callback_posix();
-
-    return result;
-}
-
-int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks, const c89thread_allocation_callbacks* pAllocationCallbacks)
-{
-    int result;
-    c89thrd_start_data_posix* pData;
-    pthread_t thread;
-
-    if (thr == NULL) {
-        return c89thrd_error;
-    }
-
-    if (func == NULL) {
-        return c89thrd_error;
-    }
+        pData = (c89thrd_start_data_win32*)c89thread_malloc(sizeof(*pData), pAllocationCallbacks);   /* <-- This will be freed when c89thrd_start_win32() is entered. */
+        if (pData == NULL) {
+            return c89thrd_nomem;
+        }
 
-    pData = (c89thrd_start_data_posix*)c89thread_malloc(sizeof(*pData), pAllocationCallbacks);   /* <-- This will be freed when c89thrd_start_posix() is entered. */
-    if (pData == NULL) {
-        return c89thrd_nomem;
+        pData->hStarted = NULL;
     }
 
     pData->func = func;
     pData->arg  = arg;
 
+    if (pAttr != NULL && pAttr->pName != NULL) {
+        c89thread_copy_string(pData->name, sizeof(pData->name), pAttr->pName);
+    } else {
+        pData->name[0] = '\0';
+    }
+
     if (pEntryExitCallbacks != NULL) {
         pData->entryExitCallbacks = *pEntryExitCallbacks;
     } else {
@@ -1388,1258 +1957,8401 @@ int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89
         pData->usingCustomAllocator = 0;
     }
 
-    result = c89thrd_result_from_pthread(pthread_create(&thread, NULL, c89thrd_start_posix, pData));
-    if (result != c89thrd_success) {
-        c89thread_free(pData, pAllocationCallbacks);
+    hThread = CreateThread(NULL, stackSize, c89thrd_start_win32, pData, creationFlags, &threadID);
+    if (hThread == NULL) {
+        int result = c89thrd_result_from_GetLastError();
+
+        if (pData->hStarted != NULL) {
+            CloseHandle(pData->hStarted);
+        } else {
+            c89thread_free(pData, pAllocationCallbacks);
+        }
+
         return result;
     }
 
-    *thr = thread;
+    if ((creationFlags & CREATE_SUSPENDED) != 0) {
+        if ((affinityMask != 0 && SetThreadAffinityMask(hThread, affinityMask) == 0) || (threadPriority != THREAD_PRIORITY_NORMAL && !SetThreadPriority(hThread, threadPriority))) {
+            int result = c89thrd_result_from_GetLastError();
+
+            /* The thread needs to run to completion so it can free its start data. Make it exit straight away. */
+            pData->func = NULL;
+            ResumeThread(hThread);
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+
+            if (pData->hStarted != NULL) {
+                CloseHandle(pData->hStarted);
+            }
+
+            return (result == c89thrd_success) ? c89thrd_error : result;
+        }
+
+        ResumeThread(hThread);
+    }
+
+    if (pData == &dataOnStack) {
+        WaitForSingleObject(dataOnStack.hStarted, INFINITE);
+        CloseHandle(dataOnStack.hStarted);
+    }
+
+    thr->handle = (c89thread_handle)hThread;
+    thr->id     = threadID;
 
     return c89thrd_success;
 }
 
+int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    c89thrd_attr attr = c89thrd_attr_init();
+    attr.pEntryExitCallbacks  = pEntryExitCallbacks;
+    attr.pAllocationCallbacks = pAllocationCallbacks;
+
+    return c89thrd_create_ex2(thr, func, arg, &attr);
+}
+
 int c89thrd_create(c89thrd_t* thr, c89thrd_start_t func, void* arg)
 {
-    return c89thrd_create_ex(thr, func, arg, NULL, NULL);
+    return c89thrd_create_ex2(thr, func, arg, NULL);
 }
 
 int c89thrd_equal(c89thrd_t lhs, c89thrd_t rhs)
 {
-    return pthread_equal(lhs, rhs);
+    /* We just compare thread IDs. */
+    return lhs.id == rhs.id;
 }
 
 c89thrd_t c89thrd_current(void)
 {
-    return pthread_self();
+    c89thrd_t thr;
+
+    thr.handle = (c89thread_handle)GetCurrentThread();
+    thr.id     = GetCurrentThreadId();
+
+    return thr;
 }
 
 int c89thrd_sleep(const struct timespec* duration, struct timespec* remaining)
 {
     /*
-    The documentation for thrd_sleep() mentions nanosleep(), so we'll go ahead and use that if it's
-    available. Otherwise we'll fallback to select() and use a similar algorithm to what we use with
-    the Windows build. We need to keep in mind the requirement to handle signal interrupts.
-    */
-    int presult;
-    int errorCode;
+    Sleeping is annoyingly complicated in C11. Nothing crazy or anything, but it's not just a simple
+    millisecond sleep. These are the rules:
+    
+        * On success, return 0
+        * When the sleep is interupted due to a signal, return -1
+        * When any other error occurs, return some other negative value.
+        * When the sleep is interupted, the `remaining` output parameter needs to be filled out with
+          the remaining time.
 
-    #if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 199309L
-    {
-        presult = nanosleep(duration, remaining);
-        errorCode = errno;
-        if (presult != 0) {
-            if (errorCode == EINTR) {
-                return c89thrd_signal;
-            }
+    In order to detect a signal, we can use SleepEx(). This only has a resolution of 1 millisecond,
+    however (this is true for everything on Windows). SleepEx() will return WAIT_IO_COMPLETION if
+    some I/O completion event occurs. This is the best we'll get on Windows, I think.
 
-            return c89thrd_error;    
-        }
+    In order to calculate the value to place into `remaining`, we need to get the time before sleeping
+    and then get the time after the sleeping. We'll then have enough information to calculate the
+    difference which will be our remining. This is only required when the `remaining` parameter is not
+    NULL. Unfortunately we cannot use timespec_get() here because it doesn't have good support with
+    MinGW. We'll instead use Windows' high resolution performance counter which is supported back to
+    Windows 2000.
+    */
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    DWORD sleepResult;
+    c89thread_uint64 sleepMilliseconds;
+
+    if (duration == NULL || duration->tv_sec < 0 || duration->tv_nsec < 0 || duration->tv_nsec >= 1000000000) {
+        return c89thrd_error;
     }
-    #else
-    {
-        /*
-        We need to fall back to select(). We'll use c89timespec_get() to retrieve the time before and after
-        for the purpose of diffing.
-        */
-        struct timeval tv;
-        struct timespec tsBeg;
-        struct timespec tsEnd;
 
-        if (duration == NULL) {
+    frequency.QuadPart = 0;
+    start.QuadPart = 0;
+
+    if (remaining != NULL) {
+        if (QueryPerformanceFrequency(&frequency) == FALSE) {
             return c89thrd_error;
         }
 
-        /*
-        We need to grab the time before the wait. This will be diff'd with the time after waiting to
-        produce the remaining amount.
-        */
-        if (remaining != NULL) {
-            presult = c89timespec_get(&tsBeg, TIME_UTC);
-            if (presult == 0) {
-                return c89thrd_error;   /* Failed to retrieve the start time. */
-            }
+        if (QueryPerformanceCounter(&start) == FALSE) {
+            return c89thrd_error;   /* Failed to retrieve the start time. */
         }
+    }
 
-        tv.tv_sec  = duration->tv_sec;
-        tv.tv_usec = duration->tv_nsec / 1000;
+    /*
+    A 64-bit time_t can technically overflow, but it would require a timeout of millions of years so
+    it's not worth addressing this. A 32-bit time_t cannot specify a value large enough to cause an
+    overflow.
+    */
+    sleepMilliseconds = (((c89thread_uint64)duration->tv_sec * 1000) + ((c89thread_uint64)duration->tv_nsec / 1000000));
 
-        /*
-        We need to sleep for the *minimum* of `duration`. Our nanoseconds-to-microseconds conversion
-        above may have truncated some nanoseconds, so we'll need to add a microsecond to compensate.
-        */
-        if ((duration->tv_nsec % 1000) != 0) {
-            tv.tv_usec += 1;
-            if (tv.tv_usec >= 1000000) {
-                tv.tv_usec -= 1000000;
-                tv.tv_sec += 1;
-            }
-        }
+    /*
+    A small, but important detail here. The C11 spec states that thrd_sleep() should sleep for a
+    *minimum* of the specified duration. In the above calculation we converted nanoseconds to
+    milliseconds, however this requires a division which may truncate a non-zero sub-millisecond
+    amount of time. We need to add an extra millisecond to meet the minimum duration requirement if
+    indeed we truncated.
+    */
+    if ((duration->tv_nsec % 1000000) != 0) {
+        sleepMilliseconds += 1; /* We truncated a sub-millisecond amount of time. Add an extra millisecond to meet the minimum duration requirement. */
+    }
+    
+    for (;;) {
+        DWORD sleepChunk;
 
-        presult = select(0, NULL, NULL, NULL, &tv);
-        errorCode = errno;
-        if (presult == 0) {
-            if (remaining != NULL) {
-                remaining->tv_sec  = 0;
-                remaining->tv_nsec = 0;
-            }
+        if (sleepMilliseconds >= INFINITE) {
+            sleepChunk = INFINITE - 1;
+        } else {
+            sleepChunk = (DWORD)sleepMilliseconds;
+        }
 
-            return c89thrd_success;
+        sleepResult = SleepEx(sleepChunk, TRUE); /* <-- Make this sleep alertable so we can detect WAIT_IO_COMPLETION and return -1. */
+        if (sleepResult != 0 || sleepMilliseconds <= sleepChunk) {
+            break;
         }
 
-        /* Getting here means didn't wait the whole time. We'll need to grab the diff. */
+        sleepMilliseconds -= sleepChunk;
+    }
+
+    if (sleepResult == 0) {
         if (remaining != NULL) {
-            if (c89timespec_get(&tsEnd, TIME_UTC) != 0) {
-                if (c89timespec_cmp(tsEnd, tsBeg) <= 0) {
+            remaining->tv_sec  = 0;
+            remaining->tv_nsec = 0;
+        }
+
+        return c89thrd_success;
+    }
+
+    /*
+    Getting here means we didn't sleep for the specified amount of time. We need to fill `remaining`.
+    To do this, we need to find out out much time has elapsed and then offset that will the requested
+    duration. This is the hard part of the process because we need to convert to and from timespec.
+    */
+    if (remaining != NULL) {
+        LARGE_INTEGER end;
+        if (QueryPerformanceCounter(&end)) {
+            LARGE_INTEGER elapsed;
+            elapsed.QuadPart = end.QuadPart - start.QuadPart;
+
+            /*
+            Convert the elapsed counter to a timespec, then subtract it from the requested duration.
+            Use overflow-safe integer arithmetic for the fractional second.
+            */
+            {
+                struct timespec elapsedTime;
+                c89thread_uint64 elapsedNanoseconds;
+                LONGLONG elapsedSeconds;
+
+                elapsedSeconds = elapsed.QuadPart / frequency.QuadPart;
+                if (elapsed.QuadPart < 0) {
                     *remaining = *duration;
+                } else if (elapsedSeconds > (LONGLONG)duration->tv_sec) {
+                    remaining->tv_sec  = 0;
+                    remaining->tv_nsec = 0;
                 } else {
-                    struct timespec elapsed = c89timespec_diff(tsEnd, tsBeg);
-                    if (c89timespec_cmp(elapsed, *duration) < 0) {
-                        *remaining = c89timespec_diff(*duration, elapsed);
-                    } else {
+                    elapsedTime.tv_sec  = (time_t)elapsedSeconds;
+                    if (!c89thread_mul_div_u64((c89thread_uint64)(elapsed.QuadPart % frequency.QuadPart), 1000000000, (c89thread_uint64)frequency.QuadPart, &elapsedNanoseconds)) {
                         remaining->tv_sec  = 0;
                         remaining->tv_nsec = 0;
+                    } else {
+                        elapsedTime.tv_nsec = (long)elapsedNanoseconds;
+
+                        if (c89timespec_cmp(elapsedTime, *duration) < 0) {
+                            *remaining = c89timespec_diff(*duration, elapsedTime);
+                        } else {
+                            remaining->tv_sec  = 0;
+                            remaining->tv_nsec = 0;
+                        }
                     }
                 }
-            } else {
-                /* Failed to get the end time, somehow. Shouldn't ever happen. */
-                remaining->tv_sec  = 0;
-                remaining->tv_nsec = 0;
             }
+        } else {
+            remaining->tv_sec  = 0; /* Just for safety. */
+            remaining->tv_nsec = 0;
         }
+    }
 
-        if (errorCode == EINTR) {
-            return c89thrd_signal;
+    if (sleepResult == WAIT_IO_COMPLETION) {
+        return c89thrd_signal;  /* -1 */
+    } else {
+        return c89thrd_error;   /* "other negative value if an error occurred." */
+    }
+}
+
+int c89thrd_sleep_until(const struct timespec* time_point, int base)
+{
+    struct timespec tsNow;
+    c89thread_uint64 milliseconds;
+
+    if (time_point == NULL || (base != TIME_UTC && base != TIME_MONOTONIC)) {
+        return c89thrd_error;
+    }
+
+    /* Sleep() can wake up a little early so keep going until the time point has actually passed. */
+    for (;;) {
+        if (base == TIME_MONOTONIC) {
+            tsNow = c89timespec_now_monotonic();
         } else {
-            return c89thrd_error;
+            tsNow = c89timespec_now();
+        }
+
+        if (c89timespec_cmp(tsNow, *time_point) >= 0) {
+            return c89thrd_success;
+        }
+
+        milliseconds = c89timespec_diff_milliseconds(*time_point, tsNow);
+        if (milliseconds >= INFINITE) {
+            milliseconds = INFINITE - 1;
         }
+
+        Sleep((DWORD)milliseconds);
     }
-    #endif
-    
-    return c89thrd_success;
+}
+
+/* Sleeps until a c89timespec_now_monotonic() time point using the OS. Used by the precise sleep which spins for whatever is left. */
+static int c89thrd_sleep_os_until(const struct timespec* time_point)
+{
+    return c89thrd_sleep_until(time_point, TIME_MONOTONIC);
 }
 
 void c89thrd_yield(void)
 {
-    sched_yield();
+    Sleep(0);
 }
 
 void c89thrd_exit(int res)
 {
-    c89thrd_run_exit_callback_posix();
-    pthread_exit((void*)(c89thread_intptr)res);
+    c89thrd_run_exit_callback_win32();
+    ExitThread((DWORD)res);
+}
+
+int c89thrd_cache_init(const c89thrd_cache_config* pConfig, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    /* Not implemented. This relies on condition variables which are not yet implemented for Win32. */
+    (void)pConfig;
+    (void)pAllocationCallbacks;
+    return c89thrd_error;
+}
+
+void c89thrd_cache_uninit(void)
+{
 }
 
 int c89thrd_detach(c89thrd_t thr)
 {
     /*
-    The documentation for thrd_detach() explicitly says c89thrd_success if successful or c89thrd_error
-    for any other error. Don't use c89thrd_result_from_errno() here.
+    The documentation for thrd_detach() says explicitly that any error should return thrd_error.
+    We'll do the same, so make sure c89thrd_result_from_GetLastError() is not used here.
     */
-    int result = c89thrd_result_from_pthread(pthread_detach(thr));
-    if (result != c89thrd_success) {
+    BOOL result;
+
+    result = CloseHandle((HANDLE)thr.handle);
+    if (!result) {
         return c89thrd_error;
     }
 
     return c89thrd_success;
 }
 
-int c89thrd_join(c89thrd_t thr, int* res)
+static int c89thrd_join_win32(c89thrd_t thr, int* res, const struct timespec* time_point, int isTry)
 {
-    /* Same rules apply here as thrd_detach() with respect to the return value. */
-    void* retval;
-    int result = c89thrd_result_from_pthread(pthread_join(thr, &retval));
-    if (result != c89thrd_success) {
-        return c89thrd_error;   
+    DWORD waitResult;
+
+    /*
+    Like thrd_detach(), the documentation for thrd_join() says to return thrd_success or thrd_error.
+    Therefore, make sure c89thrd_result_from_GetLastError() is not used here.
+
+    In Win32, waiting for the thread to complete and retrieving the result is done as two separate
+    steps.
+    */
+
+    /* Wait for the thread. */
+    if (isTry) {
+        waitResult = WaitForSingleObject((HANDLE)thr.handle, 0);
+    } else if (time_point != NULL) {
+        waitResult = c89wait_for_single_object_until((HANDLE)thr.handle, time_point);
+    } else {
+        waitResult = WaitForSingleObject((HANDLE)thr.handle, INFINITE);
+    }
+
+    if (waitResult == WAIT_TIMEOUT) {
+        return (isTry) ? c89thrd_busy : c89thrd_timedout;
+    }
+
+    if (waitResult != WAIT_OBJECT_0) {
+        return c89thrd_error;   /* Wait failed. */
     }
 
+    /* Retrieve the result code if required. */
     if (res != NULL) {
-        *res = (int)(c89thread_intptr)retval;
+        DWORD exitCode;
+        if (GetExitCodeThread((HANDLE)thr.handle, &exitCode) == FALSE) {
+            c89thrd_detach(thr);
+            return c89thrd_error;
+        }
+
+        *res = (int)exitCode;
     }
 
-    return c89thrd_success;
+    /*
+    It's not entirely clear from the documentation for thrd_join() as to whether or not the thread
+    handle should be closed at this point. I think it makes sense to close it here, as I don't recall
+    ever seeing a pattern or joining a thread, and then explicitly closing the thread handle. I think
+    joining should be an implicit detach.
+    */
+    return c89thrd_detach(thr);
 }
 
-
-/* BEG c89mtx_pthread.c */
-int c89mtx_init(c89mtx_t* mutex, int type)
+int c89thrd_join(c89thrd_t thr, int* res)
 {
-    int result;
+    return c89thrd_join_win32(thr, res, NULL, 0);
+}
 
-    if (mutex == NULL) {
+int c89thrd_timedjoin(c89thrd_t thr, int* res, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
         return c89thrd_error;
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        /* Initialize the main mutex */
-        result = c89thrd_result_from_pthread(pthread_mutex_init(&mutex->mutex, NULL));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
-        
-        /* For recursive mutexes, we need the guard mutex and metadata */
-        if ((type & c89mtx_recursive) != 0) {
-            if (c89thrd_result_from_pthread(pthread_mutex_init(&mutex->guard, NULL)) != c89thrd_success) {
-                pthread_mutex_destroy(&mutex->mutex);
-                return c89thrd_error;
-            }
+    return c89thrd_join_win32(thr, res, time_point, 0);
+}
 
-            mutex->recursionCount = 0;
-        }
-        
-        mutex->type = type;
-        
-        return c89thrd_success;
-    }
-    #else
-    {
-        if ((type & c89mtx_recursive) != 0) {
-            pthread_mutexattr_t attr;
+int c89thrd_tryjoin(c89thrd_t thr, int* res)
+{
+    return c89thrd_join_win32(thr, res, NULL, 1);
+}
 
-            result = c89thrd_result_from_pthread(pthread_mutexattr_init(&attr));
-            if (result != c89thrd_success) {
-                return c89thrd_error;
-            }
-
-            result = c89thrd_result_from_pthread(pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE));
-            if (result == c89thrd_success) {
-                result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)mutex, &attr));
-            }
+int c89thrd_set_affinity(c89thrd_t thr, const c89thread_cpu_set* pAffinity)
+{
+    DWORD_PTR mask;
 
-            pthread_mutexattr_destroy(&attr);
-        } else {
-            result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)mutex, NULL));
-        }
+    if (pAffinity == NULL) {
+        return c89thrd_error;
+    }
 
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
+    mask = c89thread_cpu_set_to_mask_win32(pAffinity);
+    if (mask == 0) {
+        return c89thrd_error;
+    }
 
-        return c89thrd_success;
+    if (SetThreadAffinityMask((HANDLE)thr.handle, mask) == 0) {
+        return c89thrd_error;
     }
-    #endif
+
+    return c89thrd_success;
 }
 
-void c89mtx_destroy(c89mtx_t* mutex)
+int c89thrd_get_affinity(c89thrd_t thr, c89thread_cpu_set* pAffinity)
 {
-    if (mutex == NULL) {
-        return;
+    DWORD_PTR processMask;
+    DWORD_PTR systemMask;
+    DWORD_PTR threadMask;
+
+    if (pAffinity == NULL) {
+        return c89thrd_error;
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        /* Only destroy the guard mutex if it was initialized (for recursive mutexes) */
-        if ((mutex->type & c89mtx_recursive) != 0) {
-            pthread_mutex_destroy(&mutex->guard);
-        }
+    /*
+    There is no function for retrieving a thread's affinity mask, but SetThreadAffinityMask() returns the
+    previous mask. Set it to the process' mask, which every thread mask is a subset of, and then restore it.
+    */
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        return c89thrd_error;
+    }
 
-        pthread_mutex_destroy(&mutex->mutex);
+    threadMask = SetThreadAffinityMask((HANDLE)thr.handle, processMask);
+    if (threadMask == 0) {
+        return c89thrd_error;
     }
-    #else
-    {
-        pthread_mutex_destroy((pthread_mutex_t*)mutex);
+
+    if (threadMask != processMask) {
+        SetThreadAffinityMask((HANDLE)thr.handle, threadMask);
     }
-    #endif
+
+    c89thread_cpu_set_from_mask_win32(pAffinity, threadMask);
+    return c89thrd_success;
 }
 
-int c89mtx_lock(c89mtx_t* mutex)
+/* SetThreadDescription() and GetThreadDescription() are only available from Windows 10 version 1607 so they need to be loaded at runtime. */
+typedef HRESULT (WINAPI * c89thread_SetThreadDescription_proc)(HANDLE hThread, PCWSTR lpThreadDescription);
+typedef HRESULT (WINAPI * c89thread_GetThreadDescription_proc)(HANDLE hThread, PWSTR* ppszThreadDescription);
+
+static FARPROC c89thread_get_kernel32_proc(const char* pName)
 {
-    int result;
+    HMODULE hKernel32 = GetModuleHandleA("kernel32.dll");
+    if (hKernel32 == NULL) {
+        return NULL;
+    }
 
-    if (mutex == NULL) {
+    return GetProcAddress(hKernel32, pName);
+}
+
+int c89thrd_set_name(c89thrd_t thr, const char* pName)
+{
+    c89thread_SetThreadDescription_proc pSetThreadDescription;
+    WCHAR nameW[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    char nameTruncated[C89THREAD_MAX_THREAD_NAME_LENGTH];
+
+    if (pName == NULL) {
         return c89thrd_error;
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        pthread_t currentThread;
+    pSetThreadDescription = (c89thread_SetThreadDescription_proc)c89thread_get_kernel32_proc("SetThreadDescription");
+    if (pSetThreadDescription == NULL) {
+        return c89thrd_error;
+    }
 
-        /* Optimized path for plain mutexes. */
-        if ((mutex->type & c89mtx_recursive) == 0) {
-            result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->mutex));
-            if (result != c89thrd_success) {
-                return c89thrd_error;
-            }
+    c89thread_copy_string(nameTruncated, sizeof(nameTruncated), pName);
+    if (MultiByteToWideChar(CP_UTF8, 0, nameTruncated, -1, nameW, C89THREAD_MAX_THREAD_NAME_LENGTH) == 0) {
+        return c89thrd_error;
+    }
 
-            return c89thrd_success;
-        }
+    if (FAILED(pSetThreadDescription((HANDLE)thr.handle, nameW))) {
+        return c89thrd_error;
+    }
 
-        /* Getting here means it's a recursive mutex. */
-        currentThread = pthread_self();
-        
-        /* First, lock the guard mutex to safely access the metadata. */
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
+    return c89thrd_success;
+}
 
-        /* We can bomb out early if the current thread already owns this mutex. */
-        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
-            if (mutex->recursionCount == INT_MAX) {
-                pthread_mutex_unlock(&mutex->guard);
-                return c89thrd_error;
-            }
+int c89thrd_get_name(c89thrd_t thr, char* pName, size_t nameSize)
+{
+    c89thread_GetThreadDescription_proc pGetThreadDescription;
+    PWSTR pNameW;
+    int length;
 
-            mutex->recursionCount += 1;
-            pthread_mutex_unlock(&mutex->guard);
-            return c89thrd_success;
-        }
+    if (pName == NULL || nameSize == 0) {
+        return c89thrd_error;
+    }
 
-        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
-        pthread_mutex_unlock(&mutex->guard);
-        
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->mutex));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
-        
-        /* Update metadata. */
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
-        if (result != c89thrd_success) {
-            pthread_mutex_unlock(&mutex->mutex);
-            return c89thrd_error;
-        }
-        
-        mutex->owner = currentThread;
-        mutex->recursionCount = 1;
-        
-        pthread_mutex_unlock(&mutex->guard);
+    pName[0] = '\0';
 
-        return c89thrd_success;
+    pGetThreadDescription = (c89thread_GetThreadDescription_proc)c89thread_get_kernel32_proc("GetThreadDescription");
+    if (pGetThreadDescription == NULL) {
+        return c89thrd_error;
     }
-    #else
-    {
-        result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)mutex));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
 
-        return c89thrd_success;
+    if (FAILED(pGetThreadDescription((HANDLE)thr.handle, &pNameW))) {
+        return c89thrd_error;
     }
-    #endif
-}
 
-/* BEG c89mtx_timedlock_pthread.c */
-/* I'm not entirely sure what the best wait time would be, so making it configurable. Defaulting to 1 microsecond. */
-#ifndef C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS
-#define C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS    1000
-#endif
+    length = WideCharToMultiByte(CP_UTF8, 0, pNameW, -1, pName, (nameSize > INT_MAX) ? INT_MAX : (int)nameSize, NULL, NULL);
+    LocalFree(pNameW);
+
+    if (length == 0) {
+        pName[0] = '\0';
+        return c89thrd_error;   /* Conversion failed or the buffer is too small. */
+    }
+
+    return c89thrd_success;
+}
 
-static int c89pthread_mutex_timedlock(pthread_mutex_t* mutex, const struct timespec* time_point)
+int c89thrd_set_priority(c89thrd_t thr, int policy, int priority)
 {
-    #if defined(__USE_XOPEN2K) && !defined(__APPLE__)
-    {
-        return c89thrd_result_from_pthread(pthread_mutex_timedlock((pthread_mutex_t*)mutex, time_point));
+    int threadPriority;
+
+    if (c89thrd_priority_from_policy_win32(policy, priority, &threadPriority) != c89thrd_success) {
+        return c89thrd_error;
     }
-    #else
-    {
-        /*
-        Fallback implementation for when pthread_mutex_timedlock() is not avaialble. This is just a
-        naive loop which waits a bit of time before continuing.
-        */
-        #if defined(C89THREAD_ENABLE_SUBOPTIMAL_WARNINGS) && !defined(__APPLE__)
-            #warning pthread_mutex_timedlock() is unavailable. Falling back to a suboptimal implementation.
-        #endif
 
-        int result;
+    if (!SetThreadPriority((HANDLE)thr.handle, threadPriority)) {
+        return c89thrd_error;
+    }
 
-        if (time_point == NULL) {
-            return c89thrd_error;
-        }
+    return c89thrd_success;
+}
 
-        for (;;) {
-            result = c89thrd_result_from_pthread(pthread_mutex_trylock((pthread_mutex_t*)mutex));
-            if (result == c89thrd_busy) {
-                struct timespec tsNow;
-                if (c89timespec_get(&tsNow, TIME_UTC) == 0) {
-                    result = c89thrd_error;
-                    break;
-                }
+int c89thrd_get_priority(c89thrd_t thr, int* pPolicy, int* pPriority)
+{
+    int threadPriority;
+    int policy;
+    int priority = 0;
 
-                if (c89timespec_cmp(tsNow, *time_point) > 0) {
-                    result = c89thrd_timedout;
-                    break;
-                } else {
-                    /* Have not yet timed out. Need to wait a bit and then try again. */
-                    c89thrd_sleep_timespec(c89timespec_nanoseconds(C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS));
-                    continue;
-                }
-            } else {
-                break;
-            }
+    threadPriority = GetThreadPriority((HANDLE)thr.handle);
+    if (threadPriority == THREAD_PRIORITY_ERROR_RETURN) {
+        return c89thrd_error;
+    }
+
+    /* This is the inverse of c89thrd_priority_from_policy_win32(). */
+    if (threadPriority <= THREAD_PRIORITY_IDLE) {
+        policy = c89thrd_sched_idle;
+    } else if (threadPriority < THREAD_PRIORITY_NORMAL) {
+        policy = c89thrd_sched_batch;
+    } else if (threadPriority == THREAD_PRIORITY_NORMAL) {
+        policy = c89thrd_sched_other;
+    } else {
+        policy = c89thrd_sched_fifo;
+
+        if (threadPriority == THREAD_PRIORITY_ABOVE_NORMAL) {
+            priority = 1;
+        } else if (threadPriority == THREAD_PRIORITY_HIGHEST) {
+            priority = 34;
+        } else {
+            priority = 67;
         }
+    }
 
-        return result;
+    if (pPolicy != NULL) {
+        *pPolicy = policy;
     }
-    #endif
+
+    if (pPriority != NULL) {
+        *pPriority = priority;
+    }
+
+    return c89thrd_success;
 }
 
-int c89mtx_timedlock(c89mtx_t* mutex, const struct timespec* time_point)
+c89thrd_native_handle_t c89thrd_native_handle(c89thrd_t thr)
+{
+    return thr.handle;
+}
+
+
+/* BEG c89mtx_win32.c */
+static int c89mtx_init_win32(c89mtx_t* mutex, int type)
 {
-    if (mutex == NULL || time_point == NULL) {
+    HANDLE hMutex;
+
+    if (mutex == NULL) {
         return c89thrd_error;
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        int result;
-        pthread_t currentThread;
+    /* Initialize the object to zero for safety. */
+    mutex->handle = NULL;
+    mutex->type   = 0;
 
-        /* Optimized path for plain mutexes. */
-        if ((mutex->type & c89mtx_recursive) == 0) {
-            result = c89pthread_mutex_timedlock(&mutex->mutex, time_point);
-            if (result != c89thrd_success) {
-                return result;
-            }
+    /*
+    CreateMutex() will create a thread-aware mutex (allowing recursiveness), whereas an auto-reset
+    event (CreateEvent()) is not thread-aware and will deadlock (will not allow recursiveness). In
+    Win32 I'm making all mutex's timeable.
+    */
+    if ((type & c89mtx_recursive) != 0) {
+        hMutex = CreateMutexA(NULL, FALSE, NULL);
+    } else {
+        hMutex = CreateEventA(NULL, FALSE, TRUE, NULL);
+    }
 
-            return c89thrd_success;
-        }
-        
-        /* Getting here means it's a recursive mutex. */
-        currentThread = pthread_self();
-        
-        /* First, lock the guard mutex to safely access the metadata. */
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
-        
-        /* We can bomb out early if the current thread already owns this mutex. */
-        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
-            if (mutex->recursionCount == INT_MAX) {
-                pthread_mutex_unlock(&mutex->guard);
-                return c89thrd_error;
-            }
+    if (hMutex == NULL) {
+        return c89thrd_result_from_GetLastError();
+    }
 
-            mutex->recursionCount += 1;
-            pthread_mutex_unlock(&mutex->guard);
-            return c89thrd_success;
-        }
-        
-        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
-        pthread_mutex_unlock(&mutex->guard);
-        
-        result = c89pthread_mutex_timedlock(&mutex->mutex, time_point);
-        if (result != c89thrd_success) {
-            return result;
+    mutex->handle = (c89thread_handle)hMutex;
+    mutex->type   = type;
+
+    return c89thrd_success;
+}
+
+static void c89mtx_destroy_win32(c89mtx_t* mutex)
+{
+    if (mutex == NULL) {
+        return;
+    }
+
+    CloseHandle((HANDLE)mutex->handle);
+}
+
+static int c89mtx_lock_win32(c89mtx_t* mutex)
+{
+    DWORD result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    result = WaitForSingleObject((HANDLE)mutex->handle, INFINITE);
+    if (result == WAIT_ABANDONED) {
+        ReleaseMutex((HANDLE)mutex->handle);
+        return c89thrd_error;
+    }
+    if (result != WAIT_OBJECT_0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+/* BEG c89mtx_timedlock_win32.c */
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89mtx_timedlock_win32(c89mtx_t* mutex, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    DWORD result;
+
+    if (mutex == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        result = c89wait_for_single_object_for((HANDLE)mutex->handle, duration);
+    } else {
+        result = c89wait_for_single_object_until_ex((HANDLE)mutex->handle, time_point, isMonotonic);
+    }
+
+    if (result == WAIT_ABANDONED) {
+        ReleaseMutex((HANDLE)mutex->handle);
+        return c89thrd_error;
+    }
+    if (result != WAIT_OBJECT_0) {
+        if (result == WAIT_TIMEOUT) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END c89mtx_timedlock_win32.c */
+
+/* BEG c89mtx_trylock_win32.c */
+static int c89mtx_trylock_win32(c89mtx_t* mutex)
+{
+    DWORD result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    result = WaitForSingleObject((HANDLE)mutex->handle, 0);
+    if (result == WAIT_ABANDONED) {
+        ReleaseMutex((HANDLE)mutex->handle);
+        return c89thrd_error;
+    }
+    if (result == WAIT_TIMEOUT) {
+        return c89thrd_busy;
+    }
+    if (result != WAIT_OBJECT_0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END c89mtx_trylock_win32.c */
+
+static int c89mtx_unlock_win32(c89mtx_t* mutex)
+{
+    BOOL result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    if ((mutex->type & c89mtx_recursive) != 0) {
+        result = ReleaseMutex((HANDLE)mutex->handle);
+    } else {
+        result = SetEvent((HANDLE)mutex->handle);
+    }
+
+    if (!result) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END c89mtx_win32.c */
+
+
+/* BEG c89cnd_win32.c */
+int c89cnd_init(c89cnd_t* cnd)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+
+void c89cnd_destroy(c89cnd_t* cnd)
+{
+    if (cnd == NULL) {
+        return;
+    }
+
+    /* Not supporting condition variables on Win32. */
+}
+
+int c89cnd_signal(c89cnd_t* cnd)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+
+int c89cnd_broadcast(c89cnd_t* cnd)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+
+int c89cnd_wait(c89cnd_t* cnd, c89mtx_t* mtx)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    (void)mtx;
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+
+int c89cnd_timedwait(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    (void)mtx;
+    (void)time_point;
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+
+int c89cnd_timedwait_monotonic(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+{
+    return c89cnd_timedwait(cnd, mtx, time_point);
+}
+
+int c89cnd_timedwait_for(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* duration)
+{
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    (void)mtx;
+    (void)duration;
+
+    /* Not supporting condition variables on Win32. */
+    return c89thrd_error;
+}
+/* END c89cnd_win32.c */
+
+
+int c89sem_init(c89sem_t* sem, int value, int valueMax)
+{
+    HANDLE hSemaphore;
+
+    if (sem == NULL || valueMax == 0 || value > valueMax) {
+        return c89thrd_error;
+    }
+
+    *sem = NULL;
+
+    hSemaphore = CreateSemaphore(NULL, value, valueMax, NULL);
+    if (hSemaphore == NULL) {
+        return c89thrd_error;
+    }
+
+    *sem = hSemaphore;
+
+    return c89thrd_success;
+}
+
+void c89sem_destroy(c89sem_t* sem)
+{
+    if (sem == NULL) {
+        return;
+    }
+
+    CloseHandle((HANDLE)*sem);
+}
+
+static int c89sem_wait_win32(c89sem_t* sem)
+{
+    DWORD result;
+
+    if (sem == NULL) {
+        return c89thrd_error;
+    }
+
+    result = WaitForSingleObject((HANDLE)*sem, INFINITE);
+    if (result != WAIT_OBJECT_0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89sem_timedwait_win32(c89sem_t* sem, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    DWORD result;
+
+    if (sem == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        result = c89wait_for_single_object_for((HANDLE)*sem, duration);
+    } else {
+        result = c89wait_for_single_object_until_ex((HANDLE)*sem, time_point, isMonotonic);
+    }
+
+    if (result != WAIT_OBJECT_0) {
+        if (result == WAIT_TIMEOUT) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89sem_post(c89sem_t* sem)
+{
+    BOOL result;
+
+    if (sem == NULL) {
+        return c89thrd_error;
+    }
+
+    result = ReleaseSemaphore((HANDLE)*sem, 1, NULL);
+    if (!result) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+
+
+int c89evnt_init(c89evnt_t* evnt)
+{
+    HANDLE hEvent;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    *evnt = NULL;
+
+    hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (hEvent == NULL) {
+        return c89thrd_error;
+    }
+
+    *evnt = hEvent;
+
+    return c89thrd_success;
+}
+
+void c89evnt_destroy(c89evnt_t* evnt)
+{
+    if (evnt == NULL) {
+        return;
+    }
+
+    CloseHandle((HANDLE)*evnt);
+}
+
+static int c89evnt_wait_win32(c89evnt_t* evnt)
+{
+    DWORD result;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    result = WaitForSingleObject((HANDLE)*evnt, INFINITE);
+    if (result != WAIT_OBJECT_0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89evnt_timedwait_win32(c89evnt_t* evnt, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    DWORD result;
+
+    if (evnt == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        result = c89wait_for_single_object_for((HANDLE)*evnt, duration);
+    } else {
+        result = c89wait_for_single_object_until_ex((HANDLE)*evnt, time_point, isMonotonic);
+    }
+
+    if (result != WAIT_OBJECT_0) {
+        if (result == WAIT_TIMEOUT) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89evnt_signal(c89evnt_t* evnt)
+{
+    BOOL result;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    result = SetEvent((HANDLE)*evnt);
+    if (!result) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+#endif
+
+/* POSIX */
+#if defined(C89THREAD_POSIX)
+#include <pthread.h>
+#include <stdlib.h>     /* For malloc(), realloc(), free(). */
+#include <errno.h>      /* For errno_t. */
+#include <string.h>     /* For memset(). */
+#include <limits.h>     /* For INT_MAX. */
+#include <sys/time.h>   /* For timeval. */
+
+#ifndef C89THREAD_MALLOC
+#define C89THREAD_MALLOC(sz)        malloc(sz)
+#endif
+
+#ifndef C89THREAD_REALLOC
+#define C89THREAD_REALLOC(p, sz)    realloc(p, sz)
+#endif
+
+#ifndef C89THREAD_FREE
+#define C89THREAD_FREE(p)           free(p)
+#endif
+
+static C89THREAD_THREAD_LOCAL c89thread_entry_exit_callbacks g_c89threadEntryExitCallbacks;
+
+#if defined(C89THREAD_PROFILE)
+static void c89thread_wait_profile_release(void);
+#endif
+
+static void c89thrd_run_exit_callback_posix(void)
+{
+    c89thrd_on_exit_t onExit;
+    void* pUserData;
+
+    onExit    = g_c89threadEntryExitCallbacks.onExit;
+    pUserData = g_c89threadEntryExitCallbacks.pUserData;
+
+    g_c89threadEntryExitCallbacks.onExit    = NULL;
+    g_c89threadEntryExitCallbacks.pUserData = NULL;
+
+    if (onExit != NULL) {
+        onExit(pUserData);
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_thread_exited();
+    }
+    #endif
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        c89thread_wait_profile_release();
+    }
+    #endif
+}
+
+/* BEG c89thrd_result_from_errno.c */
+static int c89thrd_result_from_errno(int e)
+{
+    switch (e)
+    {
+        case 0:         return c89thrd_success;
+        case ENOMEM:    return c89thrd_nomem;
+        #ifdef ETIME
+        case ETIME:     return c89thrd_timedout;
+        #endif
+        case ETIMEDOUT: return c89thrd_timedout;
+        case EBUSY:     return c89thrd_busy;
+    }
+
+    return c89thrd_error;
+}
+/* END c89thrd_result_from_errno.c */
+
+/* BEG c89thrd_result_from_pthread.c */
+static int c89thrd_result_from_pthread(int e)
+{
+    if (e == 0) {
+        return c89thrd_success;
+    } else {
+        return c89thrd_result_from_errno(e);
+    }
+}
+/* END c89thrd_result_from_pthread.c */
+
+
+/* BEG c89thrd_cache_posix.c */
+enum
+{
+    c89thrd_cache_slot_free     = 0,    /* No OS thread. */
+    c89thrd_cache_slot_running  = 1,    /* Running a function. */
+    c89thrd_cache_slot_finished = 2,    /* The function has returned, but the result has not yet been retrieved with c89thrd_join(). */
+    c89thrd_cache_slot_parked   = 3     /* Waiting for another function to run. */
+};
+
+typedef struct
+{
+    pthread_t thread;
+    int state;
+    int isDetached;     /* Set when c89thrd_detach() is called while the function is still running. */
+    int hasExited;      /* Set when the function called c89thrd_exit(), which terminates the OS thread. */
+    int result;
+    c89thrd_start_t func;
+    void* arg;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    pthread_cond_t cond;    /* Signalled whenever the state changes. */
+} c89thrd_cache_slot;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t threadExitedCond;
+    c89thrd_cache_slot* pSlots;
+    unsigned int capacity;
+    unsigned int threadCount;   /* The number of OS threads that are still alive. */
+    unsigned int idleTimeoutMilliseconds;
+    int isShuttingDown;
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+} c89thrd_cache;
+
+static c89thrd_cache* g_c89thrdCache = NULL;
+static C89THREAD_THREAD_LOCAL c89thrd_cache_slot* g_c89thrdCacheSlot = NULL;    /* The slot of the calling thread if it belongs to the cache. */
+
+/* Must be called with the lock held. */
+static c89thrd_cache_slot* c89thrd_cache_find_slot(c89thrd_cache* pCache, pthread_t thread)
+{
+    unsigned int iSlot;
+
+    for (iSlot = 0; iSlot < pCache->capacity; iSlot += 1) {
+        c89thrd_cache_slot* pSlot = &pCache->pSlots[iSlot];
+
+        /* Only running and finished slots are associated with a c89thrd_t. Parked threads have already been joined or detached. */
+        if ((pSlot->state == c89thrd_cache_slot_running || pSlot->state == c89thrd_cache_slot_finished) && pthread_equal(pSlot->thread, thread)) {
+            return pSlot;
+        }
+    }
+
+    return NULL;
+}
+
+/* Called when a slot's result is no longer needed, either because it's been joined or it was detached. Must be called with the lock held. */
+static void c89thrd_cache_release_slot(c89thrd_cache_slot* pSlot)
+{
+    pSlot->state = (pSlot->hasExited) ? c89thrd_cache_slot_free : c89thrd_cache_slot_parked;
+    pthread_cond_broadcast(&pSlot->cond);
+}
+
+/* Called from the cached thread when a function has finished. Must be called with the lock held. */
+static void c89thrd_cache_finish_slot(c89thrd_cache_slot* pSlot, int result)
+{
+    pSlot->result = result;
+
+    if (pSlot->isDetached) {
+        c89thrd_cache_release_slot(pSlot);
+    } else {
+        pSlot->state = c89thrd_cache_slot_finished;
+        pthread_cond_broadcast(&pSlot->cond);
+    }
+}
+
+static void* c89thrd_cache_start_posix(void* pUserData)
+{
+    c89thrd_cache_slot* pSlot = (c89thrd_cache_slot*)pUserData;
+    c89thrd_cache* pCache = g_c89thrdCache;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thrd_start_t func;
+    void* arg;
+    int result;
+
+    g_c89thrdCacheSlot = pSlot;
+
+    pthread_mutex_lock(&pCache->lock);
+
+    for (;;) {
+        /* Only the creating thread can move a slot into the running state, and nothing else can touch it until it's finished. */
+        func = pSlot->func;
+        arg  = pSlot->arg;
+        entryExitCallbacks = pSlot->entryExitCallbacks;
+
+        pthread_mutex_unlock(&pCache->lock);
+        {
+            #if defined(C89THREAD_ENABLE_TRACE)
+            c89thread_uint64 taskStartTicks;
+            #endif
+
+            g_c89threadEntryExitCallbacks = entryExitCallbacks;
+
+            #if defined(C89THREAD_HAS_INSTRUMENTATION)
+            {
+                c89thread_hook_thread_created();
+            }
+            #endif
+
+            if (entryExitCallbacks.onEntry != NULL) {
+                entryExitCallbacks.onEntry(entryExitCallbacks.pUserData);
+            }
+
+            #if defined(C89THREAD_ENABLE_TRACE)
+            {
+                taskStartTicks = c89thread_ticks();
+            }
+            #endif
+
+            result = func(arg);
+
+            #if defined(C89THREAD_ENABLE_TRACE)
+            {
+                c89thread_trace_task(C89THREAD_TRACE_TASK_CACHED_THREAD, (c89thread_uintptr)func, taskStartTicks);
+            }
+            #endif
+
+            c89thrd_run_exit_callback_posix();
+        }
+        pthread_mutex_lock(&pCache->lock);
+
+        c89thrd_cache_finish_slot(pSlot, result);
+
+        /* Wait to be joined, and then for something else to do. */
+        while (pSlot->state == c89thrd_cache_slot_finished) {
+            pthread_cond_wait(&pSlot->cond, &pCache->lock);
+        }
+
+        if (pSlot->state == c89thrd_cache_slot_parked) {
+            struct timespec timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds((time_t)pCache->idleTimeoutMilliseconds));
+
+            while (pSlot->state == c89thrd_cache_slot_parked && !pCache->isShuttingDown) {
+                if (pthread_cond_timedwait(&pSlot->cond, &pCache->lock, &timeout) == ETIMEDOUT) {
+                    break;
+                }
+            }
+
+            if (pSlot->state == c89thrd_cache_slot_parked) {
+                pSlot->state = c89thrd_cache_slot_free;
+                break;  /* Idle for too long, or shutting down. */
+            }
+        }
+
+        /* If we get here a new function has been handed to us. */
+    }
+
+    pCache->threadCount -= 1;
+    pthread_cond_broadcast(&pCache->threadExitedCond);
+    pthread_mutex_unlock(&pCache->lock);
+
+    return NULL;
+}
+
+/*
+Runs a function on a cached thread. Returns c89thrd_busy if the cache is full in which case the caller
+should create a thread normally.
+*/
+static int c89thrd_cache_create(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks)
+{
+    c89thrd_cache* pCache = g_c89thrdCache;
+    c89thrd_cache_slot* pSlot;
+    c89thrd_cache_slot* pParkedSlot = NULL;
+    c89thrd_cache_slot* pFreeSlot = NULL;
+    unsigned int iSlot;
+    pthread_t thread;
+    int result;
+
+    pthread_mutex_lock(&pCache->lock);
+
+    /* Prefer a parked thread. Failing that, a free slot in which to create a new thread. */
+    for (iSlot = 0; iSlot < pCache->capacity; iSlot += 1) {
+        c89thrd_cache_slot* pCandidate = &pCache->pSlots[iSlot];
+
+        if (pCandidate->state == c89thrd_cache_slot_parked) {
+            pParkedSlot = pCandidate;
+            break;
+        }
+
+        if (pCandidate->state == c89thrd_cache_slot_free && pFreeSlot == NULL) {
+            pFreeSlot = pCandidate;
+        }
+    }
+
+    pSlot = (pParkedSlot != NULL) ? pParkedSlot : pFreeSlot;
+    if (pSlot == NULL) {
+        pthread_mutex_unlock(&pCache->lock);
+        return c89thrd_busy;
+    }
+
+    pSlot->func       = func;
+    pSlot->arg        = arg;
+    pSlot->isDetached = 0;
+    pSlot->hasExited  = 0;
+    pSlot->result     = 0;
+
+    if (pEntryExitCallbacks != NULL) {
+        pSlot->entryExitCallbacks = *pEntryExitCallbacks;
+    } else {
+        pSlot->entryExitCallbacks.onEntry   = NULL;
+        pSlot->entryExitCallbacks.onExit    = NULL;
+        pSlot->entryExitCallbacks.pUserData = NULL;
+    }
+
+    if (pParkedSlot != NULL) {
+        /* Hand the function over to the parked thread. */
+        pSlot->state = c89thrd_cache_slot_running;
+        pthread_cond_broadcast(&pSlot->cond);
+
+        *thr = pSlot->thread;
+        pthread_mutex_unlock(&pCache->lock);
+
+        return c89thrd_success;
+    }
+
+    /* The slot is reserved by putting it into the running state. The new thread will pick up the function from the slot when it starts. */
+    pSlot->state = c89thrd_cache_slot_running;
+    pCache->threadCount += 1;
+
+    result = c89thrd_result_from_pthread(pthread_create(&thread, NULL, c89thrd_cache_start_posix, pSlot));
+    if (result != c89thrd_success) {
+        pSlot->state = c89thrd_cache_slot_free;
+        pCache->threadCount -= 1;
+        pthread_mutex_unlock(&pCache->lock);
+        return result;
+    }
+
+    /* Cached threads are never joined with pthread_join(). c89thrd_join() waits on the slot instead. */
+    pthread_detach(thread);
+
+    pSlot->thread = thread;
+    *thr = thread;
+
+    pthread_mutex_unlock(&pCache->lock);
+
+    return c89thrd_success;
+}
+
+/* Returned by c89thrd_cache_join() and c89thrd_cache_detach() when the thread does not belong to the cache. This is never returned to the application. */
+#define C89THRD_NOT_CACHED  1
+
+/* The time point is optional. When isTry is set, c89thrd_busy is returned if the thread is still running. */
+static int c89thrd_cache_join(c89thrd_t thr, int* res, const struct timespec* time_point, int isTry)
+{
+    c89thrd_cache* pCache = g_c89thrdCache;
+    c89thrd_cache_slot* pSlot;
+
+    if (pCache == NULL) {
+        return C89THRD_NOT_CACHED;
+    }
+
+    pthread_mutex_lock(&pCache->lock);
+
+    pSlot = c89thrd_cache_find_slot(pCache, thr);
+    if (pSlot == NULL || pSlot->isDetached) {
+        pthread_mutex_unlock(&pCache->lock);
+        return (pSlot == NULL) ? C89THRD_NOT_CACHED : c89thrd_error;
+    }
+
+    while (pSlot->state == c89thrd_cache_slot_running) {
+        if (isTry) {
+            pthread_mutex_unlock(&pCache->lock);
+            return c89thrd_busy;
+        }
+
+        if (time_point == NULL) {
+            pthread_cond_wait(&pSlot->cond, &pCache->lock);
+        } else {
+            if (pthread_cond_timedwait(&pSlot->cond, &pCache->lock, time_point) == ETIMEDOUT && pSlot->state == c89thrd_cache_slot_running) {
+                pthread_mutex_unlock(&pCache->lock);
+                return c89thrd_timedout;
+            }
+        }
+    }
+
+    if (res != NULL) {
+        *res = pSlot->result;
+    }
+
+    c89thrd_cache_release_slot(pSlot);
+
+    pthread_mutex_unlock(&pCache->lock);
+
+    return c89thrd_success;
+}
+
+static int c89thrd_cache_detach(c89thrd_t thr)
+{
+    c89thrd_cache* pCache = g_c89thrdCache;
+    c89thrd_cache_slot* pSlot;
+
+    if (pCache == NULL) {
+        return C89THRD_NOT_CACHED;
+    }
+
+    pthread_mutex_lock(&pCache->lock);
+
+    pSlot = c89thrd_cache_find_slot(pCache, thr);
+    if (pSlot == NULL || pSlot->isDetached) {
+        pthread_mutex_unlock(&pCache->lock);
+        return (pSlot == NULL) ? C89THRD_NOT_CACHED : c89thrd_error;
+    }
+
+    if (pSlot->state == c89thrd_cache_slot_finished) {
+        c89thrd_cache_release_slot(pSlot);
+    } else {
+        pSlot->isDetached = 1;
+    }
+
+    pthread_mutex_unlock(&pCache->lock);
+
+    return c89thrd_success;
+}
+
+/* Called from c89thrd_exit(). The OS thread is terminated so the slot can't be reused. */
+static void c89thrd_cache_exit(int res)
+{
+    c89thrd_cache* pCache = g_c89thrdCache;
+    c89thrd_cache_slot* pSlot = g_c89thrdCacheSlot;
+
+    pthread_mutex_lock(&pCache->lock);
+    {
+        pSlot->hasExited = 1;
+        c89thrd_cache_finish_slot(pSlot, res);
+
+        pCache->threadCount -= 1;
+        pthread_cond_broadcast(&pCache->threadExitedCond);
+    }
+    pthread_mutex_unlock(&pCache->lock);
+
+    pthread_exit(NULL);
+}
+
+c89thrd_cache_config c89thrd_cache_config_init(unsigned int capacity, unsigned int idleTimeoutMilliseconds)
+{
+    c89thrd_cache_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.capacity                = capacity;
+    config.idleTimeoutMilliseconds = idleTimeoutMilliseconds;
+
+    return config;
+}
+
+int c89thrd_cache_init(const c89thrd_cache_config* pConfig, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    c89thrd_cache* pCache;
+    unsigned int iSlot;
+    int result;
+
+    if (pConfig == NULL || pConfig->capacity == 0 || g_c89thrdCache != NULL) {
+        return c89thrd_error;
+    }
+
+    pCache = (c89thrd_cache*)c89thread_malloc(sizeof(*pCache) + sizeof(*pCache->pSlots) * pConfig->capacity, pAllocationCallbacks);
+    if (pCache == NULL) {
+        return c89thrd_nomem;
+    }
+
+    memset(pCache, 0, sizeof(*pCache) + sizeof(*pCache->pSlots) * pConfig->capacity);
+
+    pCache->pSlots   = (c89thrd_cache_slot*)(pCache + 1);
+    pCache->capacity = pConfig->capacity;
+    pCache->idleTimeoutMilliseconds = pConfig->idleTimeoutMilliseconds;
+
+    if (pAllocationCallbacks != NULL) {
+        pCache->allocationCallbacks  = *pAllocationCallbacks;
+        pCache->usingCustomAllocator = 1;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_mutex_init(&pCache->lock, NULL));
+    if (result != c89thrd_success) {
+        c89thread_free(pCache, pAllocationCallbacks);
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init(&pCache->threadExitedCond, NULL));
+    if (result != c89thrd_success) {
+        pthread_mutex_destroy(&pCache->lock);
+        c89thread_free(pCache, pAllocationCallbacks);
+        return result;
+    }
+
+    for (iSlot = 0; iSlot < pCache->capacity; iSlot += 1) {
+        result = c89thrd_result_from_pthread(pthread_cond_init(&pCache->pSlots[iSlot].cond, NULL));
+        if (result != c89thrd_success) {
+            while (iSlot > 0) {
+                iSlot -= 1;
+                pthread_cond_destroy(&pCache->pSlots[iSlot].cond);
+            }
+
+            pthread_cond_destroy(&pCache->threadExitedCond);
+            pthread_mutex_destroy(&pCache->lock);
+            c89thread_free(pCache, pAllocationCallbacks);
+            return result;
+        }
+    }
+
+    g_c89thrdCache = pCache;
+
+    return c89thrd_success;
+}
+
+void c89thrd_cache_uninit(void)
+{
+    c89thrd_cache* pCache = g_c89thrdCache;
+    unsigned int iSlot;
+
+    if (pCache == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pCache->lock);
+    {
+        pCache->isShuttingDown = 1;
+
+        for (iSlot = 0; iSlot < pCache->capacity; iSlot += 1) {
+            pthread_cond_broadcast(&pCache->pSlots[iSlot].cond);
+        }
+
+        while (pCache->threadCount > 0) {
+            pthread_cond_wait(&pCache->threadExitedCond, &pCache->lock);
+        }
+    }
+    pthread_mutex_unlock(&pCache->lock);
+
+    g_c89thrdCache = NULL;
+
+    for (iSlot = 0; iSlot < pCache->capacity; iSlot += 1) {
+        pthread_cond_destroy(&pCache->pSlots[iSlot].cond);
+    }
+
+    pthread_cond_destroy(&pCache->threadExitedCond);
+    pthread_mutex_destroy(&pCache->lock);
+
+    c89thread_free(pCache, (pCache->usingCustomAllocator) ? &pCache->allocationCallbacks : NULL);
+}
+/* END c89thrd_cache_posix.c */
+
+
+/* BEG c89thrd_completion_posix.c */
+/*
+Timed joins need to be able to wait for a thread to finish without calling pthread_join(). glibc has
+pthread_timedjoin_np() for this. Elsewhere each thread gets a completion record which it marks as done
+when it finishes. Records are kept in a global list keyed on the pthread_t, and are removed when the
+thread is joined or detached.
+*/
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    #define C89THREAD_HAS_PTHREAD_TIMEDJOIN
+#endif
+
+#if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+typedef struct c89thrd_completion c89thrd_completion;
+struct c89thrd_completion
+{
+    pthread_t thread;
+    int isRegistered;   /* Set once the creating thread knows the pthread_t. */
+    int isDone;
+    int isDetached;     /* When set, the thread frees the record itself when it finishes. */
+    c89thrd_completion* pNext;
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+};
+
+static pthread_mutex_t g_c89thrdCompletionLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_c89thrdCompletionCond = PTHREAD_COND_INITIALIZER;
+static c89thrd_completion* g_pC89thrdCompletions = NULL;
+static C89THREAD_THREAD_LOCAL c89thrd_completion* g_pC89thrdCompletion = NULL;   /* The completion record of the calling thread, if any. */
+
+static c89thrd_completion* c89thrd_completion_alloc(const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    c89thrd_completion* pCompletion;
+
+    pCompletion = (c89thrd_completion*)c89thread_malloc(sizeof(*pCompletion), pAllocationCallbacks);
+    if (pCompletion == NULL) {
+        return NULL;
+    }
+
+    memset(pCompletion, 0, sizeof(*pCompletion));
+
+    if (pAllocationCallbacks != NULL) {
+        pCompletion->allocationCallbacks  = *pAllocationCallbacks;
+        pCompletion->usingCustomAllocator = 1;
+    }
+
+    return pCompletion;
+}
+
+static void c89thrd_completion_free(c89thrd_completion* pCompletion)
+{
+    c89thread_free(pCompletion, (pCompletion->usingCustomAllocator) ? &pCompletion->allocationCallbacks : NULL);
+}
+
+/* Must be called with the lock held. */
+static void c89thrd_completion_unlink(c89thrd_completion* pCompletion)
+{
+    c89thrd_completion** ppNext;
+
+    for (ppNext = &g_pC89thrdCompletions; *ppNext != NULL; ppNext = &(*ppNext)->pNext) {
+        if (*ppNext == pCompletion) {
+            *ppNext = pCompletion->pNext;
+            return;
+        }
+    }
+}
+
+/* Must be called with the lock held. */
+static c89thrd_completion* c89thrd_completion_find(pthread_t thread)
+{
+    c89thrd_completion* pCompletion;
+
+    for (pCompletion = g_pC89thrdCompletions; pCompletion != NULL; pCompletion = pCompletion->pNext) {
+        if (pthread_equal(pCompletion->thread, thread)) {
+            return pCompletion;
+        }
+    }
+
+    return NULL;
+}
+
+/* Called by the creating thread once the pthread_t is known. */
+static void c89thrd_completion_register(c89thrd_completion* pCompletion, pthread_t thread)
+{
+    pthread_mutex_lock(&g_c89thrdCompletionLock);
+    {
+        pCompletion->thread       = thread;
+        pCompletion->isRegistered = 1;
+        pCompletion->pNext        = g_pC89thrdCompletions;
+        g_pC89thrdCompletions     = pCompletion;
+    }
+    pthread_mutex_unlock(&g_c89thrdCompletionLock);
+}
+
+/* Called by a thread when it finishes, either by returning or with c89thrd_exit(). */
+static void c89thrd_completion_signal(void)
+{
+    c89thrd_completion* pCompletion = g_pC89thrdCompletion;
+
+    if (pCompletion == NULL) {
+        return;
+    }
+
+    g_pC89thrdCompletion = NULL;
+
+    pthread_mutex_lock(&g_c89thrdCompletionLock);
+    {
+        if (pCompletion->isDetached) {
+            c89thrd_completion_unlink(pCompletion);
+            c89thrd_completion_free(pCompletion);
+        } else {
+            pCompletion->isDone = 1;
+            pthread_cond_broadcast(&g_c89thrdCompletionCond);
+        }
+    }
+    pthread_mutex_unlock(&g_c89thrdCompletionLock);
+}
+
+/* Waits for the thread to finish without joining it. The time point is optional. */
+static int c89thrd_completion_wait(pthread_t thread, const struct timespec* time_point, int isTry)
+{
+    c89thrd_completion* pCompletion;
+    int result = c89thrd_success;
+
+    pthread_mutex_lock(&g_c89thrdCompletionLock);
+    {
+        pCompletion = c89thrd_completion_find(thread);
+        if (pCompletion == NULL) {
+            result = c89thrd_error;   /* Not created by c89thread, or created with noAlloc. */
+        } else {
+            while (!pCompletion->isDone) {
+                if (isTry) {
+                    result = c89thrd_busy;
+                    break;
+                }
+
+                if (time_point == NULL) {
+                    pthread_cond_wait(&g_c89thrdCompletionCond, &g_c89thrdCompletionLock);
+                } else {
+                    if (pthread_cond_timedwait(&g_c89thrdCompletionCond, &g_c89thrdCompletionLock, time_point) == ETIMEDOUT && !pCompletion->isDone) {
+                        result = c89thrd_timedout;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_c89thrdCompletionLock);
+
+    return result;
+}
+
+/* Called when a thread has been joined or detached. */
+static void c89thrd_completion_release(pthread_t thread, int isDetach)
+{
+    c89thrd_completion* pCompletion;
+
+    pthread_mutex_lock(&g_c89thrdCompletionLock);
+    {
+        pCompletion = c89thrd_completion_find(thread);
+        if (pCompletion != NULL) {
+            if (isDetach && !pCompletion->isDone) {
+                pCompletion->isDetached = 1;    /* The thread will free it when it finishes. */
+            } else {
+                c89thrd_completion_unlink(pCompletion);
+                c89thrd_completion_free(pCompletion);
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_c89thrdCompletionLock);
+}
+#endif
+/* END c89thrd_completion_posix.c */
+
+/*
+When a thread needs to do something that can fail before running user code, the creating thread waits
+for it to report back with this.
+*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+    int result;
+} c89thrd_start_handshake_posix;
+
+typedef struct
+{
+    c89thrd_start_t func;
+    void* arg;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thread_allocation_callbacks allocationCallbacks;
+    int usingCustomAllocator;
+    char name[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    int schedPolicy;
+    int schedPriority;
+    int nice;
+    int isOnCreatorStack;                       /* When set, pHandshake is also set and the start data must not be touched after the handshake. */
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    c89thrd_completion* pCompletion;
+    #endif
+    c89thrd_start_handshake_posix* pHandshake;  /* Only set when the creating thread is waiting on the new thread. */
+} c89thrd_start_data_posix;
+
+/* Setting the nice value of an individual thread is only possible on Linux. */
+#if defined(__linux__)
+    #include <sys/resource.h>   /* For setpriority(). */
+    #define C89THREAD_HAS_PER_THREAD_NICE
+#endif
+
+/* The affinity functions are GNU extensions. They're also available in musl, but not Bionic. */
+#if defined(__linux__) && defined(_GNU_SOURCE) && !defined(__ANDROID__)
+    #define C89THREAD_HAS_PTHREAD_AFFINITY
+#endif
+
+/*
+pthread_setname_np() is non-standard. Linux and macOS both have it, but with different signatures. Linux
+limits names to 16 bytes, including the null terminator, and will fail with ERANGE if it's longer.
+*/
+#if defined(__linux__) && defined(_GNU_SOURCE)
+    #define C89THREAD_HAS_PTHREAD_SETNAME_LINUX
+    #define C89THREAD_MAX_PTHREAD_NAME_LENGTH   16
+#elif defined(__APPLE__) && defined(__MACH__)
+    #define C89THREAD_HAS_PTHREAD_SETNAME_APPLE
+    #define C89THREAD_MAX_PTHREAD_NAME_LENGTH   64
+#endif
+
+/*
+pthread_attr_setstack() and pthread_attr_setguardsize() are POSIX.1-2001, and libcs only declare them when
+that is requested. The C library defines _POSIX_C_SOURCE or _XOPEN_SOURCE itself in its default mode, so
+this also works without any feature macros. The BSDs always declare them.
+*/
+#if (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L) || (defined(_XOPEN_SOURCE) && _XOPEN_SOURCE >= 600) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    #define C89THREAD_HAS_PTHREAD_ATTR_SETSTACK
+#endif
+
+#if defined(C89THREAD_HAS_PTHREAD_AFFINITY)
+static void c89thread_cpu_set_to_cpu_set_t(const c89thread_cpu_set* pSet, cpu_set_t* pCPUSet)
+{
+    unsigned int iCPU;
+
+    CPU_ZERO(pCPUSet);
+
+    for (iCPU = 0; iCPU < CPU_SETSIZE && iCPU < C89THREAD_MAX_CPUS; iCPU += 1) {
+        if (c89thread_cpu_set_contains(pSet, iCPU)) {
+            CPU_SET(iCPU, pCPUSet);
+        }
+    }
+}
+
+static void c89thread_cpu_set_from_cpu_set_t(c89thread_cpu_set* pSet, const cpu_set_t* pCPUSet)
+{
+    unsigned int iCPU;
+
+    c89thread_cpu_set_zero(pSet);
+
+    for (iCPU = 0; iCPU < CPU_SETSIZE && iCPU < C89THREAD_MAX_CPUS; iCPU += 1) {
+        if (CPU_ISSET(iCPU, pCPUSet)) {
+            c89thread_cpu_set_add(pSet, iCPU);
+        }
+    }
+}
+#endif
+
+/* Applies the scheduling attributes from the new thread. This is done here rather than with pthread_attr_t because glibc rejects SCHED_BATCH and SCHED_IDLE in thread attributes. */
+static int c89thrd_apply_start_scheduling_posix(const c89thrd_start_data_posix* pStartData)
+{
+    if (pStartData->schedPolicy != c89thrd_sched_inherit) {
+        int result = c89thrd_set_priority(pthread_self(), pStartData->schedPolicy, pStartData->schedPriority);
+        if (result != c89thrd_success) {
+            return result;
+        }
+    }
+
+    if (pStartData->nice != 0) {
+        #if defined(C89THREAD_HAS_PER_THREAD_NICE)
+        {
+            /* On Linux the nice value belongs to the thread and a PID of 0 refers to the calling thread. */
+            if (setpriority(PRIO_PROCESS, 0, pStartData->nice) != 0) {
+                return c89thrd_error;
+            }
+        }
+        #else
+        {
+            return c89thrd_error;
+        }
+        #endif
+    }
+
+    return c89thrd_success;
+}
+
+static void* c89thrd_start_posix(void* pUserData)
+{
+    c89thrd_start_data_posix* pStartData = (c89thrd_start_data_posix*)pUserData;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thrd_start_t func;
+    void* arg;
+    void* result;
+    int isOnCreatorStack;
+    int handshakeResult = c89thrd_success;
+
+    entryExitCallbacks = pStartData->entryExitCallbacks;
+    func = pStartData->func;
+    arg  = pStartData->arg;
+    isOnCreatorStack = pStartData->isOnCreatorStack;
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        g_pC89thrdCompletion = pStartData->pCompletion;
+    }
+    #endif
+
+    /* The name is set here rather than by the creating thread so it's in place before any user code is run. */
+    if (pStartData->name[0] != '\0') {
+        c89thrd_set_name(c89thrd_current(), pStartData->name);
+    }
+
+    if (pStartData->pHandshake != NULL) {
+        c89thrd_start_handshake_posix* pHandshake = pStartData->pHandshake;
+
+        handshakeResult = c89thrd_apply_start_scheduling_posix(pStartData);
+
+        /* The handshake lives on the creating thread's stack and must not be touched after this. Neither can the start data if it's there too. */
+        pthread_mutex_lock(&pHandshake->lock);
+        {
+            pHandshake->result = handshakeResult;
+            pHandshake->done   = 1;
+            pthread_cond_signal(&pHandshake->cond);
+        }
+        pthread_mutex_unlock(&pHandshake->lock);
+    }
+
+    /* Free the start data before calling user code. */
+    if (!isOnCreatorStack) {
+        c89thread_free(pStartData, (pStartData->usingCustomAllocator) ? &pStartData->allocationCallbacks : NULL);
+    }
+
+    if (handshakeResult != c89thrd_success) {
+        /* The creating thread will join us and report the error. User code must not be run. */
+        #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+        {
+            c89thrd_completion_signal();
+        }
+        #endif
+
+        return NULL;
+    }
+
+    g_c89threadEntryExitCallbacks = entryExitCallbacks;
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_thread_created();
+    }
+    #endif
+
+    if (entryExitCallbacks.onEntry != NULL) {
+        entryExitCallbacks.onEntry(entryExitCallbacks.pUserData);
+    }
+
+    result = (void*)(c89thread_intptr)func(arg);
+
+    c89thrd_run_exit_callback_posix();
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        c89thrd_completion_signal();
+    }
+    #endif
+
+    return result;
+}
+
+static int c89thrd_attr_set_stack_posix(pthread_attr_t* pAttrPOSIX, const c89thrd_attr* pAttr)
+{
+    size_t stackSize = pAttr->stackSize;
+
+    if (pAttr->pStack != NULL) {
+        #if defined(C89THREAD_HAS_PTHREAD_ATTR_SETSTACK)
+        {
+            /* The buffer can't be made any bigger so it's an error for it to be too small. */
+            #if defined(PTHREAD_STACK_MIN)
+            {
+                if (stackSize < (size_t)PTHREAD_STACK_MIN) {
+                    return c89thrd_error;
+                }
+            }
+            #endif
+
+            return c89thrd_result_from_pthread(pthread_attr_setstack(pAttrPOSIX, pAttr->pStack, stackSize));
+        }
+        #else
+        {
+            return c89thrd_error;
+        }
+        #endif
+    }
+
+    if (stackSize > 0) {
+        int result;
+
+        #if defined(PTHREAD_STACK_MIN)
+        {
+            if (stackSize < (size_t)PTHREAD_STACK_MIN) {
+                stackSize = (size_t)PTHREAD_STACK_MIN;
+            }
+        }
+        #endif
+
+        result = c89thrd_result_from_pthread(pthread_attr_setstacksize(pAttrPOSIX, stackSize));
+        if (result != c89thrd_success) {
+            return result;
+        }
+    }
+
+    if (pAttr->guardSize > 0) {
+        #if defined(C89THREAD_HAS_PTHREAD_ATTR_SETSTACK)
+        {
+            return c89thrd_result_from_pthread(pthread_attr_setguardsize(pAttrPOSIX, pAttr->guardSize));
+        }
+        #else
+        {
+            return c89thrd_error;
+        }
+        #endif
+    }
+
+    return c89thrd_success;
+}
+
+int c89thrd_create_ex2(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thrd_attr* pAttr)
+{
+    int result;
+    c89thrd_start_data_posix* pData;
+    pthread_t thread;
+    pthread_attr_t attr;
+    c89thrd_start_handshake_posix handshake;
+    c89thrd_start_data_posix dataOnStack;
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    c89thrd_completion* pCompletion;
+    #endif
+    int noAlloc = 0;
+    int waitForStart = 0;
+    const c89thread_entry_exit_callbacks* pEntryExitCallbacks = NULL;
+    const c89thread_allocation_callbacks* pAllocationCallbacks = NULL;
+
+    if (thr == NULL) {
+        return c89thrd_error;
+    }
+
+    if (func == NULL) {
+        return c89thrd_error;
+    }
+
+    if (pAttr != NULL) {
+        pEntryExitCallbacks  = pAttr->pEntryExitCallbacks;
+        pAllocationCallbacks = pAttr->pAllocationCallbacks;
+        noAlloc              = pAttr->noAlloc;
+        waitForStart         = pAttr->noAlloc || pAttr->schedPolicy != c89thrd_sched_inherit || pAttr->nice != 0;
+    }
+
+    /* Anything that changes the OS thread itself rules out the cache. */
+    if (g_c89thrdCache != NULL && (pAttr == NULL || (pAttr->pAffinity == NULL && pAttr->stackSize == 0 && pAttr->guardSize == 0 && pAttr->pStack == NULL && pAttr->pName == NULL && pAttr->schedPolicy == c89thrd_sched_inherit && pAttr->nice == 0))) {
+        result = c89thrd_cache_create(thr, func, arg, pEntryExitCallbacks);
+        if (result != c89thrd_busy) {
+            return result;
+        }
+
+        /* The cache is full. Fall through and create a thread normally. */
+    }
+
+    result = c89thrd_result_from_pthread(pthread_attr_init(&attr));
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    if (pAttr != NULL && (pAttr->stackSize > 0 || pAttr->guardSize > 0 || pAttr->pStack != NULL)) {
+        result = c89thrd_attr_set_stack_posix(&attr, pAttr);
+        if (result != c89thrd_success) {
+            pthread_attr_destroy(&attr);
+            return result;
+        }
+    }
+
+    if (pAttr != NULL && pAttr->pAffinity != NULL) {
+        #if defined(C89THREAD_HAS_PTHREAD_AFFINITY)
+        {
+            /* Setting the affinity on the attributes means the thread will never run on any other CPU. */
+            cpu_set_t cpuSet;
+            c89thread_cpu_set_to_cpu_set_t(pAttr->pAffinity, &cpuSet);
+
+            result = c89thrd_result_from_pthread(pthread_attr_setaffinity_np(&attr, sizeof(cpuSet), &cpuSet));
+        }
+        #else
+        {
+            result = c89thrd_error;
+        }
+        #endif
+
+        if (result != c89thrd_success) {
+            pthread_attr_destroy(&attr);
+            return result;
+        }
+    }
+
+    if (noAlloc) {
+        pData = &dataOnStack;
+    } else {
+        pData = (c89thrd_start_data_posix*)c89thread_malloc(sizeof(*pData), pAllocationCallbacks);   /* <-- This will be freed when c89thrd_start_posix() is entered. */
+        if (pData == NULL) {
+            pthread_attr_destroy(&attr);
+            return c89thrd_nomem;
+        }
+    }
+
+    pData->func = func;
+    pData->arg  = arg;
+
+    if (pAttr != NULL && pAttr->pName != NULL) {
+        c89thread_copy_string(pData->name, sizeof(pData->name), pAttr->pName);
+    } else {
+        pData->name[0] = '\0';
+    }
+
+    if (pEntryExitCallbacks != NULL) {
+        pData->entryExitCallbacks = *pEntryExitCallbacks;
+    } else {
+        pData->entryExitCallbacks.onEntry   = NULL;
+        pData->entryExitCallbacks.onExit    = NULL;
+        pData->entryExitCallbacks.pUserData = NULL;
+    }
+
+    if (pAllocationCallbacks != NULL) {
+        pData->allocationCallbacks  = *pAllocationCallbacks;
+        pData->usingCustomAllocator = 1;
+    } else {
+        pData->allocationCallbacks.onMalloc  = NULL;
+        pData->allocationCallbacks.onRealloc = NULL;
+        pData->allocationCallbacks.onFree    = NULL;
+        pData->allocationCallbacks.pUserData = NULL;
+        pData->usingCustomAllocator = 0;
+    }
+
+    pData->schedPolicy      = (pAttr != NULL) ? pAttr->schedPolicy   : c89thrd_sched_inherit;
+    pData->schedPriority    = (pAttr != NULL) ? pAttr->schedPriority : 0;
+    pData->nice             = (pAttr != NULL) ? pAttr->nice          : 0;
+    pData->isOnCreatorStack = noAlloc;
+    pData->pHandshake       = NULL;
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        /* Allocating the completion record would defeat the point of noAlloc. Timed joins are unavailable for these threads. */
+        pData->pCompletion = NULL;
+        if (!noAlloc) {
+            pData->pCompletion = c89thrd_completion_alloc(pAllocationCallbacks);
+            if (pData->pCompletion == NULL) {
+                pthread_attr_destroy(&attr);
+                c89thread_free(pData, pAllocationCallbacks);
+                return c89thrd_nomem;
+            }
+        }
+    }
+    #endif
+
+    if (waitForStart) {
+        pData->pHandshake = &handshake;
+
+        handshake.done   = 0;
+        handshake.result = c89thrd_error;
+
+        result = c89thrd_result_from_pthread(pthread_mutex_init(&handshake.lock, NULL));
+        if (result == c89thrd_success) {
+            result = c89thrd_result_from_pthread(pthread_cond_init(&handshake.cond, NULL));
+            if (result != c89thrd_success) {
+                pthread_mutex_destroy(&handshake.lock);
+            }
+        }
+
+        if (result != c89thrd_success) {
+            pthread_attr_destroy(&attr);
+            if (!noAlloc) {
+                #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+                {
+                    c89thrd_completion_free(pData->pCompletion);
+                }
+                #endif
+
+                c89thread_free(pData, pAllocationCallbacks);
+            }
+
+            return result;
+        }
+    }
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        pCompletion = pData->pCompletion;   /* pData may be freed by the new thread before we get a chance to register. */
+    }
+    #endif
+
+    result = c89thrd_result_from_pthread(pthread_create(&thread, &attr, c89thrd_start_posix, pData));
+    pthread_attr_destroy(&attr);
+
+    if (result != c89thrd_success) {
+        if (waitForStart) {
+            pthread_cond_destroy(&handshake.cond);
+            pthread_mutex_destroy(&handshake.lock);
+        }
+
+        if (!noAlloc) {
+            #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+            {
+                c89thrd_completion_free(pCompletion);
+            }
+            #endif
+
+            c89thread_free(pData, pAllocationCallbacks);
+        }
+
+        return result;
+    }
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        if (pCompletion != NULL) {
+            c89thrd_completion_register(pCompletion, thread);
+        }
+    }
+    #endif
+
+    /* pData cannot be used from here since it'll be freed by the new thread, or is no longer needed if it's on our stack. */
+    if (waitForStart) {
+        pthread_mutex_lock(&handshake.lock);
+        {
+            while (!handshake.done) {
+                pthread_cond_wait(&handshake.cond, &handshake.lock);
+            }
+        }
+        pthread_mutex_unlock(&handshake.lock);
+
+        pthread_cond_destroy(&handshake.cond);
+        pthread_mutex_destroy(&handshake.lock);
+
+        if (handshake.result != c89thrd_success) {
+            pthread_join(thread, NULL);
+
+            #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+            {
+                c89thrd_completion_release(thread, 0);
+            }
+            #endif
+
+            return c89thrd_error;
+        }
+    }
+
+    *thr = thread;
+
+    return c89thrd_success;
+}
+
+int c89thrd_create_ex(c89thrd_t* thr, c89thrd_start_t func, void* arg, const c89thread_entry_exit_callbacks* pEntryExitCallbacks, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    c89thrd_attr attr = c89thrd_attr_init();
+    attr.pEntryExitCallbacks  = pEntryExitCallbacks;
+    attr.pAllocationCallbacks = pAllocationCallbacks;
+
+    return c89thrd_create_ex2(thr, func, arg, &attr);
+}
+
+int c89thrd_create(c89thrd_t* thr, c89thrd_start_t func, void* arg)
+{
+    return c89thrd_create_ex2(thr, func, arg, NULL);
+}
+
+int c89thrd_equal(c89thrd_t lhs, c89thrd_t rhs)
+{
+    return pthread_equal(lhs, rhs);
+}
+
+c89thrd_t c89thrd_current(void)
+{
+    return pthread_self();
+}
+
+int c89thrd_sleep(const struct timespec* duration, struct timespec* remaining)
+{
+    /*
+    The documentation for thrd_sleep() mentions nanosleep(), so we'll go ahead and use that if it's
+    available. Otherwise we'll fallback to select() and use a similar algorithm to what we use with
+    the Windows build. We need to keep in mind the requirement to handle signal interrupts.
+    */
+    int presult;
+    int errorCode;
+
+    #if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 199309L
+    {
+        presult = nanosleep(duration, remaining);
+        errorCode = errno;
+        if (presult != 0) {
+            if (errorCode == EINTR) {
+                return c89thrd_signal;
+            }
+
+            return c89thrd_error;    
+        }
+    }
+    #else
+    {
+        /*
+        We need to fall back to select(). We'll use c89timespec_get() to retrieve the time before and after
+        for the purpose of diffing.
+        */
+        struct timeval tv;
+        struct timespec tsBeg;
+        struct timespec tsEnd;
+
+        if (duration == NULL) {
+            return c89thrd_error;
+        }
+
+        /*
+        We need to grab the time before the wait. This will be diff'd with the time after waiting to
+        produce the remaining amount.
+        */
+        if (remaining != NULL) {
+            presult = c89timespec_get(&tsBeg, TIME_UTC);
+            if (presult == 0) {
+                return c89thrd_error;   /* Failed to retrieve the start time. */
+            }
+        }
+
+        tv.tv_sec  = duration->tv_sec;
+        tv.tv_usec = duration->tv_nsec / 1000;
+
+        /*
+        We need to sleep for the *minimum* of `duration`. Our nanoseconds-to-microseconds conversion
+        above may have truncated some nanoseconds, so we'll need to add a microsecond to compensate.
+        */
+        if ((duration->tv_nsec % 1000) != 0) {
+            tv.tv_usec += 1;
+            if (tv.tv_usec >= 1000000) {
+                tv.tv_usec -= 1000000;
+                tv.tv_sec += 1;
+            }
+        }
+
+        presult = select(0, NULL, NULL, NULL, &tv);
+        errorCode = errno;
+        if (presult == 0) {
+            if (remaining != NULL) {
+                remaining->tv_sec  = 0;
+                remaining->tv_nsec = 0;
+            }
+
+            return c89thrd_success;
+        }
+
+        /* Getting here means didn't wait the whole time. We'll need to grab the diff. */
+        if (remaining != NULL) {
+            if (c89timespec_get(&tsEnd, TIME_UTC) != 0) {
+                if (c89timespec_cmp(tsEnd, tsBeg) <= 0) {
+                    *remaining = *duration;
+                } else {
+                    struct timespec elapsed = c89timespec_diff(tsEnd, tsBeg);
+                    if (c89timespec_cmp(elapsed, *duration) < 0) {
+                        *remaining = c89timespec_diff(*duration, elapsed);
+                    } else {
+                        remaining->tv_sec  = 0;
+                        remaining->tv_nsec = 0;
+                    }
+                }
+            } else {
+                /* Failed to get the end time, somehow. Shouldn't ever happen. */
+                remaining->tv_sec  = 0;
+                remaining->tv_nsec = 0;
+            }
+        }
+
+        if (errorCode == EINTR) {
+            return c89thrd_signal;
+        } else {
+            return c89thrd_error;
+        }
+    }
+    #endif
+    
+    return c89thrd_success;
+}
+
+/* clock_nanosleep() is not available on Apple platforms. */
+#if defined(CLOCK_MONOTONIC) && defined(TIMER_ABSTIME) && !defined(__APPLE__)
+    #define C89THREAD_HAS_CLOCK_NANOSLEEP
+#endif
+
+#if defined(__linux__)
+    #include <sys/prctl.h>  /* For PR_SET_TIMERSLACK. */
+#endif
+
+#if defined(PR_SET_TIMERSLACK)
+static C89THREAD_THREAD_LOCAL int g_c89thrdTimerSlackReduced = 0;
+#endif
+
+int c89thrd_sleep_until(const struct timespec* time_point, int base)
+{
+    if (time_point == NULL || (base != TIME_UTC && base != TIME_MONOTONIC)) {
+        return c89thrd_error;
+    }
+
+    #if defined(C89THREAD_HAS_CLOCK_NANOSLEEP)
+    {
+        int result;
+
+        for (;;) {
+            result = clock_nanosleep((base == TIME_MONOTONIC) ? CLOCK_MONOTONIC : CLOCK_REALTIME, TIMER_ABSTIME, time_point, NULL);
+            if (result == 0) {
+                return c89thrd_success;
+            }
+
+            /* The time point is absolute so when interrupted by a signal we can just go back to sleep. */
+            if (result != EINTR) {
+                return c89thrd_error;
+            }
+        }
+    }
+    #else
+    {
+        struct timespec tsNow;
+        struct timespec tsRemaining;
+        int result;
+
+        for (;;) {
+            if (base == TIME_MONOTONIC) {
+                tsNow = c89timespec_now_monotonic();
+            } else {
+                tsNow = c89timespec_now();
+            }
+
+            if (c89timespec_cmp(tsNow, *time_point) >= 0) {
+                return c89thrd_success;
+            }
+
+            tsRemaining = c89timespec_diff(*time_point, tsNow);
+
+            result = c89thrd_sleep(&tsRemaining, NULL);
+            if (result != c89thrd_success && result != c89thrd_signal) {
+                return c89thrd_error;
+            }
+        }
+    }
+    #endif
+}
+
+/* Sleeps until a c89timespec_now_monotonic() time point using the OS. Used by the precise sleep which spins for whatever is left. */
+static int c89thrd_sleep_os_until(const struct timespec* time_point)
+{
+    #if defined(PR_SET_TIMERSLACK)
+    {
+        /* The default timer slack is 50 microseconds which would swamp the precision we're after. */
+        if (!g_c89thrdTimerSlackReduced) {
+            prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+            g_c89thrdTimerSlackReduced = 1;
+        }
+    }
+    #endif
+
+    return c89thrd_sleep_until(time_point, TIME_MONOTONIC);
+}
+
+void c89thrd_yield(void)
+{
+    sched_yield();
+}
+
+void c89thrd_exit(int res)
+{
+    c89thrd_run_exit_callback_posix();
+
+    if (g_c89thrdCacheSlot != NULL) {
+        c89thrd_cache_exit(res);
+    }
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        c89thrd_completion_signal();
+    }
+    #endif
+
+    pthread_exit((void*)(c89thread_intptr)res);
+}
+
+int c89thrd_detach(c89thrd_t thr)
+{
+    /*
+    The documentation for thrd_detach() explicitly says c89thrd_success if successful or c89thrd_error
+    for any other error. Don't use c89thrd_result_from_errno() here.
+    */
+    int result;
+
+    result = c89thrd_cache_detach(thr);
+    if (result != C89THRD_NOT_CACHED) {
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_detach(thr));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    #if !defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        c89thrd_completion_release(thr, 1);
+    }
+    #endif
+
+    return c89thrd_success;
+}
+
+/* The time point is optional. When isTry is set, c89thrd_busy is returned if the thread is still running. */
+static int c89thrd_join_posix(c89thrd_t thr, int* res, const struct timespec* time_point, int isTry)
+{
+    /* Same rules apply here as thrd_detach() with respect to the return value, except for c89thrd_busy and c89thrd_timedout. */
+    void* retval;
+    int result;
+
+    result = c89thrd_cache_join(thr, res, time_point, isTry);
+    if (result != C89THRD_NOT_CACHED) {
+        return result;
+    }
+
+    #if defined(C89THREAD_HAS_PTHREAD_TIMEDJOIN)
+    {
+        if (isTry) {
+            result = pthread_tryjoin_np(thr, &retval);
+        } else if (time_point != NULL) {
+            result = pthread_timedjoin_np(thr, &retval, time_point);
+        } else {
+            result = pthread_join(thr, &retval);
+        }
+
+        if (result == EBUSY) {
+            return c89thrd_busy;
+        }
+
+        if (result == ETIMEDOUT) {
+            return c89thrd_timedout;
+        }
+
+        if (result != 0) {
+            return c89thrd_error;
+        }
+    }
+    #else
+    {
+        if (isTry || time_point != NULL) {
+            result = c89thrd_completion_wait(thr, time_point, isTry);
+            if (result != c89thrd_success) {
+                return result;
+            }
+        }
+
+        result = c89thrd_result_from_pthread(pthread_join(thr, &retval));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+
+        c89thrd_completion_release(thr, 0);
+    }
+    #endif
+
+    if (res != NULL) {
+        *res = (int)(c89thread_intptr)retval;
+    }
+
+    return c89thrd_success;
+}
+
+int c89thrd_join(c89thrd_t thr, int* res)
+{
+    return c89thrd_join_posix(thr, res, NULL, 0);
+}
+
+int c89thrd_timedjoin(c89thrd_t thr, int* res, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_join_posix(thr, res, time_point, 0);
+}
+
+int c89thrd_tryjoin(c89thrd_t thr, int* res)
+{
+    return c89thrd_join_posix(thr, res, NULL, 1);
+}
+
+int c89thrd_set_affinity(c89thrd_t thr, const c89thread_cpu_set* pAffinity)
+{
+    if (pAffinity == NULL) {
+        return c89thrd_error;
+    }
+
+    #if defined(C89THREAD_HAS_PTHREAD_AFFINITY)
+    {
+        cpu_set_t cpuSet;
+        c89thread_cpu_set_to_cpu_set_t(pAffinity, &cpuSet);
+
+        return c89thrd_result_from_pthread(pthread_setaffinity_np(thr, sizeof(cpuSet), &cpuSet));
+    }
+    #else
+    {
+        (void)thr;
+        return c89thrd_error;
+    }
+    #endif
+}
+
+int c89thrd_get_affinity(c89thrd_t thr, c89thread_cpu_set* pAffinity)
+{
+    if (pAffinity == NULL) {
+        return c89thrd_error;
+    }
+
+    #if defined(C89THREAD_HAS_PTHREAD_AFFINITY)
+    {
+        cpu_set_t cpuSet;
+        int result;
+
+        result = c89thrd_result_from_pthread(pthread_getaffinity_np(thr, sizeof(cpuSet), &cpuSet));
+        if (result != c89thrd_success) {
+            return result;
+        }
+
+        c89thread_cpu_set_from_cpu_set_t(pAffinity, &cpuSet);
+        return c89thrd_success;
+    }
+    #else
+    {
+        (void)thr;
+        return c89thrd_error;
+    }
+    #endif
+}
+
+int c89thrd_set_name(c89thrd_t thr, const char* pName)
+{
+    if (pName == NULL) {
+        return c89thrd_error;
+    }
+
+    #if defined(C89THREAD_HAS_PTHREAD_SETNAME_LINUX) || defined(C89THREAD_HAS_PTHREAD_SETNAME_APPLE)
+    {
+        char nameTruncated[C89THREAD_MAX_PTHREAD_NAME_LENGTH];
+        c89thread_copy_string(nameTruncated, sizeof(nameTruncated), pName);
+
+        #if defined(C89THREAD_HAS_PTHREAD_SETNAME_LINUX)
+        {
+            return c89thrd_result_from_pthread(pthread_setname_np(thr, nameTruncated));
+        }
+        #else
+        {
+            /* Apple only allows naming the calling thread. */
+            if (!pthread_equal(thr, pthread_self())) {
+                return c89thrd_error;
+            }
+
+            return c89thrd_result_from_pthread(pthread_setname_np(nameTruncated));
+        }
+        #endif
+    }
+    #else
+    {
+        (void)thr;
+        return c89thrd_error;
+    }
+    #endif
+}
+
+int c89thrd_get_name(c89thrd_t thr, char* pName, size_t nameSize)
+{
+    if (pName == NULL || nameSize == 0) {
+        return c89thrd_error;
+    }
+
+    pName[0] = '\0';
+
+    #if defined(C89THREAD_HAS_PTHREAD_SETNAME_LINUX) || defined(C89THREAD_HAS_PTHREAD_SETNAME_APPLE)
+    {
+        /* Linux will fail with ERANGE if the buffer is smaller than the maximum name length, so go through a buffer that's big enough. */
+        char name[C89THREAD_MAX_PTHREAD_NAME_LENGTH];
+        int result;
+
+        result = c89thrd_result_from_pthread(pthread_getname_np(thr, name, sizeof(name)));
+        if (result != c89thrd_success) {
+            return result;
+        }
+
+        if (strlen(name) >= nameSize) {
+            return c89thrd_error;
+        }
+
+        c89thread_copy_string(pName, nameSize, name);
+        return c89thrd_success;
+    }
+    #else
+    {
+        (void)thr;
+        return c89thrd_error;
+    }
+    #endif
+}
+
+static int c89thrd_sched_policy_to_posix(int policy, int* pPolicyPOSIX)
+{
+    switch (policy)
+    {
+        case c89thrd_sched_other: *pPolicyPOSIX = SCHED_OTHER; return c89thrd_success;
+        #if defined(SCHED_BATCH)
+        case c89thrd_sched_batch: *pPolicyPOSIX = SCHED_BATCH; return c89thrd_success;
+        #endif
+        #if defined(SCHED_IDLE)
+        case c89thrd_sched_idle:  *pPolicyPOSIX = SCHED_IDLE;  return c89thrd_success;
+        #endif
+        case c89thrd_sched_fifo:  *pPolicyPOSIX = SCHED_FIFO;  return c89thrd_success;
+        case c89thrd_sched_rr:    *pPolicyPOSIX = SCHED_RR;    return c89thrd_success;
+        default: break;
+    }
+
+    return c89thrd_error;
+}
+
+int c89thrd_set_priority(c89thrd_t thr, int policy, int priority)
+{
+    struct sched_param param;
+    int policyPOSIX;
+
+    if (c89thrd_sched_policy_to_posix(policy, &policyPOSIX) != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    /* As per the documentation, any failure is reported as c89thrd_error. In practice it'll be EPERM or EINVAL. */
+    if (pthread_setschedparam(thr, policyPOSIX, &param) != 0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89thrd_get_priority(c89thrd_t thr, int* pPolicy, int* pPriority)
+{
+    struct sched_param param;
+    int policyPOSIX;
+    int policy;
+
+    if (pthread_getschedparam(thr, &policyPOSIX, &param) != 0) {
+        return c89thrd_error;
+    }
+
+    if (policyPOSIX == SCHED_FIFO) {
+        policy = c89thrd_sched_fifo;
+    } else if (policyPOSIX == SCHED_RR) {
+        policy = c89thrd_sched_rr;
+    }
+    #if defined(SCHED_BATCH)
+    else if (policyPOSIX == SCHED_BATCH) {
+        policy = c89thrd_sched_batch;
+    }
+    #endif
+    #if defined(SCHED_IDLE)
+    else if (policyPOSIX == SCHED_IDLE) {
+        policy = c89thrd_sched_idle;
+    }
+    #endif
+    else {
+        policy = c89thrd_sched_other;
+    }
+
+    if (pPolicy != NULL) {
+        *pPolicy = policy;
+    }
+
+    if (pPriority != NULL) {
+        *pPriority = param.sched_priority;
+    }
+
+    return c89thrd_success;
+}
+
+c89thrd_native_handle_t c89thrd_native_handle(c89thrd_t thr)
+{
+    return thr;
+}
+
+
+/* BEG c89mtx_pthread.c */
+static int c89mtx_init_pthread(c89mtx_t* mutex, int type)
+{
+    int result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        /* Initialize the main mutex */
+        result = c89thrd_result_from_pthread(pthread_mutex_init(&mutex->mutex, NULL));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+        
+        /* For recursive mutexes, we need the guard mutex and metadata */
+        if ((type & c89mtx_recursive) != 0) {
+            if (c89thrd_result_from_pthread(pthread_mutex_init(&mutex->guard, NULL)) != c89thrd_success) {
+                pthread_mutex_destroy(&mutex->mutex);
+                return c89thrd_error;
+            }
+
+            mutex->recursionCount = 0;
+        }
+        
+        mutex->type = type;
+        
+        return c89thrd_success;
+    }
+    #else
+    {
+        if ((type & c89mtx_recursive) != 0) {
+            pthread_mutexattr_t attr;
+
+            result = c89thrd_result_from_pthread(pthread_mutexattr_init(&attr));
+            if (result != c89thrd_success) {
+                return c89thrd_error;
+            }
+
+            result = c89thrd_result_from_pthread(pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE));
+            if (result == c89thrd_success) {
+                result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)mutex, &attr));
+            }
+
+            pthread_mutexattr_destroy(&attr);
+        } else {
+            result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)mutex, NULL));
+        }
+
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+
+        return c89thrd_success;
+    }
+    #endif
+}
+
+static void c89mtx_destroy_pthread(c89mtx_t* mutex)
+{
+    if (mutex == NULL) {
+        return;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        /* Only destroy the guard mutex if it was initialized (for recursive mutexes) */
+        if ((mutex->type & c89mtx_recursive) != 0) {
+            pthread_mutex_destroy(&mutex->guard);
+        }
+
+        pthread_mutex_destroy(&mutex->mutex);
+    }
+    #else
+    {
+        pthread_mutex_destroy((pthread_mutex_t*)mutex);
+    }
+    #endif
+}
+
+static int c89mtx_lock_pthread(c89mtx_t* mutex)
+{
+    int result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        pthread_t currentThread;
+
+        /* Optimized path for plain mutexes. */
+        if ((mutex->type & c89mtx_recursive) == 0) {
+            result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->mutex));
+            if (result != c89thrd_success) {
+                return c89thrd_error;
+            }
+
+            return c89thrd_success;
+        }
+
+        /* Getting here means it's a recursive mutex. */
+        currentThread = pthread_self();
+        
+        /* First, lock the guard mutex to safely access the metadata. */
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+
+        /* We can bomb out early if the current thread already owns this mutex. */
+        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
+            if (mutex->recursionCount == INT_MAX) {
+                pthread_mutex_unlock(&mutex->guard);
+                return c89thrd_error;
+            }
+
+            mutex->recursionCount += 1;
+            pthread_mutex_unlock(&mutex->guard);
+            return c89thrd_success;
+        }
+
+        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
+        pthread_mutex_unlock(&mutex->guard);
+        
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->mutex));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+        
+        /* Update metadata. */
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
+        if (result != c89thrd_success) {
+            pthread_mutex_unlock(&mutex->mutex);
+            return c89thrd_error;
+        }
+        
+        mutex->owner = currentThread;
+        mutex->recursionCount = 1;
+        
+        pthread_mutex_unlock(&mutex->guard);
+
+        return c89thrd_success;
+    }
+    #else
+    {
+        result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)mutex));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+
+        return c89thrd_success;
+    }
+    #endif
+}
+
+/* BEG c89thread_clock_pthread.c */
+/*
+pthread_cond_clockwait() and pthread_mutex_clocklock() take the clock as a parameter which means the
+same object can be waited on with both TIME_UTC and monotonic time points. They were added in glibc 2.30.
+ThreadSanitizer doesn't understand these and reports false positives, so don't use them with it.
+*/
+#if defined(__has_feature)
+    #if __has_feature(thread_sanitizer)
+        #define C89THREAD_THREAD_SANITIZER
+    #endif
+#endif
+#if defined(__SANITIZE_THREAD__)
+    #define C89THREAD_THREAD_SANITIZER
+#endif
+
+#if defined(__GLIBC__) && defined(_GNU_SOURCE) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30)) && !defined(C89THREAD_THREAD_SANITIZER)
+    #define C89THREAD_HAS_PTHREAD_CLOCKWAIT
+#endif
+
+#if !defined(C89THREAD_HAS_PTHREAD_CLOCKWAIT)
+/* Converts a monotonic time point to TIME_UTC. A time point that has already passed is converted to the current time. */
+static struct timespec c89timespec_monotonic_to_utc(const struct timespec* time_point)
+{
+    struct timespec tsNowMonotonic;
+    struct timespec tsNowUTC;
+
+    tsNowMonotonic = c89timespec_now_monotonic();
+    tsNowUTC       = c89timespec_now();
+
+    if (c89timespec_cmp(*time_point, tsNowMonotonic) > 0) {
+        tsNowUTC = c89timespec_add(tsNowUTC, c89timespec_diff(*time_point, tsNowMonotonic));
+    }
+
+    return tsNowUTC;
+}
+#endif
+
+static int c89pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* time_point, int isMonotonic)
+{
+    if (isMonotonic) {
+        #if defined(C89THREAD_HAS_PTHREAD_CLOCKWAIT)
+        {
+            return c89thrd_result_from_pthread(pthread_cond_clockwait(cond, mutex, CLOCK_MONOTONIC, time_point));
+        }
+        #else
+        {
+            struct timespec tsUTC = c89timespec_monotonic_to_utc(time_point);
+            return c89thrd_result_from_pthread(pthread_cond_timedwait(cond, mutex, &tsUTC));
+        }
+        #endif
+    }
+
+    return c89thrd_result_from_pthread(pthread_cond_timedwait(cond, mutex, time_point));
+}
+
+/*
+pthread has no relative waits so durations need to be turned into a time point. Use whichever clock can
+be waited on natively so it's only a single clock read.
+*/
+static struct timespec c89timespec_time_point_from_duration(const struct timespec* duration, int* pIsMonotonic)
+{
+    struct timespec tsNow;
+
+    #if defined(C89THREAD_HAS_PTHREAD_CLOCKWAIT)
+    {
+        tsNow = c89timespec_now_monotonic();
+        *pIsMonotonic = 1;
+    }
+    #else
+    {
+        tsNow = c89timespec_now();
+        *pIsMonotonic = 0;
+    }
+    #endif
+
+    if (duration->tv_sec < 0) {
+        return tsNow;
+    }
+
+    return c89timespec_add(tsNow, *duration);
+}
+/* END c89thread_clock_pthread.c */
+
+/* BEG c89mtx_timedlock_pthread.c */
+/* I'm not entirely sure what the best wait time would be, so making it configurable. Defaulting to 1 microsecond. */
+#ifndef C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS
+#define C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS    1000
+#endif
+
+static int c89pthread_mutex_timedlock(pthread_mutex_t* mutex, const struct timespec* time_point, int isMonotonic)
+{
+    #if defined(__USE_XOPEN2K) && !defined(__APPLE__)
+    {
+        if (isMonotonic) {
+            #if defined(C89THREAD_HAS_PTHREAD_CLOCKWAIT)
+            {
+                return c89thrd_result_from_pthread(pthread_mutex_clocklock(mutex, CLOCK_MONOTONIC, time_point));
+            }
+            #else
+            {
+                struct timespec tsUTC = c89timespec_monotonic_to_utc(time_point);
+                return c89thrd_result_from_pthread(pthread_mutex_timedlock(mutex, &tsUTC));
+            }
+            #endif
+        }
+
+        return c89thrd_result_from_pthread(pthread_mutex_timedlock((pthread_mutex_t*)mutex, time_point));
+    }
+    #else
+    {
+        /*
+        Fallback implementation for when pthread_mutex_timedlock() is not avaialble. This is just a
+        naive loop which waits a bit of time before continuing.
+        */
+        #if defined(C89THREAD_ENABLE_SUBOPTIMAL_WARNINGS) && !defined(__APPLE__)
+            #warning pthread_mutex_timedlock() is unavailable. Falling back to a suboptimal implementation.
+        #endif
+
+        int result;
+
+        if (time_point == NULL) {
+            return c89thrd_error;
+        }
+
+        for (;;) {
+            result = c89thrd_result_from_pthread(pthread_mutex_trylock((pthread_mutex_t*)mutex));
+            if (result == c89thrd_busy) {
+                struct timespec tsNow;
+                if (isMonotonic) {
+                    tsNow = c89timespec_now_monotonic();
+                } else if (c89timespec_get(&tsNow, TIME_UTC) == 0) {
+                    result = c89thrd_error;
+                    break;
+                }
+
+                if (c89timespec_cmp(tsNow, *time_point) > 0) {
+                    result = c89thrd_timedout;
+                    break;
+                } else {
+                    /* Have not yet timed out. Need to wait a bit and then try again. */
+                    c89thrd_sleep_timespec(c89timespec_nanoseconds(C89THREAD_TIMEDLOCK_WAIT_TIME_IN_NANOSECONDS));
+                    continue;
+                }
+            } else {
+                break;
+            }
+        }
+
+        return result;
+    }
+    #endif
+}
+
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89mtx_timedlock_pthread(c89mtx_t* mutex, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    struct timespec time_point_from_duration;
+
+    if (mutex == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        time_point_from_duration = c89timespec_time_point_from_duration(duration, &isMonotonic);
+        time_point = &time_point_from_duration;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        int result;
+        pthread_t currentThread;
+
+        /* Optimized path for plain mutexes. */
+        if ((mutex->type & c89mtx_recursive) == 0) {
+            result = c89pthread_mutex_timedlock(&mutex->mutex, time_point, isMonotonic);
+            if (result != c89thrd_success) {
+                return result;
+            }
+
+            return c89thrd_success;
+        }
+        
+        /* Getting here means it's a recursive mutex. */
+        currentThread = pthread_self();
+        
+        /* First, lock the guard mutex to safely access the metadata. */
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+        
+        /* We can bomb out early if the current thread already owns this mutex. */
+        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
+            if (mutex->recursionCount == INT_MAX) {
+                pthread_mutex_unlock(&mutex->guard);
+                return c89thrd_error;
+            }
+
+            mutex->recursionCount += 1;
+            pthread_mutex_unlock(&mutex->guard);
+            return c89thrd_success;
+        }
+        
+        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
+        pthread_mutex_unlock(&mutex->guard);
+        
+        result = c89pthread_mutex_timedlock(&mutex->mutex, time_point, isMonotonic);
+        if (result != c89thrd_success) {
+            return result;
+        }
+
+        /* Update metadata. */
+        if (c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard)) != c89thrd_success) {
+            pthread_mutex_unlock(&mutex->mutex);
+            return c89thrd_error;
+        }
+        
+        mutex->owner = currentThread;
+        mutex->recursionCount = 1;
+        
+        pthread_mutex_unlock(&mutex->guard);
+
+        return c89thrd_success;
+    }
+    #else
+    {
+        return c89pthread_mutex_timedlock((pthread_mutex_t*)mutex, time_point, isMonotonic);
+    }
+    #endif
+}
+
+/* END c89mtx_timedlock_pthread.c */
+
+/* BEG c89mtx_trylock_pthread.c */
+static int c89mtx_trylock_pthread(c89mtx_t* mutex)
+{
+    int result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        pthread_t currentThread;
+
+        /* Optimized path for plain mutexes. */
+        if ((mutex->type & c89mtx_recursive) == 0) {
+            return c89thrd_result_from_pthread(pthread_mutex_trylock(&mutex->mutex));
+        }
+
+        /* Getting here means it's a recursive mutex. */
+        currentThread = pthread_self();
+        
+        /* Lock the guard mutex to safely access the metadata. */
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+        
+        /* We can bomb out early if the current thread already owns this mutex. */
+        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
+            if (mutex->recursionCount == INT_MAX) {
+                pthread_mutex_unlock(&mutex->guard);
+                return c89thrd_error;
+            }
+
+            mutex->recursionCount += 1;
+            pthread_mutex_unlock(&mutex->guard);
+            return c89thrd_success;
+        }
+        
+        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
+        pthread_mutex_unlock(&mutex->guard);
+        
+        result = c89thrd_result_from_pthread(pthread_mutex_trylock(&mutex->mutex));
+        if (result != c89thrd_success) {
+            if (result == c89thrd_busy) {
+                return c89thrd_busy;
+            }
+
+            return c89thrd_error;
+        }
+        
+        /* Update metadata. */
+        if (pthread_mutex_lock(&mutex->guard) != 0) {
+            pthread_mutex_unlock(&mutex->mutex);
+            return c89thrd_error;
+        }
+        
+        mutex->owner = currentThread;
+        mutex->recursionCount = 1;
+        
+        pthread_mutex_unlock(&mutex->guard);
+
+        return c89thrd_success;
+    }
+    #else
+    {
+        result = c89thrd_result_from_pthread(pthread_mutex_trylock((pthread_mutex_t*)mutex));
+        if (result != c89thrd_success) {
+            if (result == c89thrd_busy) {
+                return c89thrd_busy;
+            }
+
+            return c89thrd_error;
+        }
+
+        return c89thrd_success;
+    }
+    #endif
+}
+/* END c89mtx_trylock_pthread.c */
+
+static int c89mtx_unlock_pthread(c89mtx_t* mutex)
+{
+    int result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        pthread_t currentThread;
+
+        /* Optimized path for plain mutexes. */
+        if ((mutex->type & c89mtx_recursive) == 0) {
+            result = c89thrd_result_from_pthread(pthread_mutex_unlock(&mutex->mutex));
+            if (result != c89thrd_success) {
+                return c89thrd_error;
+            }
+
+            return c89thrd_success;
+        }
+        
+        /* Getting here means it's a recursive mutex. */
+        currentThread = pthread_self();
+        
+        /* Lock the guard mutex to safely access the metadata */
+        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+        
+        /* Check if the current thread owns the mutex */
+        if (mutex->recursionCount == 0 || !pthread_equal(mutex->owner, currentThread)) {
+            /* Getting here means we are trying to unlock a mutex that is not owned by this thread. Bomb out. */
+            pthread_mutex_unlock(&mutex->guard);
+            return c89thrd_error;
+        }
+        
+        mutex->recursionCount -= 1;
+
+        if (mutex->recursionCount == 0) {
+            /* Last unlock. Unlock the main mutex. */
+            pthread_mutex_unlock(&mutex->guard);
+
+            result = c89thrd_result_from_pthread(pthread_mutex_unlock(&mutex->mutex));
+            if (result != c89thrd_success) {
+                return c89thrd_error;
+            }
+        } else {
+            /* Still recursively locked, just unlock the guard mutex. */
+            pthread_mutex_unlock(&mutex->guard);
+        }
+        
+        return c89thrd_success;
+    }
+    #else
+    {
+        result = c89thrd_result_from_pthread(pthread_mutex_unlock((pthread_mutex_t*)mutex));
+        if (result != c89thrd_success) {
+            return c89thrd_error;
+        }
+
+        return c89thrd_success;
+    }
+    #endif
+}
+/* END c89mtx_pthread.c */
+
+
+/* BEG c89cnd_pthread.c */
+#if defined(C89THREAD_PROFILE)
+static unsigned int c89mtx_profile_suspend(c89mtx_t* mutex);
+static void c89mtx_profile_resume(c89mtx_t* mutex, unsigned int lockDepth);
+static void c89thread_wait_histogram_record(const void* pObject, c89thread_uint64 startTicks);
+#endif
+
+static int c89cnd_wait_pthread(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point, int isMonotonic)
+{
+    int result;
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    int recursionCount;
+    pthread_t currentThread;
+    #endif
+    #if defined(C89THREAD_PROFILE)
+    unsigned int profileLockDepth;
+    c89thread_uint64 profileStartTicks;
+    #endif
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        recursionCount = 0;
+        currentThread = pthread_self();
+
+        if ((mtx->type & c89mtx_recursive) != 0) {
+            result = c89thrd_result_from_pthread(pthread_mutex_lock(&mtx->guard));
+            if (result != c89thrd_success) {
+                return c89thrd_error;
+            }
+
+            if (mtx->recursionCount == 0 || !pthread_equal(mtx->owner, currentThread)) {
+                pthread_mutex_unlock(&mtx->guard);
+                return c89thrd_error;
+            }
+
+            recursionCount = mtx->recursionCount;
+            mtx->recursionCount = 0;
+
+            pthread_mutex_unlock(&mtx->guard);
+        }
+    }
+    #endif
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        profileLockDepth  = c89mtx_profile_suspend(mtx);
+        profileStartTicks = c89thread_ticks();
+    }
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_released(c89thread_object_mtx, mtx);
+        c89thread_hook_before_block(c89thread_object_cnd, cnd);
+    }
+    #endif
+
+    if (time_point != NULL) {
+        result = c89pthread_cond_timedwait((pthread_cond_t*)cnd, (pthread_mutex_t*)mtx, time_point, isMonotonic);
+    } else {
+        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)cnd, (pthread_mutex_t*)mtx));
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_after_block(c89thread_object_cnd, cnd, result);
+        c89thread_hook_acquired(c89thread_object_mtx, mtx);
+    }
+    #endif
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        if (result == c89thrd_success) {
+            c89thread_wait_histogram_record(cnd, profileStartTicks);
+        }
+
+        c89mtx_profile_resume(mtx, profileLockDepth);
+    }
+    #endif
+
+    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
+    {
+        if ((mtx->type & c89mtx_recursive) != 0) {
+            if (c89thrd_result_from_pthread(pthread_mutex_lock(&mtx->guard)) != c89thrd_success) {
+                return c89thrd_error;
+            }
+
+            mtx->owner = currentThread;
+            mtx->recursionCount = recursionCount;
+
+            pthread_mutex_unlock(&mtx->guard);
+        }
+    }
+    #endif
+
+    return result;
+}
+
+int c89cnd_init(c89cnd_t* cnd)
+{
+    int result;
+
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)cnd, NULL));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+void c89cnd_destroy(c89cnd_t* cnd)
+{
+    if (cnd == NULL) {
+        return;
+    }
+
+    pthread_cond_destroy((pthread_cond_t*)cnd);
+}
+
+int c89cnd_signal(c89cnd_t* cnd)
+{
+    int result;
+
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_signal((pthread_cond_t*)cnd));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89cnd_broadcast(c89cnd_t* cnd)
+{
+    int result;
+
+    if (cnd == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_broadcast((pthread_cond_t*)cnd));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89cnd_wait(c89cnd_t* cnd, c89mtx_t* mtx)
+{
+    int result;
+
+    if (cnd == NULL || mtx == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89cnd_wait_pthread(cnd, mtx, NULL, 0);
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+static int c89cnd_timedwait_pthread(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point, int isMonotonic)
+{
+    int result;
+
+    if (cnd == NULL || mtx == NULL || time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89cnd_wait_pthread(cnd, mtx, time_point, isMonotonic);
+    if (result != c89thrd_success) {
+        if (result == c89thrd_timedout) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89cnd_timedwait(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+{
+    return c89cnd_timedwait_pthread(cnd, mtx, time_point, 0);
+}
+
+int c89cnd_timedwait_monotonic(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+{
+    return c89cnd_timedwait_pthread(cnd, mtx, time_point, 1);
+}
+
+int c89cnd_timedwait_for(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* duration)
+{
+    struct timespec time_point;
+    int isMonotonic;
+
+    if (duration == NULL) {
+        return c89thrd_error;
+    }
+
+    time_point = c89timespec_time_point_from_duration(duration, &isMonotonic);
+    return c89cnd_timedwait_pthread(cnd, mtx, &time_point, isMonotonic);
+}
+/* END c89cnd_pthread.c */
+
+
+int c89sem_init(c89sem_t* sem, int value, int valueMax)
+{
+    int result;
+
+    if (sem == NULL || value < 0 || valueMax <= 0 || value > valueMax) {
+        return c89thrd_error;
+    }
+
+    sem->value    = value;
+    sem->valueMax = valueMax;
+
+    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&sem->lock, NULL));
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&sem->cond, NULL));
+    if (result != c89thrd_success) {
+        pthread_mutex_destroy((pthread_mutex_t*)&sem->lock);
+        return result;  /* Failed to create condition variable. */
+    }
+
+    return c89thrd_success;
+}
+
+void c89sem_destroy(c89sem_t* sem)
+{
+    if (sem == NULL) {
+        return;
+    }
+
+    pthread_cond_destroy((pthread_cond_t*)&sem->cond);
+    pthread_mutex_destroy((pthread_mutex_t*)&sem->lock);
+}
+
+static int c89sem_wait_pthread(c89sem_t* sem)
+{
+    int result;
+
+    if (sem == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&sem->lock));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    /* We need to wait on a condition variable before escaping. We can't return from this function until the semaphore has been signaled. */
+    while (sem->value == 0) {
+        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)&sem->cond, (pthread_mutex_t*)&sem->lock));
+        if (result != c89thrd_success) {
+            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+            return c89thrd_error;
+        }
+    }
+
+    sem->value -= 1;
+    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+
+    return c89thrd_success;
+}
+
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89sem_timedwait_pthread(c89sem_t* sem, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    struct timespec time_point_from_duration;
+    int result;
+
+    if (sem == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        time_point_from_duration = c89timespec_time_point_from_duration(duration, &isMonotonic);
+        time_point = &time_point_from_duration;
+    }
+
+    result = c89pthread_mutex_timedlock((pthread_mutex_t*)&sem->lock, time_point, isMonotonic);
+    if (result != 0) {
+        if (result == c89thrd_timedout) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    /* We need to wait on a condition variable before escaping. We can't return from this function until the semaphore has been signaled. */
+    while (sem->value == 0) {
+        result = c89pthread_cond_timedwait((pthread_cond_t*)&sem->cond, (pthread_mutex_t*)&sem->lock, time_point, isMonotonic);
+        if (result == c89thrd_timedout) {
+            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+            return c89thrd_timedout;
+        }
+
+        if (result != c89thrd_success) {
+            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+            return c89thrd_error;
+        }
+    }
+
+    sem->value -= 1;
+
+    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+    return c89thrd_success;
+}
+
+int c89sem_post(c89sem_t* sem)
+{
+    int result;
+
+    if (sem == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&sem->lock));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    if (sem->value < sem->valueMax) {
+        sem->value += 1;
+        pthread_cond_signal((pthread_cond_t*)&sem->cond);
+        result = c89thrd_success;
+    } else {
+        result = c89thrd_error;
+    }
+
+    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+    return result;
+}
+
+
+
+int c89evnt_init(c89evnt_t* evnt)
+{
+    int result;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    evnt->value = 0;
+
+    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&evnt->lock, NULL));
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&evnt->cond, NULL));
+    if (result != c89thrd_success) {
+        pthread_mutex_destroy((pthread_mutex_t*)&evnt->lock);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+void c89evnt_destroy(c89evnt_t* evnt)
+{
+    if (evnt == NULL) {
+        return;
+    }
+
+    pthread_cond_destroy((pthread_cond_t*)&evnt->cond);
+    pthread_mutex_destroy((pthread_mutex_t*)&evnt->lock);
+}
+
+static int c89evnt_wait_pthread(c89evnt_t* evnt)
+{
+    int result;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&evnt->lock));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    while (evnt->value == 0) {
+        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)&evnt->cond, (pthread_mutex_t*)&evnt->lock));
+        if (result != c89thrd_success) {
+            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+            return c89thrd_error;
+        }
+    }
+    evnt->value = 0;  /* Auto-reset. */
+
+    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+    return c89thrd_success;
+}
+
+/* When `duration` is non-NULL it is used instead of `time_point`. */
+static int c89evnt_timedwait_pthread(c89evnt_t* evnt, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    struct timespec time_point_from_duration;
+    int result;
+
+    if (evnt == NULL || (time_point == NULL && duration == NULL)) {
+        return c89thrd_error;
+    }
+
+    if (duration != NULL) {
+        time_point_from_duration = c89timespec_time_point_from_duration(duration, &isMonotonic);
+        time_point = &time_point_from_duration;
+    }
+
+    result = c89pthread_mutex_timedlock((pthread_mutex_t*)&evnt->lock, time_point, isMonotonic);
+    if (result != 0) {
+        if (result == c89thrd_timedout) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    while (evnt->value == 0) {
+        result = c89pthread_cond_timedwait((pthread_cond_t*)&evnt->cond, (pthread_mutex_t*)&evnt->lock, time_point, isMonotonic);
+        if (result == c89thrd_timedout) {
+            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+            return c89thrd_timedout;
+        }
+        
+        if (result != c89thrd_success) {
+            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+            return c89thrd_error;
+        }
+    }
+    evnt->value = 0;  /* Auto-reset. */
+
+    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+    return c89thrd_success;
+}
+
+int c89evnt_signal(c89evnt_t* evnt)
+{
+    int result;
+
+    if (evnt == NULL) {
+        return c89thrd_error;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&evnt->lock));
+    if (result != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    evnt->value = 1;
+    pthread_cond_signal((pthread_cond_t*)&evnt->cond);
+
+    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
+    return c89thrd_success;
+}
+#endif
+/* END c89thread_types.c */
+
+
+/* BEG c89thread_atomic.c */
+/*
+Only a small number of atomic operations are needed internally so they're implemented here rather
+than pulling in a full atomics library. Everything is sequentially consistent which keeps things
+simple to reason about. These are not part of the public API.
+*/
+#if defined(C89THREAD_WIN32)
+    /* Win32. The Interlocked* functions are available on every compiler targeting Windows. */
+    static c89thread_uint32 c89thread_atomic_load_32(volatile c89thread_uint32* p)
+    {
+        return (c89thread_uint32)InterlockedExchangeAdd((LONG*)p, 0);
+    }
+
+    static void c89thread_atomic_store_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        InterlockedExchange((LONG*)p, (LONG)value);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_add_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return (c89thread_uint32)InterlockedExchangeAdd((LONG*)p, (LONG)value);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_sub_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return (c89thread_uint32)InterlockedExchangeAdd((LONG*)p, -(LONG)value);
+    }
+
+    static c89thread_uint64 c89thread_atomic_load_64(volatile c89thread_uint64* p)
+    {
+        return (c89thread_uint64)InterlockedCompareExchange64((volatile LONGLONG*)p, 0, 0);
+    }
+
+    static void c89thread_atomic_store_64(volatile c89thread_uint64* p, c89thread_uint64 value)
+    {
+        /* InterlockedExchange64() is not available on 32-bit builds with older SDKs. */
+        LONGLONG oldValue;
+
+        do {
+            oldValue = *(volatile LONGLONG*)p;
+        } while (InterlockedCompareExchange64((volatile LONGLONG*)p, (LONGLONG)value, oldValue) != oldValue);
+    }
+#elif defined(__ATOMIC_SEQ_CST)
+    /* GCC 4.7+ and Clang. */
+    static c89thread_uint32 c89thread_atomic_load_32(volatile c89thread_uint32* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+    }
+
+    static void c89thread_atomic_store_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_add_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return __atomic_fetch_add(p, value, __ATOMIC_SEQ_CST);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_sub_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return __atomic_fetch_sub(p, value, __ATOMIC_SEQ_CST);
+    }
+
+    static c89thread_uint64 c89thread_atomic_load_64(volatile c89thread_uint64* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+    }
+
+    static void c89thread_atomic_store_64(volatile c89thread_uint64* p, c89thread_uint64 value)
+    {
+        __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+    }
+#elif defined(__GNUC__)
+    /* Older versions of GCC. The __sync_* builtins are all full barriers. */
+    static c89thread_uint32 c89thread_atomic_load_32(volatile c89thread_uint32* p)
+    {
+        return __sync_fetch_and_add(p, 0);
+    }
+
+    static void c89thread_atomic_store_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        __sync_synchronize();
+        __sync_lock_test_and_set(p, value);
+        __sync_synchronize();
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_add_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return __sync_fetch_and_add(p, value);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_sub_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        return __sync_fetch_and_sub(p, value);
+    }
+
+    static c89thread_uint64 c89thread_atomic_load_64(volatile c89thread_uint64* p)
+    {
+        return __sync_fetch_and_add(p, 0);
+    }
+
+    static void c89thread_atomic_store_64(volatile c89thread_uint64* p, c89thread_uint64 value)
+    {
+        c89thread_uint64 oldValue;
+
+        do {
+            oldValue = *p;
+        } while (!__sync_bool_compare_and_swap(p, oldValue, value));
+    }
+#else
+    /*
+    Unknown compiler. Fall back to a global lock. This is slow, but it's correct and it keeps the
+    primitives building on compilers we don't know about.
+    */
+    #if defined(C89THREAD_ENABLE_SUBOPTIMAL_WARNINGS)
+        #warning Atomics are unavailable. Falling back to a suboptimal lock based implementation.
+    #endif
+
+    static pthread_mutex_t g_c89thread_AtomicLock = PTHREAD_MUTEX_INITIALIZER;
+
+    static c89thread_uint32 c89thread_atomic_load_32(volatile c89thread_uint32* p)
+    {
+        c89thread_uint32 value;
+
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        value = *p;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+
+        return value;
+    }
+
+    static void c89thread_atomic_store_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        *p = value;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_add_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        c89thread_uint32 oldValue;
+
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        oldValue = *p;
+        *p = oldValue + value;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+
+        return oldValue;
+    }
+
+    static c89thread_uint32 c89thread_atomic_fetch_sub_32(volatile c89thread_uint32* p, c89thread_uint32 value)
+    {
+        c89thread_uint32 oldValue;
+
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        oldValue = *p;
+        *p = oldValue - value;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+
+        return oldValue;
+    }
+
+    static c89thread_uint64 c89thread_atomic_load_64(volatile c89thread_uint64* p)
+    {
+        c89thread_uint64 value;
+
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        value = *p;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+
+        return value;
+    }
+
+    static void c89thread_atomic_store_64(volatile c89thread_uint64* p, c89thread_uint64 value)
+    {
+        pthread_mutex_lock(&g_c89thread_AtomicLock);
+        *p = value;
+        pthread_mutex_unlock(&g_c89thread_AtomicLock);
+    }
+#endif
+
+/* A hint to the CPU that we're in a spin loop. */
+static void c89thread_spin_pause(void)
+{
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+    {
+        __asm__ __volatile__ ("pause");
+    }
+    #elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || (defined(__ARM_ARCH) && __ARM_ARCH >= 7))
+    {
+        __asm__ __volatile__ ("yield");
+    }
+    #elif defined(C89THREAD_WIN32) && defined(YieldProcessor)
+    {
+        YieldProcessor();
+    }
+    #else
+    {
+        /* Don't know how to pause on this platform. Just do a normal spin. */
+    }
+    #endif
+}
+/* END c89thread_atomic.c */
+
+/* BEG c89thread_platform.c */
+/*
+Synchronization primitives whose public functions are wrapped by the profiler are implemented in the
+platform sections as static functions with a _win32 or _pthread suffix. This selects the right one.
+*/
+#if defined(C89THREAD_WIN32)
+    #define C89THREAD_PLATFORM(name) name##_win32
+#else
+    #define C89THREAD_PLATFORM(name) name##_pthread
+#endif
+/* END c89thread_platform.c */
+
+/* BEG c89thread_profile.c */
+#if defined(C89THREAD_PROFILE) || defined(C89THREAD_ENABLE_TRACE)
+/*
+A ticket lock for the profiler's and tracer's global state. It's never taken when recording, only when
+something is created or destroyed, on a thread's first event and when reporting. It can't be a c89mtx_t
+since that would be profiled and traced itself.
+*/
+static volatile c89thread_uint32 g_c89threadProfileTicket;
+static volatile c89thread_uint32 g_c89threadProfileServing;
+
+static void c89thread_profile_lock(void)
+{
+    c89thread_uint32 ticket;
+
+    ticket = c89thread_atomic_fetch_add_32(&g_c89threadProfileTicket, 1);
+    while (c89thread_atomic_load_32(&g_c89threadProfileServing) != ticket) {
+        c89thread_spin_pause();
+    }
+}
+
+static void c89thread_profile_unlock(void)
+{
+    c89thread_atomic_fetch_add_32(&g_c89threadProfileServing, 1);
+}
+#endif
+
+#if defined(C89THREAD_PROFILE)
+#include <string.h> /* For memset(), memmove() and strcmp(). */
+
+#define C89THREAD_WAIT_PROFILE_MAX_OBJECTS  16
+
+typedef struct
+{
+    const void* pObject;
+    char name[C89THREAD_WAIT_HISTOGRAM_MAX_NAME_LENGTH];
+} c89thread_profile_name;
+
+static c89thread_profile_name* g_pc89threadProfileNames;
+static size_t g_c89threadProfileNameCount;
+static size_t g_c89threadProfileNameCapacity;
+
+/* Must be called with the profile lock held. */
+static const char* c89thread_profile_find_name(const void* pObject)
+{
+    size_t i;
+
+    for (i = 0; i < g_c89threadProfileNameCount; i += 1) {
+        if (g_pc89threadProfileNames[i].pObject == pObject) {
+            return g_pc89threadProfileNames[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+int c89thread_profile_set_name(const void* pObject, const char* pName)
+{
+    size_t i;
+    int result = c89thrd_success;
+
+    if (pObject == NULL) {
+        return c89thrd_error;
+    }
+
+    c89thread_profile_lock();
+    {
+        for (i = 0; i < g_c89threadProfileNameCount; i += 1) {
+            if (g_pc89threadProfileNames[i].pObject == pObject) {
+                break;
+            }
+        }
+
+        if (pName == NULL) {
+            /* Removing. Order doesn't matter so move the last one into the gap. */
+            if (i < g_c89threadProfileNameCount) {
+                g_c89threadProfileNameCount -= 1;
+                g_pc89threadProfileNames[i] = g_pc89threadProfileNames[g_c89threadProfileNameCount];
+            }
+        } else {
+            if (i == g_c89threadProfileNameCount) {
+                if (g_c89threadProfileNameCount == g_c89threadProfileNameCapacity) {
+                    size_t newCapacity = (g_c89threadProfileNameCapacity == 0) ? 16 : g_c89threadProfileNameCapacity * 2;
+                    c89thread_profile_name* pNewNames = (c89thread_profile_name*)c89thread_realloc(g_pc89threadProfileNames, newCapacity * sizeof(*pNewNames), NULL);
+                    if (pNewNames == NULL) {
+                        result = c89thrd_nomem;
+                    } else {
+                        g_pc89threadProfileNames       = pNewNames;
+                        g_c89threadProfileNameCapacity = newCapacity;
+                    }
+                }
+
+                if (result == c89thrd_success) {
+                    g_pc89threadProfileNames[i].pObject = pObject;
+                    g_c89threadProfileNameCount += 1;
+                }
+            }
+
+            if (result == c89thrd_success) {
+                c89thread_copy_string(g_pc89threadProfileNames[i].name, sizeof(g_pc89threadProfileNames[i].name), pName);
+            }
+        }
+    }
+    c89thread_profile_unlock();
+
+    return result;
+}
+
+
+/*
+The wait histograms of a single thread. Only the owning thread adds to the buckets and the object list.
+Readers see an object once entryCount has been published. The extra row is the overflow histogram.
+
+Tables are never freed. When a thread exits its table is orphaned and adopted by the next thread that
+needs one, so the memory used is bounded by the largest number of threads that have waited at once.
+*/
+typedef struct c89thread_wait_profile c89thread_wait_profile;
+struct c89thread_wait_profile
+{
+    c89thread_wait_profile* pNext;
+    volatile c89thread_uint32 isOrphaned;
+    volatile c89thread_uint32 entryCount;
+    c89thread_uint32 compactedResetCount;  /* The value of g_c89threadWaitProfileResetCount when the table was last compacted. */
+    const void* pObjects[C89THREAD_WAIT_PROFILE_MAX_OBJECTS];
+    volatile c89thread_uint32 buckets[C89THREAD_WAIT_PROFILE_MAX_OBJECTS + 1][C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT];
+};
+
+static c89thread_wait_profile* g_pc89threadWaitProfileHead;
+static volatile c89thread_uint32 g_c89threadWaitProfileResetCount;
+static C89THREAD_THREAD_LOCAL c89thread_wait_profile* g_pc89threadWaitProfile = NULL;
+
+/*
+Removes objects with empty histograms so their entries can be reused. Must be called with the profile
+lock held, by the owning thread or on an orphaned table, so nothing else can be touching it.
+*/
+static void c89thread_wait_profile_compact(c89thread_wait_profile* pProfile)
+{
+    c89thread_uint32 entryCount;
+    c89thread_uint32 iEntry;
+    c89thread_uint32 iKept = 0;
+    size_t iBucket;
+    int isEmpty;
+
+    entryCount = pProfile->entryCount;
+
+    for (iEntry = 0; iEntry < entryCount; iEntry += 1) {
+        isEmpty = 1;
+        for (iBucket = 0; iBucket < C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT; iBucket += 1) {
+            if (pProfile->buckets[iEntry][iBucket] != 0) {
+                isEmpty = 0;
+                break;
+            }
+        }
+
+        if (isEmpty) {
+            continue;
+        }
+
+        if (iKept != iEntry) {
+            pProfile->pObjects[iKept] = pProfile->pObjects[iEntry];
+            for (iBucket = 0; iBucket < C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT; iBucket += 1) {
+                pProfile->buckets[iKept ][iBucket] = pProfile->buckets[iEntry][iBucket];
+                pProfile->buckets[iEntry][iBucket] = 0;
+            }
+        }
+
+        iKept += 1;
+    }
+
+    pProfile->compactedResetCount = c89thread_atomic_load_32(&g_c89threadWaitProfileResetCount);
+    c89thread_atomic_store_32(&pProfile->entryCount, iKept);
+}
+
+static c89thread_wait_profile* c89thread_wait_profile_acquire(void)
+{
+    c89thread_wait_profile* pProfile;
+
+    c89thread_profile_lock();
+    {
+        for (pProfile = g_pc89threadWaitProfileHead; pProfile != NULL; pProfile = pProfile->pNext) {
+            if (pProfile->isOrphaned) {
+                pProfile->isOrphaned = 0;
+                c89thread_wait_profile_compact(pProfile);
+                break;
+            }
+        }
+
+        if (pProfile == NULL) {
+            pProfile = (c89thread_wait_profile*)c89thread_malloc(sizeof(*pProfile), NULL);
+            if (pProfile != NULL) {
+                memset(pProfile, 0, sizeof(*pProfile));
+                pProfile->pNext = g_pc89threadWaitProfileHead;
+                g_pc89threadWaitProfileHead = pProfile;
+            }
+        }
+    }
+    c89thread_profile_unlock();
+
+    g_pc89threadWaitProfile = pProfile;
+    return pProfile;
+}
+
+/* Called when a thread exits. Its histograms stay where they are and are picked up by another thread. */
+static void c89thread_wait_profile_release(void)
+{
+    if (g_pc89threadWaitProfile != NULL) {
+        c89thread_atomic_store_32(&g_pc89threadWaitProfile->isOrphaned, 1);
+        g_pc89threadWaitProfile = NULL;
+    }
+}
+
+static size_t c89thread_wait_histogram_bucket_index(c89thread_uint64 nanoseconds)
+{
+    size_t log2 = 3;
+    size_t index;
+
+    if (nanoseconds < 8) {
+        return (size_t)nanoseconds;
+    }
+
+    while ((nanoseconds >> (log2 + 1)) != 0) {
+        log2 += 1;
+    }
+
+    /* Each power of two is split into 8 linear buckets using the 3 bits below the top one. */
+    index = (log2 - 2) * 8 + (size_t)((nanoseconds >> (log2 - 3)) & 7);
+    if (index >= C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT) {
+        index  = C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT - 1;
+    }
+
+    return index;
+}
+
+c89thread_uint64 c89thread_wait_histogram_bucket_bound(size_t index)
+{
+    if (index < 8) {
+        return (c89thread_uint64)index;
+    }
+
+    if (index >= C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT) {
+        return C89THREAD_UINT64_MAX;
+    }
+
+    return (c89thread_uint64)(8 + (index & 7)) << (index / 8 - 1);
+}
+
+/* Records a successful wait on `pObject` that started at `startTicks`. */
+static void c89thread_wait_histogram_record(const void* pObject, c89thread_uint64 startTicks)
+{
+    c89thread_wait_profile* pProfile;
+    c89thread_uint64 nanoseconds;
+    c89thread_uint32 entryCount;
+    c89thread_uint32 iEntry;
+
+    nanoseconds = c89thread_ticks_to_ns(c89thread_ticks() - startTicks);
+
+    pProfile = g_pc89threadWaitProfile;
+    if (pProfile == NULL) {
+        pProfile = c89thread_wait_profile_acquire();
+        if (pProfile == NULL) {
+            return;
+        }
+    }
+
+    entryCount = pProfile->entryCount;  /* Only this thread writes it. */
+    for (iEntry = 0; iEntry < entryCount; iEntry += 1) {
+        if (pProfile->pObjects[iEntry] == pObject) {
+            break;
+        }
+    }
+
+    /*
+    If the table is full try making room, but only if there's been a reset since last time. Otherwise
+    nothing could have been emptied and we'd be taking the lock for nothing.
+    */
+    if (iEntry == C89THREAD_WAIT_PROFILE_MAX_OBJECTS && pProfile->compactedResetCount != c89thread_atomic_load_32(&g_c89threadWaitProfileResetCount)) {
+        c89thread_profile_lock();
+        {
+            c89thread_wait_profile_compact(pProfile);
+        }
+        c89thread_profile_unlock();
+
+        entryCount = pProfile->entryCount;
+        iEntry     = entryCount;
+    }
+
+    if (iEntry == entryCount && entryCount < C89THREAD_WAIT_PROFILE_MAX_OBJECTS) {
+        pProfile->pObjects[iEntry] = pObject;
+        c89thread_atomic_store_32(&pProfile->entryCount, entryCount + 1);
+    }
+
+    c89thread_atomic_fetch_add_32(&pProfile->buckets[iEntry][c89thread_wait_histogram_bucket_index(nanoseconds)], 1);
+}
+
+/* Adds one row of a thread's buckets into a histogram, optionally taking them out of the thread's table. */
+static void c89thread_wait_histogram_merge(c89thread_wait_histogram* pHistogram, volatile c89thread_uint32* pBuckets, int reset)
+{
+    size_t iBucket;
+    c89thread_uint32 count;
+
+    for (iBucket = 0; iBucket < C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT; iBucket += 1) {
+        count = c89thread_atomic_load_32(&pBuckets[iBucket]);
+        if (count == 0) {
+            continue;
+        }
+
+        if (reset) {
+            c89thread_atomic_fetch_sub_32(&pBuckets[iBucket], count);
+        }
+
+        pHistogram->buckets[iBucket] += count;
+        pHistogram->count            += count;
+    }
+}
+
+size_t c89thread_wait_histogram_snapshot(c89thread_wait_histogram* pHistograms, size_t capacity, int reset)
+{
+    c89thread_wait_profile* pProfile;
+    c89thread_uint32 entryCount;
+    c89thread_uint32 iEntry;
+    size_t histogramCount = 0;
+    size_t iHistogram;
+    const void* pObject;
+    const char* pName;
+
+    if (pHistograms == NULL) {
+        return 0;
+    }
+
+    c89thread_profile_lock();
+    {
+        for (pProfile = g_pc89threadWaitProfileHead; pProfile != NULL; pProfile = pProfile->pNext) {
+            entryCount = c89thread_atomic_load_32(&pProfile->entryCount);
+
+            /* The last iteration is the overflow histogram which has no object. */
+            for (iEntry = 0; iEntry <= entryCount; iEntry += 1) {
+                if (iEntry < entryCount) {
+                    pObject = pProfile->pObjects[iEntry];
+                    pName   = c89thread_profile_find_name(pObject);
+                    if (pName != NULL) {
+                        pObject = NULL;
+                    }
+                } else {
+                    pObject = NULL;
+                    pName   = NULL;
+                }
+
+                for (iHistogram = 0; iHistogram < histogramCount; iHistogram += 1) {
+                    if (pName != NULL) {
+                        if (strcmp(pHistograms[iHistogram].name, pName) == 0) {
+                            break;
+                        }
+                    } else {
+                        if (pHistograms[iHistogram].name[0] == '\0' && pHistograms[iHistogram].pObject == pObject) {
+                            break;
+                        }
+                    }
+                }
+
+                if (iHistogram == histogramCount) {
+                    if (histogramCount == capacity) {
+                        continue;   /* No room. */
+                    }
+
+                    memset(&pHistograms[iHistogram], 0, sizeof(pHistograms[iHistogram]));
+                    pHistograms[iHistogram].pObject = pObject;
+                    if (pName != NULL) {
+                        c89thread_copy_string(pHistograms[iHistogram].name, sizeof(pHistograms[iHistogram].name), pName);
+                    }
+
+                    histogramCount += 1;
+                }
+
+                c89thread_wait_histogram_merge(&pHistograms[iHistogram], pProfile->buckets[(iEntry < entryCount) ? iEntry : C89THREAD_WAIT_PROFILE_MAX_OBJECTS], reset);
+            }
+        }
+
+        if (reset) {
+            c89thread_atomic_fetch_add_32(&g_c89threadWaitProfileResetCount, 1);
+        }
+    }
+    c89thread_profile_unlock();
+
+    /* The overflow histogram is only reported if something went into it. */
+    for (iHistogram = 0; iHistogram < histogramCount; iHistogram += 1) {
+        if (pHistograms[iHistogram].pObject == NULL && pHistograms[iHistogram].name[0] == '\0' && pHistograms[iHistogram].count == 0) {
+            histogramCount -= 1;
+            if (iHistogram < histogramCount) {
+                memmove(&pHistograms[iHistogram], &pHistograms[iHistogram + 1], (histogramCount - iHistogram) * sizeof(*pHistograms));
+            }
+            break;
+        }
+    }
+
+    return histogramCount;
+}
+
+c89thread_uint64 c89thread_wait_histogram_percentile(const c89thread_wait_histogram* pHistogram, double percentile)
+{
+    c89thread_uint64 target;
+    c89thread_uint64 runningCount = 0;
+    size_t iBucket;
+
+    if (pHistogram == NULL || pHistogram->count == 0) {
+        return 0;
+    }
+
+    if (percentile <= 0) {
+        target = 1;
+    } else if (percentile >= 100) {
+        target = pHistogram->count;
+    } else {
+        target = (c89thread_uint64)(((double)pHistogram->count * percentile) / 100.0);
+        if ((double)target < ((double)pHistogram->count * percentile) / 100.0) {
+            target += 1;    /* Round up. */
+        }
+
+        if (target == 0) {
+            target = 1;
+        }
+    }
+
+    for (iBucket = 0; iBucket < C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT; iBucket += 1) {
+        runningCount += pHistogram->buckets[iBucket];
+        if (runningCount >= target) {
+            break;
+        }
+    }
+
+    if (iBucket >= C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT - 1) {
+        return C89THREAD_UINT64_MAX;
+    }
+
+    return c89thread_wait_histogram_bucket_bound(iBucket + 1) - 1;
+}
+#endif  /* C89THREAD_PROFILE */
+/* END c89thread_profile.c */
+
+/* BEG c89thread_trace.c */
+#if defined(C89THREAD_ENABLE_TRACE)
+#if (C89THREAD_TRACE_BUFFER_SIZE & (C89THREAD_TRACE_BUFFER_SIZE - 1)) != 0
+#error C89THREAD_TRACE_BUFFER_SIZE must be a power of two.
+#endif
+
+#define C89THREAD_TRACE_MAX_HELD_MUTEXES    16
+
+/* Event kinds. The low byte holds the object type for waits and holds, or the C89THREAD_TRACE_TASK_* type for tasks. */
+#define C89THREAD_TRACE_EVENT_THREAD_START  (1 << 8)
+#define C89THREAD_TRACE_EVENT_THREAD_EXIT   (2 << 8)
+#define C89THREAD_TRACE_EVENT_WAIT          (3 << 8)
+#define C89THREAD_TRACE_EVENT_HOLD          (4 << 8)
+#define C89THREAD_TRACE_EVENT_TASK          (5 << 8)
+
+/*
+Every field is written and read atomically because the dump can read an event while its slot is being
+reused, or while the whole buffer is being handed to a new thread. Those events are detected with the
+write index and the buffer's generation and skipped.
+*/
+typedef struct
+{
+    volatile c89thread_uint64 startTicks;
+    volatile c89thread_uint64 endTicks;
+    volatile c89thread_uint64 object;
+    volatile c89thread_uint32 kind;
+} c89thread_trace_event;
+
+typedef struct c89thread_trace_buffer c89thread_trace_buffer;
+struct c89thread_trace_buffer
+{
+    c89thread_trace_buffer* pNext;
+    c89thread_uint32 threadID;              /* The tid in the trace. Buffers that are reused get a new one. */
+    c89thread_uint32 isOrphaned;            /* Set when the thread exits. Protected by the profile lock. */
+    c89thread_uint32 isDumped;              /* Set once an orphaned buffer has been written out. Protected by the profile lock. */
+    volatile c89thread_uint32 writeIndex;   /* Only increases until the buffer is reused. The slot is writeIndex modulo the buffer size. */
+    volatile c89thread_uint32 generation;   /* Incremented before the buffer is reused, which resets writeIndex. */
+    char threadName[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    c89thread_trace_event events[C89THREAD_TRACE_BUFFER_SIZE];
+};
+
+typedef struct
+{
+    const void* pMutex;
+    c89thread_uint64 acquiredTicks;
+} c89thread_trace_held_mutex;
+
+static c89thread_trace_buffer* g_pc89threadTraceBufferHead;
+static c89thread_uint32 g_c89threadTraceNextThreadID;   /* Protected by the profile lock. */
+
+static C89THREAD_THREAD_LOCAL c89thread_trace_buffer* g_pc89threadTraceBuffer = NULL;
+static C89THREAD_THREAD_LOCAL c89thread_uint64 g_c89threadTraceBlockStartTicks = 0;
+static C89THREAD_THREAD_LOCAL c89thread_trace_held_mutex g_c89threadTraceHeldMutexes[C89THREAD_TRACE_MAX_HELD_MUTEXES];
+static C89THREAD_THREAD_LOCAL c89thread_uint32 g_c89threadTraceHeldMutexCount = 0;
+
+static c89thread_trace_buffer* c89thread_trace_acquire_buffer(void)
+{
+    c89thread_trace_buffer* pBuffer;
+    char threadName[C89THREAD_MAX_THREAD_NAME_LENGTH];
+
+    /* The name is retrieved outside of the lock since it can call into the OS. */
+    if (c89thrd_get_name(c89thrd_current(), threadName, sizeof(threadName)) != c89thrd_success) {
+        threadName[0] = '\0';
+    }
+
+    c89thread_profile_lock();
+    {
+        for (pBuffer = g_pc89threadTraceBufferHead; pBuffer != NULL; pBuffer = pBuffer->pNext) {
+            if (pBuffer->isOrphaned && pBuffer->isDumped) {
+                break;
+            }
+        }
+
+        if (pBuffer == NULL) {
+            pBuffer = (c89thread_trace_buffer*)c89thread_malloc(sizeof(*pBuffer), NULL);
+            if (pBuffer != NULL) {
+                c89thread_atomic_store_32(&pBuffer->generation, 0);
+                pBuffer->pNext = g_pc89threadTraceBufferHead;
+                g_pc89threadTraceBufferHead = pBuffer;
+            }
+        }
+
+        if (pBuffer != NULL) {
+            g_c89threadTraceNextThreadID += 1;
+
+            pBuffer->threadID   = g_c89threadTraceNextThreadID;
+            pBuffer->isOrphaned = 0;
+            pBuffer->isDumped   = 0;
+
+            /* A dump that's still reading the previous thread's events must see the new generation before the write index goes backwards. */
+            c89thread_atomic_store_32(&pBuffer->generation, c89thread_atomic_load_32(&pBuffer->generation) + 1);
+            c89thread_atomic_store_32(&pBuffer->writeIndex, 0);
+            c89thread_copy_string(pBuffer->threadName, sizeof(pBuffer->threadName), threadName);
+        }
+    }
+    c89thread_profile_unlock();
+
+    g_pc89threadTraceBuffer = pBuffer;
+    return pBuffer;
+}
+
+static void c89thread_trace_write(c89thread_uint32 kind, c89thread_uint64 object, c89thread_uint64 startTicks, c89thread_uint64 endTicks)
+{
+    c89thread_trace_buffer* pBuffer;
+    c89thread_trace_event* pEvent;
+    c89thread_uint32 writeIndex;
+
+    pBuffer = g_pc89threadTraceBuffer;
+    if (pBuffer == NULL) {
+        pBuffer = c89thread_trace_acquire_buffer();
+        if (pBuffer == NULL) {
+            return;
+        }
+    }
+
+    writeIndex = pBuffer->writeIndex;   /* Only this thread writes it. */
+    pEvent = &pBuffer->events[writeIndex & (C89THREAD_TRACE_BUFFER_SIZE - 1)];
+
+    c89thread_atomic_store_64(&pEvent->startTicks, startTicks);
+    c89thread_atomic_store_64(&pEvent->endTicks,   endTicks);
+    c89thread_atomic_store_64(&pEvent->object,     object);
+    c89thread_atomic_store_32(&pEvent->kind,       kind);
+
+    c89thread_atomic_store_32(&pBuffer->writeIndex, writeIndex + 1);
+}
+
+static void c89thread_trace_before_block(void)
+{
+    g_c89threadTraceBlockStartTicks = c89thread_ticks();
+}
+
+static void c89thread_trace_after_block(int objectType, const void* pObject)
+{
+    c89thread_trace_write(C89THREAD_TRACE_EVENT_WAIT | (c89thread_uint32)objectType, (c89thread_uintptr)pObject, g_c89threadTraceBlockStartTicks, c89thread_ticks());
+}
+
+static void c89thread_trace_acquired(const void* pObject)
+{
+    if (g_c89threadTraceHeldMutexCount < C89THREAD_TRACE_MAX_HELD_MUTEXES) {
+        g_c89threadTraceHeldMutexes[g_c89threadTraceHeldMutexCount].pMutex        = pObject;
+        g_c89threadTraceHeldMutexes[g_c89threadTraceHeldMutexCount].acquiredTicks = c89thread_ticks();
+        g_c89threadTraceHeldMutexCount += 1;
+    }
+}
+
+static void c89thread_trace_released(const void* pObject)
+{
+    c89thread_uint32 iHeld;
+
+    /* Mutexes are usually released in reverse order so search from the end. Recursive locks pair up innermost first. */
+    for (iHeld = g_c89threadTraceHeldMutexCount; iHeld > 0; iHeld -= 1) {
+        if (g_c89threadTraceHeldMutexes[iHeld - 1].pMutex == pObject) {
+            c89thread_trace_write(C89THREAD_TRACE_EVENT_HOLD | c89thread_object_mtx, (c89thread_uintptr)pObject, g_c89threadTraceHeldMutexes[iHeld - 1].acquiredTicks, c89thread_ticks());
+
+            for (; iHeld < g_c89threadTraceHeldMutexCount; iHeld += 1) {
+                g_c89threadTraceHeldMutexes[iHeld - 1] = g_c89threadTraceHeldMutexes[iHeld];
+            }
+
+            g_c89threadTraceHeldMutexCount -= 1;
+            break;
+        }
+    }
+}
+
+static void c89thread_trace_thread_created(void)
+{
+    c89thread_uint64 now = c89thread_ticks();
+    c89thread_trace_write(C89THREAD_TRACE_EVENT_THREAD_START, 0, now, now);
+}
+
+static void c89thread_trace_thread_exited(void)
+{
+    c89thread_uint64 now = c89thread_ticks();
+
+    c89thread_trace_write(C89THREAD_TRACE_EVENT_THREAD_EXIT, 0, now, now);
+
+    /* The buffer is kept until it's been written out. Anything still held was leaked by the thread. */
+    if (g_pc89threadTraceBuffer != NULL) {
+        c89thread_profile_lock();
+        {
+            g_pc89threadTraceBuffer->isOrphaned = 1;
+        }
+        c89thread_profile_unlock();
+
+        g_pc89threadTraceBuffer = NULL;
+    }
+
+    g_c89threadTraceHeldMutexCount = 0;
+}
+
+/* Records a function run on behalf of the user, like a timer callback. The address of the function is recorded so it can be symbolized. */
+static void c89thread_trace_task(c89thread_uint32 taskType, c89thread_uint64 function, c89thread_uint64 startTicks)
+{
+    c89thread_trace_write(C89THREAD_TRACE_EVENT_TASK | taskType, function, startTicks, c89thread_ticks());
+}
+
+static const char* c89thread_trace_object_type_name(c89thread_uint32 objectType)
+{
+    switch (objectType)
+    {
+        case c89thread_object_mtx:     return "mutex";
+        case c89thread_object_cnd:     return "condition variable";
+        case c89thread_object_sem:     return "semaphore";
+        case c89thread_object_evnt:    return "event";
+        case c89thread_object_barrier: return "barrier";
+        case c89thread_object_latch:   return "latch";
+        default:                       return "unknown";
+    }
+}
+
+static double c89thread_trace_microseconds(c89thread_uint64 ticks, c89thread_uint64 baseTicks)
+{
+    return (double)c89thread_ticks_to_ns(ticks - baseTicks) / 1000.0;
+}
+
+/* Thread names come from the user so they need escaping. Anything unusual is dropped. */
+static int c89thread_trace_write_json_string(FILE* pFile, const char* pString)
+{
+    if (fputc('"', pFile) == EOF) {
+        return c89thrd_error;
+    }
+
+    for (; *pString != '\0'; pString += 1) {
+        if (*pString == '"' || *pString == '\\') {
+            if (fputc('\\', pFile) == EOF) {
+                return c89thrd_error;
+            }
+        } else if ((unsigned char)*pString < 0x20) {
+            continue;
+        }
+
+        if (fputc(*pString, pFile) == EOF) {
+            return c89thrd_error;
+        }
+    }
+
+    if (fputc('"', pFile) == EOF) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+typedef struct
+{
+    c89thread_trace_buffer* pBuffer;
+    c89thread_uint32 generation;
+    c89thread_uint32 threadID;
+    c89thread_uint32 isOrphaned;
+    char threadName[C89THREAD_MAX_THREAD_NAME_LENGTH];
+} c89thread_trace_dump_thread;
+
+/*
+Reads an event from a buffer. Returns 0 if it's been overwritten or is being overwritten, or if the
+buffer has been given to another thread since `generation` was taken.
+*/
+static int c89thread_trace_read_event(c89thread_trace_buffer* pBuffer, c89thread_uint32 generation, c89thread_uint32 index, c89thread_uint64* pStartTicks, c89thread_uint64* pEndTicks, c89thread_uint64* pObject, c89thread_uint32* pKind)
+{
+    c89thread_trace_event* pEvent = &pBuffer->events[index & (C89THREAD_TRACE_BUFFER_SIZE - 1)];
+
+    *pStartTicks = c89thread_atomic_load_64(&pEvent->startTicks);
+    *pEndTicks   = c89thread_atomic_load_64(&pEvent->endTicks);
+    *pObject     = c89thread_atomic_load_64(&pEvent->object);
+    *pKind       = c89thread_atomic_load_32(&pEvent->kind);
+
+    /*
+    Reusing the buffer resets the write index, which on its own would make the new thread's events
+    look like ours. The generation is checked first since it's changed before the index is reset.
+    */
+    if (c89thread_atomic_load_32(&pBuffer->generation) != generation) {
+        return 0;
+    }
+
+    /* The slot is reused when event index + size is written. If that's started the event may be torn. */
+    return (c89thread_atomic_load_32(&pBuffer->writeIndex) - index) < C89THREAD_TRACE_BUFFER_SIZE;
+}
+
+static void c89thread_trace_event_range(c89thread_trace_buffer* pBuffer, c89thread_uint32* pFirst, c89thread_uint32* pEnd)
+{
+    *pEnd = c89thread_atomic_load_32(&pBuffer->writeIndex);
+
+    if (*pEnd > C89THREAD_TRACE_BUFFER_SIZE) {
+        *pFirst = *pEnd - C89THREAD_TRACE_BUFFER_SIZE;
+    } else {
+        *pFirst = 0;
+    }
+}
+
+int c89thread_trace_dump(FILE* pFile)
+{
+    c89thread_trace_buffer* pBuffer;
+    c89thread_trace_dump_thread* pThreads;
+    size_t threadCount = 0;
+    size_t iThread;
+    c89thread_uint32 iEvent;
+    c89thread_uint32 firstEvent;
+    c89thread_uint32 endEvent;
+    c89thread_uint64 baseTicks = C89THREAD_UINT64_MAX;
+    c89thread_uint64 startTicks;
+    c89thread_uint64 endTicks;
+    c89thread_uint64 object;
+    c89thread_uint32 kind;
+    const char* pSeparator = "";
+    int result = c89thrd_success;
+
+    if (pFile == NULL) {
+        return c89thrd_error;
+    }
+
+    /*
+    Only the list is read under the lock. Buffers are never freed so it's safe to read them after.
+    The buffer of an exited thread can be given to a new thread while we're reading it if another dump
+    has marked it as dumped. The generation taken here is how we tell that's happened.
+    */
+    c89thread_profile_lock();
+    {
+        for (pBuffer = g_pc89threadTraceBufferHead; pBuffer != NULL; pBuffer = pBuffer->pNext) {
+            threadCount += 1;
+        }
+
+        pThreads = (c89thread_trace_dump_thread*)c89thread_malloc(sizeof(*pThreads) * (threadCount + 1), NULL);
+        if (pThreads != NULL) {
+            threadCount = 0;
+            for (pBuffer = g_pc89threadTraceBufferHead; pBuffer != NULL; pBuffer = pBuffer->pNext) {
+                pThreads[threadCount].pBuffer    = pBuffer;
+                pThreads[threadCount].generation = c89thread_atomic_load_32(&pBuffer->generation);
+                pThreads[threadCount].threadID   = pBuffer->threadID;
+                pThreads[threadCount].isOrphaned = pBuffer->isOrphaned;
+                c89thread_copy_string(pThreads[threadCount].threadName, sizeof(pThreads[threadCount].threadName), pBuffer->threadName);
+                threadCount += 1;
+            }
+        }
+    }
+    c89thread_profile_unlock();
+
+    if (pThreads == NULL) {
+        return c89thrd_nomem;
+    }
+
+    /* Timestamps are relative to the earliest event. */
+    for (iThread = 0; iThread < threadCount; iThread += 1) {
+        c89thread_trace_event_range(pThreads[iThread].pBuffer, &firstEvent, &endEvent);
+
+        for (iEvent = firstEvent; iEvent != endEvent; iEvent += 1) {
+            if (c89thread_trace_read_event(pThreads[iThread].pBuffer, pThreads[iThread].generation, iEvent, &startTicks, &endTicks, &object, &kind) && startTicks < baseTicks) {
+                baseTicks = startTicks;
+            }
+        }
+    }
+
+    if (fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") < 0) {
+        result = c89thrd_error;
+    }
+
+    for (iThread = 0; iThread < threadCount && result == c89thrd_success; iThread += 1) {
+        if (pThreads[iThread].threadName[0] != '\0') {
+            if (fprintf(pFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", pSeparator, (unsigned int)pThreads[iThread].threadID) < 0 ||
+                c89thread_trace_write_json_string(pFile, pThreads[iThread].threadName) != c89thrd_success ||
+                fprintf(pFile, "}}") < 0) {
+                result = c89thrd_error;
+                break;
+            }
+
+            pSeparator = ",";
+        }
+
+        c89thread_trace_event_range(pThreads[iThread].pBuffer, &firstEvent, &endEvent);
+
+        for (iEvent = firstEvent; iEvent != endEvent; iEvent += 1) {
+            int written = 0;
+
+            if (!c89thread_trace_read_event(pThreads[iThread].pBuffer, pThreads[iThread].generation, iEvent, &startTicks, &endTicks, &object, &kind) || startTicks < baseTicks || endTicks < startTicks) {
+                continue;
+            }
+
+            switch (kind & ~(c89thread_uint32)0xFF)
+            {
+                case C89THREAD_TRACE_EVENT_THREAD_START:
+                case C89THREAD_TRACE_EVENT_THREAD_EXIT:
+                {
+                    written = fprintf(pFile, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                        pSeparator,
+                        ((kind & ~(c89thread_uint32)0xFF) == C89THREAD_TRACE_EVENT_THREAD_START) ? "thread start" : "thread exit",
+                        (unsigned int)pThreads[iThread].threadID,
+                        c89thread_trace_microseconds(startTicks, baseTicks));
+                } break;
+
+                case C89THREAD_TRACE_EVENT_WAIT:
+                case C89THREAD_TRACE_EVENT_HOLD:
+                {
+                    written = fprintf(pFile, "%s\n{\"name\":\"%s %s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"object\":\"%p\"}}",
+                        pSeparator,
+                        c89thread_trace_object_type_name(kind & 0xFF),
+                        ((kind & ~(c89thread_uint32)0xFF) == C89THREAD_TRACE_EVENT_WAIT) ? "wait" : "hold",
+                        c89thread_trace_object_type_name(kind & 0xFF),
+                        (unsigned int)pThreads[iThread].threadID,
+                        c89thread_trace_microseconds(startTicks, baseTicks),
+                        c89thread_trace_microseconds(endTicks, startTicks),
+                        (void*)(c89thread_uintptr)object);
+                } break;
+
+                case C89THREAD_TRACE_EVENT_TASK:
+                {
+                    written = fprintf(pFile, "%s\n{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"function\":\"%p\"}}",
+                        pSeparator,
+                        ((kind & 0xFF) == C89THREAD_TRACE_TASK_TIMER) ? "timer callback" : "cached thread task",
+                        (unsigned int)pThreads[iThread].threadID,
+                        c89thread_trace_microseconds(startTicks, baseTicks),
+                        c89thread_trace_microseconds(endTicks, startTicks),
+                        (void*)(c89thread_uintptr)object);
+                } break;
+
+                default: continue;
+            }
+
+            if (written < 0) {
+                result = c89thrd_error;
+                break;
+            }
+
+            pSeparator = ",";
+        }
+    }
+
+    if (result == c89thrd_success && fprintf(pFile, "\n]}\n") < 0) {
+        result = c89thrd_error;
+    }
+
+    /* Buffers of threads that had already exited can now be reused. */
+    if (result == c89thrd_success) {
+        c89thread_profile_lock();
+        {
+            for (iThread = 0; iThread < threadCount; iThread += 1) {
+                if (pThreads[iThread].isOrphaned && c89thread_atomic_load_32(&pThreads[iThread].pBuffer->generation) == pThreads[iThread].generation) {
+                    pThreads[iThread].pBuffer->isDumped = 1;
+                }
+            }
+        }
+        c89thread_profile_unlock();
+    }
+
+    c89thread_free(pThreads, NULL);
+
+    return result;
+}
+#endif  /* C89THREAD_ENABLE_TRACE */
+/* END c89thread_trace.c */
+
+/* BEG c89mtx.c */
+/*
+The platform sections implement the mutex itself. The public functions live here so the profiler and
+hooks can wrap all of them in one place. Without either they forward straight to the platform.
+*/
+#if defined(C89THREAD_PROFILE)
+#include <stdlib.h> /* For qsort(). */
+
+/* The list of live mutexes. It's protected by the profile lock. */
+static c89mtx_profile* g_pc89mtxProfileListHead;
+
+static void c89mtx_profile_register(c89mtx_t* mutex, const char* pFile, int line)
+{
+    c89mtx_profile* pProfile = &mutex->profile;
+
+    memset(pProfile, 0, sizeof(*pProfile));
+    pProfile->pFile = pFile;
+    pProfile->line  = line;
+
+    c89thread_profile_lock();
+    {
+        pProfile->pNext = g_pc89mtxProfileListHead;
+        if (pProfile->pNext != NULL) {
+            pProfile->pNext->pPrev = pProfile;
+        }
+
+        g_pc89mtxProfileListHead = pProfile;
+    }
+    c89thread_profile_unlock();
+}
+
+static void c89mtx_profile_unregister(c89mtx_t* mutex)
+{
+    c89mtx_profile* pProfile = &mutex->profile;
+
+    c89thread_profile_lock();
+    {
+        if (pProfile->pPrev != NULL) {
+            pProfile->pPrev->pNext = pProfile->pNext;
+        } else {
+            g_pc89mtxProfileListHead = pProfile->pNext;
+        }
+
+        if (pProfile->pNext != NULL) {
+            pProfile->pNext->pPrev = pProfile->pPrev;
+        }
+    }
+    c89thread_profile_unlock();
+}
+
+/* Must be called while holding the mutex. The statistics are protected by the mutex itself. */
+static void c89mtx_profile_acquired(c89mtx_t* mutex, c89thread_uint64 waitStartTicks, int isContended)
+{
+    c89mtx_profile* pProfile = &mutex->profile;
+    c89thread_uint64 nowTicks;
+    c89thread_uint64 waitTicks;
+
+    pProfile->lockDepth += 1;
+
+    /* Relocking a recursive mutex we already own isn't a new acquisition. */
+    if (pProfile->lockDepth > 1) {
+        return;
+    }
+
+    nowTicks = c89thread_ticks();
+
+    pProfile->acquisitionCount += 1;
+    pProfile->acquireTicks      = nowTicks;
+
+    if (isContended) {
+        waitTicks = nowTicks - waitStartTicks;
+
+        pProfile->contendedCount += 1;
+        pProfile->totalWaitTicks += waitTicks;
+        if (pProfile->maxWaitTicks < waitTicks) {
+            pProfile->maxWaitTicks = waitTicks;
+        }
+    }
+}
+
+/* Must be called before unlocking. */
+static void c89mtx_profile_released(c89mtx_t* mutex)
+{
+    c89mtx_profile* pProfile = &mutex->profile;
+    c89thread_uint64 holdTicks;
+
+    /* Unlocking a mutex that isn't locked is an error that the platform will report. */
+    if (pProfile->lockDepth == 0) {
+        return;
+    }
+
+    pProfile->lockDepth -= 1;
+
+    if (pProfile->lockDepth == 0) {
+        holdTicks = c89thread_ticks() - pProfile->acquireTicks;
+
+        pProfile->totalHoldTicks += holdTicks;
+        if (pProfile->maxHoldTicks < holdTicks) {
+            pProfile->maxHoldTicks = holdTicks;
+        }
+    }
+}
+
+/* Called around condition variable waits which release the mutex, including any recursion, and take it back. */
+static unsigned int c89mtx_profile_suspend(c89mtx_t* mutex)
+{
+    unsigned int lockDepth;
+
+    lockDepth = mutex->profile.lockDepth;
+    if (lockDepth > 0) {
+        mutex->profile.lockDepth = 1;
+        c89mtx_profile_released(mutex);
+    }
+
+    return lockDepth;
+}
+
+static void c89mtx_profile_resume(c89mtx_t* mutex, unsigned int lockDepth)
+{
+    if (lockDepth > 0) {
+        c89mtx_profile_acquired(mutex, 0, 0);
+        mutex->profile.lockDepth = lockDepth;
+    }
+}
+
+int c89mtx_get_profile_stats(const c89mtx_t* mutex, c89mtx_profile_stats* pStats)
+{
+    if (pStats == NULL) {
+        return c89thrd_error;
+    }
+
+    memset(pStats, 0, sizeof(*pStats));
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    pStats->pFile                = mutex->profile.pFile;
+    pStats->line                 = mutex->profile.line;
+    pStats->acquisitionCount     = mutex->profile.acquisitionCount;
+    pStats->contendedCount       = mutex->profile.contendedCount;
+    pStats->totalWaitNanoseconds = c89thread_ticks_to_ns(mutex->profile.totalWaitTicks);
+    pStats->maxWaitNanoseconds   = c89thread_ticks_to_ns(mutex->profile.maxWaitTicks);
+    pStats->totalHoldNanoseconds = c89thread_ticks_to_ns(mutex->profile.totalHoldTicks);
+    pStats->maxHoldNanoseconds   = c89thread_ticks_to_ns(mutex->profile.maxHoldTicks);
+
+    return c89thrd_success;
+}
+
+static int c89mtx_profile_stats_compare(const void* pA, const void* pB)
+{
+    const c89mtx_profile_stats* pStatsA = (const c89mtx_profile_stats*)pA;
+    const c89mtx_profile_stats* pStatsB = (const c89mtx_profile_stats*)pB;
+
+    /* Most contended first. */
+    if (pStatsA->totalWaitNanoseconds > pStatsB->totalWaitNanoseconds) {
+        return -1;
+    }
+    if (pStatsA->totalWaitNanoseconds < pStatsB->totalWaitNanoseconds) {
+        return 1;
+    }
+
+    if (pStatsA->contendedCount > pStatsB->contendedCount) {
+        return -1;
+    }
+    if (pStatsA->contendedCount < pStatsB->contendedCount) {
+        return 1;
+    }
+
+    return 0;
+}
+
+#define C89THREAD_PROFILE_MAX_FILE_NAME_LENGTH  28  /* Longer file names are trimmed in the report. */
+
+void c89thread_profile_dump(FILE* pFile)
+{
+    c89mtx_profile_stats* pStats;
+    c89mtx_profile* pProfile;
+    size_t count;
+    size_t i;
+
+    if (pFile == NULL) {
+        pFile = stderr;
+    }
+
+    /* Snapshot everything while holding the list lock so no mutex can be destroyed while we're reading it. */
+    pStats = NULL;
+    count  = 0;
+
+    c89thread_profile_lock();
+    {
+        for (pProfile = g_pc89mtxProfileListHead; pProfile != NULL; pProfile = pProfile->pNext) {
+            count += 1;
+        }
+
+        if (count > 0) {
+            pStats = (c89mtx_profile_stats*)c89thread_malloc(sizeof(*pStats) * count, NULL);
+        }
+
+        if (pStats != NULL) {
+            for (pProfile = g_pc89mtxProfileListHead, i = 0; pProfile != NULL; pProfile = pProfile->pNext, i += 1) {
+                pStats[i].pFile                = pProfile->pFile;
+                pStats[i].line                 = pProfile->line;
+                pStats[i].acquisitionCount     = pProfile->acquisitionCount;
+                pStats[i].contendedCount       = pProfile->contendedCount;
+                pStats[i].totalWaitNanoseconds = c89thread_ticks_to_ns(pProfile->totalWaitTicks);
+                pStats[i].maxWaitNanoseconds   = c89thread_ticks_to_ns(pProfile->maxWaitTicks);
+                pStats[i].totalHoldNanoseconds = c89thread_ticks_to_ns(pProfile->totalHoldTicks);
+                pStats[i].maxHoldNanoseconds   = c89thread_ticks_to_ns(pProfile->maxHoldTicks);
+            }
+        }
+    }
+    c89thread_profile_unlock();
+
+    if (count > 0 && pStats == NULL) {
+        fprintf(pFile, "c89thread: Out of memory generating the lock profile.\n");
+        return;
+    }
+
+    if (count > 0) {
+        qsort(pStats, count, sizeof(*pStats), c89mtx_profile_stats_compare);
+    }
+
+    fprintf(pFile, "%-40s %12s %12s %8s %14s %12s %14s %12s\n", "mutex", "acquired", "contended", "%", "wait total ms", "wait max us", "hold total ms", "hold max us");
+
+    for (i = 0; i < count; i += 1) {
+        char location[C89THREAD_PROFILE_MAX_FILE_NAME_LENGTH + sizeof(":-2147483648")];
+        const char* pFileName;
+
+        pFileName = (pStats[i].pFile != NULL) ? pStats[i].pFile : "(untagged)";
+
+        /* Long paths are trimmed from the front since the end is the interesting part. */
+        {
+            size_t fileNameLength = strlen(pFileName);
+            if (fileNameLength > C89THREAD_PROFILE_MAX_FILE_NAME_LENGTH) {
+                pFileName += fileNameLength - C89THREAD_PROFILE_MAX_FILE_NAME_LENGTH;
+            }
+        }
+
+        sprintf(location, "%s:%d", pFileName, pStats[i].line);
+
+        fprintf(pFile, "%-40s %12.0f %12.0f %8.2f %14.3f %12.3f %14.3f %12.3f\n",
+            location,
+            (double)pStats[i].acquisitionCount,
+            (double)pStats[i].contendedCount,
+            (pStats[i].acquisitionCount > 0) ? ((double)pStats[i].contendedCount * 100.0 / (double)pStats[i].acquisitionCount) : 0.0,
+            (double)pStats[i].totalWaitNanoseconds / 1000000.0,
+            (double)pStats[i].maxWaitNanoseconds   / 1000.0,
+            (double)pStats[i].totalHoldNanoseconds / 1000000.0,
+            (double)pStats[i].maxHoldNanoseconds   / 1000.0);
+    }
+
+    c89thread_free(pStats, NULL);
+}
+#endif  /* C89THREAD_PROFILE */
+
+#if defined(C89THREAD_PROFILE)
+int c89mtx_init_tagged(c89mtx_t* mutex, int type, const char* pFile, int line)
+{
+    int result;
+
+    result = C89THREAD_PLATFORM(c89mtx_init)(mutex, type);
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    c89mtx_profile_register(mutex, pFile, line);
+
+    return c89thrd_success;
+}
+#endif
+
+#if defined(C89THREAD_PROFILE) || defined(C89THREAD_HAS_INSTRUMENTATION)
+static void c89mtx_on_acquired(c89mtx_t* mutex, c89thread_uint64 waitStartTicks, int isContended)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        c89mtx_profile_acquired(mutex, waitStartTicks, isContended);
+    }
+    #else
+    {
+        (void)waitStartTicks;
+        (void)isContended;
+    }
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_acquired(c89thread_object_mtx, mutex);
+    }
+    #endif
+}
+
+/*
+Used instead of locking directly when profiling or hooks are enabled. A trylock first tells us whether
+we have to wait. The wait is timed from when that fails.
+*/
+static int c89mtx_lock_instrumented(c89mtx_t* mutex, const struct timespec* time_point, int isMonotonic, const struct timespec* duration, int isTimed)
+{
+    c89thread_uint64 waitStartTicks = 0;
+    int result;
+
+    if (mutex == NULL) {
+        return c89thrd_error;
+    }
+
+    result = C89THREAD_PLATFORM(c89mtx_trylock)(mutex);
+    if (result == c89thrd_success) {
+        c89mtx_on_acquired(mutex, 0, 0);
+        return c89thrd_success;
+    }
+
+    if (result != c89thrd_busy) {
+        return result;
+    }
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        waitStartTicks = c89thread_ticks();
+    }
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_before_block(c89thread_object_mtx, mutex);
+    }
+    #endif
+
+    if (isTimed) {
+        result = C89THREAD_PLATFORM(c89mtx_timedlock)(mutex, time_point, isMonotonic, duration);
+    } else {
+        result = C89THREAD_PLATFORM(c89mtx_lock)(mutex);
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_after_block(c89thread_object_mtx, mutex, result);
+    }
+    #endif
+
+    if (result == c89thrd_success) {
+        c89mtx_on_acquired(mutex, waitStartTicks, 1);
+    }
+
+    return result;
+}
+#endif
+
+/* The name is in parentheses so it isn't expanded by the c89mtx_init() macro used when profiling. */
+int (c89mtx_init)(c89mtx_t* mutex, int type)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        return c89mtx_init_tagged(mutex, type, NULL, 0);
+    }
+    #else
+    {
+        return C89THREAD_PLATFORM(c89mtx_init)(mutex, type);
+    }
+    #endif
+}
+
+void c89mtx_destroy(c89mtx_t* mutex)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        if (mutex != NULL) {
+            c89mtx_profile_unregister(mutex);
+        }
+    }
+    #endif
+
+    C89THREAD_PLATFORM(c89mtx_destroy)(mutex);
+}
+
+int c89mtx_lock(c89mtx_t* mutex)
+{
+    #if defined(C89THREAD_PROFILE) || defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        return c89mtx_lock_instrumented(mutex, NULL, 0, NULL, 0);
+    }
+    #else
+    {
+        return C89THREAD_PLATFORM(c89mtx_lock)(mutex);
+    }
+    #endif
+}
+
+static int c89mtx_timedlock_ex(c89mtx_t* mutex, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    #if defined(C89THREAD_PROFILE) || defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        if (time_point == NULL && duration == NULL) {
+            return c89thrd_error;
+        }
+
+        return c89mtx_lock_instrumented(mutex, time_point, isMonotonic, duration, 1);
+    }
+    #else
+    {
+        return C89THREAD_PLATFORM(c89mtx_timedlock)(mutex, time_point, isMonotonic, duration);
+    }
+    #endif
+}
+
+int c89mtx_timedlock(c89mtx_t* mutex, const struct timespec* time_point)
+{
+    return c89mtx_timedlock_ex(mutex, time_point, 0, NULL);
+}
+
+int c89mtx_timedlock_monotonic(c89mtx_t* mutex, const struct timespec* time_point)
+{
+    return c89mtx_timedlock_ex(mutex, time_point, 1, NULL);
+}
+
+int c89mtx_timedlock_for(c89mtx_t* mutex, const struct timespec* duration)
+{
+    if (duration == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89mtx_timedlock_ex(mutex, NULL, 0, duration);
+}
+
+int c89mtx_trylock(c89mtx_t* mutex)
+{
+    int result;
+
+    result = C89THREAD_PLATFORM(c89mtx_trylock)(mutex);
+
+    #if defined(C89THREAD_PROFILE) || defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        if (result == c89thrd_success) {
+            c89mtx_on_acquired(mutex, 0, 0);
+        }
+    }
+    #endif
+
+    return result;
+}
+
+int c89mtx_unlock(c89mtx_t* mutex)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        if (mutex != NULL) {
+            c89mtx_profile_released(mutex);
+        }
+    }
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        if (mutex != NULL) {
+            c89thread_hook_released(c89thread_object_mtx, mutex);
+        }
+    }
+    #endif
+
+    return C89THREAD_PLATFORM(c89mtx_unlock)(mutex);
+}
+/* END c89mtx.c */
+
+/* BEG c89sem.c */
+/* Waiting is implemented by the platform sections. The public functions live here so waits can be profiled and hooked. */
+/* Waits forever when both `time_point` and `duration` are NULL. */
+static int c89sem_wait_ex(c89sem_t* sem, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    int result;
+    #if defined(C89THREAD_PROFILE)
+    c89thread_uint64 startTicks = c89thread_ticks();
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_before_block(c89thread_object_sem, sem);
+    }
+    #endif
+
+    if (time_point == NULL && duration == NULL) {
+        result = C89THREAD_PLATFORM(c89sem_wait)(sem);
+    } else {
+        result = C89THREAD_PLATFORM(c89sem_timedwait)(sem, time_point, isMonotonic, duration);
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_after_block(c89thread_object_sem, sem, result);
+    }
+    #endif
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        if (result == c89thrd_success) {
+            c89thread_wait_histogram_record(sem, startTicks);
+        }
+    }
+    #endif
+
+    return result;
+}
+
+int c89sem_wait(c89sem_t* sem)
+{
+    return c89sem_wait_ex(sem, NULL, 0, NULL);
+}
+
+int c89sem_timedwait(c89sem_t* sem, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89sem_wait_ex(sem, time_point, 0, NULL);
+}
+
+int c89sem_timedwait_monotonic(c89sem_t* sem, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89sem_wait_ex(sem, time_point, 1, NULL);
+}
+
+int c89sem_timedwait_for(c89sem_t* sem, const struct timespec* duration)
+{
+    if (duration == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89sem_wait_ex(sem, NULL, 0, duration);
+}
+/* END c89sem.c */
+
+
+/* BEG c89evnt.c */
+/* Waits forever when both `time_point` and `duration` are NULL. */
+static int c89evnt_wait_ex(c89evnt_t* evnt, const struct timespec* time_point, int isMonotonic, const struct timespec* duration)
+{
+    int result;
+    #if defined(C89THREAD_PROFILE)
+    c89thread_uint64 startTicks = c89thread_ticks();
+    #endif
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_before_block(c89thread_object_evnt, evnt);
+    }
+    #endif
+
+    if (time_point == NULL && duration == NULL) {
+        result = C89THREAD_PLATFORM(c89evnt_wait)(evnt);
+    } else {
+        result = C89THREAD_PLATFORM(c89evnt_timedwait)(evnt, time_point, isMonotonic, duration);
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        c89thread_hook_after_block(c89thread_object_evnt, evnt, result);
+    }
+    #endif
+
+    #if defined(C89THREAD_PROFILE)
+    {
+        if (result == c89thrd_success) {
+            c89thread_wait_histogram_record(evnt, startTicks);
+        }
+    }
+    #endif
+
+    return result;
+}
+
+int c89evnt_wait(c89evnt_t* evnt)
+{
+    return c89evnt_wait_ex(evnt, NULL, 0, NULL);
+}
+
+int c89evnt_timedwait(c89evnt_t* evnt, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89evnt_wait_ex(evnt, time_point, 0, NULL);
+}
+
+int c89evnt_timedwait_monotonic(c89evnt_t* evnt, const struct timespec* time_point)
+{
+    if (time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89evnt_wait_ex(evnt, time_point, 1, NULL);
+}
+
+int c89evnt_timedwait_for(c89evnt_t* evnt, const struct timespec* duration)
+{
+    if (duration == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89evnt_wait_ex(evnt, NULL, 0, duration);
+}
+/* END c89evnt.c */
+
+
+/* BEG c89thread_barrier.c */
+/* The number of times a thread will check if the phase has been released before going to sleep. */
+#ifndef C89THREAD_BARRIER_SPIN_COUNT
+#define C89THREAD_BARRIER_SPIN_COUNT        4000
+#endif
+
+/* Barriers with more threads than this will use the tree barrier when initialized with c89barrier_init(). */
+#ifndef C89THREAD_BARRIER_TREE_THRESHOLD
+#define C89THREAD_BARRIER_TREE_THRESHOLD    32
+#endif
+
+/* The default number of arrivals per node for the tree barrier. */
+#ifndef C89THREAD_BARRIER_TREE_FAN_IN
+#define C89THREAD_BARRIER_TREE_FAN_IN       4
+#endif
+
+#define C89THREAD_BARRIER_NO_PARENT         0xFFFFFFFF
+
+/* Each node of the tree barrier lives on its own cache line. Leaves come first, and the root is last. */
+typedef struct
+{
+    volatile c89thread_uint32 counter;      /* The number of threads that have arrived at this node in the current phase. Can exceed capacity, see c89barrier_arrive_tree(). */
+    c89thread_uint32 capacity;
+    c89thread_uint32 parent;
+    char padding[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint32)*3];
+} c89barrier_node;
+
+/*
+The leaf a thread took a slot in the last time it arrived at a tree barrier. Keeping this sticky
+means threads settle into their own leaf after the first phase and stop probing.
+*/
+static C89THREAD_THREAD_LOCAL c89thread_uint32 g_c89barrierLeafHint;
+
+#if defined(C89THREAD_WIN32)
+static int c89barrier_init_parking(c89barrier_t* barrier)
+{
+    barrier->events[0] = (c89thread_handle)CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (barrier->events[0] == NULL) {
+        return c89thrd_result_from_GetLastError();
+    }
+
+    barrier->events[1] = (c89thread_handle)CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (barrier->events[1] == NULL) {
+        int result = c89thrd_result_from_GetLastError();
+        CloseHandle((HANDLE)barrier->events[0]);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+static void c89barrier_uninit_parking(c89barrier_t* barrier)
+{
+    CloseHandle((HANDLE)barrier->events[1]);
+    CloseHandle((HANDLE)barrier->events[0]);
+}
+
+static void c89barrier_prepare_release(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    /*
+    The event for the next phase will still be signaled from the last time it was used so it needs
+    to be reset before the sense is flipped, otherwise threads in the next phase will fall straight
+    through. Nobody can be waiting on it at this point because every thread has arrived.
+    */
+    ResetEvent((HANDLE)barrier->events[sense ^ 1]);
+}
+
+static void c89barrier_release(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    SetEvent((HANDLE)barrier->events[sense]);
+}
+
+static int c89barrier_park(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    if (WaitForSingleObject((HANDLE)barrier->events[sense], INFINITE) != WAIT_OBJECT_0) {
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+#else
+static int c89barrier_init_parking(c89barrier_t* barrier)
+{
+    int result;
+
+    barrier->sleepers = 0;
+
+    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&barrier->lock, NULL));
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&barrier->cond, NULL));
+    if (result != c89thrd_success) {
+        pthread_mutex_destroy((pthread_mutex_t*)&barrier->lock);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+static void c89barrier_uninit_parking(c89barrier_t* barrier)
+{
+    pthread_cond_destroy((pthread_cond_t*)&barrier->cond);
+    pthread_mutex_destroy((pthread_mutex_t*)&barrier->lock);
+}
+
+static void c89barrier_prepare_release(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    /* Nothing to do with pthread. The condition variable is re-checked against the sense. */
+    (void)barrier;
+    (void)sense;
+}
+
+static void c89barrier_release(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    (void)sense;
+
+    /*
+    The common case is that everybody is still spinning in which case we don't need to touch the
+    mutex at all. The sense has already been flipped at this point, and sleepers are counted before
+    the sense is re-checked under the lock, so we can't miss anybody.
+    */
+    if (c89thread_atomic_load_32(&barrier->sleepers) > 0) {
+        pthread_mutex_lock((pthread_mutex_t*)&barrier->lock);
+        pthread_cond_broadcast((pthread_cond_t*)&barrier->cond);
+        pthread_mutex_unlock((pthread_mutex_t*)&barrier->lock);
+    }
+}
+
+static int c89barrier_park(c89barrier_t* barrier, c89thread_uint32 sense)
+{
+    int result = c89thrd_success;
+
+    if (pthread_mutex_lock((pthread_mutex_t*)&barrier->lock) != 0) {
+        return c89thrd_error;
+    }
+
+    c89thread_atomic_fetch_add_32(&barrier->sleepers, 1);
+    {
+        while (c89thread_atomic_load_32(&barrier->sense) == sense) {
+            if (pthread_cond_wait((pthread_cond_t*)&barrier->cond, (pthread_mutex_t*)&barrier->lock) != 0) {
+                result = c89thrd_error;
+                break;
+            }
+        }
+    }
+    c89thread_atomic_fetch_sub_32(&barrier->sleepers, 1);
+
+    pthread_mutex_unlock((pthread_mutex_t*)&barrier->lock);
+    return result;
+}
+#endif
+
+c89barrier_config c89barrier_config_init(unsigned int count)
+{
+    c89barrier_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.count = count;
+    config.fanIn = 0;
+
+    if (count > C89THREAD_BARRIER_TREE_THRESHOLD) {
+        config.type = c89barrier_type_tree;
+    } else {
+        config.type = c89barrier_type_flat;
+    }
+
+    /* There's no point spinning on a single core machine. The thread we're waiting on can't run while we're spinning. */
+    if (c89thread_get_logical_cpu_count() > 1) {
+        config.spinCount = C89THREAD_BARRIER_SPIN_COUNT;
+    } else {
+        config.spinCount = 0;
+    }
+
+    return config;
+}
+
+static c89thread_uint32 c89barrier_choose_fan_in(void)
+{
+    /*
+    Smaller nodes mean less contention per node, but a deeper tree. There's no benefit in having
+    more arrivals per node than there are CPUs to run them concurrently.
+    */
+    c89thread_uint32 fanIn = C89THREAD_BARRIER_TREE_FAN_IN;
+    c89thread_uint32 cpuCount = (c89thread_uint32)c89thread_get_logical_cpu_count();
+
+    if (fanIn > cpuCount) {
+        fanIn = cpuCount;
+    }
+
+    if (fanIn < 2) {
+        fanIn = 2;
+    }
+
+    return fanIn;
+}
+
+static int c89barrier_init_tree(c89barrier_t* barrier, c89thread_uint32 fanIn, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    c89barrier_node* pNodes;
+    c89thread_uint32 nodeCount;
+    c89thread_uint32 levelCount;
+    c89thread_uint32 levelBeg;
+    c89thread_uint32 arrivals;
+
+    if (fanIn < 2) {
+        fanIn = 2;
+    }
+
+    /* First count the nodes. Each level has one node for every `fanIn` arrivals from the level below. */
+    nodeCount = 0;
+    arrivals  = barrier->count;
+    for (;;) {
+        levelCount = (arrivals + fanIn - 1) / fanIn;
+        nodeCount += levelCount;
+
+        if (levelCount == 1) {
+            break;
+        }
+
+        arrivals = levelCount;
+    }
+
+    pNodes = (c89barrier_node*)c89thread_malloc(sizeof(*pNodes) * nodeCount, pAllocationCallbacks);
+    if (pNodes == NULL) {
+        return c89thrd_nomem;
+    }
+
+    memset(pNodes, 0, sizeof(*pNodes) * nodeCount);
+
+    /* Now link everything up level by level. */
+    levelBeg = 0;
+    arrivals = barrier->count;
+    for (;;) {
+        c89thread_uint32 iNode;
+
+        levelCount = (arrivals + fanIn - 1) / fanIn;
+
+        for (iNode = 0; iNode < levelCount; iNode += 1) {
+            c89barrier_node* pNode = &pNodes[levelBeg + iNode];
+
+            if (iNode < levelCount - 1) {
+                pNode->capacity = fanIn;
+            } else {
+                pNode->capacity = arrivals - (fanIn * iNode);   /* The last node on the level takes the remainder. */
+            }
+
+            if (levelCount == 1) {
+                pNode->parent = C89THREAD_BARRIER_NO_PARENT;
+            } else {
+                pNode->parent = levelBeg + levelCount + (iNode / fanIn);
+            }
+        }
+
+        if (levelBeg == 0) {
+            barrier->leafCount = levelCount;
+        }
+
+        if (levelCount == 1) {
+            break;
+        }
+
+        levelBeg += levelCount;
+        arrivals  = levelCount;
+    }
+
+    barrier->pNodes    = pNodes;
+    barrier->nodeCount = nodeCount;
+
+    return c89thrd_success;
+}
+
+/*
+Returns non-zero if the calling thread was the last to arrive, in which case it is responsible for
+releasing the phase.
+
+The thread to leaf mapping is not known up front because c89barrier_wait() doesn't take a thread
+index. Instead a thread starts at its hint and takes a slot in the first leaf that still has room.
+The counter of a full leaf can go past its capacity because of this, so only the thread that takes
+the last slot exactly moves up to the parent. Interior nodes only ever see one arrival per child.
+Counters are reset by the releasing thread before the next phase starts. Nobody can be probing at
+that point since every thread has already taken a slot.
+*/
+static int c89barrier_arrive_tree(c89barrier_t* barrier)
+{
+    c89barrier_node* pNodes = (c89barrier_node*)barrier->pNodes;
+    c89thread_uint32 iNode;
+    c89thread_uint32 arrival;
+
+    if (g_c89barrierLeafHint == 0) {
+        /* First time this thread has used a tree barrier. Spread threads out based on their thread-local storage address. */
+        g_c89barrierLeafHint = (c89thread_uint32)((c89thread_uintptr)&g_c89barrierLeafHint / C89THREAD_CACHE_LINE_SIZE) + 1;
+    }
+
+    iNode = (g_c89barrierLeafHint - 1) % barrier->leafCount;
+    for (;;) {
+        arrival = c89thread_atomic_fetch_add_32(&pNodes[iNode].counter, 1);
+        if (arrival < pNodes[iNode].capacity) {
+            break;
+        }
+
+        iNode = (iNode + 1) % barrier->leafCount;
+    }
+
+    g_c89barrierLeafHint = iNode + 1;
+
+    while (arrival == pNodes[iNode].capacity - 1) {
+        if (pNodes[iNode].parent == C89THREAD_BARRIER_NO_PARENT) {
+            return 1;   /* Last to arrive at the root. */
+        }
+
+        iNode = pNodes[iNode].parent;
+        arrival = c89thread_atomic_fetch_add_32(&pNodes[iNode].counter, 1);
+    }
+
+    return 0;
+}
+
+int c89barrier_init_ex(c89barrier_t* barrier, const c89barrier_config* pConfig, const c89thread_allocation_callbacks* pAllocationCallbacks)
+{
+    int result;
+
+    if (barrier == NULL) {
+        return c89thrd_error;
+    }
+
+    memset(barrier, 0, sizeof(*barrier));
+
+    if (pConfig == NULL || pConfig->count == 0) {
+        return c89thrd_error;
+    }
+
+    if (pConfig->type != c89barrier_type_flat && pConfig->type != c89barrier_type_tree) {
+        return c89thrd_error;
+    }
+
+    barrier->type      = pConfig->type;
+    barrier->count     = (c89thread_uint32)pConfig->count;
+    barrier->counter   = (c89thread_uint32)pConfig->count;
+    barrier->sense     = 0;
+    barrier->spinCount = (c89thread_uint32)pConfig->spinCount;
+
+    if (pAllocationCallbacks != NULL) {
+        barrier->allocationCallbacks  = *pAllocationCallbacks;
+        barrier->usingCustomAllocator = 1;
+    }
+
+    if (barrier->type == c89barrier_type_tree) {
+        c89thread_uint32 fanIn = (c89thread_uint32)pConfig->fanIn;
+        if (fanIn == 0) {
+            fanIn = c89barrier_choose_fan_in();
+        }
+
+        result = c89barrier_init_tree(barrier, fanIn, pAllocationCallbacks);
+        if (result != c89thrd_success) {
+            return result;
+        }
+    }
+
+    result = c89barrier_init_parking(barrier);
+    if (result != c89thrd_success) {
+        c89thread_free(barrier->pNodes, pAllocationCallbacks);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+int c89barrier_init(c89barrier_t* barrier, unsigned int count)
+{
+    c89barrier_config config = c89barrier_config_init(count);
+    return c89barrier_init_ex(barrier, &config, NULL);
+}
+
+void c89barrier_destroy(c89barrier_t* barrier)
+{
+    if (barrier == NULL) {
+        return;
+    }
+
+    c89barrier_uninit_parking(barrier);
+    c89thread_free(barrier->pNodes, (barrier->usingCustomAllocator) ? &barrier->allocationCallbacks : NULL);
+}
+
+int c89barrier_wait(c89barrier_t* barrier)
+{
+    c89thread_uint32 sense;
+    c89thread_uint32 iSpin;
+    int isLast;
+
+    if (barrier == NULL) {
+        return c89thrd_error;
+    }
+
+    /*
+    The sense cannot flip until we've arrived so we can safely grab it here. Threads in the current
+    phase wait for it to change from this value.
+    */
+    sense = c89thread_atomic_load_32(&barrier->sense);
+
+    if (barrier->type == c89barrier_type_tree) {
+        isLast = c89barrier_arrive_tree(barrier);
+    } else {
+        isLast = c89thread_atomic_fetch_sub_32(&barrier->counter, 1) == 1;
+    }
+
+    if (isLast) {
+        /* We're the last to arrive. Reset the counters for the next phase and then release everybody. */
+        if (barrier->type == c89barrier_type_tree) {
+            c89barrier_node* pNodes = (c89barrier_node*)barrier->pNodes;
+            c89thread_uint32 iNode;
+
+            for (iNode = 0; iNode < barrier->nodeCount; iNode += 1) {
+                c89thread_atomic_store_32(&pNodes[iNode].counter, 0);
+            }
+        } else {
+            c89thread_atomic_store_32(&barrier->counter, barrier->count);
+        }
+
+        c89barrier_prepare_release(barrier, sense);
+        c89thread_atomic_store_32(&barrier->sense, sense ^ 1);
+        c89barrier_release(barrier, sense);
+
+        return c89barrier_serial_thread;
+    }
+
+    for (iSpin = 0; iSpin < barrier->spinCount; iSpin += 1) {
+        if (c89thread_atomic_load_32(&barrier->sense) != sense) {
+            return c89thrd_success;
+        }
+
+        c89thread_spin_pause();
+    }
+
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        int result;
+
+        c89thread_hook_before_block(c89thread_object_barrier, barrier);
+        result = c89barrier_park(barrier, sense);
+        c89thread_hook_after_block(c89thread_object_barrier, barrier, result);
+
+        return result;
+    }
+    #else
+    {
+        return c89barrier_park(barrier, sense);
+    }
+    #endif
+}
+/* END c89thread_barrier.c */
+
+
+/* BEG c89thread_latch.c */
+#if defined(C89THREAD_WIN32)
+static int c89latch_init_parking(c89latch_t* latch)
+{
+    latch->event = (c89thread_handle)CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (latch->event == NULL) {
+        return c89thrd_result_from_GetLastError();
+    }
+
+    return c89thrd_success;
+}
+
+static void c89latch_uninit_parking(c89latch_t* latch)
+{
+    CloseHandle((HANDLE)latch->event);
+}
+
+static void c89latch_release(c89latch_t* latch)
+{
+    SetEvent((HANDLE)latch->event);
+}
+
+static int c89latch_park(c89latch_t* latch, const struct timespec* time_point, int isMonotonic)
+{
+    DWORD result;
+
+    if (time_point != NULL) {
+        result = c89wait_for_single_object_until_ex((HANDLE)latch->event, time_point, isMonotonic);
+    } else {
+        result = WaitForSingleObject((HANDLE)latch->event, INFINITE);
+    }
+
+    if (result != WAIT_OBJECT_0) {
+        if (result == WAIT_TIMEOUT) {
+            return c89thrd_timedout;
+        }
+
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+#else
+static int c89latch_init_parking(c89latch_t* latch)
+{
+    int result;
+
+    latch->sleepers = 0;
+
+    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&latch->lock, NULL));
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&latch->cond, NULL));
+    if (result != c89thrd_success) {
+        pthread_mutex_destroy((pthread_mutex_t*)&latch->lock);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+static void c89latch_uninit_parking(c89latch_t* latch)
+{
+    pthread_cond_destroy((pthread_cond_t*)&latch->cond);
+    pthread_mutex_destroy((pthread_mutex_t*)&latch->lock);
+}
+
+static void c89latch_release(c89latch_t* latch)
+{
+    /* Same as the barrier. Sleepers are counted before the counter is re-checked under the lock so we can't miss anybody. */
+    if (c89thread_atomic_load_32(&latch->sleepers) > 0) {
+        pthread_mutex_lock((pthread_mutex_t*)&latch->lock);
+        pthread_cond_broadcast((pthread_cond_t*)&latch->cond);
+        pthread_mutex_unlock((pthread_mutex_t*)&latch->lock);
+    }
+}
+
+static int c89latch_park(c89latch_t* latch, const struct timespec* time_point, int isMonotonic)
+{
+    int result = c89thrd_success;
+
+    if (pthread_mutex_lock((pthread_mutex_t*)&latch->lock) != 0) {
+        return c89thrd_error;
+    }
+
+    c89thread_atomic_fetch_add_32(&latch->sleepers, 1);
+    {
+        while (c89thread_atomic_load_32(&latch->counter) != 0) {
+            if (time_point != NULL) {
+                result = c89pthread_cond_timedwait((pthread_cond_t*)&latch->cond, (pthread_mutex_t*)&latch->lock, time_point, isMonotonic);
+            } else {
+                result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)&latch->cond, (pthread_mutex_t*)&latch->lock));
+            }
+
+            if (result != c89thrd_success) {
+                if (result != c89thrd_timedout) {
+                    result = c89thrd_error;
+                }
+
+                break;
+            }
+        }
+
+        /* We may have timed out right as the latch was released. Don't report a timeout in that case. */
+        if (result == c89thrd_timedout && c89thread_atomic_load_32(&latch->counter) == 0) {
+            result = c89thrd_success;
+        }
+    }
+    c89thread_atomic_fetch_sub_32(&latch->sleepers, 1);
+
+    pthread_mutex_unlock((pthread_mutex_t*)&latch->lock);
+    return result;
+}
+#endif
+
+static int c89latch_block(c89latch_t* latch, const struct timespec* time_point, int isMonotonic)
+{
+    #if defined(C89THREAD_HAS_INSTRUMENTATION)
+    {
+        int result;
+
+        c89thread_hook_before_block(c89thread_object_latch, latch);
+        result = c89latch_park(latch, time_point, isMonotonic);
+        c89thread_hook_after_block(c89thread_object_latch, latch, result);
+
+        return result;
+    }
+    #else
+    {
+        return c89latch_park(latch, time_point, isMonotonic);
+    }
+    #endif
+}
+
+int c89latch_init(c89latch_t* latch, unsigned int count)
+{
+    if (latch == NULL) {
+        return c89thrd_error;
+    }
+
+    memset(latch, 0, sizeof(*latch));
+    latch->counter = (c89thread_uint32)count;
+
+    return c89latch_init_parking(latch);
+}
+
+void c89latch_destroy(c89latch_t* latch)
+{
+    if (latch == NULL) {
+        return;
+    }
+
+    c89latch_uninit_parking(latch);
+}
+
+int c89latch_count_down(c89latch_t* latch, unsigned int n)
+{
+    c89thread_uint32 counter;
+
+    if (latch == NULL) {
+        return c89thrd_error;
+    }
+
+    if (n == 0) {
+        return c89thrd_success;
+    }
+
+    counter = c89thread_atomic_fetch_sub_32(&latch->counter, (c89thread_uint32)n);
+    if (counter < n) {
+        /*
+        Counted down past zero. Put the count back. If the other threads' count downs brought it to
+        zero in the meantime, we're the ones who have to release the latch.
+        */
+        if (c89thread_atomic_fetch_add_32(&latch->counter, (c89thread_uint32)n) + (c89thread_uint32)n == 0) {
+            c89latch_release(latch);
+        }
+
+        return c89thrd_error;
+    }
+
+    /* Only the final count down needs to wake anybody up. */
+    if (counter == n) {
+        c89latch_release(latch);
+    }
+
+    return c89thrd_success;
+}
+
+int c89latch_try_wait(c89latch_t* latch)
+{
+    if (latch == NULL) {
+        return c89thrd_error;
+    }
+
+    if (c89thread_atomic_load_32(&latch->counter) == 0) {
+        return c89thrd_success;
+    }
+
+    return c89thrd_busy;
+}
+
+int c89latch_wait(c89latch_t* latch)
+{
+    if (latch == NULL) {
+        return c89thrd_error;
+    }
+
+    if (c89thread_atomic_load_32(&latch->counter) == 0) {
+        return c89thrd_success;
+    }
+
+    return c89latch_block(latch, NULL, 0);
+}
+
+int c89latch_timedwait(c89latch_t* latch, const struct timespec* time_point)
+{
+    if (latch == NULL || time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    if (c89thread_atomic_load_32(&latch->counter) == 0) {
+        return c89thrd_success;
+    }
+
+    return c89latch_block(latch, time_point, 0);
+}
+
+int c89latch_timedwait_monotonic(c89latch_t* latch, const struct timespec* time_point)
+{
+    if (latch == NULL || time_point == NULL) {
+        return c89thrd_error;
+    }
+
+    if (c89thread_atomic_load_32(&latch->counter) == 0) {
+        return c89thrd_success;
+    }
+
+    return c89latch_block(latch, time_point, 1);
+}
+
+int c89latch_arrive_and_wait(c89latch_t* latch, unsigned int n)
+{
+    int result;
+
+    result = c89latch_count_down(latch, n);
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    return c89latch_wait(latch);
+}
+/* END c89thread_latch.c */
+
+
+/* BEG c89thread_sleep.c */
+int c89thrd_sleep_timespec(struct timespec ts)
+{
+    return c89thrd_sleep(&ts, NULL);
+}
+
+int c89thrd_sleep_milliseconds(int milliseconds)
+{
+    if (milliseconds < 0) {
+        milliseconds = 0;
+    }
+
+    return c89thrd_sleep_timespec(c89timespec_milliseconds(milliseconds));
+}
+
+
+/* The amount of time before the deadline at which the precise sleep stops sleeping and starts spinning. */
+#ifndef C89THREAD_SLEEP_SPIN_THRESHOLD_IN_NANOSECONDS
+    #if defined(C89THREAD_WIN32)
+        #define C89THREAD_SLEEP_SPIN_THRESHOLD_IN_NANOSECONDS   2000000
+    #else
+        #define C89THREAD_SLEEP_SPIN_THRESHOLD_IN_NANOSECONDS   100000
+    #endif
+#endif
+
+#define C89THREAD_SLEEP_CALIBRATION_SAMPLES                 32
+#define C89THREAD_SLEEP_CALIBRATION_SAMPLE_IN_NANOSECONDS   500000
+#define C89THREAD_SLEEP_MAX_SPIN_THRESHOLD_IN_NANOSECONDS   100000000   /* Calibration will never report more than this. */
+
+static volatile c89thread_uint32 g_c89thrdSleepSpinThreshold = C89THREAD_SLEEP_SPIN_THRESHOLD_IN_NANOSECONDS;
+
+/* The time point is relative to c89timespec_now_monotonic(). */
+static int c89thrd_sleep_precise_until(const struct timespec* time_point)
+{
+    struct timespec tsWake;
+    int result;
+
+    tsWake = c89timespec_diff(*time_point, c89timespec_nanoseconds((time_t)c89thread_atomic_load_32(&g_c89thrdSleepSpinThreshold)));
+    if (c89timespec_cmp(c89timespec_now_monotonic(), tsWake) < 0) {
+        result = c89thrd_sleep_os_until(&tsWake);
+        if (result != c89thrd_success) {
+            return result;
+        }
+    }
+
+    while (c89timespec_cmp(c89timespec_now_monotonic(), *time_point) < 0) {
+        c89thread_spin_pause();
+    }
+
+    return c89thrd_success;
+}
+
+int c89thrd_sleep_precise(const struct timespec* duration)
+{
+    struct timespec tsDeadline;
+
+    if (duration == NULL || duration->tv_sec < 0) {
+        return c89thrd_error;
+    }
+
+    tsDeadline = c89timespec_add(c89timespec_now_monotonic(), *duration);
+
+    return c89thrd_sleep_precise_until(&tsDeadline);
+}
+
+int c89thrd_sleep_calibrate(struct timespec* pSpinThreshold)
+{
+    struct timespec tsTarget;
+    struct timespec tsOvershoot;
+    c89thread_uint64 overshoots[C89THREAD_SLEEP_CALIBRATION_SAMPLES];
+    c89thread_uint64 overshoot;
+    c89thread_uint64 threshold;
+    int iSample;
+    int jSample;
+    int result;
+
+    /* Measure how late the OS wakes us up. The samples are kept sorted. */
+    for (iSample = 0; iSample < C89THREAD_SLEEP_CALIBRATION_SAMPLES; iSample += 1) {
+        tsTarget = c89timespec_add(c89timespec_now_monotonic(), c89timespec_nanoseconds(C89THREAD_SLEEP_CALIBRATION_SAMPLE_IN_NANOSECONDS));
+
+        result = c89thrd_sleep_os_until(&tsTarget);
+        if (result != c89thrd_success) {
+            return result;
+        }
+
+        overshoot = 0;
+
+        tsOvershoot = c89timespec_now_monotonic();
+        if (c89timespec_cmp(tsOvershoot, tsTarget) > 0) {
+            tsOvershoot = c89timespec_diff(tsOvershoot, tsTarget);
+            overshoot   = ((c89thread_uint64)tsOvershoot.tv_sec * 1000000000) + (c89thread_uint64)tsOvershoot.tv_nsec;
+        }
+
+        for (jSample = iSample; jSample > 0 && overshoots[jSample - 1] > overshoot; jSample -= 1) {
+            overshoots[jSample] = overshoots[jSample - 1];
+        }
+
+        overshoots[jSample] = overshoot;
+    }
+
+    /*
+    The worst case tends to be an outlier caused by preemption, and spinning for that long on every
+    sleep would waste a lot of CPU time. Use the 90th percentile with some headroom instead.
+    */
+    threshold  = overshoots[(C89THREAD_SLEEP_CALIBRATION_SAMPLES * 9) / 10];
+    threshold += threshold / 4;
+    if (threshold > C89THREAD_SLEEP_MAX_SPIN_THRESHOLD_IN_NANOSECONDS) {
+        threshold = C89THREAD_SLEEP_MAX_SPIN_THRESHOLD_IN_NANOSECONDS;
+    }
+
+    c89thread_atomic_store_32(&g_c89thrdSleepSpinThreshold, (c89thread_uint32)threshold);
+
+    if (pSpinThreshold != NULL) {
+        *pSpinThreshold = c89timespec_nanoseconds((time_t)threshold);
+    }
+
+    return c89thrd_success;
+}
+/* END c89thread_sleep.c */
+
+
+/* BEG c89thread_periodic.c */
+static c89thread_uint64 c89timespec_to_nanoseconds_u64(struct timespec ts)
+{
+    return ((c89thread_uint64)ts.tv_sec * 1000000000) + (c89thread_uint64)ts.tv_nsec;
+}
+
+static struct timespec c89timespec_from_nanoseconds_u64(c89thread_uint64 nanoseconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = (time_t)(nanoseconds / 1000000000);
+    ts.tv_nsec = (long)(nanoseconds % 1000000000);
+
+    return ts;
+}
+
+int c89periodic_init(c89periodic_t* periodic, const struct timespec* period, unsigned int flags)
+{
+    if (periodic == NULL || period == NULL) {
+        return c89thrd_error;
+    }
+
+    if (period->tv_sec < 0 || period->tv_nsec < 0 || (period->tv_sec == 0 && period->tv_nsec == 0)) {
+        return c89thrd_error;
+    }
+
+    memset(periodic, 0, sizeof(*periodic));
+    periodic->period = *period;
+    periodic->next   = c89timespec_add(c89timespec_now_monotonic(), *period);
+    periodic->flags  = flags;
+
+    return c89thrd_success;
+}
+
+int c89periodic_wait(c89periodic_t* periodic, unsigned int* pOverruns)
+{
+    struct timespec tsNow;
+    c89thread_uint64 periodInNanoseconds;
+    c89thread_uint64 missed;
+    int result;
+
+    if (pOverruns != NULL) {
+        *pOverruns = 0;
+    }
+
+    if (periodic == NULL) {
+        return c89thrd_error;
+    }
+
+    tsNow = c89timespec_now_monotonic();
+
+    if (c89timespec_cmp(tsNow, periodic->next) < 0) {
+        if ((periodic->flags & c89periodic_precise) != 0) {
+            result = c89thrd_sleep_precise_until(&periodic->next);
+        } else {
+            result = c89thrd_sleep_until(&periodic->next, TIME_MONOTONIC);
+        }
+
+        if (result != c89thrd_success) {
+            return result;
+        }
+
+        periodic->next = c89timespec_add(periodic->next, periodic->period);
+        return c89thrd_success;
+    }
+
+    /*
+    We're late. The current deadline counts as an overrun, as does every deadline after it that has
+    also passed. Skip over all of them so the next deadline is in the future but still in phase.
+    */
+    periodInNanoseconds = c89timespec_to_nanoseconds_u64(periodic->period);
+    missed = 1 + (c89timespec_to_nanoseconds_u64(c89timespec_diff(tsNow, periodic->next)) / periodInNanoseconds);
+
+    periodic->next      = c89timespec_add(periodic->next, c89timespec_from_nanoseconds_u64(missed * periodInNanoseconds));
+    periodic->overruns += missed;
+
+    if (pOverruns != NULL) {
+        *pOverruns = (missed > UINT_MAX) ? UINT_MAX : (unsigned int)missed;
+    }
+
+    return c89thrd_success;
+}
+/* END c89thread_periodic.c */
+
+
+/* BEG c89thread_ticks.c */
+#if defined(C89THREAD_WIN32)
+static volatile c89thread_uint64 g_c89threadTicksFrequency = 0;
+
+c89thread_uint64 c89thread_ticks(void)
+{
+    LARGE_INTEGER counter;
+
+    /* Cannot fail on Windows XP and newer. */
+    QueryPerformanceCounter(&counter);
+
+    return (c89thread_uint64)counter.QuadPart;
+}
+
+c89thread_uint64 c89thread_ticks_to_ns(c89thread_uint64 ticks)
+{
+    c89thread_uint64 frequency;
+    c89thread_uint64 nanoseconds;
+
+    /*
+    The frequency is fixed at boot so every thread that races to initialize it stores the same value.
+    It's published atomically so readers never see a torn value. InitOnceExecuteOnce() would do the
+    same job but isn't available on Windows XP.
+    */
+    frequency = c89thread_atomic_load_64(&g_c89threadTicksFrequency);
+    if (frequency == 0) {
+        LARGE_INTEGER qpf;
+        QueryPerformanceFrequency(&qpf);
+
+        frequency = (c89thread_uint64)qpf.QuadPart;
+        c89thread_atomic_store_64(&g_c89threadTicksFrequency, frequency);
+    }
+
+    if (!c89thread_mul_div_u64(ticks, 1000000000, frequency, &nanoseconds)) {
+        return C89THREAD_UINT64_MAX;
+    }
+
+    return nanoseconds;
+}
+#else
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+    #define C89THREAD_HAS_RDTSC
+#endif
+
+#if defined(CLOCK_MONOTONIC_RAW)
+    #define C89THREAD_TICKS_CLOCK   CLOCK_MONOTONIC_RAW
+#elif defined(CLOCK_MONOTONIC)
+    #define C89THREAD_TICKS_CLOCK   CLOCK_MONOTONIC
+#endif
+
+#define C89THREAD_TSC_CALIBRATION_IN_NANOSECONDS    10000000
+
+static c89thread_uint64 c89thread_ticks_clock(void)
+{
+    struct timespec ts;
+
+    #if defined(C89THREAD_TICKS_CLOCK)
+    {
+        clock_gettime(C89THREAD_TICKS_CLOCK, &ts);
+    }
+    #else
+    {
+        ts = c89timespec_now_monotonic();
+    }
+    #endif
+
+    return ((c89thread_uint64)ts.tv_sec * 1000000000) + (c89thread_uint64)ts.tv_nsec;
+}
+
+#if defined(C89THREAD_HAS_RDTSC)
+static pthread_once_t g_c89threadTscOnce = PTHREAD_ONCE_INIT;
+static c89thread_uint64 g_c89threadTscFrequency = 0;     /* 0 if the TSC can't be used. */
+
+static c89thread_uint64 c89thread_rdtsc(void)
+{
+    unsigned int lo;
+    unsigned int hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+
+    return ((c89thread_uint64)hi << 32) | lo;
+}
+
+static void c89thread_cpuid(unsigned int leaf, unsigned int* pEAX, unsigned int* pEDX)
+{
+    unsigned int ebx;
+    unsigned int ecx;
+
+    __asm__ __volatile__ ("cpuid" : "=a"(*pEAX), "=b"(ebx), "=c"(ecx), "=d"(*pEDX) : "a"(leaf), "c"(0));
+
+    (void)ebx;
+    (void)ecx;
+}
+
+static void c89thread_init_tsc(void)
+{
+    unsigned int eax;
+    unsigned int edx;
+    c89thread_uint64 tscBeg;
+    c89thread_uint64 tscEnd;
+    c89thread_uint64 clockBeg;
+    c89thread_uint64 clockEnd;
+
+    /* An invariant TSC ticks at a constant rate regardless of power state. Without it the TSC is useless as a clock. */
+    c89thread_cpuid(0x80000000, &eax, &edx);
+    if (eax < 0x80000007) {
+        return;
+    }
+
+    c89thread_cpuid(0x80000007, &eax, &edx);
+    if ((edx & (1 << 8)) == 0) {
+        return;
+    }
+
+    clockBeg = c89thread_ticks_clock();
+    tscBeg   = c89thread_rdtsc();
+
+    do {
+        c89thrd_sleep_milliseconds(1);
+        clockEnd = c89thread_ticks_clock();
+    } while (clockEnd - clockBeg < C89THREAD_TSC_CALIBRATION_IN_NANOSECONDS);
+
+    tscEnd = c89thread_rdtsc();
+
+    if (tscEnd > tscBeg) {
+        g_c89threadTscFrequency = ((tscEnd - tscBeg) * 1000000000) / (clockEnd - clockBeg);
+    }
+}
+#endif
+
+c89thread_uint64 c89thread_ticks(void)
+{
+    #if defined(C89THREAD_HAS_RDTSC)
+    {
+        pthread_once(&g_c89threadTscOnce, c89thread_init_tsc);
+
+        if (g_c89threadTscFrequency != 0) {
+            return c89thread_rdtsc();
+        }
+    }
+    #endif
+
+    return c89thread_ticks_clock();
+}
+
+c89thread_uint64 c89thread_ticks_to_ns(c89thread_uint64 ticks)
+{
+    #if defined(C89THREAD_HAS_RDTSC)
+    {
+        c89thread_uint64 frequency;
+
+        pthread_once(&g_c89threadTscOnce, c89thread_init_tsc);
+
+        frequency = g_c89threadTscFrequency;
+        if (frequency != 0) {
+            /* Split to avoid overflowing. The remainder is less than the frequency so this is fine for anything under 18GHz. */
+            return ((ticks / frequency) * 1000000000) + (((ticks % frequency) * 1000000000) / frequency);
+        }
+    }
+    #endif
+
+    return ticks;
+}
+#endif
+/* END c89thread_ticks.c */
+
+
+/* BEG c89thread_coarse_clock.c */
+struct timespec c89timespec_now_coarse(void)
+{
+    #if defined(CLOCK_REALTIME_COARSE) && !defined(C89THREAD_WIN32)
+    {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+            return ts;
+        }
+    }
+    #endif
+
+    return c89timespec_now();
+}
+
+struct timespec c89timespec_now_monotonic_coarse(void)
+{
+    #if defined(CLOCK_MONOTONIC_COARSE) && !defined(C89THREAD_WIN32)
+    {
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0) {
+            return ts;
+        }
+    }
+    #endif
+
+    return c89timespec_now_monotonic();
+}
+
+
+/* Both values are in nanoseconds and are zero when the ticker isn't running. Padded so nothing else shares the cache line. */
+typedef struct
+{
+    char padding0[C89THREAD_CACHE_LINE_SIZE];
+    volatile c89thread_uint64 utc;
+    volatile c89thread_uint64 monotonic;
+    char padding1[C89THREAD_CACHE_LINE_SIZE - sizeof(c89thread_uint64)*2];
+} c89timespec_cached_clock;
+
+typedef struct
+{
+    c89thrd_t thread;
+    c89evnt_t stopEvent;
+    struct timespec interval;
+    int isRunning;
+} c89timespec_ticker;
+
+static c89timespec_cached_clock g_c89timespecCachedClock;
+static c89timespec_ticker g_c89timespecTicker;
+
+static void c89timespec_ticker_publish(void)
+{
+    c89thread_atomic_store_64(&g_c89timespecCachedClock.utc,       c89timespec_to_nanoseconds_u64(c89timespec_now()));
+    c89thread_atomic_store_64(&g_c89timespecCachedClock.monotonic, c89timespec_to_nanoseconds_u64(c89timespec_now_monotonic()));
+}
+
+static int c89timespec_ticker_entry(void* pUserData)
+{
+    c89timespec_ticker* pTicker = (c89timespec_ticker*)pUserData;
+
+    /* The stop event being signalled is the only way out. Timing out means it's time to publish again. */
+    while (c89evnt_timedwait_for(&pTicker->stopEvent, &pTicker->interval) == c89thrd_timedout) {
+        c89timespec_ticker_publish();
+    }
+
+    return 0;
+}
+
+int c89timespec_ticker_init(const struct timespec* interval)
+{
+    int result;
+
+    /* A zero interval would have the ticker thread spinning. */
+    if (interval == NULL || interval->tv_sec < 0 || interval->tv_nsec < 0 || (interval->tv_sec == 0 && interval->tv_nsec == 0)) {
+        return c89thrd_error;
+    }
+
+    if (g_c89timespecTicker.isRunning) {
+        return c89thrd_busy;
+    }
+
+    g_c89timespecTicker.interval = *interval;
+
+    result = c89evnt_init(&g_c89timespecTicker.stopEvent);
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    /* Publish before starting the thread so the cached time is valid as soon as we return. */
+    c89timespec_ticker_publish();
+
+    result = c89thrd_create(&g_c89timespecTicker.thread, c89timespec_ticker_entry, &g_c89timespecTicker);
+    if (result != c89thrd_success) {
+        c89thread_atomic_store_64(&g_c89timespecCachedClock.utc,       0);
+        c89thread_atomic_store_64(&g_c89timespecCachedClock.monotonic, 0);
+        c89evnt_destroy(&g_c89timespecTicker.stopEvent);
+        return result;
+    }
+
+    g_c89timespecTicker.isRunning = 1;
+
+    return c89thrd_success;
+}
+
+void c89timespec_ticker_uninit(void)
+{
+    if (!g_c89timespecTicker.isRunning) {
+        return;
+    }
+
+    c89evnt_signal(&g_c89timespecTicker.stopEvent);
+    c89thrd_join(g_c89timespecTicker.thread, NULL);
+    c89evnt_destroy(&g_c89timespecTicker.stopEvent);
+
+    c89thread_atomic_store_64(&g_c89timespecCachedClock.utc,       0);
+    c89thread_atomic_store_64(&g_c89timespecCachedClock.monotonic, 0);
+
+    g_c89timespecTicker.isRunning = 0;
+}
+
+struct timespec c89timespec_now_cached(void)
+{
+    c89thread_uint64 nanoseconds;
+
+    nanoseconds = c89thread_atomic_load_64(&g_c89timespecCachedClock.utc);
+    if (nanoseconds == 0) {
+        return c89timespec_now_coarse();
+    }
+
+    return c89timespec_from_nanoseconds_u64(nanoseconds);
+}
+
+struct timespec c89timespec_now_monotonic_cached(void)
+{
+    c89thread_uint64 nanoseconds;
+
+    nanoseconds = c89thread_atomic_load_64(&g_c89timespecCachedClock.monotonic);
+    if (nanoseconds == 0) {
+        return c89timespec_now_monotonic_coarse();
+    }
+
+    return c89timespec_from_nanoseconds_u64(nanoseconds);
+}
+/* END c89thread_coarse_clock.c */
+
+/* BEG c89thread_timer.c */
+#define C89TIMER_WHEEL_MASK     ((c89thread_uint64)C89TIMER_WHEEL_SLOTS - 1)
+#define C89TIMER_EXPIRED_SLOT   (C89TIMER_WHEEL_LEVELS*C89TIMER_WHEEL_SLOTS)
+
+/* The furthest ahead a timer can be placed in the top level. Anything further out is re-inserted when it cascades. */
+#define C89TIMER_WHEEL_RANGE    (((c89thread_uint64)1 << (C89TIMER_WHEEL_LEVELS*C89TIMER_WHEEL_BITS)) - 1)
+
+c89timer_service_config c89timer_service_config_init(void)
+{
+    c89timer_service_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.resolution.tv_sec  = 0;
+    config.resolution.tv_nsec = 1000000;
+
+    return config;
+}
+
+static c89thread_uint64 c89timer_service_duration_to_nanoseconds(struct timespec duration)
+{
+    /* Clamped to a bit over 136 years so the conversion can't overflow. */
+    if ((c89thread_uint64)duration.tv_sec >= ((c89thread_uint64)1 << 32)) {
+        duration.tv_sec  = (time_t)(((c89thread_uint64)1 << 32) - 1);
+        duration.tv_nsec = 0;
+    }
+
+    return c89timespec_to_nanoseconds_u64(duration);
+}
+
+static c89thread_uint64 c89timer_service_elapsed_nanoseconds(const c89timer_service* pService)
+{
+    return c89timespec_to_nanoseconds_u64(c89timespec_diff(c89timespec_now_monotonic(), pService->startTime));
+}
+
+static c89thread_uint64 c89timer_service_now_tick(const c89timer_service* pService)
+{
+    return c89timer_service_elapsed_nanoseconds(pService) / pService->resolution;
+}
+
+static void c89timer_service_link(c89timer_service* pService, c89timer_t* pTimer, unsigned int slot)
+{
+    pTimer->slot  = slot;
+    pTimer->pPrev = NULL;
+    pTimer->pNext = pService->pSlots[slot];
+
+    if (pTimer->pNext != NULL) {
+        pTimer->pNext->pPrev = pTimer;
+    }
+
+    pService->pSlots[slot] = pTimer;
+}
+
+static void c89timer_service_unlink(c89timer_service* pService, c89timer_t* pTimer)
+{
+    if (pTimer->pPrev != NULL) {
+        pTimer->pPrev->pNext = pTimer->pNext;
+    } else {
+        pService->pSlots[pTimer->slot] = pTimer->pNext;
+    }
+
+    if (pTimer->pNext != NULL) {
+        pTimer->pNext->pPrev = pTimer->pPrev;
+    }
+
+    pTimer->pNext = NULL;
+    pTimer->pPrev = NULL;
+}
+
+/*
+Places a timer in the lowest level that can represent its distance from the current tick. Level n
+covers distances below 2^(bits*(n+1)) ticks, and its slots are indexed by bits*n of the expiry tick.
+The expiry must be at or after the current tick.
+*/
+static void c89timer_service_insert(c89timer_service* pService, c89timer_t* pTimer)
+{
+    c89thread_uint64 expiry;
+    c89thread_uint64 delta;
+    unsigned int level;
+
+    expiry = pTimer->expiry;
+    delta  = expiry - pService->currentTick;
+
+    if (delta > C89TIMER_WHEEL_RANGE) {
+        delta  = C89TIMER_WHEEL_RANGE;
+        expiry = pService->currentTick + C89TIMER_WHEEL_RANGE;
+    }
+
+    for (level = 0; level < C89TIMER_WHEEL_LEVELS - 1; level += 1) {
+        if (delta < ((c89thread_uint64)1 << (C89TIMER_WHEEL_BITS*(level + 1)))) {
+            break;
+        }
+    }
+
+    c89timer_service_link(pService, pTimer, (level * C89TIMER_WHEEL_SLOTS) + (unsigned int)((expiry >> (C89TIMER_WHEEL_BITS*level)) & C89TIMER_WHEEL_MASK));
+}
+
+/* Moves every timer in the current slot of the given level down into the lower levels. */
+static void c89timer_service_cascade(c89timer_service* pService, unsigned int level)
+{
+    unsigned int slot;
+    c89timer_t* pTimer;
+    c89timer_t* pNext;
+
+    slot   = (level * C89TIMER_WHEEL_SLOTS) + (unsigned int)((pService->currentTick >> (C89TIMER_WHEEL_BITS*level)) & C89TIMER_WHEEL_MASK);
+    pTimer = pService->pSlots[slot];
+    pService->pSlots[slot] = NULL;
+
+    while (pTimer != NULL) {
+        pNext = pTimer->pNext;
+        c89timer_service_insert(pService, pTimer);
+        pTimer = pNext;
+    }
+}
+
+/*
+Returns the first tick after the current one that needs processing. That's either the next non-empty
+slot in the bottom level or the point where the bottom level wraps and the next level cascades.
+*/
+static c89thread_uint64 c89timer_service_next_tick(const c89timer_service* pService)
+{
+    c89thread_uint64 tick;
+    c89thread_uint64 wrapTick;
+
+    if (pService->pendingCount == 0) {
+        return C89THREAD_UINT64_MAX;
+    }
+
+    wrapTick = (pService->currentTick | C89TIMER_WHEEL_MASK) + 1;
+
+    for (tick = pService->currentTick + 1; tick < wrapTick; tick += 1) {
+        if (pService->pSlots[tick & C89TIMER_WHEEL_MASK] != NULL) {
+            return tick;
+        }
+    }
+
+    return wrapTick;
+}
+
+/* Steps to the next tick, cascading the upper levels where they wrap, and moves the due timers to the expired list. */
+static void c89timer_service_advance(c89timer_service* pService)
+{
+    unsigned int level;
+    c89timer_t* pTimer;
+    c89timer_t* pNext;
+
+    pService->currentTick += 1;
+
+    for (level = 1; level < C89TIMER_WHEEL_LEVELS; level += 1) {
+        if ((pService->currentTick & (((c89thread_uint64)1 << (C89TIMER_WHEEL_BITS*level)) - 1)) != 0) {
+            break;
+        }
+
+        c89timer_service_cascade(pService, level);
+    }
+
+    pTimer = pService->pSlots[pService->currentTick & C89TIMER_WHEEL_MASK];
+    pService->pSlots[pService->currentTick & C89TIMER_WHEEL_MASK] = NULL;
+
+    while (pTimer != NULL) {
+        pNext = pTimer->pNext;
+        c89timer_service_link(pService, pTimer, C89TIMER_EXPIRED_SLOT);
+        pTimer = pNext;
+    }
+}
+
+/* Runs the callbacks of everything in the expired list. The lock is released around each callback. */
+static void c89timer_service_run_expired(c89timer_service* pService)
+{
+    c89timer_t* pTimer;
+    c89timer_proc proc;
+    void* pUserData;
+    c89thread_uint64 period;
+
+    while ((pTimer = pService->pSlots[C89TIMER_EXPIRED_SLOT]) != NULL) {
+        c89timer_service_unlink(pService, pTimer);
+        pTimer->isPending = 0;
+        pService->pendingCount -= 1;
+
+        /* One-shot timers must not be touched once the callback starts since the callback is allowed to free them. */
+        proc      = pTimer->proc;
+        pUserData = pTimer->pUserData;
+        period    = pTimer->period;
+
+        pService->pRunning = pTimer;
+        pService->isRunningCancelled = 0;
+
+        c89mtx_unlock(&pService->lock);
+        {
+            #if defined(C89THREAD_ENABLE_TRACE)
+            {
+                c89thread_uint64 callbackStartTicks = c89thread_ticks();
+                proc(pUserData);
+                c89thread_trace_task(C89THREAD_TRACE_TASK_TIMER, (c89thread_uintptr)proc, callbackStartTicks);
+            }
+            #else
+            {
+                proc(pUserData);
+            }
+            #endif
+        }
+        c89mtx_lock(&pService->lock);
+
+        /* A periodic timer that was rescheduled or cancelled while its callback was running is left alone. */
+        if (period != 0 && !pService->isRunningCancelled && !pTimer->isPending) {
+            pTimer->expiry += period;
+
+            /* Missed periods are skipped rather than run back to back, but the timer stays in phase. */
+            if (pTimer->expiry <= pService->currentTick) {
+                pTimer->expiry += (((pService->currentTick - pTimer->expiry) / period) + 1) * period;
+            }
+
+            c89timer_service_insert(pService, pTimer);
+            pTimer->isPending = 1;
+            pService->pendingCount += 1;
+        }
+
+        pService->pRunning = NULL;
+        pService->callbackGeneration += 1;
+
+        if (pService->cancelWaiterCount > 0) {
+            c89evnt_signal(&pService->callbackEvent);
+        }
+    }
+}
+
+static int c89timer_service_entry(void* pUserData)
+{
+    c89timer_service* pService = (c89timer_service*)pUserData;
+    c89thread_uint64 nowTick;
+    c89thread_uint64 nextTick;
+    struct timespec wakeTime;
+
+    c89mtx_lock(&pService->lock);
+
+    while (!pService->isShuttingDown) {
+        nowTick = c89timer_service_now_tick(pService);
+
+        /* Skip straight over ticks with nothing in them rather than stepping through them one at a time. */
+        while (pService->currentTick < nowTick && !pService->isShuttingDown) {
+            nextTick = c89timer_service_next_tick(pService);
+            if (nextTick > nowTick) {
+                pService->currentTick = nowTick;
+                break;
+            }
+
+            pService->currentTick = nextTick - 1;
+            c89timer_service_advance(pService);
+            c89timer_service_run_expired(pService);
+        }
+
+        if (pService->isShuttingDown) {
+            break;
+        }
+
+        /* Anything scheduled before this tick wakes us up. It's reset to zero when we wake since we'll recalculate it anyway. */
+        pService->wakeTick = c89timer_service_next_tick(pService);
+        nextTick = pService->wakeTick;
+
+        c89mtx_unlock(&pService->lock);
+        {
+            if (nextTick == C89THREAD_UINT64_MAX) {
+                c89evnt_wait(&pService->wakeEvent);
+            } else {
+                wakeTime = c89timespec_add(pService->startTime, c89timespec_from_nanoseconds_u64(nextTick * pService->resolution));
+                c89evnt_timedwait_monotonic(&pService->wakeEvent, &wakeTime);
+            }
+        }
+        c89mtx_lock(&pService->lock);
+
+        pService->wakeTick = 0;
+    }
+
+    c89mtx_unlock(&pService->lock);
+
+    return 0;
+}
+
+int c89timer_service_init(c89timer_service* pService, const c89timer_service_config* pConfig)
+{
+    c89timer_service_config config;
+    int result;
+
+    if (pService == NULL) {
+        return c89thrd_error;
+    }
+
+    memset(pService, 0, sizeof(*pService));
+
+    if (pConfig != NULL) {
+        config = *pConfig;
+    } else {
+        config = c89timer_service_config_init();
+    }
+
+    if (config.resolution.tv_sec < 0 || config.resolution.tv_nsec < 0) {
+        return c89thrd_error;
+    }
+
+    pService->resolution = c89timespec_to_nanoseconds_u64(config.resolution);
+    if (pService->resolution == 0) {
+        return c89thrd_error;
+    }
+
+    result = c89mtx_init(&pService->lock, c89mtx_plain);
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    result = c89evnt_init(&pService->wakeEvent);
+    if (result != c89thrd_success) {
+        c89mtx_destroy(&pService->lock);
+        return result;
+    }
+
+    result = c89evnt_init(&pService->callbackEvent);
+    if (result != c89thrd_success) {
+        c89evnt_destroy(&pService->wakeEvent);
+        c89mtx_destroy(&pService->lock);
+        return result;
+    }
+
+    pService->startTime = c89timespec_now_monotonic();
+
+    result = c89thrd_create(&pService->thread, c89timer_service_entry, pService);
+    if (result != c89thrd_success) {
+        c89evnt_destroy(&pService->callbackEvent);
+        c89evnt_destroy(&pService->wakeEvent);
+        c89mtx_destroy(&pService->lock);
+        return result;
+    }
+
+    return c89thrd_success;
+}
+
+void c89timer_service_uninit(c89timer_service* pService)
+{
+    unsigned int slot;
+    c89timer_t* pTimer;
+
+    if (pService == NULL) {
+        return;
+    }
+
+    c89mtx_lock(&pService->lock);
+    {
+        pService->isShuttingDown = 1;
+    }
+    c89mtx_unlock(&pService->lock);
+
+    c89evnt_signal(&pService->wakeEvent);
+    c89thrd_join(pService->thread, NULL);
+
+    /* Anything still pending is dropped and detached so a later c89timer_cancel() doesn't touch the destroyed lock. */
+    for (slot = 0; slot <= C89TIMER_EXPIRED_SLOT; slot += 1) {
+        while ((pTimer = pService->pSlots[slot]) != NULL) {
+            c89timer_service_unlink(pService, pTimer);
+            pTimer->isPending = 0;
+            pTimer->pService  = NULL;
+        }
+    }
+
+    c89evnt_destroy(&pService->callbackEvent);
+    c89evnt_destroy(&pService->wakeEvent);
+    c89mtx_destroy(&pService->lock);
+}
+
+
+void c89timer_init(c89timer_t* pTimer)
+{
+    if (pTimer == NULL) {
+        return;
+    }
+
+    memset(pTimer, 0, sizeof(*pTimer));
+}
+
+/* The deadline is in nanoseconds since the service started. */
+static int c89timer_schedule_ex(c89timer_service* pService, c89timer_t* pTimer, c89thread_uint64 deadline, const struct timespec* period, c89timer_proc proc, void* pUserData)
+{
+    c89thread_uint64 expiry;
+    c89thread_uint64 periodInTicks;
+
+    periodInTicks = 0;
+    if (period != NULL) {
+        if (period->tv_sec < 0 || period->tv_nsec < 0) {
+            return c89thrd_error;
+        }
+
+        /* A period shorter than the resolution is rounded up to a single tick. */
+        periodInTicks = (c89timer_service_duration_to_nanoseconds(*period) + pService->resolution - 1) / pService->resolution;
+        if (periodInTicks == 0) {
+            return c89thrd_error;
+        }
+    }
+
+    /* Rounded up so the timer never fires early. The tick is processed once the clock has reached its start. */
+    expiry = (deadline + pService->resolution - 1) / pService->resolution;
+
+    c89mtx_lock(&pService->lock);
+    {
+        /* A pending timer can only be moved within the service it was scheduled on. */
+        if (pTimer->isPending && pTimer->pService != pService) {
+            c89mtx_unlock(&pService->lock);
+            return c89thrd_error;
+        }
+
+        if (pTimer->isPending) {
+            c89timer_service_unlink(pService, pTimer);
+            pService->pendingCount -= 1;
+        }
+
+        /*
+        The service thread doesn't advance the current tick while there's nothing pending. Catch it up
+        now, which is free since the wheel is empty, or else the service thread would have to step
+        through the whole idle period before it could get to this timer.
+        */
+        if (pService->pendingCount == 0) {
+            c89thread_uint64 nowTick = c89timer_service_now_tick(pService);
+            if (nowTick > pService->currentTick) {
+                pService->currentTick = nowTick;
+            }
+        }
+
+        /* Deadlines that have already passed run on the next tick. */
+        if (expiry <= pService->currentTick) {
+            expiry = pService->currentTick + 1;
+        }
+
+        pTimer->pService  = pService;
+        pTimer->proc      = proc;
+        pTimer->pUserData = pUserData;
+        pTimer->expiry    = expiry;
+        pTimer->period    = periodInTicks;
+        pTimer->isPending = 1;
+
+        c89timer_service_insert(pService, pTimer);
+        pService->pendingCount += 1;
+
+        /* Only wake the service thread if it's asleep and this timer is due before it would have woken up anyway. */
+        if (expiry < pService->wakeTick) {
+            c89evnt_signal(&pService->wakeEvent);
+        }
+    }
+    c89mtx_unlock(&pService->lock);
+
+    return c89thrd_success;
+}
+
+static int c89timer_schedule_after(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* delay, const struct timespec* period, c89timer_proc proc, void* pUserData)
+{
+    if (pService == NULL || pTimer == NULL || delay == NULL || proc == NULL) {
+        return c89thrd_error;
+    }
+
+    if (delay->tv_sec < 0 || delay->tv_nsec < 0) {
+        return c89thrd_error;
+    }
+
+    return c89timer_schedule_ex(pService, pTimer, c89timer_service_elapsed_nanoseconds(pService) + c89timer_service_duration_to_nanoseconds(*delay), period, proc, pUserData);
+}
+
+int c89timer_schedule(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* delay, c89timer_proc proc, void* pUserData)
+{
+    return c89timer_schedule_after(pService, pTimer, delay, NULL, proc, pUserData);
+}
+
+int c89timer_schedule_periodic(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* delay, const struct timespec* period, c89timer_proc proc, void* pUserData)
+{
+    if (period == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89timer_schedule_after(pService, pTimer, delay, period, proc, pUserData);
+}
+
+int c89timer_schedule_at(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* time_point, c89timer_proc proc, void* pUserData)
+{
+    struct timespec now;
+    c89thread_uint64 elapsed;
+
+    if (pService == NULL || pTimer == NULL || time_point == NULL || proc == NULL) {
+        return c89thrd_error;
+    }
+
+    /* The wheel runs on the monotonic clock so the deadline is converted to a distance from now. */
+    now     = c89timespec_now();
+    elapsed = c89timer_service_elapsed_nanoseconds(pService);
+
+    if (c89timespec_cmp(*time_point, now) <= 0) {
+        return c89timer_schedule_ex(pService, pTimer, elapsed, NULL, proc, pUserData);
+    }
+
+    return c89timer_schedule_ex(pService, pTimer, elapsed + c89timer_service_duration_to_nanoseconds(c89timespec_diff(*time_point, now)), NULL, proc, pUserData);
+}
+
+int c89timer_schedule_at_monotonic(c89timer_service* pService, c89timer_t* pTimer, const struct timespec* time_point, c89timer_proc proc, void* pUserData)
+{
+    if (pService == NULL || pTimer == NULL || time_point == NULL || proc == NULL) {
+        return c89thrd_error;
+    }
+
+    if (c89timespec_cmp(*time_point, pService->startTime) <= 0) {
+        return c89timer_schedule_ex(pService, pTimer, 0, NULL, proc, pUserData);
+    }
+
+    return c89timer_schedule_ex(pService, pTimer, c89timer_service_duration_to_nanoseconds(c89timespec_diff(*time_point, pService->startTime)), NULL, proc, pUserData);
+}
+
+int c89timer_cancel(c89timer_t* pTimer)
+{
+    c89timer_service* pService;
+    c89thread_uint64 callbackGeneration;
+    int result;
+
+    if (pTimer == NULL || pTimer->pService == NULL) {
+        return c89thrd_error;
+    }
+
+    pService = pTimer->pService;
+    result   = c89thrd_error;
+
+    c89mtx_lock(&pService->lock);
+    {
+        if (pTimer->isPending) {
+            c89timer_service_unlink(pService, pTimer);
+            pTimer->isPending = 0;
+            pService->pendingCount -= 1;
+            result = c89thrd_success;
+        }
+
+        if (pService->pRunning == pTimer) {
+            if (pTimer->period != 0 && !pService->isRunningCancelled) {
+                result = c89thrd_success;
+            }
+
+            pService->isRunningCancelled = 1;
+
+            /*
+            Wait for the callback to return, unless we're being called from it. The generation changes as
+            soon as this callback returns, even if the same timer starts running again straight after.
+
+            The event is auto-reset so it only wakes one waiter at a time. Each waiter passes the wakeup on
+            when it's done so every canceller gets woken without any of them having to poll. A waiter
+            whose callback is still running just goes back to sleep, and the next callback to return
+            starts the chain again. Condition variables would be simpler, but they aren't available on
+            Win32.
+            */
+            if (!c89thrd_equal(c89thrd_current(), pService->thread)) {
+                callbackGeneration = pService->callbackGeneration;
+
+                pService->cancelWaiterCount += 1;
+
+                while (pService->callbackGeneration == callbackGeneration) {
+                    c89mtx_unlock(&pService->lock);
+                    {
+                        c89evnt_wait(&pService->callbackEvent);
+                    }
+                    c89mtx_lock(&pService->lock);
+                }
+
+                pService->cancelWaiterCount -= 1;
+
+                if (pService->cancelWaiterCount > 0) {
+                    c89evnt_signal(&pService->callbackEvent);
+                }
+            }
+        }
+    }
+    c89mtx_unlock(&pService->lock);
+
+    return result;
+}
+/* END c89thread_timer.c */
+
+
+/* BEG c89thread_timespec.c */
+#if defined(_WIN32)
+int c89timespec_get(struct timespec* ts, int base)
+{
+    FILETIME ft;
+    LONGLONG current100Nanoseconds;
+
+    if (ts == NULL) {
+        return 0;   /* 0 = error. */
+    }
+
+    ts->tv_sec  = 0;
+    ts->tv_nsec = 0;
+
+    if (base == TIME_MONOTONIC) {
+        *ts = c89timespec_now_monotonic();
+        return base;
+    }
+
+    /* Otherwise only supporting UTC. */
+    if (base != TIME_UTC) {
+        return 0;   /* 0 = error. */
+    }
+
+    GetSystemTimeAsFileTime(&ft);
+    current100Nanoseconds = (((LONGLONG)ft.dwHighDateTime << 32) | (LONGLONG)ft.dwLowDateTime);
+    current100Nanoseconds = current100Nanoseconds - ((LONGLONG)116444736 * 1000000000); /* Windows to Unix epoch. Normal value is 116444736000000000LL, but VC6 doesn't like 64-bit constants. */
+
+    ts->tv_sec  = (time_t)(current100Nanoseconds / 10000000);
+    ts->tv_nsec =  (long)((current100Nanoseconds - (ts->tv_sec * 10000000)) * 100);
+
+    return base;
+}
+#else
+struct timespec c89timespec_from_timeval(struct timeval* tv)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = tv->tv_sec;
+    ts.tv_nsec = tv->tv_usec * 1000;
+
+    return ts;
+}
+
+int c89timespec_get(struct timespec* ts, int base)
+{
+    if (ts == NULL) {
+        return 0;
+    }
+
+    /* timespec_get() does not necessarily support TIME_MONOTONIC, so handle it ourselves. */
+    if (base == TIME_MONOTONIC) {
+        *ts = c89timespec_now_monotonic();
+        return base;
+    }
+
+    /*
+    This is annoying to get working on all compilers. Here's the hierarchy:
+
+        * If using C11, use timespec_get(); else
+        * If _POSIX_C_SOURCE >= 199309L, use clock_gettime(CLOCK_REALTIME, ...); else
+        * Fall back to gettimeofday().
+    */
+    #if defined (__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__APPLE__) && !defined(__ANDROID__)
+    {
+        return timespec_get(ts, base);
+    }
+    #else
+    {
+        if (base != TIME_UTC) {
+            return 0;   /* Only TIME_UTC is supported. 0 = error. */
+        }
+
+        #if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 199309L
+        {
+            if (clock_gettime(CLOCK_REALTIME, ts) != 0) {
+                return 0;   /* Failed to retrieve the time. 0 = error. */
+            }
+
+            /* Getting here means we were successful. On success, need to return base (strange...) */
+            return base;
+        }
+        #else
+        {
+            struct timeval tv;
+            if (gettimeofday(&tv, NULL) != 0) {
+                return 0;   /* Failed to retrieve the time. 0 = error. */
+            }
+
+            *ts = c89timespec_from_timeval(&tv);
+            return base;
+        }
+        #endif  /* _POSIX_C_SOURCE >= 199309L */
+    }
+    #endif  /* C11 */
+}
+#endif
+
+
+struct timespec c89timespec_now(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = 0;
+    ts.tv_nsec = 0;
+    c89timespec_get(&ts, TIME_UTC);
+
+    return ts;
+}
+
+struct timespec c89timespec_now_monotonic(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = 0;
+    ts.tv_nsec = 0;
+
+    #if defined(C89THREAD_WIN32)
+    {
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        c89thread_uint64 nanoseconds;
+
+        /* QueryPerformanceCounter() cannot fail on Windows XP and newer. */
+        if (QueryPerformanceFrequency(&frequency) && QueryPerformanceCounter(&counter)) {
+            ts.tv_sec = (time_t)(counter.QuadPart / frequency.QuadPart);
+            if (c89thread_mul_div_u64((c89thread_uint64)(counter.QuadPart % frequency.QuadPart), 1000000000, (c89thread_uint64)frequency.QuadPart, &nanoseconds)) {
+                ts.tv_nsec = (long)nanoseconds;
+            }
+        }
+    }
+    #elif defined(CLOCK_MONOTONIC)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    }
+    #else
+    {
+        /* No monotonic clock is available. The best we can do is the system time. */
+        c89timespec_get(&ts, TIME_UTC);
+    }
+    #endif
+
+    return ts;
+}
+
+struct timespec c89timespec_nanoseconds(time_t nanoseconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = nanoseconds / 1000000000;
+    ts.tv_nsec = (long)(nanoseconds - (ts.tv_sec * 1000000000));
+
+    return ts;
+}
+
+struct timespec c89timespec_milliseconds(time_t milliseconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = milliseconds / 1000;
+    ts.tv_nsec = (long)((milliseconds - (ts.tv_sec * 1000)) * 1000000);
+
+    return ts;
+}
+
+struct timespec c89timespec_seconds(time_t seconds)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = seconds;
+    ts.tv_nsec = 0;
+
+    return ts;
+}
+
+struct timespec c89timespec_diff(struct timespec lhs, struct timespec rhs)
+{
+    struct timespec diff;
+
+    diff.tv_sec = lhs.tv_sec - rhs.tv_sec;
+
+    if (lhs.tv_nsec >= rhs.tv_nsec) {
+        diff.tv_nsec = lhs.tv_nsec - rhs.tv_nsec;
+    } else {
+        diff.tv_nsec = lhs.tv_nsec + 1000000000 - rhs.tv_nsec;
+        diff.tv_sec -= 1;
+    }
+
+    return diff;
+}
+
+struct timespec c89timespec_add(struct timespec tsA, struct timespec tsB)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = tsA.tv_sec  + tsB.tv_sec;
+    ts.tv_nsec = tsA.tv_nsec + tsB.tv_nsec;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_nsec -= 1000000000;
+        ts.tv_sec  += 1;
+    }
+    
+    return ts;
+}
+
+int c89timespec_cmp(struct timespec tsA, struct timespec tsB)
+{
+    if (tsA.tv_sec == tsB.tv_sec) {
+        if (tsA.tv_nsec == tsB.tv_nsec) {
+            return 0;
+        } else {
+            if (tsA.tv_nsec > tsB.tv_nsec) {
+                return +1;
+            } else {
+                return -1;
+            }
+        }
+    } else {
+        if (tsA.tv_sec > tsB.tv_sec) {
+            return +1;
+        } else {
+            return -1;
         }
+    }
+}
+/* END c89thread_timespec.c */
+
+
+/* BEG c89thread_cpu_count.c */
+#if !defined(_WIN32)
+    #if defined(__APPLE__) && defined(__MACH__)
+        #if !defined(_DARWIN_C_SOURCE) && (defined(_XOPEN_SOURCE) || defined(_POSIX_C_SOURCE))
+        #define _DARWIN_C_SOURCE
+        #endif
+        #include <sys/types.h>
+        #include <sys/sysctl.h>  /* For sysctlbyname() to get CPU count. */
+    #else
+        #include <unistd.h>      /* For sysconf() to get CPU count. */
+    #endif
+#endif
+
+int c89thread_get_logical_cpu_count(void)
+{
+    #if defined(_WIN32)
+    {
+        SYSTEM_INFO sysInfo;
+        GetSystemInfo(&sysInfo);
 
-        /* Update metadata. */
-        if (c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard)) != c89thrd_success) {
-            pthread_mutex_unlock(&mutex->mutex);
-            return c89thrd_error;
+        return (int)sysInfo.dwNumberOfProcessors;
+    }
+    #elif defined(__APPLE__) && defined(__MACH__)
+    {
+        int count;
+        size_t size = sizeof(count);
+
+        if (sysctlbyname("hw.logicalcpu", &count, &size, NULL, 0) != 0) {
+            /* Fall back to physical CPU cound. */
+            if (sysctlbyname("hw.physicalcpu", &count, &size, NULL, 0) != 0) {
+                return 1;  /* Failed to retrieve the logical CPU count. */
+            }
         }
-        
-        mutex->owner = currentThread;
-        mutex->recursionCount = 1;
-        
-        pthread_mutex_unlock(&mutex->guard);
 
-        return c89thrd_success;
+        return count;
     }
     #else
     {
-        return c89pthread_mutex_timedlock((pthread_mutex_t*)mutex, time_point);
+        int count = sysconf(_SC_NPROCESSORS_ONLN);
+        if (count < 1) {
+            return 1;  /* Failed to retrieve the logical CPU count. */
+        }
+
+        return count;
     }
     #endif
 }
-/* END c89mtx_timedlock_pthread.c */
+/* END c89thread_cpu_count.c */
 
-/* BEG c89mtx_trylock_pthread.c */
-int c89mtx_trylock(c89mtx_t* mutex)
+
+/* BEG c89thread_topology.c */
+#if !defined(_WIN32)
+#include <stdio.h>  /* For fopen() to read sysfs. */
+#endif
+
+/* The raw identifiers gathered for each CPU before they're turned into zero based indices. */
+typedef struct
 {
-    int result;
+    c89thread_uint64 package;
+    c89thread_uint64 core;
+    c89thread_uint64 l2;
+    c89thread_uint64 l3;
+} c89thread_cpu_keys;
 
-    if (mutex == NULL) {
-        return c89thrd_error;
+/*
+Keys taken from a cache description are tagged with the top bit and the cache level. Without this
+they could collide with the fallback keys, which are derived from the core or the CPU, and two
+unrelated cache domains would be grouped together.
+*/
+#define C89THREAD_CACHE_KEY(level, id)  (((c89thread_uint64)1 << 63) | ((c89thread_uint64)(level) << 56) | (c89thread_uint64)(id))
+
+static int c89thread_topology_alloc(c89thread_topology* pTopology, unsigned int cpuCount, c89thread_cpu_keys** ppKeys)
+{
+    const c89thread_allocation_callbacks* pAllocationCallbacks = (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL;
+
+    pTopology->pCPUs = (c89thread_cpu_info*)c89thread_malloc(sizeof(*pTopology->pCPUs) * cpuCount, pAllocationCallbacks);
+    if (pTopology->pCPUs == NULL) {
+        return c89thrd_nomem;
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        pthread_t currentThread;
+    *ppKeys = (c89thread_cpu_keys*)c89thread_malloc(sizeof(**ppKeys) * cpuCount, pAllocationCallbacks);
+    if (*ppKeys == NULL) {
+        c89thread_free(pTopology->pCPUs, pAllocationCallbacks);
+        pTopology->pCPUs = NULL;
+        return c89thrd_nomem;
+    }
 
-        /* Optimized path for plain mutexes. */
-        if ((mutex->type & c89mtx_recursive) == 0) {
-            return c89thrd_result_from_pthread(pthread_mutex_trylock(&mutex->mutex));
-        }
+    memset(pTopology->pCPUs, 0, sizeof(*pTopology->pCPUs) * cpuCount);
+    memset(*ppKeys, 0, sizeof(**ppKeys) * cpuCount);
+    pTopology->cpuCount = cpuCount;
 
-        /* Getting here means it's a recursive mutex. */
-        currentThread = pthread_self();
-        
-        /* Lock the guard mutex to safely access the metadata. */
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
-        
-        /* We can bomb out early if the current thread already owns this mutex. */
-        if (mutex->recursionCount > 0 && pthread_equal(mutex->owner, currentThread)) {
-            if (mutex->recursionCount == INT_MAX) {
-                pthread_mutex_unlock(&mutex->guard);
-                return c89thrd_error;
-            }
+    return c89thrd_success;
+}
 
-            mutex->recursionCount += 1;
-            pthread_mutex_unlock(&mutex->guard);
-            return c89thrd_success;
-        }
-        
-        /* The guard mutex needs to be unlocked before locking the main mutex or else we'll deadlock. */
-        pthread_mutex_unlock(&mutex->guard);
-        
-        result = c89thrd_result_from_pthread(pthread_mutex_trylock(&mutex->mutex));
-        if (result != c89thrd_success) {
-            if (result == c89thrd_busy) {
-                return c89thrd_busy;
-            }
+/*
+Converts a key to a zero based index by giving each distinct key the next index in the order they're
+first seen. Topologies are small so the quadratic search is fine.
+*/
+static unsigned int c89thread_topology_assign_indices(c89thread_topology* pTopology, const c89thread_cpu_keys* pKeys, size_t keyOffset, size_t indexOffset)
+{
+    unsigned int iCPU;
+    unsigned int jCPU;
+    unsigned int groupCount = 0;
 
-            return c89thrd_error;
-        }
-        
-        /* Update metadata. */
-        if (pthread_mutex_lock(&mutex->guard) != 0) {
-            pthread_mutex_unlock(&mutex->mutex);
-            return c89thrd_error;
-        }
-        
-        mutex->owner = currentThread;
-        mutex->recursionCount = 1;
-        
-        pthread_mutex_unlock(&mutex->guard);
+    for (iCPU = 0; iCPU < pTopology->cpuCount; iCPU += 1) {
+        c89thread_uint64 key = *(const c89thread_uint64*)((const char*)&pKeys[iCPU] + keyOffset);
+        unsigned int* pIndex = (unsigned int*)((char*)&pTopology->pCPUs[iCPU] + indexOffset);
 
-        return c89thrd_success;
-    }
-    #else
-    {
-        result = c89thrd_result_from_pthread(pthread_mutex_trylock((pthread_mutex_t*)mutex));
-        if (result != c89thrd_success) {
-            if (result == c89thrd_busy) {
-                return c89thrd_busy;
+        for (jCPU = 0; jCPU < iCPU; jCPU += 1) {
+            if (*(const c89thread_uint64*)((const char*)&pKeys[jCPU] + keyOffset) == key) {
+                *pIndex = *(const unsigned int*)((const char*)&pTopology->pCPUs[jCPU] + indexOffset);
+                break;
             }
-
-            return c89thrd_error;
         }
 
-        return c89thrd_success;
+        if (jCPU == iCPU) {
+            *pIndex = groupCount;
+            groupCount += 1;
+        }
     }
-    #endif
+
+    return groupCount;
 }
-/* END c89mtx_trylock_pthread.c */
 
-int c89mtx_unlock(c89mtx_t* mutex)
+static void c89thread_topology_finalize(c89thread_topology* pTopology, const c89thread_cpu_keys* pKeys)
 {
-    int result;
+    unsigned int iCPU;
+    unsigned int jCPU;
 
-    if (mutex == NULL) {
-        return c89thrd_error;
-    }
+    pTopology->packageCount = c89thread_topology_assign_indices(pTopology, pKeys, offsetof(c89thread_cpu_keys, package), offsetof(c89thread_cpu_info, packageIndex));
+    pTopology->coreCount    = c89thread_topology_assign_indices(pTopology, pKeys, offsetof(c89thread_cpu_keys, core),    offsetof(c89thread_cpu_info, coreIndex));
+    pTopology->l2Count      = c89thread_topology_assign_indices(pTopology, pKeys, offsetof(c89thread_cpu_keys, l2),      offsetof(c89thread_cpu_info, l2Index));
+    pTopology->l3Count      = c89thread_topology_assign_indices(pTopology, pKeys, offsetof(c89thread_cpu_keys, l3),      offsetof(c89thread_cpu_info, l3Index));
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        pthread_t currentThread;
+    /* SMT index and NUMA node count. */
+    pTopology->numaNodeCount = 0;
+    for (iCPU = 0; iCPU < pTopology->cpuCount; iCPU += 1) {
+        int isNewNode = 1;
 
-        /* Optimized path for plain mutexes. */
-        if ((mutex->type & c89mtx_recursive) == 0) {
-            result = c89thrd_result_from_pthread(pthread_mutex_unlock(&mutex->mutex));
-            if (result != c89thrd_success) {
-                return c89thrd_error;
+        pTopology->pCPUs[iCPU].smtIndex = 0;
+
+        for (jCPU = 0; jCPU < iCPU; jCPU += 1) {
+            if (pTopology->pCPUs[jCPU].coreIndex == pTopology->pCPUs[iCPU].coreIndex) {
+                pTopology->pCPUs[iCPU].smtIndex += 1;
             }
 
-            return c89thrd_success;
-        }
-        
-        /* Getting here means it's a recursive mutex. */
-        currentThread = pthread_self();
-        
-        /* Lock the guard mutex to safely access the metadata */
-        result = c89thrd_result_from_pthread(pthread_mutex_lock(&mutex->guard));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
-        
-        /* Check if the current thread owns the mutex */
-        if (mutex->recursionCount == 0 || !pthread_equal(mutex->owner, currentThread)) {
-            /* Getting here means we are trying to unlock a mutex that is not owned by this thread. Bomb out. */
-            pthread_mutex_unlock(&mutex->guard);
-            return c89thrd_error;
+            if (pTopology->pCPUs[jCPU].numaNode == pTopology->pCPUs[iCPU].numaNode) {
+                isNewNode = 0;
+            }
         }
-        
-        mutex->recursionCount -= 1;
-
-        if (mutex->recursionCount == 0) {
-            /* Last unlock. Unlock the main mutex. */
-            pthread_mutex_unlock(&mutex->guard);
 
-            result = c89thrd_result_from_pthread(pthread_mutex_unlock(&mutex->mutex));
-            if (result != c89thrd_success) {
-                return c89thrd_error;
-            }
-        } else {
-            /* Still recursively locked, just unlock the guard mutex. */
-            pthread_mutex_unlock(&mutex->guard);
+        if (isNewNode) {
+            pTopology->numaNodeCount += 1;
         }
-        
-        return c89thrd_success;
     }
-    #else
+}
+
+/* Used when we don't have any better information. Each logical CPU is treated as its own core. */
+static int c89thread_topology_query_fallback(c89thread_topology* pTopology, c89thread_cpu_keys** ppKeys)
+{
+    int result;
+    unsigned int cpuCount;
+    unsigned int smtWidth = 1;
+    unsigned int iCPU;
+
+    cpuCount = (unsigned int)c89thread_get_logical_cpu_count();
+
+    #if defined(__APPLE__) && defined(__MACH__)
     {
-        result = c89thrd_result_from_pthread(pthread_mutex_unlock((pthread_mutex_t*)mutex));
-        if (result != c89thrd_success) {
-            return c89thrd_error;
-        }
+        /* We can at least work out how many hardware threads there are per core. */
+        int physicalCount;
+        size_t size = sizeof(physicalCount);
 
-        return c89thrd_success;
+        if (sysctlbyname("hw.physicalcpu", &physicalCount, &size, NULL, 0) == 0 && physicalCount > 0 && (cpuCount % (unsigned int)physicalCount) == 0) {
+            smtWidth = cpuCount / (unsigned int)physicalCount;
+        }
     }
     #endif
-}
-/* END c89mtx_pthread.c */
 
+    result = c89thread_topology_alloc(pTopology, cpuCount, ppKeys);
+    if (result != c89thrd_success) {
+        return result;
+    }
+
+    for (iCPU = 0; iCPU < cpuCount; iCPU += 1) {
+        pTopology->pCPUs[iCPU].id       = iCPU;
+        pTopology->pCPUs[iCPU].numaNode = 0;
+        (*ppKeys)[iCPU].package = 0;
+        (*ppKeys)[iCPU].core    = iCPU / smtWidth;
+        (*ppKeys)[iCPU].l2      = iCPU / smtWidth;
+        (*ppKeys)[iCPU].l3      = 0;
+    }
+
+    return c89thrd_success;
+}
 
-/* BEG c89cnd_pthread.c */
-static int c89cnd_wait_pthread(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0501
+static int c89thread_topology_query_win32(c89thread_topology* pTopology, c89thread_cpu_keys** ppKeys)
 {
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* pInfos;
+    DWORD infoSize = 0;
+    DWORD infoCount;
+    DWORD iInfo;
+    ULONG_PTR allMask = 0;
+    unsigned int cpuIndices[sizeof(ULONG_PTR) * 8];
+    unsigned int cpuCount = 0;
+    unsigned int iBit;
+    unsigned int iCPU;
     int result;
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    int recursionCount;
-    pthread_t currentThread;
-    #endif
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        recursionCount = 0;
-        currentThread = pthread_self();
+    if (GetLogicalProcessorInformation(NULL, &infoSize) != FALSE || GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+        return c89thrd_error;
+    }
 
-        if ((mtx->type & c89mtx_recursive) != 0) {
-            result = c89thrd_result_from_pthread(pthread_mutex_lock(&mtx->guard));
-            if (result != c89thrd_success) {
-                return c89thrd_error;
-            }
+    pInfos = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)c89thread_malloc(infoSize, (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL);
+    if (pInfos == NULL) {
+        return c89thrd_nomem;
+    }
 
-            if (mtx->recursionCount == 0 || !pthread_equal(mtx->owner, currentThread)) {
-                pthread_mutex_unlock(&mtx->guard);
-                return c89thrd_error;
-            }
+    if (GetLogicalProcessorInformation(pInfos, &infoSize) == FALSE) {
+        c89thread_free(pInfos, (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL);
+        return c89thrd_error;
+    }
 
-            recursionCount = mtx->recursionCount;
-            mtx->recursionCount = 0;
+    infoCount = infoSize / sizeof(*pInfos);
 
-            pthread_mutex_unlock(&mtx->guard);
+    /* The set of logical CPUs is the union of every core's mask. */
+    for (iInfo = 0; iInfo < infoCount; iInfo += 1) {
+        if (pInfos[iInfo].Relationship == RelationProcessorCore) {
+            allMask |= pInfos[iInfo].ProcessorMask;
         }
     }
-    #endif
 
-    if (time_point != NULL) {
-        result = c89thrd_result_from_pthread(pthread_cond_timedwait((pthread_cond_t*)cnd, (pthread_mutex_t*)mtx, time_point));
-    } else {
-        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)cnd, (pthread_mutex_t*)mtx));
+    for (iBit = 0; iBit < sizeof(ULONG_PTR) * 8; iBit += 1) {
+        if ((allMask & ((ULONG_PTR)1 << iBit)) != 0) {
+            cpuIndices[iBit] = cpuCount;
+            cpuCount += 1;
+        }
     }
 
-    #ifdef C89THREAD_USE_MANUAL_RECURSIVE_MUTEX
-    {
-        if ((mtx->type & c89mtx_recursive) != 0) {
-            if (c89thrd_result_from_pthread(pthread_mutex_lock(&mtx->guard)) != c89thrd_success) {
-                return c89thrd_error;
-            }
-
-            mtx->owner = currentThread;
-            mtx->recursionCount = recursionCount;
+    result = c89thread_topology_alloc(pTopology, cpuCount, ppKeys);
+    if (result != c89thrd_success) {
+        c89thread_free(pInfos, (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL);
+        return result;
+    }
 
-            pthread_mutex_unlock(&mtx->guard);
+    for (iBit = 0; iBit < sizeof(ULONG_PTR) * 8; iBit += 1) {
+        if ((allMask & ((ULONG_PTR)1 << iBit)) != 0) {
+            pTopology->pCPUs[cpuIndices[iBit]].id = iBit;
+            (*ppKeys)[cpuIndices[iBit]].l2 = iBit;  /* Defaults for when there's no cache information. */
+            (*ppKeys)[cpuIndices[iBit]].l3 = C89THREAD_UINT64_MAX;  /* Replaced with the package below if there's no L3 information. */
         }
     }
-    #endif
 
-    return result;
-}
+    /* Each entry's index is used as the key for the CPUs it covers. */
+    for (iInfo = 0; iInfo < infoCount; iInfo += 1) {
+        for (iBit = 0; iBit < sizeof(ULONG_PTR) * 8; iBit += 1) {
+            c89thread_cpu_keys* pKeys;
 
-int c89cnd_init(c89cnd_t* cnd)
-{
-    int result;
+            if ((pInfos[iInfo].ProcessorMask & allMask & ((ULONG_PTR)1 << iBit)) == 0) {
+                continue;
+            }
 
-    if (cnd == NULL) {
-        return c89thrd_error;
+            pKeys = &(*ppKeys)[cpuIndices[iBit]];
+
+            switch (pInfos[iInfo].Relationship)
+            {
+                case RelationProcessorCore:    pKeys->core    = iInfo; break;
+                case RelationProcessorPackage: pKeys->package = iInfo; break;
+                case RelationNumaNode:         pTopology->pCPUs[cpuIndices[iBit]].numaNode = (unsigned int)pInfos[iInfo].NumaNode.NodeNumber; break;
+                case RelationCache:
+                {
+                    if (pInfos[iInfo].Cache.Type != CacheInstruction) {
+                        if (pInfos[iInfo].Cache.Level == 2) {
+                            pKeys->l2 = C89THREAD_CACHE_KEY(2, iInfo);
+                        } else if (pInfos[iInfo].Cache.Level == 3) {
+                            pKeys->l3 = C89THREAD_CACHE_KEY(3, iInfo);
+                        }
+                    }
+                } break;
+                default: break;
+            }
+        }
     }
 
-    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)cnd, NULL));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
+    /* Like on Linux, assume one L3 per package when it isn't reported so separate sockets aren't merged. */
+    for (iCPU = 0; iCPU < cpuCount; iCPU += 1) {
+        if ((*ppKeys)[iCPU].l3 == C89THREAD_UINT64_MAX) {
+            (*ppKeys)[iCPU].l3 = (*ppKeys)[iCPU].package;
+        }
     }
 
+    c89thread_free(pInfos, (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL);
     return c89thrd_success;
 }
-
-void c89cnd_destroy(c89cnd_t* cnd)
+#else
+static int c89thread_topology_query_win32(c89thread_topology* pTopology, c89thread_cpu_keys** ppKeys)
 {
-    if (cnd == NULL) {
-        return;
-    }
-
-    pthread_cond_destroy((pthread_cond_t*)cnd);
+    /* GetLogicalProcessorInformation() is not available with this SDK. */
+    (void)pTopology;
+    (void)ppKeys;
+    return c89thrd_error;
 }
-
-int c89cnd_signal(c89cnd_t* cnd)
+#endif
+#else
+/* Reads a small text file such as those found in sysfs. The buffer is always null terminated. */
+static int c89thread_read_text_file(const char* pFilePath, char* pBuffer, size_t bufferSize)
 {
-    int result;
+    FILE* pFile;
+    size_t bytesRead;
 
-    if (cnd == NULL) {
-        return c89thrd_error;
-    }
+    pBuffer[0] = '\0';
 
-    result = c89thrd_result_from_pthread(pthread_cond_signal((pthread_cond_t*)cnd));
-    if (result != c89thrd_success) {
+    pFile = fopen(pFilePath, "rb");
+    if (pFile == NULL) {
         return c89thrd_error;
     }
 
+    bytesRead = fread(pBuffer, 1, bufferSize - 1, pFile);
+    fclose(pFile);
+
+    pBuffer[bytesRead] = '\0';
     return c89thrd_success;
 }
 
-int c89cnd_broadcast(c89cnd_t* cnd)
+static int c89thread_parse_uint(const char** ppStr, unsigned int* pValue)
 {
-    int result;
+    const char* pStr = *ppStr;
+    unsigned int value = 0;
 
-    if (cnd == NULL) {
-        return c89thrd_error;
+    if (*pStr < '0' || *pStr > '9') {
+        return 0;
     }
 
-    result = c89thrd_result_from_pthread(pthread_cond_broadcast((pthread_cond_t*)cnd));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
+    while (*pStr >= '0' && *pStr <= '9') {
+        value = (value * 10) + (unsigned int)(*pStr - '0');
+        pStr += 1;
     }
 
-    return c89thrd_success;
+    *ppStr  = pStr;
+    *pValue = value;
+    return 1;
 }
 
-int c89cnd_wait(c89cnd_t* cnd, c89mtx_t* mtx)
+/* Retrieves the next range from a CPU list such as "0-3,8,10-11". Returns 0 when there are no more. */
+static int c89thread_next_cpu_range(const char** ppList, unsigned int* pBeg, unsigned int* pEnd)
 {
-    int result;
+    while (**ppList == ',' || **ppList == ' ' || **ppList == '\t') {
+        *ppList += 1;
+    }
 
-    if (cnd == NULL || mtx == NULL) {
-        return c89thrd_error;
+    if (!c89thread_parse_uint(ppList, pBeg)) {
+        return 0;
     }
 
-    result = c89cnd_wait_pthread(cnd, mtx, NULL);
-    if (result != c89thrd_success) {
-        return c89thrd_error;
+    *pEnd = *pBeg;
+
+    if (**ppList == '-') {
+        *ppList += 1;
+        if (!c89thread_parse_uint(ppList, pEnd) || *pEnd < *pBeg) {
+            return 0;
+        }
     }
 
-    return c89thrd_success;
+    return 1;
 }
 
-int c89cnd_timedwait(c89cnd_t* cnd, c89mtx_t* mtx, const struct timespec* time_point)
+static int c89thread_read_uint_file(const char* pFilePath, unsigned int* pValue)
 {
-    int result;
-
-    if (cnd == NULL || mtx == NULL || time_point == NULL) {
-        return c89thrd_error;
-    }
-
-    result = c89cnd_wait_pthread(cnd, mtx, time_point);
-    if (result != c89thrd_success) {
-        if (result == c89thrd_timedout) {
-            return c89thrd_timedout;
-        }
+    char buffer[64];
+    const char* pStr = buffer;
 
-        return c89thrd_error;
+    if (c89thread_read_text_file(pFilePath, buffer, sizeof(buffer)) != c89thrd_success) {
+        return 0;
     }
 
-    return c89thrd_success;
+    return c89thread_parse_uint(&pStr, pValue);
 }
-/* END c89cnd_pthread.c */
 
+/* Paths are built with sprintf() so the root needs to be short enough to leave room for the rest of the path. */
+#define C89THREAD_MAX_SYSFS_ROOT_LENGTH 160
+#define C89THREAD_MAX_SYSFS_PATH_LENGTH 256
 
-int c89sem_init(c89sem_t* sem, int value, int valueMax)
+static int c89thread_topology_query_sysfs(c89thread_topology* pTopology, c89thread_cpu_keys** ppKeys, const char* pRoot)
 {
+    char path[C89THREAD_MAX_SYSFS_PATH_LENGTH];
+    char list[4096];
+    const char* pList;
+    unsigned int cpuCount;
+    unsigned int iCPU;
+    unsigned int beg;
+    unsigned int end;
     int result;
 
-    if (sem == NULL || value < 0 || valueMax <= 0 || value > valueMax) {
+    if (strlen(pRoot) > C89THREAD_MAX_SYSFS_ROOT_LENGTH) {
         return c89thrd_error;
     }
 
-    sem->value    = value;
-    sem->valueMax = valueMax;
+    sprintf(path, "%s/sys/devices/system/cpu/online", pRoot);
+    if (c89thread_read_text_file(path, list, sizeof(list)) != c89thrd_success) {
+        return c89thrd_error;
+    }
 
-    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&sem->lock, NULL));
+    /* Count first so we know how much to allocate. */
+    cpuCount = 0;
+    pList = list;
+    while (c89thread_next_cpu_range(&pList, &beg, &end)) {
+        cpuCount += (end - beg) + 1;
+    }
+
+    if (cpuCount == 0) {
+        return c89thrd_error;
+    }
+
+    result = c89thread_topology_alloc(pTopology, cpuCount, ppKeys);
     if (result != c89thrd_success) {
         return result;
     }
 
-    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&sem->cond, NULL));
-    if (result != c89thrd_success) {
-        pthread_mutex_destroy((pthread_mutex_t*)&sem->lock);
-        return result;  /* Failed to create condition variable. */
+    iCPU = 0;
+    pList = list;
+    while (c89thread_next_cpu_range(&pList, &beg, &end)) {
+        for (; beg <= end; beg += 1) {
+            pTopology->pCPUs[iCPU].id = beg;
+            iCPU += 1;
+        }
     }
 
-    return c89thrd_success;
-}
+    for (iCPU = 0; iCPU < cpuCount; iCPU += 1) {
+        c89thread_cpu_keys* pKeys = &(*ppKeys)[iCPU];
+        unsigned int id = pTopology->pCPUs[iCPU].id;
+        unsigned int package;
+        unsigned int core;
+        unsigned int iCache;
 
-void c89sem_destroy(c89sem_t* sem)
-{
-    if (sem == NULL) {
-        return;
-    }
+        /* Package. Can be -1 on some systems which fails to parse and is treated as 0. */
+        sprintf(path, "%s/sys/devices/system/cpu/cpu%u/topology/physical_package_id", pRoot, id);
+        if (!c89thread_read_uint_file(path, &package)) {
+            package = 0;
+        }
 
-    pthread_cond_destroy((pthread_cond_t*)&sem->cond);
-    pthread_mutex_destroy((pthread_mutex_t*)&sem->lock);
-}
+        /* Core. core_id is only unique within a package. */
+        sprintf(path, "%s/sys/devices/system/cpu/cpu%u/topology/core_id", pRoot, id);
+        if (!c89thread_read_uint_file(path, &core)) {
+            core = id;
+        }
 
-int c89sem_wait(c89sem_t* sem)
-{
-    int result;
+        pKeys->package = package;
+        pKeys->core    = ((c89thread_uint64)package << 32) | core;
 
-    if (sem == NULL) {
-        return c89thrd_error;
-    }
+        /* Caches. Without any information we assume SMT siblings share an L2 and each package has its own L3. */
+        pKeys->l2 = pKeys->core;
+        pKeys->l3 = pKeys->package;
 
-    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&sem->lock));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
-    }
+        for (iCache = 0; ; iCache += 1) {
+            char type[32];
+            unsigned int level;
+            unsigned int firstSharedCPU;
 
-    /* We need to wait on a condition variable before escaping. We can't return from this function until the semaphore has been signaled. */
-    while (sem->value == 0) {
-        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)&sem->cond, (pthread_mutex_t*)&sem->lock));
-        if (result != c89thrd_success) {
-            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
-            return c89thrd_error;
-        }
-    }
+            sprintf(path, "%s/sys/devices/system/cpu/cpu%u/cache/index%u/level", pRoot, id, iCache);
+            if (!c89thread_read_uint_file(path, &level)) {
+                break;  /* No more caches. */
+            }
 
-    sem->value -= 1;
-    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
+            if (level != 2 && level != 3) {
+                continue;
+            }
 
-    return c89thrd_success;
-}
+            sprintf(path, "%s/sys/devices/system/cpu/cpu%u/cache/index%u/type", pRoot, id, iCache);
+            if (c89thread_read_text_file(path, type, sizeof(type)) == c89thrd_success && strncmp(type, "Instruction", 11) == 0) {
+                continue;
+            }
 
-int c89sem_timedwait(c89sem_t* sem, const struct timespec* time_point)
-{
-    int result;
+            /* The first CPU sharing the cache identifies the group. */
+            sprintf(path, "%s/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", pRoot, id, iCache);
+            if (c89thread_read_text_file(path, list, sizeof(list)) != c89thrd_success) {
+                continue;
+            }
 
-    if (sem == NULL || time_point == NULL) {
-        return c89thrd_error;
-    }
+            pList = list;
+            if (!c89thread_next_cpu_range(&pList, &firstSharedCPU, &end)) {
+                continue;
+            }
 
-    result = c89pthread_mutex_timedlock((pthread_mutex_t*)&sem->lock, time_point);
-    if (result != 0) {
-        if (result == c89thrd_timedout) {
-            return c89thrd_timedout;
+            if (level == 2) {
+                pKeys->l2 = C89THREAD_CACHE_KEY(2, firstSharedCPU);
+            } else {
+                pKeys->l3 = C89THREAD_CACHE_KEY(3, firstSharedCPU);
+            }
         }
-
-        return c89thrd_error;
     }
 
-    /* We need to wait on a condition variable before escaping. We can't return from this function until the semaphore has been signaled. */
-    while (sem->value == 0) {
-        result = c89thrd_result_from_pthread(pthread_cond_timedwait((pthread_cond_t*)&sem->cond, (pthread_mutex_t*)&sem->lock, time_point));
-        if (result == c89thrd_timedout) {
-            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
-            return c89thrd_timedout;
-        }
+    /* NUMA nodes. If there's no node information everything stays on node 0. */
+    sprintf(path, "%s/sys/devices/system/node/online", pRoot);
+    if (c89thread_read_text_file(path, list, sizeof(list)) == c89thrd_success) {
+        char nodeList[sizeof(list)];
+        const char* pNodeList = nodeList;
+        unsigned int nodeBeg;
+        unsigned int nodeEnd;
 
-        if (result != c89thrd_success) {
-            pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
-            return c89thrd_error;
+        memcpy(nodeList, list, sizeof(list));
+
+        while (c89thread_next_cpu_range(&pNodeList, &nodeBeg, &nodeEnd)) {
+            for (; nodeBeg <= nodeEnd; nodeBeg += 1) {
+                sprintf(path, "%s/sys/devices/system/node/node%u/cpulist", pRoot, nodeBeg);
+                if (c89thread_read_text_file(path, list, sizeof(list)) != c89thrd_success) {
+                    continue;
+                }
+
+                pList = list;
+                while (c89thread_next_cpu_range(&pList, &beg, &end)) {
+                    for (iCPU = 0; iCPU < cpuCount; iCPU += 1) {
+                        if (pTopology->pCPUs[iCPU].id >= beg && pTopology->pCPUs[iCPU].id <= end) {
+                            pTopology->pCPUs[iCPU].numaNode = nodeBeg;
+                        }
+                    }
+                }
+            }
         }
     }
 
-    sem->value -= 1;
-
-    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
     return c89thrd_success;
 }
+#endif
 
-int c89sem_post(c89sem_t* sem)
+static int c89thread_get_topology_from_root(c89thread_topology* pTopology, const char* pRoot, const c89thread_allocation_callbacks* pAllocationCallbacks)
 {
+    c89thread_cpu_keys* pKeys = NULL;
     int result;
 
-    if (sem == NULL) {
+    if (pTopology == NULL) {
         return c89thrd_error;
     }
 
-    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&sem->lock));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
-    }
+    memset(pTopology, 0, sizeof(*pTopology));
 
-    if (sem->value < sem->valueMax) {
-        sem->value += 1;
-        pthread_cond_signal((pthread_cond_t*)&sem->cond);
-        result = c89thrd_success;
-    } else {
-        result = c89thrd_error;
+    if (pAllocationCallbacks != NULL) {
+        pTopology->allocationCallbacks  = *pAllocationCallbacks;
+        pTopology->usingCustomAllocator = 1;
     }
 
-    pthread_mutex_unlock((pthread_mutex_t*)&sem->lock);
-    return result;
-}
-
-
-
-int c89evnt_init(c89evnt_t* evnt)
-{
-    int result;
-
-    if (evnt == NULL) {
-        return c89thrd_error;
+    #if defined(_WIN32)
+    {
+        (void)pRoot;
+        result = c89thread_topology_query_win32(pTopology, &pKeys);
     }
+    #else
+    {
+        result = c89thread_topology_query_sysfs(pTopology, &pKeys, pRoot);
+    }
+    #endif
 
-    evnt->value = 0;
-
-    result = c89thrd_result_from_pthread(pthread_mutex_init((pthread_mutex_t*)&evnt->lock, NULL));
-    if (result != c89thrd_success) {
+    if (result == c89thrd_nomem) {
         return result;
     }
 
-    result = c89thrd_result_from_pthread(pthread_cond_init((pthread_cond_t*)&evnt->cond, NULL));
     if (result != c89thrd_success) {
-        pthread_mutex_destroy((pthread_mutex_t*)&evnt->lock);
-        return result;
+        result = c89thread_topology_query_fallback(pTopology, &pKeys);
+        if (result != c89thrd_success) {
+            return result;
+        }
     }
 
+    c89thread_topology_finalize(pTopology, pKeys);
+    c89thread_free(pKeys, pAllocationCallbacks);
+
     return c89thrd_success;
 }
 
-void c89evnt_destroy(c89evnt_t* evnt)
+int c89thread_get_topology(c89thread_topology* pTopology, const c89thread_allocation_callbacks* pAllocationCallbacks)
 {
-    if (evnt == NULL) {
-        return;
-    }
-
-    pthread_cond_destroy((pthread_cond_t*)&evnt->cond);
-    pthread_mutex_destroy((pthread_mutex_t*)&evnt->lock);
+    return c89thread_get_topology_from_root(pTopology, "", pAllocationCallbacks);
 }
 
-int c89evnt_wait(c89evnt_t* evnt)
+void c89thread_free_topology(c89thread_topology* pTopology)
 {
-    int result;
-
-    if (evnt == NULL) {
-        return c89thrd_error;
+    if (pTopology == NULL) {
+        return;
     }
 
-    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&evnt->lock));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
-    }
+    c89thread_free(pTopology->pCPUs, (pTopology->usingCustomAllocator) ? &pTopology->allocationCallbacks : NULL);
+    pTopology->pCPUs    = NULL;
+    pTopology->cpuCount = 0;
+}
+/* END c89thread_topology.c */
 
-    while (evnt->value == 0) {
-        result = c89thrd_result_from_pthread(pthread_cond_wait((pthread_cond_t*)&evnt->cond, (pthread_mutex_t*)&evnt->lock));
-        if (result != c89thrd_success) {
-            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-            return c89thrd_error;
-        }
-    }
-    evnt->value = 0;  /* Auto-reset. */
 
-    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-    return c89thrd_success;
-}
+/* BEG c89thread_usable_cpu_count.c */
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#include <sched.h>  /* For sched_getaffinity(). */
+#endif
 
-int c89evnt_timedwait(c89evnt_t* evnt, const struct timespec* time_point)
+#if defined(_WIN32)
+/* Returns 0 if the affinity mask could not be retrieved. */
+static int c89thread_get_affinity_cpu_count(const char* pRoot)
 {
-    int result;
-
-    if (evnt == NULL || time_point == NULL) {
-        return c89thrd_error;
-    }
+    DWORD_PTR processMask;
+    DWORD_PTR systemMask;
+    int count = 0;
 
-    result = c89pthread_mutex_timedlock((pthread_mutex_t*)&evnt->lock, time_point);
-    if (result != 0) {
-        if (result == c89thrd_timedout) {
-            return c89thrd_timedout;
-        }
+    (void)pRoot;
 
-        return c89thrd_error;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        return 0;
     }
 
-    while (evnt->value == 0) {
-        result = c89thrd_result_from_pthread(pthread_cond_timedwait((pthread_cond_t*)&evnt->cond, (pthread_mutex_t*)&evnt->lock, time_point));
-        if (result == c89thrd_timedout) {
-            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-            return c89thrd_timedout;
-        }
-        
-        if (result != c89thrd_success) {
-            pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-            return c89thrd_error;
-        }
+    while (processMask != 0) {
+        count += (int)(processMask & 1);
+        processMask >>= 1;
     }
-    evnt->value = 0;  /* Auto-reset. */
 
-    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-    return c89thrd_success;
+    return count;
 }
+#else
+/* The cgroup path is appended to the mount point so it needs a bit of extra room on top of the sysfs path. */
+#define C89THREAD_MAX_CGROUP_PATH_LENGTH 256
 
-int c89evnt_signal(c89evnt_t* evnt)
+/* Returns 0 if the affinity mask could not be retrieved. */
+static int c89thread_get_affinity_cpu_count(const char* pRoot)
 {
-    int result;
+    char path[C89THREAD_MAX_SYSFS_PATH_LENGTH];
+    char status[8192];
+    const char* pList;
+    unsigned int beg;
+    unsigned int end;
+    int count = 0;
+
+    #if defined(__linux__) && defined(_GNU_SOURCE)
+    {
+        if (pRoot[0] == '\0') {
+            cpu_set_t cpuSet;
 
-    if (evnt == NULL) {
-        return c89thrd_error;
+            /* This will fail with EINVAL on systems with more CPUs than fit in a cpu_set_t, in which case we'll fall through to /proc. */
+            if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+                return CPU_COUNT(&cpuSet);
+            }
+        }
+    }
+    #endif
+
+    sprintf(path, "%s/proc/self/status", pRoot);
+    if (c89thread_read_text_file(path, status, sizeof(status)) != c89thrd_success) {
+        return 0;
     }
 
-    result = c89thrd_result_from_pthread(pthread_mutex_lock((pthread_mutex_t*)&evnt->lock));
-    if (result != c89thrd_success) {
-        return c89thrd_error;
+    pList = strstr(status, "Cpus_allowed_list:");
+    if (pList == NULL) {
+        return 0;
     }
 
-    evnt->value = 1;
-    pthread_cond_signal((pthread_cond_t*)&evnt->cond);
+    pList += strlen("Cpus_allowed_list:");
+    while (c89thread_next_cpu_range(&pList, &beg, &end)) {
+        count += (int)(end - beg + 1);
+    }
 
-    pthread_mutex_unlock((pthread_mutex_t*)&evnt->lock);
-    return c89thrd_success;
+    return count;
 }
-#endif
-/* END c89thread_types.c */
-
 
-/* BEG c89thread_sleep.c */
-int c89thrd_sleep_timespec(struct timespec ts)
+/* Returns the quota of a single cgroup rounded up to a whole number of CPUs, or 0 if it is unlimited. */
+static unsigned int c89thread_read_cgroup_cpu_limit(const char* pDirectory, int isV2)
 {
-    return c89thrd_sleep(&ts, NULL);
-}
+    char path[C89THREAD_MAX_SYSFS_PATH_LENGTH + C89THREAD_MAX_CGROUP_PATH_LENGTH + sizeof("/cpu.cfs_period_us")];  /* The longest file name we append. */
+    char buffer[64];
+    const char* pStr = buffer;
+    unsigned int quota;
+    unsigned int period;
 
-int c89thrd_sleep_milliseconds(int milliseconds)
-{
-    if (milliseconds < 0) {
-        milliseconds = 0;
+    if (strlen(pDirectory) + sizeof("/cpu.cfs_period_us") > sizeof(path)) {
+        return 0;
     }
 
-    return c89thrd_sleep_timespec(c89timespec_milliseconds(milliseconds));
-}
-/* END c89thread_sleep.c */
+    if (isV2) {
+        /* cpu.max is "<quota> <period>", where the quota is "max" when there is no limit. */
+        sprintf(path, "%s/cpu.max", pDirectory);
+        if (c89thread_read_text_file(path, buffer, sizeof(buffer)) != c89thrd_success) {
+            return 0;
+        }
 
+        if (!c89thread_parse_uint(&pStr, &quota)) {
+            return 0;
+        }
 
-/* BEG c89thread_timespec.c */
-#if defined(_WIN32)
-int c89timespec_get(struct timespec* ts, int base)
-{
-    FILETIME ft;
-    LONGLONG current100Nanoseconds;
+        while (*pStr == ' ') {
+            pStr += 1;
+        }
 
-    if (ts == NULL) {
-        return 0;   /* 0 = error. */
-    }
+        if (!c89thread_parse_uint(&pStr, &period)) {
+            return 0;
+        }
+    } else {
+        /* cpu.cfs_quota_us is -1 when there is no limit which will fail to parse as an unsigned integer. */
+        sprintf(path, "%s/cpu.cfs_quota_us", pDirectory);
+        if (!c89thread_read_uint_file(path, &quota)) {
+            return 0;
+        }
 
-    ts->tv_sec  = 0;
-    ts->tv_nsec = 0;
+        sprintf(path, "%s/cpu.cfs_period_us", pDirectory);
+        if (!c89thread_read_uint_file(path, &period)) {
+            return 0;
+        }
+    }
 
-    /* Currently only supporting UTC. */
-    if (base != TIME_UTC) {
-        return 0;   /* 0 = error. */
+    if (quota == 0 || period == 0) {
+        return 0;
     }
 
-    GetSystemTimeAsFileTime(&ft);
-    current100Nanoseconds = (((LONGLONG)ft.dwHighDateTime << 32) | (LONGLONG)ft.dwLowDateTime);
-    current100Nanoseconds = current100Nanoseconds - ((LONGLONG)116444736 * 1000000000); /* Windows to Unix epoch. Normal value is 116444736000000000LL, but VC6 doesn't like 64-bit constants. */
+    return (quota / period) + ((quota % period) != 0);
+}
 
-    ts->tv_sec  = (time_t)(current100Nanoseconds / 10000000);
-    ts->tv_nsec =  (long)((current100Nanoseconds - (ts->tv_sec * 10000000)) * 100);
+/*
+Walks from the process' cgroup up to the root of the hierarchy and returns the tightest limit. Returns 0
+if there is no limit.
 
-    return base;
-}
-#else
-struct timespec c89timespec_from_timeval(struct timeval* tv)
+Without a cgroup namespace the path in /proc/self/cgroup is relative to the host's hierarchy and will not
+exist inside a container. That's fine because we'll eventually walk up to the mount point which is the
+container's own cgroup in that case.
+*/
+static unsigned int c89thread_get_cgroup_hierarchy_cpu_limit(const char* pMount, const char* pCgroupPath, int isV2)
 {
-    struct timespec ts;
+    char directory[C89THREAD_MAX_SYSFS_PATH_LENGTH + C89THREAD_MAX_CGROUP_PATH_LENGTH];
+    char* pSlash;
+    size_t mountLength;
+    unsigned int limit = 0;
+    unsigned int levelLimit;
 
-    ts.tv_sec  = tv->tv_sec;
-    ts.tv_nsec = tv->tv_usec * 1000;
+    mountLength = strlen(pMount);
+    memcpy(directory, pMount, mountLength);
+    memcpy(directory + mountLength, pCgroupPath, strlen(pCgroupPath) + 1);
 
-    return ts;
+    for (;;) {
+        levelLimit = c89thread_read_cgroup_cpu_limit(directory, isV2);
+        if (levelLimit > 0 && (limit == 0 || levelLimit < limit)) {
+            limit = levelLimit;
+        }
+
+        pSlash = strrchr(directory + mountLength, '/');
+        if (pSlash == NULL) {
+            break;
+        }
+
+        *pSlash = '\0';
+    }
+
+    return limit;
 }
 
-int c89timespec_get(struct timespec* ts, int base)
+/* Returns the CPU limit imposed by the cgroup quota, or 0 if there is no limit or cgroups are not available. */
+static unsigned int c89thread_get_cgroup_cpu_limit(const char* pRoot)
 {
-    if (ts == NULL) {
+    char path[C89THREAD_MAX_SYSFS_PATH_LENGTH];
+    char mount[C89THREAD_MAX_SYSFS_PATH_LENGTH];
+    char cgroups[4096];
+    char cgroupPath[C89THREAD_MAX_CGROUP_PATH_LENGTH];
+    const char* pLine;
+    const char* pControllers;
+    const char* pControllersEnd;
+    const char* pPath;
+    size_t pathLength;
+    unsigned int limit = 0;
+    unsigned int hierarchyLimit;
+    int isV2;
+
+    sprintf(path, "%s/proc/self/cgroup", pRoot);
+    if (c89thread_read_text_file(path, cgroups, sizeof(cgroups)) != c89thrd_success) {
         return 0;
     }
 
-    /*
-    This is annoying to get working on all compilers. Here's the hierarchy:
+    /* Each line is "<hierarchy-id>:<controller-list>:<path>". The cgroup v2 hierarchy has an ID of 0 and no controllers. */
+    for (pLine = cgroups; *pLine != '\0'; pLine = pPath + pathLength + (pPath[pathLength] == '\n')) {
+        pControllers = strchr(pLine, ':');
+        if (pControllers == NULL) {
+            break;
+        }
+        pControllers += 1;
 
-        * If using C11, use timespec_get(); else
-        * If _POSIX_C_SOURCE >= 199309L, use clock_gettime(CLOCK_REALTIME, ...); else
-        * Fall back to gettimeofday().
-    */
-    #if defined (__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__APPLE__) && !defined(__ANDROID__)
-    {
-        return timespec_get(ts, base);
-    }
-    #else
-    {
-        if (base != TIME_UTC) {
-            return 0;   /* Only TIME_UTC is supported. 0 = error. */
+        pControllersEnd = strchr(pControllers, ':');
+        if (pControllersEnd == NULL) {
+            break;
         }
 
-        #if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 199309L
-        {
-            if (clock_gettime(CLOCK_REALTIME, ts) != 0) {
-                return 0;   /* Failed to retrieve the time. 0 = error. */
+        pPath = pControllersEnd + 1;
+        pathLength = strcspn(pPath, "\n");
+
+        isV2 = (pLine[0] == '0' && pControllers == pLine + 2 && pControllersEnd == pControllers);
+        if (!isV2) {
+            /* We're only interested in the hierarchy with the "cpu" controller, which may be comounted with others like "cpu,cpuacct". */
+            const char* pController = pControllers;
+            int hasCPU = 0;
+
+            while (pController < pControllersEnd) {
+                size_t controllerLength = strcspn(pController, ",:");
+                if (controllerLength == 3 && strncmp(pController, "cpu", 3) == 0) {
+                    hasCPU = 1;
+                }
+
+                pController += controllerLength + 1;
             }
 
-            /* Getting here means we were successful. On success, need to return base (strange...) */
-            return base;
+            if (!hasCPU) {
+                continue;
+            }
         }
-        #else
-        {
-            struct timeval tv;
-            if (gettimeofday(&tv, NULL) != 0) {
-                return 0;   /* Failed to retrieve the time. 0 = error. */
+
+        /* The root cgroup is "/", which we treat as empty so it can be appended to the mount point. Paths that are too long are treated the same. */
+        if (pathLength < sizeof(cgroupPath)) {
+            memcpy(cgroupPath, pPath, pathLength);
+            cgroupPath[pathLength] = '\0';
+        } else {
+            cgroupPath[0] = '\0';
+        }
+
+        if (strcmp(cgroupPath, "/") == 0) {
+            cgroupPath[0] = '\0';
+        }
+
+        if (isV2) {
+            sprintf(mount, "%s/sys/fs/cgroup", pRoot);
+            hierarchyLimit = c89thread_get_cgroup_hierarchy_cpu_limit(mount, cgroupPath, isV2);
+        } else {
+            /* The v1 cpu hierarchy is normally mounted at "cpu,cpuacct" with "cpu" being a symlink to it, but either may exist on its own. */
+            sprintf(mount, "%s/sys/fs/cgroup/cpu,cpuacct", pRoot);
+            hierarchyLimit = c89thread_get_cgroup_hierarchy_cpu_limit(mount, cgroupPath, isV2);
+
+            if (hierarchyLimit == 0) {
+                sprintf(mount, "%s/sys/fs/cgroup/cpu", pRoot);
+                hierarchyLimit = c89thread_get_cgroup_hierarchy_cpu_limit(mount, cgroupPath, isV2);
             }
+        }
 
-            *ts = c89timespec_from_timeval(&tv);
-            return base;
+        if (hierarchyLimit > 0 && (limit == 0 || hierarchyLimit < limit)) {
+            limit = hierarchyLimit;
         }
-        #endif  /* _POSIX_C_SOURCE >= 199309L */
     }
-    #endif  /* C11 */
+
+    return limit;
 }
 #endif
 
-
-struct timespec c89timespec_now(void)
+int c89thread_get_usable_cpu_count_from_root(const char* pRoot)
 {
-    struct timespec ts;
+    int count;
 
-    ts.tv_sec  = 0;
-    ts.tv_nsec = 0;
-    c89timespec_get(&ts, TIME_UTC);
+    if (pRoot == NULL) {
+        pRoot = "";
+    }
 
-    return ts;
-}
+    #if !defined(_WIN32)
+    {
+        if (strlen(pRoot) > C89THREAD_MAX_SYSFS_ROOT_LENGTH) {
+            return c89thread_get_logical_cpu_count();
+        }
+    }
+    #endif
 
-struct timespec c89timespec_nanoseconds(time_t nanoseconds)
-{
-    struct timespec ts;
+    count = c89thread_get_affinity_cpu_count(pRoot);
+    if (count <= 0) {
+        count = c89thread_get_logical_cpu_count();
+    }
 
-    ts.tv_sec  = nanoseconds / 1000000000;
-    ts.tv_nsec = (long)(nanoseconds - (ts.tv_sec * 1000000000));
+    #if !defined(_WIN32)
+    {
+        unsigned int limit = c89thread_get_cgroup_cpu_limit(pRoot);
+        if (limit > 0 && limit < (unsigned int)count) {
+            count = (int)limit;
+        }
+    }
+    #endif
 
-    return ts;
+    if (count < 1) {
+        count = 1;
+    }
+
+    return count;
 }
 
-struct timespec c89timespec_milliseconds(time_t milliseconds)
+int c89thread_get_usable_cpu_count(void)
 {
-    struct timespec ts;
+    return c89thread_get_usable_cpu_count_from_root("");
+}
+/* END c89thread_usable_cpu_count.c */
 
-    ts.tv_sec  = milliseconds / 1000;
-    ts.tv_nsec = (long)((milliseconds - (ts.tv_sec * 1000)) * 1000000);
 
-    return ts;
+/* BEG c89thread_cpu_set.c */
+void c89thread_cpu_set_zero(c89thread_cpu_set* pSet)
+{
+    if (pSet == NULL) {
+        return;
+    }
+
+    memset(pSet, 0, sizeof(*pSet));
 }
 
-struct timespec c89timespec_seconds(time_t seconds)
+void c89thread_cpu_set_add(c89thread_cpu_set* pSet, unsigned int cpu)
 {
-    struct timespec ts;
-
-    ts.tv_sec  = seconds;
-    ts.tv_nsec = 0;
+    if (pSet == NULL || cpu >= C89THREAD_MAX_CPUS) {
+        return;
+    }
 
-    return ts;
+    pSet->bits[cpu / 32] |= ((c89thread_uint32)1 << (cpu % 32));
 }
 
-struct timespec c89timespec_diff(struct timespec lhs, struct timespec rhs)
+void c89thread_cpu_set_remove(c89thread_cpu_set* pSet, unsigned int cpu)
 {
-    struct timespec diff;
+    if (pSet == NULL || cpu >= C89THREAD_MAX_CPUS) {
+        return;
+    }
 
-    diff.tv_sec = lhs.tv_sec - rhs.tv_sec;
+    pSet->bits[cpu / 32] &= ~((c89thread_uint32)1 << (cpu % 32));
+}
 
-    if (lhs.tv_nsec >= rhs.tv_nsec) {
-        diff.tv_nsec = lhs.tv_nsec - rhs.tv_nsec;
-    } else {
-        diff.tv_nsec = lhs.tv_nsec + 1000000000 - rhs.tv_nsec;
-        diff.tv_sec -= 1;
+int c89thread_cpu_set_contains(const c89thread_cpu_set* pSet, unsigned int cpu)
+{
+    if (pSet == NULL || cpu >= C89THREAD_MAX_CPUS) {
+        return 0;
     }
 
-    return diff;
+    return (pSet->bits[cpu / 32] & ((c89thread_uint32)1 << (cpu % 32))) != 0;
 }
 
-struct timespec c89timespec_add(struct timespec tsA, struct timespec tsB)
+unsigned int c89thread_cpu_set_count(const c89thread_cpu_set* pSet)
 {
-    struct timespec ts;
+    unsigned int count = 0;
+    size_t iWord;
 
-    ts.tv_sec  = tsA.tv_sec  + tsB.tv_sec;
-    ts.tv_nsec = tsA.tv_nsec + tsB.tv_nsec;
-    if (ts.tv_nsec >= 1000000000) {
-        ts.tv_nsec -= 1000000000;
-        ts.tv_sec  += 1;
+    if (pSet == NULL) {
+        return 0;
     }
-    
-    return ts;
-}
 
-int c89timespec_cmp(struct timespec tsA, struct timespec tsB)
-{
-    if (tsA.tv_sec == tsB.tv_sec) {
-        if (tsA.tv_nsec == tsB.tv_nsec) {
-            return 0;
-        } else {
-            if (tsA.tv_nsec > tsB.tv_nsec) {
-                return +1;
-            } else {
-                return -1;
-            }
-        }
-    } else {
-        if (tsA.tv_sec > tsB.tv_sec) {
-            return +1;
-        } else {
-            return -1;
+    for (iWord = 0; iWord < sizeof(pSet->bits) / sizeof(pSet->bits[0]); iWord += 1) {
+        c89thread_uint32 word = pSet->bits[iWord];
+        while (word != 0) {
+            word &= word - 1;
+            count += 1;
         }
     }
-}
-/* END c89thread_timespec.c */
 
+    return count;
+}
+/* END c89thread_cpu_set.c */
 
-/* BEG c89thread_cpu_count.c */
-#if !defined(_WIN32)
-    #if defined(__APPLE__) && defined(__MACH__)
-        #if !defined(_DARWIN_C_SOURCE) && (defined(_XOPEN_SOURCE) || defined(_POSIX_C_SOURCE))
-        #define _DARWIN_C_SOURCE
-        #endif
-        #include <sys/types.h>
-        #include <sys/sysctl.h>  /* For sysctlbyname() to get CPU count. */
-    #else
-        #include <unistd.h>      /* For sysconf() to get CPU count. */
-    #endif
-#endif
 
-int c89thread_get_logical_cpu_count(void)
+/* BEG c89thrd_attr.c */
+c89thrd_attr c89thrd_attr_init(void)
 {
-    #if defined(_WIN32)
-    {
-        SYSTEM_INFO sysInfo;
-        GetSystemInfo(&sysInfo);
-
-        return (int)sysInfo.dwNumberOfProcessors;
-    }
-    #elif defined(__APPLE__) && defined(__MACH__)
-    {
-        int count;
-        size_t size = sizeof(count);
-
-        if (sysctlbyname("hw.logicalcpu", &count, &size, NULL, 0) != 0) {
-            /* Fall back to physical CPU cound. */
-            if (sysctlbyname("hw.physicalcpu", &count, &size, NULL, 0) != 0) {
-                return 1;  /* Failed to retrieve the logical CPU count. */
-            }
-        }
+    c89thrd_attr attr;
 
-        return count;
-    }
-    #else
-    {
-        int count = sysconf(_SC_NPROCESSORS_ONLN);
-        if (count < 1) {
-            return 1;  /* Failed to retrieve the logical CPU count. */
-        }
+    memset(&attr, 0, sizeof(attr));
 
-        return count;
-    }
-    #endif
+    return attr;
 }
-/* END c89thread_cpu_count.c */
+/* END c89thrd_attr.c */
 
 
 /* BEG c89thread_allocation_callbacks.c */
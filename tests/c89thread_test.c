@@ -1,3 +1,7 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* For GNU extensions like thread affinity. */
+#endif
+
 #define C89THREAD_IMPLEMENTATION
 /*#define C89THREAD_USE_MANUAL_RECURSIVE_MUTEX*/
 #include "c89thread.h"
@@ -6,6 +10,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
 typedef struct c89thread_test c89thread_test;
 
@@ -423,393 +428,3148 @@ int c89thread_test_c89thrd_sleep(c89thread_test* pTest)
 /* END test_c89thrd_sleep */
 
 
-/* BEG test_c89mtx */
-static int c89thread_test_c89mtx_basic__thread_entry(void* pUserData)
+/* BEG test_c89thrd_sleep_precise */
+int c89thread_test_c89thrd_sleep_precise(c89thread_test* pTest)
 {
-    c89mtx_t* pMutex = (c89mtx_t*)pUserData;
+    struct timespec spinThreshold;
+    struct timespec duration;
+    struct timespec start;
+    struct timespec elapsed;
+    int iSleep;
     int result;
 
-    result = c89mtx_lock(pMutex);
+    result = c89thrd_sleep_calibrate(&spinThreshold);
     if (result != c89thrd_success) {
-        printf("Thread failed to lock mutex: %d\n", result);
+        printf("%s: c89thrd_sleep_calibrate() failed.\n", pTest->name);
         return result;
     }
 
-    c89thrd_sleep_milliseconds(10); /* Simulate some work. */
+    if (spinThreshold.tv_sec < 0 || spinThreshold.tv_nsec < 0) {
+        printf("%s: c89thrd_sleep_calibrate() returned a negative spin threshold.\n", pTest->name);
+        return c89thrd_error;
+    }
 
-    result = c89mtx_unlock(pMutex);
-    if (result != c89thrd_success) {
-        printf("Thread failed to unlock mutex: %d\n", result);
-        return result;
+    /*
+    The precision we get depends heavily on the load of the machine running the test so this only
+    checks that we never wake up early and aren't wildly late.
+    */
+    duration = c89timespec_nanoseconds(200000);
+
+    for (iSleep = 0; iSleep < 10; iSleep += 1) {
+        start = c89timespec_now_monotonic();
+
+        result = c89thrd_sleep_precise(&duration);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_sleep_precise() failed.\n", pTest->name);
+            return result;
+        }
+
+        elapsed = c89timespec_diff(c89timespec_now_monotonic(), start);
+        if (c89timespec_cmp(elapsed, duration) < 0) {
+            printf("%s: c89thrd_sleep_precise() woke up early.\n", pTest->name);
+            return c89thrd_error;
+        }
+
+        if (c89timespec_cmp(elapsed, c89timespec_add(duration, c89timespec_milliseconds(50))) > 0) {
+            printf("%s: c89thrd_sleep_precise() overslept by more than 50 milliseconds.\n", pTest->name);
+            return c89thrd_error;
+        }
     }
 
-    return 0;
+    return c89thrd_success;
 }
+/* END test_c89thrd_sleep_precise */
 
-int c89thread_test_c89mtx_basic(c89thread_test* pTest, int type)
+
+/* BEG test_c89thrd_sleep_until */
+int c89thread_test_c89thrd_sleep_until(c89thread_test* pTest)
 {
-    c89mtx_t mutex;
-    c89thrd_t thread;
+    struct timespec timePoint;
+    int result;
+
+    timePoint = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(10));
+    result = c89thrd_sleep_until(&timePoint, TIME_MONOTONIC);
+    if (result != c89thrd_success || c89timespec_cmp(c89timespec_now_monotonic(), timePoint) < 0) {
+        printf("%s: c89thrd_sleep_until(TIME_MONOTONIC) failed or woke up early.\n", pTest->name);
+        return c89thrd_error;
+    }
 
+    timePoint = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
+    result = c89thrd_sleep_until(&timePoint, TIME_UTC);
+    if (result != c89thrd_success || c89timespec_cmp(c89timespec_now(), timePoint) < 0) {
+        printf("%s: c89thrd_sleep_until(TIME_UTC) failed or woke up early.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    /* A time point in the past should return straight away. */
+    timePoint = c89timespec_now_monotonic();
+    if (c89thrd_sleep_until(&timePoint, TIME_MONOTONIC) != c89thrd_success) {
+        printf("%s: c89thrd_sleep_until() failed with a time point in the past.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89thrd_sleep_until(&timePoint, 12345) != c89thrd_error) {
+        printf("%s: c89thrd_sleep_until() accepted an invalid base.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END test_c89thrd_sleep_until */
+
+
+/* BEG test_c89periodic */
+int c89thread_test_c89periodic(c89thread_test* pTest)
+{
+    c89periodic_t periodic;
+    struct timespec period;
+    struct timespec firstDeadline;
+    struct timespec expectedDeadline;
+    unsigned int overruns;
+    int lateTickCount = 0;
+    int iTick;
     int result;
 
-    result = c89mtx_init(&mutex, type);
+    period = c89timespec_milliseconds(5);
+
+    result = c89periodic_init(&periodic, &period, 0);
     if (result != c89thrd_success) {
-        printf("%s: c89mtx_init() failed.\n", pTest->name);
+        printf("%s: c89periodic_init() failed.\n", pTest->name);
         return result;
     }
 
-    result = c89thrd_create(&thread, c89thread_test_c89mtx_basic__thread_entry, &mutex);
-    if (result != c89thrd_success) {
-        printf("%s: c89thrd_create() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
-        return result;
+    firstDeadline = periodic.next;
+
+    for (iTick = 0; iTick < 5; iTick += 1) {
+        result = c89periodic_wait(&periodic, &overruns);
+        if (result != c89thrd_success) {
+            printf("%s: c89periodic_wait() failed.\n", pTest->name);
+            return result;
+        }
+
+        if (overruns > 0) {
+            lateTickCount += 1;
+        }
     }
 
-    result = c89mtx_lock(&mutex);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_lock() failed.\n", pTest->name);
-        c89thrd_join(thread, NULL);
-        c89mtx_destroy(&mutex);
-        return result;
+    /*
+    Every deadline is a whole number of periods after the first, however late we were. A late tick
+    advances by the number of deadlines it missed rather than by one.
+    */
+    expectedDeadline = c89timespec_add(firstDeadline, c89timespec_milliseconds((time_t)(5 * (5 - lateTickCount + (int)periodic.overruns))));
+    if (c89timespec_cmp(periodic.next, expectedDeadline) != 0) {
+        printf("%s: The deadlines drifted.\n", pTest->name);
+        return c89thrd_error;
     }
 
-    c89thrd_sleep_milliseconds(10); /* Simulate some work. */
+    /* Taking three periods to do the work should miss at least two deadlines. */
+    c89thrd_sleep_milliseconds(15);
 
-    result = c89mtx_unlock(&mutex);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-        c89thrd_join(thread, NULL);
-        c89mtx_destroy(&mutex);
-        return result;
+    result = c89periodic_wait(&periodic, &overruns);
+    if (result != c89thrd_success || overruns < 2) {
+        printf("%s: c89periodic_wait() did not report the overrun.\n", pTest->name);
+        return c89thrd_error;
     }
 
-    result = c89thrd_join(thread, NULL);
-    if (result != c89thrd_success) {
-        printf("%s: c89thrd_join() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
-        return result;
+    if (c89timespec_cmp(periodic.next, c89timespec_now_monotonic()) <= 0) {
+        printf("%s: The next deadline is not in the future after an overrun.\n", pTest->name);
+        return c89thrd_error;
     }
 
-    c89mtx_destroy(&mutex);
     return c89thrd_success;
 }
+/* END test_c89periodic */
 
 
+/* BEG test_c89thrd_affinity */
 typedef struct
 {
-    c89mtx_t* pMutex;
+    c89thread_cpu_set affinity;
     int result;
-} c89thread_test_c89mtx_timed_data;
+} c89thread_test_c89thrd_affinity_data;
 
-static int c89thread_test_c89mtx_timed__thread_entry(void* pUserData)
+static int c89thread_test_c89thrd_affinity__entry(void* pUserData)
 {
-    c89thread_test_c89mtx_timed_data* pData = (c89thread_test_c89mtx_timed_data*)pUserData;
-    struct timespec timeout;
-    int result;
+    c89thread_test_c89thrd_affinity_data* pData = (c89thread_test_c89thrd_affinity_data*)pUserData;
 
-    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
-
-    /* The calling thread will be holding the lock. We expect this one to fail. */
-    result = c89mtx_timedlock(pData->pMutex, &timeout);
-    if (result != c89thrd_success) {
-        if (result == c89thrd_timedout) {
-            pData->result = c89thrd_success;
-        } else {
-            printf("c89mtx_timedlock() failed with unexpected error: %d\n", result);
-            pData->result = result;
-            return result;
-        }
-    } else {
-        /* We successfully locked the mutex which should never have happened. This is a failure case. */
-        printf("c89mtx_timedlock() succeeded unexpectedly (error case expected).\n");
-        pData->result = c89thrd_error;
-        c89mtx_unlock(pData->pMutex);
-    }
+    pData->result = c89thrd_get_affinity(c89thrd_current(), &pData->affinity);
 
     return 0;
 }
 
-int c89thread_test_c89mtx_timed(c89thread_test* pTest, int type)
+int c89thread_test_c89thrd_affinity(c89thread_test* pTest)
 {
-    c89mtx_t mutex;
-    struct timespec timeout;
+    c89thread_test_c89thrd_affinity_data data;
+    c89thread_cpu_set original;
+    c89thread_cpu_set pinned;
+    c89thrd_attr attr;
+    c89thrd_t thread;
+    unsigned int firstCPU;
     int result;
 
-    result = c89mtx_init(&mutex, type | c89mtx_timed);
+    result = c89thrd_get_affinity(c89thrd_current(), &original);
     if (result != c89thrd_success) {
-        printf("%s: c89mtx_init() failed.\n", pTest->name);
+        printf("%s: c89thrd_get_affinity() failed.\n", pTest->name);
         return result;
     }
 
-    /* A simple timed lock and unlock with no contention to start with. */
-    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
-
-    result = c89mtx_timedlock(&mutex, &timeout);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_timedlock() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
-        return result;
+    if (c89thread_cpu_set_count(&original) == 0) {
+        printf("%s: The current thread has an empty affinity mask.\n", pTest->name);
+        return c89thrd_error;
     }
 
-    result = c89mtx_unlock(&mutex);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
-        return result;
+    for (firstCPU = 0; !c89thread_cpu_set_contains(&original, firstCPU); firstCPU += 1) {
     }
 
+    /* Pin a new thread to a single CPU. It should see that as its affinity from the moment it starts. */
+    c89thread_cpu_set_zero(&pinned);
+    c89thread_cpu_set_add(&pinned, firstCPU);
 
-    /* Do a test with contention to force a timeout. */
-    {
-        c89thrd_t thread;
-        c89thread_test_c89mtx_timed_data data;
+    attr = c89thrd_attr_init();
+    attr.pAffinity = &pinned;
 
-        data.pMutex = &mutex;
-        data.result = c89thrd_error;
+    data.result = c89thrd_error;
 
-        /* Must lock the mutex before starting the thread. */
-        result = c89mtx_lock(&mutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_lock() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+    result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_affinity__entry, &data, &attr);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_create_ex2() failed.\n", pTest->name);
+        return result;
+    }
 
-        result = c89thrd_create(&thread, c89thread_test_c89mtx_timed__thread_entry, &data);
-        if (result != c89thrd_success) {
-            printf("%s: c89thrd_create() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+    c89thrd_join(thread, NULL);
 
-        result = c89thrd_join(thread, NULL);
-        if (result != c89thrd_success) {
-            printf("%s: c89thrd_join() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+    if (data.result != c89thrd_success || c89thread_cpu_set_count(&data.affinity) != 1 || !c89thread_cpu_set_contains(&data.affinity, firstCPU)) {
+        printf("%s: The new thread was not pinned to CPU %u.\n", pTest->name, firstCPU);
+        return c89thrd_error;
+    }
 
-        result = c89mtx_unlock(&mutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
+    /* Changing the affinity of an existing thread. */
+    result = c89thrd_set_affinity(c89thrd_current(), &pinned);
+    if (result == c89thrd_success) {
+        result = c89thrd_get_affinity(c89thrd_current(), &data.affinity);
+        if (result == c89thrd_success && (c89thread_cpu_set_count(&data.affinity) != 1 || !c89thread_cpu_set_contains(&data.affinity, firstCPU))) {
+            printf("%s: c89thrd_set_affinity() did not change the affinity.\n", pTest->name);
+            result = c89thrd_error;
         }
 
-        if (data.result != c89thrd_success) {
-            printf("%s: c89thread_test_c89mtx_timed__thread_entry() failed with result %d.\n", pTest->name, data.result);
-            c89mtx_destroy(&mutex);
-            return data.result;
-        }
+        c89thrd_set_affinity(c89thrd_current(), &original);
+    } else {
+        printf("%s: c89thrd_set_affinity() failed.\n", pTest->name);
     }
 
-    c89mtx_destroy(&mutex);
-    return c89thrd_success;
+    return result;
 }
+/* END test_c89thrd_affinity */
 
 
+/* BEG test_c89thrd_stack */
+#if !defined(_WIN32)
+#include <unistd.h> /* For sysconf(). */
+#endif
+
 typedef struct
 {
-    c89mtx_t* pMutex;
-    int result;
-} c89thread_test_c89mtx_trylock_data;
+    char* pStackBeg;
+    char* pStackEnd;
+    int insideStack;
+    int sum;
+} c89thread_test_c89thrd_stack_data;
 
-static int c89thread_test_c89mtx_trylock__thread_entry(void* pUserData)
+static int c89thread_test_c89thrd_stack__entry(void* pUserData)
 {
-    c89thread_test_c89mtx_trylock_data* pData = (c89thread_test_c89mtx_trylock_data*)pUserData;
-    int result;
+    c89thread_test_c89thrd_stack_data* pData = (c89thread_test_c89thrd_stack_data*)pUserData;
+    char scratch[16384];  /* Make sure a decent chunk of a small stack is usable. */
+    size_t i;
 
-    /* The calling thread will be holding the lock. We expect this one to fail with c89thrd_busy. */
-    result = c89mtx_trylock(pData->pMutex);
-    if (result != c89thrd_success) {
-        if (result == c89thrd_busy) {
-            pData->result = c89thrd_success;
-        } else {
-            printf("c89mtx_trylock() failed with unexpected error: %d\n", result);
-            pData->result = result;
-            return result;
-        }
-    } else {
-        /* We successfully locked the mutex which should never have happened. This is a failure case. */
-        printf("c89mtx_trylock() succeeded unexpectedly (error case expected).\n");
-        pData->result = c89thrd_error;
-        c89mtx_unlock(pData->pMutex);
+    for (i = 0; i < sizeof(scratch); i += 1) {
+        scratch[i] = (char)(i & 0x7F);
     }
 
+    pData->sum = 0;
+    for (i = 0; i < sizeof(scratch); i += 1) {
+        pData->sum += scratch[i];
+    }
+
+    pData->insideStack = (scratch >= pData->pStackBeg && scratch < pData->pStackEnd);
+
     return 0;
 }
 
-int c89thread_test_c89mtx_trylock(c89thread_test* pTest, int type)
+int c89thread_test_c89thrd_stack(c89thread_test* pTest)
 {
-    c89mtx_t mutex;
+    c89thread_test_c89thrd_stack_data data;
+    c89thrd_attr attr;
+    c89thrd_t thread;
+    int expectedSum;
     int result;
 
-    result = c89mtx_init(&mutex, type);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_init() failed.\n", pTest->name);
-        return result;
-    }
+    expectedSum = (16384 / 128) * (127 * 128 / 2);
 
-    /* Initial trylock with no contention. This should always succeed. */
-    result = c89mtx_trylock(&mutex);
-    if (result != c89thrd_success) {
-        printf("%s: c89mtx_trylock() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
-        return result;
-    }
+    /* A small stack with an explicit guard size. */
+    attr = c89thrd_attr_init();
+    attr.stackSize = 64 * 1024;
+    attr.guardSize = 4096;
 
-    result = c89mtx_unlock(&mutex);
+    memset(&data, 0, sizeof(data));
+
+    result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_stack__entry, &data, &attr);
     if (result != c89thrd_success) {
-        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-        c89mtx_destroy(&mutex);
+        printf("%s: c89thrd_create_ex2() failed with a 64KB stack.\n", pTest->name);
         return result;
     }
 
+    c89thrd_join(thread, NULL);
 
-    /* TODO: Test trylock with contention to force a failure. */
+    if (data.sum != expectedSum) {
+        printf("%s: Thread with a 64KB stack did not run correctly.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    /* A stack provided by the caller. Not supported on Windows. */
+    #if !defined(_WIN32)
     {
-        c89thrd_t thread;
-        c89thread_test_c89mtx_trylock_data data;
+        size_t stackSize = 2 * 1024 * 1024;   /* glibc puts thread local storage at the top of the stack, and sanitizers use a lot of it. */
+        size_t pageSize  = (size_t)sysconf(_SC_PAGESIZE);
+        void* pAllocation;
+        void* pStack;
+
+        /* The stack must be page aligned. Some platforms, like macOS, reject it otherwise. */
+        pAllocation = c89thread_malloc(stackSize + pageSize, NULL);
+        if (pAllocation == NULL) {
+            return c89thrd_nomem;
+        }
 
-        data.pMutex = &mutex;
-        data.result = c89thrd_error;
+        pStack = (void*)(((c89thread_uintptr)pAllocation + (pageSize - 1)) & ~(c89thread_uintptr)(pageSize - 1));
 
-        /* Make sure the mutex is locked before starting the thread. */
-        result = c89mtx_lock(&mutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_lock() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+        attr = c89thrd_attr_init();
+        attr.stackSize = stackSize;
+        attr.pStack    = pStack;
 
-        result = c89thrd_create(&thread, c89thread_test_c89mtx_trylock__thread_entry, &data);
-        if (result != c89thrd_success) {
-            printf("%s: c89thrd_create() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+        memset(&data, 0, sizeof(data));
+        data.pStackBeg = (char*)pStack;
+        data.pStackEnd = (char*)pStack + stackSize;
 
-        result = c89thrd_join(thread, NULL);
-        if (result != c89thrd_success) {
-            printf("%s: c89thrd_join() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
-        }
+        result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_stack__entry, &data, &attr);
+        if (result == c89thrd_success) {
+            c89thrd_join(thread, NULL);
 
-        result = c89mtx_unlock(&mutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-            c89mtx_destroy(&mutex);
-            return result;
+            if (data.sum != expectedSum || !data.insideStack) {
+                printf("%s: Thread did not run on the provided stack.\n", pTest->name);
+                result = c89thrd_error;
+            }
+        } else {
+            printf("%s: c89thrd_create_ex2() failed with a provided stack.\n", pTest->name);
         }
 
-        if (data.result != c89thrd_success) {
-            printf("%s: c89thread_test_c89mtx_trylock__thread_entry() failed with result %d.\n", pTest->name, data.result);
-            c89mtx_destroy(&mutex);
-            return data.result;
-        }
+        c89thread_free(pAllocation, NULL);
     }
+    #endif
 
-    c89mtx_destroy(&mutex);
-    return c89thrd_success;
+    return result;
+}
+/* END test_c89thrd_stack */
+
+
+/* BEG test_c89thrd_name */
+typedef struct
+{
+    char name[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    int result;
+} c89thread_test_c89thrd_name_data;
+
+static int c89thread_test_c89thrd_name__entry(void* pUserData)
+{
+    c89thread_test_c89thrd_name_data* pData = (c89thread_test_c89thrd_name_data*)pUserData;
+
+    pData->result = c89thrd_get_name(c89thrd_current(), pData->name, sizeof(pData->name));
+
+    return 0;
+}
+
+int c89thread_test_c89thrd_name(c89thread_test* pTest)
+{
+    c89thread_test_c89thrd_name_data data;
+    c89thrd_attr attr;
+    c89thrd_t thread;
+    char name[C89THREAD_MAX_THREAD_NAME_LENGTH];
+    int result;
+
+    /* The name given at creation time should be visible from the very start of the thread. */
+    attr = c89thrd_attr_init();
+    attr.pName = "c89test-worker";
+
+    data.result = c89thrd_error;
+
+    result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_name__entry, &data, &attr);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_create_ex2() failed.\n", pTest->name);
+        return result;
+    }
+
+    c89thrd_join(thread, NULL);
+
+    if (data.result != c89thrd_success || strcmp(data.name, "c89test-worker") != 0) {
+        printf("%s: Thread was not named at creation time.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    /* Names that are too long for the OS are truncated rather than rejected. */
+    if (c89thrd_set_name(c89thrd_current(), "c89thread-test-main-thread") != c89thrd_success) {
+        printf("%s: c89thrd_set_name() failed.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89thrd_get_name(c89thrd_current(), name, sizeof(name)) != c89thrd_success || strncmp(name, "c89thread-test-main-thread", strlen(name)) != 0 || name[0] == '\0') {
+        printf("%s: c89thrd_get_name() returned an unexpected name.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    #if !defined(_WIN32)
+    {
+        if (!pthread_equal(c89thrd_native_handle(c89thrd_current()), pthread_self())) {
+            printf("%s: c89thrd_native_handle() did not return the pthread_t.\n", pTest->name);
+            return c89thrd_error;
+        }
+    }
+    #endif
+
+    return result;
+}
+/* END test_c89thrd_name */
+
+
+/* BEG test_c89thrd_priority */
+#if defined(__linux__)
+#include <sys/resource.h>   /* For getpriority(). */
+#endif
+
+typedef struct
+{
+    int policy;
+    int nice;
+    int ran;
+    int resetResult;
+} c89thread_test_c89thrd_priority_data;
+
+static int c89thread_test_c89thrd_priority__entry(void* pUserData)
+{
+    c89thread_test_c89thrd_priority_data* pData = (c89thread_test_c89thrd_priority_data*)pUserData;
+
+    pData->ran = 1;
+    c89thrd_get_priority(c89thrd_current(), &pData->policy, NULL);
+
+    #if defined(__linux__)
+    {
+        pData->nice = getpriority(PRIO_PROCESS, 0);
+    }
+    #endif
+
+    /* Going back to the normal policy doesn't need any special permissions. */
+    pData->resetResult = c89thrd_set_priority(c89thrd_current(), c89thrd_sched_other, 0);
+
+    return 0;
+}
+
+int c89thread_test_c89thrd_priority(c89thread_test* pTest)
+{
+    c89thread_test_c89thrd_priority_data data;
+    c89thrd_attr attr;
+    c89thrd_t thread;
+    int result;
+
+    /* An invalid policy must fail without running the thread function. */
+    memset(&data, 0, sizeof(data));
+
+    attr = c89thrd_attr_init();
+    attr.schedPolicy = 1000;
+
+    result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_priority__entry, &data, &attr);
+    if (result != c89thrd_error || data.ran) {
+        printf("%s: Creating a thread with an invalid policy did not fail cleanly.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    /* A real time policy requires a priority. This must be an error rather than a crash. */
+    if (c89thrd_set_priority(c89thrd_current(), c89thrd_sched_fifo, 0) != c89thrd_error) {
+        printf("%s: Expected c89thrd_error for a real time policy with a priority of 0.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    #if defined(__linux__) || defined(_WIN32)
+    {
+        memset(&data, 0, sizeof(data));
+
+        attr = c89thrd_attr_init();
+        attr.schedPolicy = c89thrd_sched_batch;
+        #if defined(__linux__)
+        attr.nice = 5;
+        #endif
+
+        result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_priority__entry, &data, &attr);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create_ex2() failed with c89thrd_sched_batch.\n", pTest->name);
+            return result;
+        }
+
+        c89thrd_join(thread, NULL);
+
+        if (data.policy != c89thrd_sched_batch) {
+            printf("%s: Thread was not created with c89thrd_sched_batch.\n", pTest->name);
+            return c89thrd_error;
+        }
+
+        #if defined(__linux__)
+        {
+            if (data.nice != 5) {
+                printf("%s: Expected a nice value of 5, got %d.\n", pTest->name, data.nice);
+                return c89thrd_error;
+            }
+        }
+        #endif
+
+        if (data.resetResult != c89thrd_success) {
+            printf("%s: c89thrd_set_priority() failed.\n", pTest->name);
+            return c89thrd_error;
+        }
+    }
+    #endif
+
+    return c89thrd_success;
+}
+/* END test_c89thrd_priority */
+
+
+/* BEG test_c89thrd_noalloc */
+static void* c89thread_test_c89thrd_noalloc__malloc(size_t sz, void* pUserData)
+{
+    *(int*)pUserData += 1;
+    return malloc(sz);
+}
+
+static void* c89thread_test_c89thrd_noalloc__realloc(void* p, size_t sz, void* pUserData)
+{
+    *(int*)pUserData += 1;
+    return realloc(p, sz);
+}
+
+static void c89thread_test_c89thrd_noalloc__free(void* p, void* pUserData)
+{
+    (void)pUserData;
+    free(p);
+}
+
+static int c89thread_test_c89thrd_noalloc__entry(void* pUserData)
+{
+    return *(int*)pUserData + 1;
+}
+
+int c89thread_test_c89thrd_noalloc(c89thread_test* pTest)
+{
+    c89thread_allocation_callbacks allocationCallbacks;
+    c89thrd_attr attr;
+    c89thrd_t thread;
+    int allocationCount = 0;
+    int value = 41;
+    int iThread;
+    int result;
+
+    allocationCallbacks.pUserData = &allocationCount;
+    allocationCallbacks.onMalloc  = c89thread_test_c89thrd_noalloc__malloc;
+    allocationCallbacks.onRealloc = c89thread_test_c89thrd_noalloc__realloc;
+    allocationCallbacks.onFree    = c89thread_test_c89thrd_noalloc__free;
+
+    /* Sanity check that the allocation callbacks are normally used. */
+    attr = c89thrd_attr_init();
+    attr.pAllocationCallbacks = &allocationCallbacks;
+
+    result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_noalloc__entry, &value, &attr);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_create_ex2() failed.\n", pTest->name);
+        return result;
+    }
+
+    c89thrd_join(thread, NULL);
+
+    if (allocationCount == 0) {
+        printf("%s: Expected the allocation callbacks to be used.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    /* The start data is on our stack so several threads in a row will each need to have picked it up before we return. */
+    attr.noAlloc = 1;
+    allocationCount = 0;
+
+    for (iThread = 0; iThread < 8; iThread += 1) {
+        int threadResult = 0;
+
+        result = c89thrd_create_ex2(&thread, c89thread_test_c89thrd_noalloc__entry, &value, &attr);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create_ex2() failed with noAlloc.\n", pTest->name);
+            return result;
+        }
+
+        c89thrd_join(thread, &threadResult);
+
+        if (threadResult != 42) {
+            printf("%s: Expected 42, got %d.\n", pTest->name, threadResult);
+            return c89thrd_error;
+        }
+    }
+
+    if (allocationCount != 0) {
+        printf("%s: %d allocations were made with noAlloc.\n", pTest->name, allocationCount);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END test_c89thrd_noalloc */
+
+
+/* BEG test_c89thrd_cache */
+static int c89thread_test_c89thrd_cache__entry(void* pUserData)
+{
+    return *(int*)pUserData;
+}
+
+static int c89thread_test_c89thrd_cache__exit(void* pUserData)
+{
+    c89thrd_exit(*(int*)pUserData);
+    return 0;
+}
+
+static int c89thread_test_c89thrd_cache__wait(void* pUserData)
+{
+    c89latch_t* pLatch = (c89latch_t*)pUserData;
+    c89latch_wait(pLatch);
+    return 3;
+}
+
+static void c89thread_test_c89thrd_cache__on_entry_exit(void* pUserData)
+{
+    *(int*)pUserData += 1;
+}
+
+#if !defined(_WIN32)
+static int c89thread_test_c89thrd_cache_posix(c89thread_test* pTest)
+{
+    c89thrd_cache_config config;
+    c89thread_entry_exit_callbacks entryExitCallbacks;
+    c89thrd_t threads[3];
+    c89thrd_t reused;
+    c89latch_t latch;
+    int entryExitCount = 0;
+    int value1 = 1;
+    int value2 = 2;
+    int res;
+    int iThread;
+    int result;
+
+    config = c89thrd_cache_config_init(2, 5000);
+
+    result = c89thrd_cache_init(&config, NULL);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_cache_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    /* A thread that has been joined should be parked and then reused by the next create. */
+    c89thrd_create(&threads[0], c89thread_test_c89thrd_cache__entry, &value1);
+    if (c89thrd_join(threads[0], &res) != c89thrd_success || res != 1) {
+        printf("%s: Failed to join cached thread.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    entryExitCallbacks.pUserData = &entryExitCount;
+    entryExitCallbacks.onEntry   = c89thread_test_c89thrd_cache__on_entry_exit;
+    entryExitCallbacks.onExit    = c89thread_test_c89thrd_cache__on_entry_exit;
+
+    c89thrd_create_ex(&reused, c89thread_test_c89thrd_cache__entry, &value2, &entryExitCallbacks, NULL);
+    if (c89thrd_join(reused, &res) != c89thrd_success || res != 2) {
+        printf("%s: Failed to join reused thread.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (!c89thrd_equal(threads[0], reused)) {
+        printf("%s: The parked thread was not reused.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (entryExitCount != 2) {
+        printf("%s: Entry and exit callbacks were not run for the reused thread.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* c89thrd_exit() terminates the OS thread but the result must still be available to c89thrd_join(). */
+    c89thrd_create(&threads[0], c89thread_test_c89thrd_cache__exit, &value2);
+    if (c89thrd_join(threads[0], &res) != c89thrd_success || res != 2) {
+        printf("%s: Failed to retrieve the result of c89thrd_exit().\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* More threads than the capacity of the cache. The extra thread is created normally. */
+    c89latch_init(&latch, 1);
+
+    for (iThread = 0; iThread < 3; iThread += 1) {
+        if (c89thrd_create(&threads[iThread], c89thread_test_c89thrd_cache__wait, &latch) != c89thrd_success) {
+            printf("%s: c89thrd_create() failed with a full cache.\n", pTest->name);
+            result = c89thrd_error;
+        }
+    }
+
+    c89latch_count_down(&latch, 1);
+
+    for (iThread = 0; iThread < 3; iThread += 1) {
+        res = 0;
+        if (c89thrd_join(threads[iThread], &res) != c89thrd_success || res != 3) {
+            printf("%s: Failed to join thread %d with a full cache.\n", pTest->name, iThread);
+            result = c89thrd_error;
+        }
+    }
+
+    c89latch_destroy(&latch);
+
+    /* A detached thread is parked as soon as it finishes. */
+    c89thrd_create(&threads[0], c89thread_test_c89thrd_cache__entry, &value1);
+    if (c89thrd_detach(threads[0]) != c89thrd_success) {
+        printf("%s: c89thrd_detach() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Waits for the parked threads to exit. */
+    c89thrd_cache_uninit();
+
+    return result;
+}
+#endif
+
+int c89thread_test_c89thrd_cache(c89thread_test* pTest)
+{
+    #if defined(_WIN32)
+    {
+        /* Not supported on Windows. */
+        c89thrd_cache_config config = c89thrd_cache_config_init(2, 5000);
+        (void)pTest;
+        return (c89thrd_cache_init(&config, NULL) == c89thrd_error) ? c89thrd_success : c89thrd_error;
+    }
+    #else
+    {
+        return c89thread_test_c89thrd_cache_posix(pTest);
+    }
+    #endif
+}
+/* END test_c89thrd_cache */
+
+
+/* BEG test_c89thrd_timedjoin */
+static int c89thread_test_c89thrd_timedjoin__entry(void* pUserData)
+{
+    c89latch_wait((c89latch_t*)pUserData);
+    return 4;
+}
+
+static int c89thread_test_c89thrd_timedjoin_ex(c89thread_test* pTest, const char* pDescription)
+{
+    c89thrd_t thread;
+    c89latch_t latch;
+    struct timespec timeout;
+    int res = 0;
+    int result;
+
+    c89latch_init(&latch, 1);
+
+    result = c89thrd_create(&thread, c89thread_test_c89thrd_timedjoin__entry, &latch);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_create() failed (%s).\n", pTest->name, pDescription);
+        c89latch_destroy(&latch);
+        return result;
+    }
+
+    /* The thread is blocked on the latch so neither of these should be able to join it. */
+    if (c89thrd_tryjoin(thread, &res) != c89thrd_busy) {
+        printf("%s: c89thrd_tryjoin() did not return c89thrd_busy (%s).\n", pTest->name, pDescription);
+        result = c89thrd_error;
+    }
+
+    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(20));
+    if (c89thrd_timedjoin(thread, &res, &timeout) != c89thrd_timedout) {
+        printf("%s: c89thrd_timedjoin() did not time out (%s).\n", pTest->name, pDescription);
+        result = c89thrd_error;
+    }
+
+    c89latch_count_down(&latch, 1);
+
+    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(5000));
+    if (c89thrd_timedjoin(thread, &res, &timeout) != c89thrd_success || res != 4) {
+        printf("%s: c89thrd_timedjoin() failed after the thread finished (%s).\n", pTest->name, pDescription);
+        result = c89thrd_error;
+    }
+
+    c89latch_destroy(&latch);
+
+    return result;
+}
+
+int c89thread_test_c89thrd_timedjoin(c89thread_test* pTest)
+{
+    int result;
+
+    result = c89thread_test_c89thrd_timedjoin_ex(pTest, "uncached");
+
+    #if !defined(_WIN32)
+    {
+        c89thrd_cache_config config = c89thrd_cache_config_init(1, 5000);
+        if (c89thrd_cache_init(&config, NULL) != c89thrd_success) {
+            printf("%s: c89thrd_cache_init() failed.\n", pTest->name);
+            return c89thrd_error;
+        }
+
+        if (c89thread_test_c89thrd_timedjoin_ex(pTest, "cached") != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        c89thrd_cache_uninit();
+    }
+    #endif
+
+    return result;
+}
+/* END test_c89thrd_timedjoin */
+
+
+/* BEG test_c89mtx */
+static int c89thread_test_c89mtx_basic__thread_entry(void* pUserData)
+{
+    c89mtx_t* pMutex = (c89mtx_t*)pUserData;
+    int result;
+
+    result = c89mtx_lock(pMutex);
+    if (result != c89thrd_success) {
+        printf("Thread failed to lock mutex: %d\n", result);
+        return result;
+    }
+
+    c89thrd_sleep_milliseconds(10); /* Simulate some work. */
+
+    result = c89mtx_unlock(pMutex);
+    if (result != c89thrd_success) {
+        printf("Thread failed to unlock mutex: %d\n", result);
+        return result;
+    }
+
+    return 0;
+}
+
+int c89thread_test_c89mtx_basic(c89thread_test* pTest, int type)
+{
+    c89mtx_t mutex;
+    c89thrd_t thread;
+
+    int result;
+
+    result = c89mtx_init(&mutex, type);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    result = c89thrd_create(&thread, c89thread_test_c89mtx_basic__thread_entry, &mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_create() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    result = c89mtx_lock(&mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_lock() failed.\n", pTest->name);
+        c89thrd_join(thread, NULL);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    c89thrd_sleep_milliseconds(10); /* Simulate some work. */
+
+    result = c89mtx_unlock(&mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+        c89thrd_join(thread, NULL);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    result = c89thrd_join(thread, NULL);
+    if (result != c89thrd_success) {
+        printf("%s: c89thrd_join() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    c89mtx_destroy(&mutex);
+    return c89thrd_success;
+}
+
+
+typedef struct
+{
+    c89mtx_t* pMutex;
+    int result;
+} c89thread_test_c89mtx_timed_data;
+
+static int c89thread_test_c89mtx_timed__thread_entry(void* pUserData)
+{
+    c89thread_test_c89mtx_timed_data* pData = (c89thread_test_c89mtx_timed_data*)pUserData;
+    struct timespec timeout;
+    int result;
+
+    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
+
+    /* The calling thread will be holding the lock. We expect this one to fail. */
+    result = c89mtx_timedlock(pData->pMutex, &timeout);
+    if (result != c89thrd_success) {
+        if (result == c89thrd_timedout) {
+            pData->result = c89thrd_success;
+        } else {
+            printf("c89mtx_timedlock() failed with unexpected error: %d\n", result);
+            pData->result = result;
+            return result;
+        }
+    } else {
+        /* We successfully locked the mutex which should never have happened. This is a failure case. */
+        printf("c89mtx_timedlock() succeeded unexpectedly (error case expected).\n");
+        pData->result = c89thrd_error;
+        c89mtx_unlock(pData->pMutex);
+    }
+
+    return 0;
+}
+
+int c89thread_test_c89mtx_timed(c89thread_test* pTest, int type)
+{
+    c89mtx_t mutex;
+    struct timespec timeout;
+    int result;
+
+    result = c89mtx_init(&mutex, type | c89mtx_timed);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    /* A simple timed lock and unlock with no contention to start with. */
+    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
+
+    result = c89mtx_timedlock(&mutex, &timeout);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_timedlock() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    result = c89mtx_unlock(&mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+
+    /* Do a test with contention to force a timeout. */
+    {
+        c89thrd_t thread;
+        c89thread_test_c89mtx_timed_data data;
+
+        data.pMutex = &mutex;
+        data.result = c89thrd_error;
+
+        /* Must lock the mutex before starting the thread. */
+        result = c89mtx_lock(&mutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_lock() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89thrd_create(&thread, c89thread_test_c89mtx_timed__thread_entry, &data);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89thrd_join(thread, NULL);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_join() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89mtx_unlock(&mutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        if (data.result != c89thrd_success) {
+            printf("%s: c89thread_test_c89mtx_timed__thread_entry() failed with result %d.\n", pTest->name, data.result);
+            c89mtx_destroy(&mutex);
+            return data.result;
+        }
+    }
+
+    c89mtx_destroy(&mutex);
+    return c89thrd_success;
+}
+
+
+typedef struct
+{
+    c89mtx_t* pMutex;
+    int result;
+} c89thread_test_c89mtx_trylock_data;
+
+static int c89thread_test_c89mtx_trylock__thread_entry(void* pUserData)
+{
+    c89thread_test_c89mtx_trylock_data* pData = (c89thread_test_c89mtx_trylock_data*)pUserData;
+    int result;
+
+    /* The calling thread will be holding the lock. We expect this one to fail with c89thrd_busy. */
+    result = c89mtx_trylock(pData->pMutex);
+    if (result != c89thrd_success) {
+        if (result == c89thrd_busy) {
+            pData->result = c89thrd_success;
+        } else {
+            printf("c89mtx_trylock() failed with unexpected error: %d\n", result);
+            pData->result = result;
+            return result;
+        }
+    } else {
+        /* We successfully locked the mutex which should never have happened. This is a failure case. */
+        printf("c89mtx_trylock() succeeded unexpectedly (error case expected).\n");
+        pData->result = c89thrd_error;
+        c89mtx_unlock(pData->pMutex);
+    }
+
+    return 0;
+}
+
+int c89thread_test_c89mtx_trylock(c89thread_test* pTest, int type)
+{
+    c89mtx_t mutex;
+    int result;
+
+    result = c89mtx_init(&mutex, type);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    /* Initial trylock with no contention. This should always succeed. */
+    result = c89mtx_trylock(&mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_trylock() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+    result = c89mtx_unlock(&mutex);
+    if (result != c89thrd_success) {
+        printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+        c89mtx_destroy(&mutex);
+        return result;
+    }
+
+
+    /* TODO: Test trylock with contention to force a failure. */
+    {
+        c89thrd_t thread;
+        c89thread_test_c89mtx_trylock_data data;
+
+        data.pMutex = &mutex;
+        data.result = c89thrd_error;
+
+        /* Make sure the mutex is locked before starting the thread. */
+        result = c89mtx_lock(&mutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_lock() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89thrd_create(&thread, c89thread_test_c89mtx_trylock__thread_entry, &data);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89thrd_join(thread, NULL);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_join() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        result = c89mtx_unlock(&mutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+            c89mtx_destroy(&mutex);
+            return result;
+        }
+
+        if (data.result != c89thrd_success) {
+            printf("%s: c89thread_test_c89mtx_trylock__thread_entry() failed with result %d.\n", pTest->name, data.result);
+            c89mtx_destroy(&mutex);
+            return data.result;
+        }
+    }
+
+    c89mtx_destroy(&mutex);
+    return c89thrd_success;
 }
 
 
 /* BEG test_c89mtx_basic_plain */
 int c89thread_test_c89mtx_basic_plain(c89thread_test* pTest)
 {
-    return c89thread_test_c89mtx_basic(pTest, c89mtx_plain);
+    return c89thread_test_c89mtx_basic(pTest, c89mtx_plain);
+}
+/* END test_c89mtx_basic_plain */
+
+/* BEG test_c89mtx_basic_recursive */
+int c89thread_test_c89mtx_basic_recursive(c89thread_test* pTest)
+{
+    int result;
+    
+    /* First just do the basic mutex test. */
+    result = c89thread_test_c89mtx_basic(pTest, c89mtx_recursive);
+    if (result != c89thrd_success) {
+        printf("%s: Basic recursive mutex test failed.\n", pTest->name);
+        return result;
+    }
+
+    /* Now test recursive locking. */
+    {
+        c89mtx_t recursiveMutex;
+
+        result = c89mtx_init(&recursiveMutex, c89mtx_recursive);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_init() failed.\n", pTest->name);
+            return result;
+        }
+
+        result = c89mtx_lock(&recursiveMutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_lock() failed.\n", pTest->name);
+            c89mtx_destroy(&recursiveMutex);
+            return result;
+        }
+
+        result = c89mtx_lock(&recursiveMutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_lock() failed.\n", pTest->name);
+            c89mtx_unlock(&recursiveMutex);
+            c89mtx_destroy(&recursiveMutex);
+            return result;
+        }
+
+        result = c89mtx_unlock(&recursiveMutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+            c89mtx_destroy(&recursiveMutex);
+            return result;
+        }
+
+        result = c89mtx_unlock(&recursiveMutex);
+        if (result != c89thrd_success) {
+            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
+            c89mtx_destroy(&recursiveMutex);
+            return result;
+        }
+
+        c89mtx_destroy(&recursiveMutex);
+    }
+
+    return c89thrd_success;
+}
+/* END test_c89mtx_basic_recursive */
+
+/* BEG test_c89mtx_timed_plain */
+int c89thread_test_c89mtx_timed_plain(c89thread_test* pTest)
+{
+    return c89thread_test_c89mtx_timed(pTest, c89mtx_plain);
+}
+/* END test_c89mtx_timed_plain */
+
+/* BEG test_c89mtx_timed_recursive */
+int c89thread_test_c89mtx_timed_recursive(c89thread_test* pTest)
+{
+    return c89thread_test_c89mtx_timed(pTest, c89mtx_recursive);
+}
+/* END test_c89mtx_timed_recursive */
+
+/* BEG test_c89mtx_trylock_plain */
+int c89thread_test_c89mtx_trylock_plain(c89thread_test* pTest)
+{
+    return c89thread_test_c89mtx_trylock(pTest, c89mtx_plain);
+}
+/* END test_c89mtx_trylock_plain */
+
+/* BEG test_c89mtx_trylock_recursive */
+int c89thread_test_c89mtx_trylock_recursive(c89thread_test* pTest)
+{
+    return c89thread_test_c89mtx_trylock(pTest, c89mtx_recursive);
+}
+/* END test_c89mtx_trylock_recursive */
+
+/* BEG c89thread_test_contend_mutex */
+#if defined(C89THREAD_PROFILE) || defined(C89THREAD_ENABLE_HOOKS) || defined(C89THREAD_ENABLE_TRACE)
+/*
+Used by the tests for the instrumentation features to get another thread to block on a mutex that
+we're holding so that the mutex's contended path is taken.
+
+The other thread tells us when it's about to lock the mutex, and we then keep holding the mutex for
+a little while so it has time to reach the lock. Nothing guarantees it gets there before we
+unlock, so the whole thing is repeated until `isContended` confirms the contended path was taken.
+Returns the number of attempts that were made, or 0 if it failed.
+*/
+#define C89THREAD_TEST_MAX_CONTENTION_ATTEMPTS  100
+
+typedef int (* c89thread_test_contention_check_proc)(void* pUserData);
+
+typedef struct
+{
+    c89mtx_t* pMutex;
+    c89evnt_t readyEvent;
+} c89thread_test_contention;
+
+static int c89thread_test_contend_mutex__entry(void* pUserData)
+{
+    c89thread_test_contention* pContention = (c89thread_test_contention*)pUserData;
+
+    c89evnt_signal(&pContention->readyEvent);
+
+    c89mtx_lock(pContention->pMutex);
+    c89mtx_unlock(pContention->pMutex);
+
+    return 0;
+}
+
+static unsigned int c89thread_test_contend_mutex(c89mtx_t* pMutex, unsigned int holdMilliseconds, c89thread_test_contention_check_proc isContended, void* pUserData)
+{
+    c89thread_test_contention contention;
+    c89thrd_t thread;
+    unsigned int attemptCount;
+
+    contention.pMutex = pMutex;
+    if (c89evnt_init(&contention.readyEvent) != c89thrd_success) {
+        return 0;
+    }
+
+    for (attemptCount = 1; attemptCount <= C89THREAD_TEST_MAX_CONTENTION_ATTEMPTS; attemptCount += 1) {
+        c89mtx_lock(pMutex);
+        {
+            if (c89thrd_create(&thread, c89thread_test_contend_mutex__entry, &contention) != c89thrd_success) {
+                c89mtx_unlock(pMutex);
+                c89evnt_destroy(&contention.readyEvent);
+                return 0;
+            }
+
+            c89evnt_wait(&contention.readyEvent);
+            c89thrd_sleep_milliseconds(holdMilliseconds);
+        }
+        c89mtx_unlock(pMutex);
+
+        c89thrd_join(thread, NULL);
+
+        if (isContended(pUserData)) {
+            c89evnt_destroy(&contention.readyEvent);
+            return attemptCount;
+        }
+    }
+
+    c89evnt_destroy(&contention.readyEvent);
+    return 0;
+}
+#endif
+/* END c89thread_test_contend_mutex */
+
+/* BEG test_c89mtx_profile */
+#if defined(C89THREAD_PROFILE)
+#define C89THREAD_TEST_PROFILE_HOLD_MILLISECONDS    5
+
+static int c89thread_test_c89mtx_profile__is_contended(void* pUserData)
+{
+    c89mtx_profile_stats stats;
+
+    c89mtx_get_profile_stats((c89mtx_t*)pUserData, &stats);
+    return stats.contendedCount > 0;
+}
+
+static int c89thread_test_c89mtx_profile_enabled(c89thread_test* pTest)
+{
+    c89mtx_t mutex;
+    c89mtx_t recursiveMutex;
+    c89mtx_profile_stats stats;
+    unsigned int attemptCount;
+    FILE* pReport;
+    char line[256];
+    int initLine;
+    int isMutexInReport;
+    int i;
+    int result = c89thrd_success;
+
+    c89mtx_init(&mutex, c89mtx_plain); initLine = __LINE__;
+    c89mtx_init(&recursiveMutex, c89mtx_recursive);
+
+    /* Uncontended. */
+    for (i = 0; i < 10; i += 1) {
+        c89mtx_lock(&mutex);
+        c89mtx_unlock(&mutex);
+    }
+
+    c89mtx_get_profile_stats(&mutex, &stats);
+
+    if (stats.pFile == NULL || strcmp(stats.pFile, __FILE__) != 0 || stats.line != initLine) {
+        printf("%s: The mutex was not tagged with the location of c89mtx_init().\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (stats.acquisitionCount != 10 || stats.contendedCount != 0) {
+        printf("%s: Expecting 10 uncontended acquisitions.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Recursion is not counted as separate acquisitions. */
+    c89mtx_lock(&recursiveMutex);
+    c89mtx_lock(&recursiveMutex);
+    c89mtx_unlock(&recursiveMutex);
+    c89mtx_unlock(&recursiveMutex);
+
+    c89mtx_get_profile_stats(&recursiveMutex, &stats);
+    if (stats.acquisitionCount != 1) {
+        printf("%s: Recursive locks were counted as acquisitions.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Hold the lock while another thread tries to take it. Both threads acquire the mutex on each attempt, but only the last attempt was contended. */
+    attemptCount = c89thread_test_contend_mutex(&mutex, C89THREAD_TEST_PROFILE_HOLD_MILLISECONDS, c89thread_test_c89mtx_profile__is_contended, &mutex);
+    if (attemptCount == 0) {
+        printf("%s: Failed to contend the mutex.\n", pTest->name);
+        c89mtx_destroy(&recursiveMutex);
+        c89mtx_destroy(&mutex);
+        return c89thrd_error;
+    }
+
+    c89mtx_get_profile_stats(&mutex, &stats);
+
+    if (stats.acquisitionCount != 10 + (attemptCount * 2) || stats.contendedCount != 1) {
+        printf("%s: Expecting %u acquisitions, 1 of which was contended. Got %u and %u.\n", pTest->name, 10 + (attemptCount * 2), (unsigned int)stats.acquisitionCount, (unsigned int)stats.contendedCount);
+        result = c89thrd_error;
+    }
+
+    /* We held the mutex for at least the hold time on every attempt. How long the other thread waited depends on when it got to the lock. */
+    if (stats.maxWaitNanoseconds == 0 || stats.maxHoldNanoseconds < C89THREAD_TEST_PROFILE_HOLD_MILLISECONDS * 1000000) {
+        printf("%s: The wait and hold times of the contended acquisition were not recorded.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* The report should include our mutex. */
+    isMutexInReport = 0;
+    pReport = tmpfile();
+    if (pReport != NULL) {
+        c89thread_profile_dump(pReport);
+        rewind(pReport);
+
+        while (fgets(line, sizeof(line), pReport) != NULL) {
+            if (strstr(line, "c89thread_test.c") != NULL) {
+                isMutexInReport = 1;
+            }
+        }
+
+        fclose(pReport);
+
+        if (!isMutexInReport) {
+            printf("%s: The mutex was not in the report.\n", pTest->name);
+            result = c89thrd_error;
+        }
+    }
+
+    c89mtx_destroy(&recursiveMutex);
+    c89mtx_destroy(&mutex);
+
+    return result;
+}
+#endif
+
+int c89thread_test_c89mtx_profile(c89thread_test* pTest)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        return c89thread_test_c89mtx_profile_enabled(pTest);
+    }
+    #else
+    {
+        /* Nothing to test when the profiler isn't compiled in. */
+        (void)pTest;
+        return c89thrd_success;
+    }
+    #endif
+}
+/* END test_c89mtx_profile */
+
+/* END test_c89mtx */
+
+
+/* BEG test_c89barrier */
+#define C89THREAD_TEST_BARRIER_THREAD_COUNT 7
+#define C89THREAD_TEST_BARRIER_PHASE_COUNT  100
+
+typedef struct
+{
+    c89barrier_t* pBarrier;
+    int* pValues;
+    int index;
+    int serialCount;
+    int result;
+} c89thread_test_c89barrier_data;
+
+static int c89thread_test_c89barrier__entry(void* pUserData)
+{
+    c89thread_test_c89barrier_data* pData = (c89thread_test_c89barrier_data*)pUserData;
+    int iPhase;
+    int iThread;
+    int result;
+
+    pData->serialCount = 0;
+    pData->result = c89thrd_success;
+
+    for (iPhase = 0; iPhase < C89THREAD_TEST_BARRIER_PHASE_COUNT; iPhase += 1) {
+        pData->pValues[pData->index] = iPhase;
+
+        result = c89barrier_wait(pData->pBarrier);
+        if (result == c89barrier_serial_thread) {
+            pData->serialCount += 1;
+        } else if (result != c89thrd_success) {
+            pData->result = result;
+        }
+
+        /* Every thread should have written their value for this phase by now. */
+        for (iThread = 0; iThread < C89THREAD_TEST_BARRIER_THREAD_COUNT; iThread += 1) {
+            if (pData->pValues[iThread] != iPhase) {
+                pData->result = c89thrd_error;
+            }
+        }
+
+        /* Second wait so nobody writes the next phase's value while others are still checking. */
+        result = c89barrier_wait(pData->pBarrier);
+        if (result == c89barrier_serial_thread) {
+            pData->serialCount += 1;
+        } else if (result != c89thrd_success) {
+            pData->result = result;
+        }
+    }
+
+    return 0;
+}
+
+int c89thread_test_c89barrier(c89thread_test* pTest, int type)
+{
+    c89barrier_config config;
+    c89barrier_t barrier;
+    c89thrd_t threads[C89THREAD_TEST_BARRIER_THREAD_COUNT];
+    c89thread_test_c89barrier_data data[C89THREAD_TEST_BARRIER_THREAD_COUNT];
+    int values[C89THREAD_TEST_BARRIER_THREAD_COUNT];
+    int serialCount = 0;
+    int iThread;
+    int result;
+
+    config = c89barrier_config_init(C89THREAD_TEST_BARRIER_THREAD_COUNT);
+    config.type  = type;
+    config.fanIn = 2;   /* Tree only. Small enough to get an uneven tree a few levels deep. */
+
+    result = c89barrier_init_ex(&barrier, &config, NULL);
+    if (result != c89thrd_success) {
+        printf("%s: c89barrier_init_ex() failed.\n", pTest->name);
+        return result;
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_BARRIER_THREAD_COUNT; iThread += 1) {
+        values[iThread] = -1;
+        data[iThread].pBarrier = &barrier;
+        data[iThread].pValues  = values;
+        data[iThread].index    = iThread;
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_BARRIER_THREAD_COUNT; iThread += 1) {
+        result = c89thrd_create(&threads[iThread], c89thread_test_c89barrier__entry, &data[iThread]);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create() failed.\n", pTest->name);
+            return result;  /* Can't safely destroy the barrier with threads waiting on it. */
+        }
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_BARRIER_THREAD_COUNT; iThread += 1) {
+        c89thrd_join(threads[iThread], NULL);
+    }
+
+    c89barrier_destroy(&barrier);
+
+    for (iThread = 0; iThread < C89THREAD_TEST_BARRIER_THREAD_COUNT; iThread += 1) {
+        if (data[iThread].result != c89thrd_success) {
+            printf("%s: Thread %d saw an incomplete phase or failed to wait.\n", pTest->name, iThread);
+            return c89thrd_error;
+        }
+
+        serialCount += data[iThread].serialCount;
+    }
+
+    if (serialCount != C89THREAD_TEST_BARRIER_PHASE_COUNT * 2) {
+        printf("%s: Expected %d serial threads, got %d.\n", pTest->name, C89THREAD_TEST_BARRIER_PHASE_COUNT * 2, serialCount);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+/* BEG test_c89barrier_flat */
+int c89thread_test_c89barrier_flat(c89thread_test* pTest)
+{
+    return c89thread_test_c89barrier(pTest, c89barrier_type_flat);
+}
+/* END test_c89barrier_flat */
+
+/* BEG test_c89barrier_tree */
+int c89thread_test_c89barrier_tree(c89thread_test* pTest)
+{
+    return c89thread_test_c89barrier(pTest, c89barrier_type_tree);
+}
+/* END test_c89barrier_tree */
+/* END test_c89barrier */
+
+
+/* BEG test_c89latch */
+#define C89THREAD_TEST_LATCH_THREAD_COUNT   4
+
+static int c89thread_test_c89latch_count_down__entry(void* pUserData)
+{
+    c89latch_t* pLatch = (c89latch_t*)pUserData;
+
+    c89thrd_sleep_milliseconds(1); /* Simulate some work. */
+    return c89latch_count_down(pLatch, 1);
+}
+
+int c89thread_test_c89latch_count_down(c89thread_test* pTest)
+{
+    c89latch_t latch;
+    c89thrd_t threads[C89THREAD_TEST_LATCH_THREAD_COUNT];
+    struct timespec timeout;
+    int threadResult;
+    int iThread;
+    int result;
+
+    result = c89latch_init(&latch, C89THREAD_TEST_LATCH_THREAD_COUNT);
+    if (result != c89thrd_success) {
+        printf("%s: c89latch_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    /* Nobody has counted down yet so these should not succeed. */
+    result = c89latch_try_wait(&latch);
+    if (result != c89thrd_busy) {
+        printf("%s: c89latch_try_wait() returned %d. Expected c89thrd_busy.\n", pTest->name, result);
+        c89latch_destroy(&latch);
+        return c89thrd_error;
+    }
+
+    timeout = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(10));
+    result = c89latch_timedwait(&latch, &timeout);
+    if (result != c89thrd_timedout) {
+        printf("%s: c89latch_timedwait() returned %d. Expected c89thrd_timedout.\n", pTest->name, result);
+        c89latch_destroy(&latch);
+        return c89thrd_error;
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_LATCH_THREAD_COUNT; iThread += 1) {
+        result = c89thrd_create(&threads[iThread], c89thread_test_c89latch_count_down__entry, &latch);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create() failed.\n", pTest->name);
+            return result;  /* Can't safely destroy the latch with threads using it. */
+        }
+    }
+
+    result = c89latch_wait(&latch);
+    if (result != c89thrd_success) {
+        printf("%s: c89latch_wait() failed.\n", pTest->name);
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_LATCH_THREAD_COUNT; iThread += 1) {
+        c89thrd_join(threads[iThread], &threadResult);
+        if (threadResult != c89thrd_success) {
+            printf("%s: c89latch_count_down() failed.\n", pTest->name);
+            result = c89thrd_error;
+        }
+    }
+
+    if (result == c89thrd_success && c89latch_try_wait(&latch) != c89thrd_success) {
+        printf("%s: c89latch_try_wait() failed after the latch was released.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* The latch is one-shot. Counting down past zero is an error. */
+    if (result == c89thrd_success && c89latch_count_down(&latch, 1) != c89thrd_error) {
+        printf("%s: c89latch_count_down() succeeded past zero.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89latch_destroy(&latch);
+    return result;
+}
+
+static int c89thread_test_c89latch_arrive_and_wait__entry(void* pUserData)
+{
+    c89latch_t* pLatch = (c89latch_t*)pUserData;
+    return c89latch_arrive_and_wait(pLatch, 1);
+}
+
+int c89thread_test_c89latch_arrive_and_wait(c89thread_test* pTest)
+{
+    c89latch_t latch;
+    c89thrd_t threads[C89THREAD_TEST_LATCH_THREAD_COUNT];
+    int threadResult;
+    int iThread;
+    int result;
+
+    result = c89latch_init(&latch, C89THREAD_TEST_LATCH_THREAD_COUNT + 1);
+    if (result != c89thrd_success) {
+        printf("%s: c89latch_init() failed.\n", pTest->name);
+        return result;
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_LATCH_THREAD_COUNT; iThread += 1) {
+        result = c89thrd_create(&threads[iThread], c89thread_test_c89latch_arrive_and_wait__entry, &latch);
+        if (result != c89thrd_success) {
+            printf("%s: c89thrd_create() failed.\n", pTest->name);
+            return result;
+        }
+    }
+
+    /* The calling thread is the final arrival. */
+    result = c89latch_arrive_and_wait(&latch, 1);
+    if (result != c89thrd_success) {
+        printf("%s: c89latch_arrive_and_wait() failed.\n", pTest->name);
+    }
+
+    for (iThread = 0; iThread < C89THREAD_TEST_LATCH_THREAD_COUNT; iThread += 1) {
+        c89thrd_join(threads[iThread], &threadResult);
+        if (threadResult != c89thrd_success) {
+            printf("%s: c89latch_arrive_and_wait() failed on a worker thread.\n", pTest->name);
+            result = c89thrd_error;
+        }
+    }
+
+    c89latch_destroy(&latch);
+    return result;
+}
+
+static int c89thread_test_c89latch_over_count__entry(void* pUserData)
+{
+    return c89latch_wait((c89latch_t*)pUserData);
+}
+
+int c89thread_test_c89latch_over_count(c89thread_test* pTest)
+{
+    c89latch_t latch;
+    c89thrd_t thread;
+    int threadResult;
+    int result = c89thrd_success;
+
+    if (c89latch_init(&latch, 3) != c89thrd_success) {
+        printf("%s: c89latch_init() failed.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89thrd_create(&thread, c89thread_test_c89latch_over_count__entry, &latch) != c89thrd_success) {
+        printf("%s: c89thrd_create() failed.\n", pTest->name);
+        c89latch_destroy(&latch);
+        return c89thrd_error;
+    }
+
+    /* Counting down by too much must fail and put the count back. */
+    if (c89latch_count_down(&latch, 5) != c89thrd_error) {
+        printf("%s: c89latch_count_down() succeeded with more than the remaining count.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (c89latch_try_wait(&latch) != c89thrd_busy) {
+        printf("%s: c89latch_try_wait() did not return c89thrd_busy after a failed count down.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (c89latch_count_down(&latch, 2) != c89thrd_success || c89latch_count_down(&latch, 2) != c89thrd_error) {
+        printf("%s: The count was not preserved by a failed count down.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* The final count down must still release the waiter. */
+    if (c89latch_count_down(&latch, 1) != c89thrd_success) {
+        printf("%s: The final c89latch_count_down() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89thrd_join(thread, &threadResult);
+    if (threadResult != c89thrd_success) {
+        printf("%s: c89latch_wait() failed on the waiting thread.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (c89latch_try_wait(&latch) != c89thrd_success) {
+        printf("%s: c89latch_try_wait() failed after the latch was released.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89latch_destroy(&latch);
+    return result;
+}
+/* END test_c89latch */
+
+
+/* BEG test_c89timespec_monotonic */
+static int c89thread_test_c89timespec_monotonic__check(c89thread_test* pTest, const char* pFunctionName, int result, struct timespec timeout)
+{
+    if (result != c89thrd_timedout) {
+        printf("%s: %s() did not time out (%d).\n", pTest->name, pFunctionName, result);
+        return c89thrd_error;
+    }
+
+    if (c89timespec_cmp(c89timespec_now_monotonic(), timeout) < 0) {
+        printf("%s: %s() returned before the time point.\n", pTest->name, pFunctionName);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89thread_test_c89timespec_monotonic(c89thread_test* pTest)
+{
+    c89sem_t sem;
+    c89evnt_t evnt;
+    c89latch_t latch;
+    struct timespec start;
+    struct timespec timeout;
+    int result = c89thrd_success;
+
+    start = c89timespec_now_monotonic();
+    c89thrd_sleep_milliseconds(10);
+    if (c89timespec_cmp(c89timespec_diff(c89timespec_now_monotonic(), start), c89timespec_milliseconds(10)) < 0) {
+        printf("%s: c89timespec_now_monotonic() did not advance.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89sem_init(&sem, 0, 1);
+    c89evnt_init(&evnt);
+    c89latch_init(&latch, 1);
+
+    timeout = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(10));
+    if (c89thread_test_c89timespec_monotonic__check(pTest, "c89sem_timedwait_monotonic", c89sem_timedwait_monotonic(&sem, &timeout), timeout) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    timeout = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(10));
+    if (c89thread_test_c89timespec_monotonic__check(pTest, "c89evnt_timedwait_monotonic", c89evnt_timedwait_monotonic(&evnt, &timeout), timeout) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    timeout = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(10));
+    if (c89thread_test_c89timespec_monotonic__check(pTest, "c89latch_timedwait_monotonic", c89latch_timedwait_monotonic(&latch, &timeout), timeout) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    /* Once signalled, the waits should succeed without needing to time out. */
+    c89sem_post(&sem);
+    c89evnt_signal(&evnt);
+    c89latch_count_down(&latch, 1);
+
+    timeout = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(5000));
+    if (c89sem_timedwait_monotonic(&sem, &timeout) != c89thrd_success || c89evnt_timedwait_monotonic(&evnt, &timeout) != c89thrd_success || c89latch_timedwait_monotonic(&latch, &timeout) != c89thrd_success) {
+        printf("%s: A monotonic wait failed after being signalled.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89latch_destroy(&latch);
+    c89evnt_destroy(&evnt);
+    c89sem_destroy(&sem);
+
+    #if !defined(_WIN32)
+    {
+        /* Condition variables are not supported on Win32. */
+        c89mtx_t mtx;
+        c89cnd_t cnd;
+
+        c89mtx_init(&mtx, c89mtx_timed);
+        c89cnd_init(&cnd);
+
+        timeout = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(10));
+        if (c89mtx_timedlock_monotonic(&mtx, &timeout) != c89thrd_success) {
+            printf("%s: c89mtx_timedlock_monotonic() failed.\n", pTest->name);
+            result = c89thrd_error;
+        } else {
+            if (c89thread_test_c89timespec_monotonic__check(pTest, "c89cnd_timedwait_monotonic", c89cnd_timedwait_monotonic(&cnd, &mtx, &timeout), timeout) != c89thrd_success) {
+                result = c89thrd_error;
+            }
+
+            c89mtx_unlock(&mtx);
+        }
+
+        c89cnd_destroy(&cnd);
+        c89mtx_destroy(&mtx);
+    }
+    #endif
+
+    return result;
+}
+/* END test_c89timespec_monotonic */
+
+
+/* BEG test_c89timespec_for */
+int c89thread_test_c89timespec_for(c89thread_test* pTest)
+{
+    c89sem_t sem;
+    c89evnt_t evnt;
+    struct timespec duration;
+    struct timespec timeout;
+    int result = c89thrd_success;
+
+    duration = c89timespec_milliseconds(10);
+
+    c89sem_init(&sem, 0, 1);
+    c89evnt_init(&evnt);
+
+    /* The monotonic check helper works here too since the duration starts after the time point is taken. */
+    timeout = c89timespec_add(c89timespec_now_monotonic(), duration);
+    if (c89thread_test_c89timespec_monotonic__check(pTest, "c89sem_timedwait_for", c89sem_timedwait_for(&sem, &duration), timeout) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    timeout = c89timespec_add(c89timespec_now_monotonic(), duration);
+    if (c89thread_test_c89timespec_monotonic__check(pTest, "c89evnt_timedwait_for", c89evnt_timedwait_for(&evnt, &duration), timeout) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    c89sem_post(&sem);
+    c89evnt_signal(&evnt);
+
+    if (c89sem_timedwait_for(&sem, &duration) != c89thrd_success || c89evnt_timedwait_for(&evnt, &duration) != c89thrd_success) {
+        printf("%s: A relative wait failed after being signalled.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89evnt_destroy(&evnt);
+    c89sem_destroy(&sem);
+
+    #if !defined(_WIN32)
+    {
+        c89mtx_t mtx;
+        c89cnd_t cnd;
+
+        c89mtx_init(&mtx, c89mtx_timed);
+        c89cnd_init(&cnd);
+
+        if (c89mtx_timedlock_for(&mtx, &duration) != c89thrd_success) {
+            printf("%s: c89mtx_timedlock_for() failed.\n", pTest->name);
+            result = c89thrd_error;
+        } else {
+            timeout = c89timespec_add(c89timespec_now_monotonic(), duration);
+            if (c89thread_test_c89timespec_monotonic__check(pTest, "c89cnd_timedwait_for", c89cnd_timedwait_for(&cnd, &mtx, &duration), timeout) != c89thrd_success) {
+                result = c89thrd_error;
+            }
+
+            c89mtx_unlock(&mtx);
+        }
+
+        c89cnd_destroy(&cnd);
+        c89mtx_destroy(&mtx);
+    }
+    #endif
+
+    return result;
+}
+/* END test_c89timespec_for */
+
+
+/* BEG test_c89thread_ticks */
+static c89thread_uint64 c89thread_test_timespec_to_ns(struct timespec ts)
+{
+    return ((c89thread_uint64)ts.tv_sec * 1000000000) + (c89thread_uint64)ts.tv_nsec;
+}
+
+int c89thread_test_c89thread_ticks(c89thread_test* pTest)
+{
+    c89thread_uint64 ticksBeg;
+    c89thread_uint64 ticksEnd;
+    c89thread_uint64 elapsedNanoseconds;
+    c89thread_uint64 innerNanoseconds;
+    c89thread_uint64 outerNanoseconds;
+    c89thread_uint64 slackNanoseconds;
+    struct timespec outerBeg;
+    struct timespec innerBeg;
+    struct timespec innerEnd;
+    struct timespec outerEnd;
+
+    /*
+    Each tick reading is bracketed by monotonic clock readings. Being preempted between the readings
+    only widens the outer interval, so this can't fail because of a busy machine.
+    */
+    outerBeg = c89timespec_now_monotonic();
+    ticksBeg = c89thread_ticks();
+    innerBeg = c89timespec_now_monotonic();
+
+    c89thrd_sleep_milliseconds(50);
+
+    innerEnd = c89timespec_now_monotonic();
+    ticksEnd = c89thread_ticks();
+    outerEnd = c89timespec_now_monotonic();
+
+    if (ticksEnd < ticksBeg) {
+        printf("%s: c89thread_ticks() went backwards.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    elapsedNanoseconds = c89thread_ticks_to_ns(ticksEnd - ticksBeg);
+    innerNanoseconds   = c89thread_test_timespec_to_ns(c89timespec_diff(innerEnd, innerBeg));
+    outerNanoseconds   = c89thread_test_timespec_to_ns(c89timespec_diff(outerEnd, outerBeg));
+
+    /* Allow for calibration error and the two clocks being slewed differently. */
+    slackNanoseconds = (outerNanoseconds / 100) + 100000;
+
+    if (elapsedNanoseconds + slackNanoseconds < innerNanoseconds || elapsedNanoseconds > outerNanoseconds + slackNanoseconds) {
+        printf("%s: c89thread_ticks_to_ns() does not match the monotonic clock. Got %u us, expecting between %u us and %u us.\n", pTest->name,
+            (unsigned int)(elapsedNanoseconds / 1000), (unsigned int)(innerNanoseconds / 1000), (unsigned int)(outerNanoseconds / 1000));
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+/* END test_c89thread_ticks */
+
+
+/* BEG test_c89timespec_cached */
+static int c89thread_test_c89timespec_cached__check(c89thread_test* pTest, const char* pDescription, struct timespec cached, struct timespec precise, struct timespec tolerance)
+{
+    /* The cached and coarse clocks lag behind, but shouldn't be ahead or behind by more than the tolerance. */
+    if (c89timespec_cmp(cached, precise) > 0 || c89timespec_cmp(c89timespec_add(cached, tolerance), precise) < 0) {
+        printf("%s: %s is out by more than the tolerance.\n", pTest->name, pDescription);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+int c89thread_test_c89timespec_cached(c89thread_test* pTest)
+{
+    struct timespec interval;
+    struct timespec tolerance;
+    struct timespec cachedUTC;
+    struct timespec cachedMonotonic;
+    int result = c89thrd_success;
+
+    tolerance = c89timespec_milliseconds(100);
+
+    if (c89thread_test_c89timespec_cached__check(pTest, "c89timespec_now_coarse()", c89timespec_now_coarse(), c89timespec_now(), tolerance) != c89thrd_success ||
+        c89thread_test_c89timespec_cached__check(pTest, "c89timespec_now_monotonic_coarse()", c89timespec_now_monotonic_coarse(), c89timespec_now_monotonic(), tolerance) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    interval = c89timespec_milliseconds(0);
+
+    if (c89timespec_ticker_init(&interval) != c89thrd_error) {
+        printf("%s: c89timespec_ticker_init() accepted a zero interval.\n", pTest->name);
+        c89timespec_ticker_uninit();
+        return c89thrd_error;
+    }
+
+    interval = c89timespec_milliseconds(1);
+
+    if (c89timespec_ticker_init(&interval) != c89thrd_success) {
+        printf("%s: c89timespec_ticker_init() failed.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89timespec_ticker_init(&interval) != c89thrd_busy) {
+        printf("%s: c89timespec_ticker_init() did not fail while already running.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* The ticker should keep the cached time moving. */
+    cachedMonotonic = c89timespec_now_monotonic_cached();
+    c89thrd_sleep_milliseconds(20);
+
+    if (c89timespec_cmp(c89timespec_now_monotonic_cached(), cachedMonotonic) <= 0) {
+        printf("%s: The cached time did not advance.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    cachedUTC       = c89timespec_now_cached();
+    cachedMonotonic = c89timespec_now_monotonic_cached();
+
+    if (c89thread_test_c89timespec_cached__check(pTest, "c89timespec_now_cached()", cachedUTC, c89timespec_now(), tolerance) != c89thrd_success ||
+        c89thread_test_c89timespec_cached__check(pTest, "c89timespec_now_monotonic_cached()", cachedMonotonic, c89timespec_now_monotonic(), tolerance) != c89thrd_success) {
+        result = c89thrd_error;
+    }
+
+    c89timespec_ticker_uninit();
+
+    return result;
+}
+/* END test_c89timespec_cached */
+
+/* BEG test_c89timer */
+#define C89THREAD_TEST_TIMER_COUNT  1000
+
+typedef struct
+{
+    c89mtx_t lock;
+    c89evnt_t doneEvent;
+    unsigned int firedCount;
+    unsigned int earlyCount;
+    unsigned int targetCount;
+} c89thread_test_c89timer_state;
+
+typedef struct
+{
+    c89timer_t timer;
+    c89thread_test_c89timer_state* pState;
+    struct timespec deadline;
+} c89thread_test_c89timer_record;
+
+static int c89thread_test_c89timer_state_init(c89thread_test_c89timer_state* pState, unsigned int targetCount)
+{
+    memset(pState, 0, sizeof(*pState));
+    pState->targetCount = targetCount;
+
+    if (c89mtx_init(&pState->lock, c89mtx_plain) != c89thrd_success) {
+        return c89thrd_error;
+    }
+
+    if (c89evnt_init(&pState->doneEvent) != c89thrd_success) {
+        c89mtx_destroy(&pState->lock);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+
+static void c89thread_test_c89timer_state_uninit(c89thread_test_c89timer_state* pState)
+{
+    c89evnt_destroy(&pState->doneEvent);
+    c89mtx_destroy(&pState->lock);
+}
+
+static unsigned int c89thread_test_c89timer_state_fired_count(c89thread_test_c89timer_state* pState)
+{
+    unsigned int firedCount;
+
+    c89mtx_lock(&pState->lock);
+    {
+        firedCount = pState->firedCount;
+    }
+    c89mtx_unlock(&pState->lock);
+
+    return firedCount;
+}
+
+static void c89thread_test_c89timer_proc(void* pUserData)
+{
+    c89thread_test_c89timer_record* pRecord = (c89thread_test_c89timer_record*)pUserData;
+    c89thread_test_c89timer_state* pState = pRecord->pState;
+    struct timespec now;
+
+    now = c89timespec_now_monotonic();
+
+    c89mtx_lock(&pState->lock);
+    {
+        if (c89timespec_cmp(now, pRecord->deadline) < 0) {
+            pState->earlyCount += 1;
+        }
+
+        pState->firedCount += 1;
+        if (pState->firedCount == pState->targetCount) {
+            c89evnt_signal(&pState->doneEvent);
+        }
+    }
+    c89mtx_unlock(&pState->lock);
+}
+
+int c89thread_test_c89timer_schedule(c89thread_test* pTest)
+{
+    c89timer_service_config config;
+    c89timer_service service;
+    c89thread_test_c89timer_state state;
+    c89thread_test_c89timer_record* pRecords;
+    struct timespec delay;
+    struct timespec timeout;
+    unsigned int i;
+    int result = c89thrd_success;
+
+    pRecords = (c89thread_test_c89timer_record*)malloc(sizeof(*pRecords) * C89THREAD_TEST_TIMER_COUNT);
+    if (pRecords == NULL) {
+        printf("%s: Out of memory.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89thread_test_c89timer_state_init(&state, C89THREAD_TEST_TIMER_COUNT) != c89thrd_success) {
+        printf("%s: Failed to initialize test state.\n", pTest->name);
+        free(pRecords);
+        return c89thrd_error;
+    }
+
+    /* A fine resolution so the longer delays end up in the upper levels of the wheel and have to cascade down. */
+    config = c89timer_service_config_init();
+    config.resolution = c89timespec_nanoseconds(10000);
+
+    if (c89timer_service_init(&service, &config) != c89thrd_success) {
+        printf("%s: c89timer_service_init() failed.\n", pTest->name);
+        c89thread_test_c89timer_state_uninit(&state);
+        free(pRecords);
+        return c89thrd_error;
+    }
+
+    /* The first timer starts off far in the future and is then moved to be the first to fire. */
+    c89timer_init(&pRecords[0].timer);
+    pRecords[0].pState   = &state;
+    pRecords[0].deadline = c89timespec_add(c89timespec_now_monotonic(), c89timespec_seconds(60));
+
+    delay = c89timespec_seconds(60);
+    if (c89timer_schedule(&service, &pRecords[0].timer, &delay, c89thread_test_c89timer_proc, &pRecords[0]) != c89thrd_success) {
+        printf("%s: c89timer_schedule() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Delays of up to 700ms, which is 70000 ticks. */
+    for (i = 0; i < C89THREAD_TEST_TIMER_COUNT; i += 1) {
+        if (i > 0) {
+            c89timer_init(&pRecords[i].timer);
+        }
+
+        delay = c89timespec_nanoseconds((time_t)(((C89THREAD_TEST_TIMER_COUNT - i) % C89THREAD_TEST_TIMER_COUNT) * 700000));
+
+        pRecords[i].pState   = &state;
+        pRecords[i].deadline = c89timespec_add(c89timespec_now_monotonic(), delay);
+
+        if (c89timer_schedule(&service, &pRecords[i].timer, &delay, c89thread_test_c89timer_proc, &pRecords[i]) != c89thrd_success) {
+            printf("%s: c89timer_schedule() failed.\n", pTest->name);
+            result = c89thrd_error;
+            break;
+        }
+    }
+
+    timeout = c89timespec_seconds(10);
+    if (c89evnt_timedwait_for(&state.doneEvent, &timeout) != c89thrd_success) {
+        printf("%s: Only %u of %u timers fired.\n", pTest->name, c89thread_test_c89timer_state_fired_count(&state), C89THREAD_TEST_TIMER_COUNT);
+        result = c89thrd_error;
+    }
+
+    c89timer_service_uninit(&service);
+
+    if (state.earlyCount > 0) {
+        printf("%s: %u timers fired before their deadline.\n", pTest->name, state.earlyCount);
+        result = c89thrd_error;
+    }
+
+    if (state.firedCount > C89THREAD_TEST_TIMER_COUNT) {
+        printf("%s: Timers fired more than once.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89thread_test_c89timer_state_uninit(&state);
+    free(pRecords);
+
+    return result;
+}
+
+int c89thread_test_c89timer_schedule_at(c89thread_test* pTest)
+{
+    c89timer_service service;
+    c89thread_test_c89timer_state state;
+    c89thread_test_c89timer_record records[3];
+    struct timespec time_point;
+    struct timespec timeout;
+    int result = c89thrd_success;
+
+    if (c89thread_test_c89timer_state_init(&state, 3) != c89thrd_success) {
+        printf("%s: Failed to initialize test state.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89timer_service_init(&service, NULL) != c89thrd_success) {
+        printf("%s: c89timer_service_init() failed.\n", pTest->name);
+        c89thread_test_c89timer_state_uninit(&state);
+        return c89thrd_error;
+    }
+
+    c89timer_init(&records[0].timer);
+    c89timer_init(&records[1].timer);
+    c89timer_init(&records[2].timer);
+    records[0].pState = &state;
+    records[1].pState = &state;
+    records[2].pState = &state;
+
+    /* The UTC deadline is converted to the monotonic clock so allow a little for the two clocks being read at different times. */
+    records[0].deadline = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(29));
+    time_point = c89timespec_add(c89timespec_now(), c89timespec_milliseconds(30));
+
+    if (c89timer_schedule_at(&service, &records[0].timer, &time_point, c89thread_test_c89timer_proc, &records[0]) != c89thrd_success) {
+        printf("%s: c89timer_schedule_at() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    records[1].deadline = c89timespec_add(c89timespec_now_monotonic(), c89timespec_milliseconds(20));
+    time_point = records[1].deadline;
+
+    if (c89timer_schedule_at_monotonic(&service, &records[1].timer, &time_point, c89thread_test_c89timer_proc, &records[1]) != c89thrd_success) {
+        printf("%s: c89timer_schedule_at_monotonic() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* A deadline in the past should fire straight away. */
+    records[2].deadline = c89timespec_now_monotonic();
+    time_point = c89timespec_diff(records[2].deadline, c89timespec_seconds(1));
+
+    if (c89timer_schedule_at_monotonic(&service, &records[2].timer, &time_point, c89thread_test_c89timer_proc, &records[2]) != c89thrd_success) {
+        printf("%s: c89timer_schedule_at_monotonic() failed.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    timeout = c89timespec_seconds(5);
+    if (c89evnt_timedwait_for(&state.doneEvent, &timeout) != c89thrd_success) {
+        printf("%s: Only %u of 3 timers fired.\n", pTest->name, c89thread_test_c89timer_state_fired_count(&state));
+        result = c89thrd_error;
+    }
+
+    c89timer_service_uninit(&service);
+
+    if (state.earlyCount > 0) {
+        printf("%s: %u timers fired before their deadline.\n", pTest->name, state.earlyCount);
+        result = c89thrd_error;
+    }
+
+    c89thread_test_c89timer_state_uninit(&state);
+
+    return result;
+}
+
+
+typedef struct
+{
+    c89mtx_t lock;
+    int isStarted;
+    int isFinished;
+} c89thread_test_c89timer_slow_state;
+
+static void c89thread_test_c89timer_slow_proc(void* pUserData)
+{
+    c89thread_test_c89timer_slow_state* pState = (c89thread_test_c89timer_slow_state*)pUserData;
+
+    c89mtx_lock(&pState->lock);
+    {
+        pState->isStarted = 1;
+    }
+    c89mtx_unlock(&pState->lock);
+
+    c89thrd_sleep_milliseconds(50);
+
+    c89mtx_lock(&pState->lock);
+    {
+        pState->isFinished = 1;
+    }
+    c89mtx_unlock(&pState->lock);
+}
+
+static int c89thread_test_c89timer_cancel__entry(void* pUserData)
+{
+    c89timer_cancel((c89timer_t*)pUserData);
+    return 0;
+}
+
+static int c89thread_test_c89timer_wait_for_slow_proc(c89thread_test_c89timer_slow_state* pState)
+{
+    int isStarted = 0;
+    int iAttempt;
+
+    for (iAttempt = 0; iAttempt < 1000 && !isStarted; iAttempt += 1) {
+        c89mtx_lock(&pState->lock);
+        {
+            isStarted = pState->isStarted;
+        }
+        c89mtx_unlock(&pState->lock);
+
+        if (!isStarted) {
+            c89thrd_sleep_milliseconds(1);
+        }
+    }
+
+    return isStarted;
+}
+
+int c89thread_test_c89timer_cancel(c89thread_test* pTest)
+{
+    c89timer_service service;
+    c89thread_test_c89timer_state state;
+    c89thread_test_c89timer_record record;
+    c89thread_test_c89timer_slow_state slowState;
+    c89timer_t slowTimer;
+    c89thrd_t cancelThread;
+    struct timespec delay;
+    struct timespec period;
+    unsigned int firedCount;
+    int iAttempt;
+    int result = c89thrd_success;
+
+    if (c89thread_test_c89timer_state_init(&state, 0) != c89thrd_success) {
+        printf("%s: Failed to initialize test state.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89timer_service_init(&service, NULL) != c89thrd_success) {
+        printf("%s: c89timer_service_init() failed.\n", pTest->name);
+        c89thread_test_c89timer_state_uninit(&state);
+        return c89thrd_error;
+    }
+
+    c89timer_init(&record.timer);
+    record.pState   = &state;
+    record.deadline = c89timespec_now_monotonic();
+
+    if (c89timer_cancel(&record.timer) != c89thrd_error) {
+        printf("%s: Cancelling a timer that was never scheduled did not fail.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* A cancelled one-shot timer must never fire. */
+    delay = c89timespec_milliseconds(20);
+    c89timer_schedule(&service, &record.timer, &delay, c89thread_test_c89timer_proc, &record);
+
+    if (c89timer_cancel(&record.timer) != c89thrd_success) {
+        printf("%s: c89timer_cancel() failed on a pending timer.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89thrd_sleep_milliseconds(50);
+
+    if (c89thread_test_c89timer_state_fired_count(&state) != 0) {
+        printf("%s: A cancelled timer fired.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (c89timer_cancel(&record.timer) != c89thrd_error) {
+        printf("%s: Cancelling a timer twice did not fail.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* A periodic timer should keep firing until it's cancelled. */
+    delay  = c89timespec_milliseconds(5);
+    period = c89timespec_milliseconds(5);
+    c89timer_schedule_periodic(&service, &record.timer, &delay, &period, c89thread_test_c89timer_proc, &record);
+
+    for (iAttempt = 0; iAttempt < 100 && c89thread_test_c89timer_state_fired_count(&state) < 3; iAttempt += 1) {
+        c89thrd_sleep_milliseconds(10);
+    }
+
+    if (c89thread_test_c89timer_state_fired_count(&state) < 3) {
+        printf("%s: The periodic timer did not keep firing.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    if (c89timer_cancel(&record.timer) != c89thrd_success) {
+        printf("%s: c89timer_cancel() failed on a periodic timer.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    firedCount = c89thread_test_c89timer_state_fired_count(&state);
+    c89thrd_sleep_milliseconds(30);
+
+    if (c89thread_test_c89timer_state_fired_count(&state) != firedCount) {
+        printf("%s: The periodic timer fired after being cancelled.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Cancelling while the callback is running should wait for it to return. */
+    memset(&slowState, 0, sizeof(slowState));
+    c89mtx_init(&slowState.lock, c89mtx_plain);
+
+    c89timer_init(&slowTimer);
+    delay = c89timespec_nanoseconds(0);
+    c89timer_schedule(&service, &slowTimer, &delay, c89thread_test_c89timer_slow_proc, &slowState);
+
+    if (!c89thread_test_c89timer_wait_for_slow_proc(&slowState)) {
+        printf("%s: The timer callback did not start.\n", pTest->name);
+        result = c89thrd_error;
+    } else {
+        /* It has already fired so there's nothing to cancel, but we should still have waited. */
+        if (c89timer_cancel(&slowTimer) != c89thrd_error) {
+            printf("%s: Cancelling a timer that has fired did not fail.\n", pTest->name);
+            result = c89thrd_error;
+        }
+
+        c89mtx_lock(&slowState.lock);
+        {
+            if (!slowState.isFinished) {
+                printf("%s: c89timer_cancel() returned while the callback was still running.\n", pTest->name);
+                result = c89thrd_error;
+            }
+        }
+        c89mtx_unlock(&slowState.lock);
+    }
+
+    /* Every thread cancelling a running periodic timer should wait for the callback, not just one of them. */
+    slowState.isStarted  = 0;
+    slowState.isFinished = 0;
+
+    delay  = c89timespec_nanoseconds(0);
+    period = c89timespec_milliseconds(1000);
+    c89timer_schedule_periodic(&service, &slowTimer, &delay, &period, c89thread_test_c89timer_slow_proc, &slowState);
+
+    if (!c89thread_test_c89timer_wait_for_slow_proc(&slowState)) {
+        printf("%s: The periodic timer callback did not start.\n", pTest->name);
+        result = c89thrd_error;
+    } else if (c89thrd_create(&cancelThread, c89thread_test_c89timer_cancel__entry, &slowTimer) != c89thrd_success) {
+        printf("%s: Failed to create thread.\n", pTest->name);
+        c89timer_cancel(&slowTimer);
+        result = c89thrd_error;
+    } else {
+        c89timer_cancel(&slowTimer);
+
+        c89mtx_lock(&slowState.lock);
+        {
+            if (!slowState.isFinished) {
+                printf("%s: c89timer_cancel() returned while the callback was still running with two cancellers.\n", pTest->name);
+                result = c89thrd_error;
+            }
+        }
+        c89mtx_unlock(&slowState.lock);
+
+        c89thrd_join(cancelThread, NULL);
+    }
+
+    /* Timers still pending when the service goes away are detached from it. */
+    delay = c89timespec_milliseconds(10000);
+    c89timer_schedule(&service, &record.timer, &delay, c89thread_test_c89timer_proc, &record);
+
+    c89timer_service_uninit(&service);
+
+    if (c89timer_cancel(&record.timer) != c89thrd_error) {
+        printf("%s: Cancelling a timer dropped by c89timer_service_uninit() did not fail.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89mtx_destroy(&slowState.lock);
+    c89thread_test_c89timer_state_uninit(&state);
+
+    return result;
+}
+
+int c89thread_test_c89timer_idle(c89thread_test* pTest)
+{
+    c89timer_service service;
+    c89thread_test_c89timer_state state;
+    c89thread_test_c89timer_record record;
+    struct timespec delay;
+    struct timespec timeout;
+    int result = c89thrd_success;
+
+    if (c89thread_test_c89timer_state_init(&state, 1) != c89thrd_success) {
+        printf("%s: Failed to initialize test state.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    if (c89timer_service_init(&service, NULL) != c89thrd_success) {
+        printf("%s: c89timer_service_init() failed.\n", pTest->name);
+        c89thread_test_c89timer_state_uninit(&state);
+        return c89thrd_error;
+    }
+
+    /* Let the service sit idle. The first timer scheduled afterwards should catch the wheel up to now. */
+    c89thrd_sleep_milliseconds(30);
+
+    c89timer_init(&record.timer);
+    record.pState = &state;
+    delay = c89timespec_milliseconds(5);
+    record.deadline = c89timespec_add(c89timespec_now_monotonic(), delay);
+    c89timer_schedule(&service, &record.timer, &delay, c89thread_test_c89timer_proc, &record);
+
+    c89mtx_lock(&service.lock);
+    {
+        if (service.currentTick < 25) {
+            printf("%s: The service did not catch up after being idle. It's at tick %u.\n", pTest->name, (unsigned int)service.currentTick);
+            result = c89thrd_error;
+        }
+    }
+    c89mtx_unlock(&service.lock);
+
+    timeout = c89timespec_milliseconds(5000);
+    if (c89evnt_timedwait_for(&state.doneEvent, &timeout) != c89thrd_success) {
+        printf("%s: The timer did not fire after the service was idle.\n", pTest->name);
+        result = c89thrd_error;
+    } else if (state.earlyCount != 0) {
+        printf("%s: The timer fired early after the service was idle.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89timer_service_uninit(&service);
+    c89thread_test_c89timer_state_uninit(&state);
+
+    return result;
+}
+/* END test_c89timer */
+
+/* BEG test_c89thread_profile */
+#if defined(C89THREAD_PROFILE)
+#define C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY          64
+#define C89THREAD_TEST_WAIT_HISTOGRAM_WAIT_MILLISECONDS 10
+
+typedef struct
+{
+    c89evnt_t startEvent;
+    c89evnt_t evnt;
+} c89thread_test_wait_histogram_state;
+
+static int c89thread_test_c89thread_wait_histogram__entry(void* pUserData)
+{
+    c89thread_test_wait_histogram_state* pState = (c89thread_test_wait_histogram_state*)pUserData;
+
+    c89evnt_wait(&pState->startEvent);
+    c89thrd_sleep_milliseconds(C89THREAD_TEST_WAIT_HISTOGRAM_WAIT_MILLISECONDS);
+    c89evnt_signal(&pState->evnt);
+
+    return 0;
+}
+
+static const c89thread_wait_histogram* c89thread_test_find_wait_histogram(const c89thread_wait_histogram* pHistograms, size_t count, const char* pName, const void* pObject)
+{
+    size_t i;
+
+    for (i = 0; i < count; i += 1) {
+        if (pName != NULL) {
+            if (strcmp(pHistograms[i].name, pName) == 0) {
+                return &pHistograms[i];
+            }
+        } else {
+            if (pHistograms[i].name[0] == '\0' && pHistograms[i].pObject == pObject) {
+                return &pHistograms[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int c89thread_test_c89thread_wait_histogram_enabled(c89thread_test* pTest)
+{
+    c89thread_wait_histogram* pHistograms;
+    const c89thread_wait_histogram* pEventHistogram;
+    const c89thread_wait_histogram* pSemaphoreHistogram;
+    c89thread_wait_histogram histogram;
+    c89thread_test_wait_histogram_state state;
+    c89sem_t sem;
+    c89thrd_t thread;
+    unsigned int attemptCount;
+    size_t count;
+    size_t i;
+    int result = c89thrd_success;
+
+    /* Buckets must cover the whole range without gaps. */
+    for (i = 1; i < C89THREAD_WAIT_HISTOGRAM_BUCKET_COUNT; i += 1) {
+        if (c89thread_wait_histogram_bucket_bound(i) <= c89thread_wait_histogram_bucket_bound(i - 1)) {
+            printf("%s: Bucket bounds are not increasing at bucket %u.\n", pTest->name, (unsigned int)i);
+            return c89thrd_error;
+        }
+    }
+
+    memset(&histogram, 0, sizeof(histogram));
+    histogram.count = 100;
+    histogram.buckets[100] = 99;
+    histogram.buckets[200] = 1;
+    if (c89thread_wait_histogram_percentile(&histogram, 99) != c89thread_wait_histogram_bucket_bound(101) - 1 ||
+        c89thread_wait_histogram_percentile(&histogram, 100) != c89thread_wait_histogram_bucket_bound(201) - 1) {
+        printf("%s: Percentiles were not taken from the right buckets.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    pHistograms = (c89thread_wait_histogram*)malloc(sizeof(*pHistograms) * C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY);
+    if (pHistograms == NULL) {
+        printf("%s: Out of memory.\n", pTest->name);
+        return c89thrd_nomem;
+    }
+
+    c89evnt_init(&state.startEvent);
+    c89evnt_init(&state.evnt);
+    c89sem_init(&sem, 100, 100);
+    c89thread_profile_set_name(&state.evnt, "c89thread_test_event");
+
+    /* Start from nothing so earlier tests don't get in the way. */
+    c89thread_wait_histogram_snapshot(pHistograms, C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY, 1);
+
+    /*
+    The other thread starts its sleep once we're about to wait on the event so we should end up
+    waiting for the whole sleep. If we're held up before getting to the wait it'll be shorter, in
+    which case we try again. Every wait should be recorded, not just the last one.
+    */
+    pEventHistogram = NULL;
+    for (attemptCount = 1; attemptCount <= C89THREAD_TEST_MAX_CONTENTION_ATTEMPTS; attemptCount += 1) {
+        if (c89thrd_create(&thread, c89thread_test_c89thread_wait_histogram__entry, &state) != c89thrd_success) {
+            printf("%s: Failed to create thread.\n", pTest->name);
+            result = c89thrd_error;
+            break;
+        }
+
+        c89evnt_signal(&state.startEvent);
+        c89evnt_wait(&state.evnt);
+        c89thrd_join(thread, NULL);
+
+        count = c89thread_wait_histogram_snapshot(pHistograms, C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY, 0);
+        pEventHistogram = c89thread_test_find_wait_histogram(pHistograms, count, "c89thread_test_event", NULL);
+        if (pEventHistogram != NULL && c89thread_wait_histogram_percentile(pEventHistogram, 100) >= C89THREAD_TEST_WAIT_HISTOGRAM_WAIT_MILLISECONDS * 1000000) {
+            break;
+        }
+    }
+
+    for (i = 0; i < 100; i += 1) {
+        c89sem_wait(&sem);
+    }
+
+    count = c89thread_wait_histogram_snapshot(pHistograms, C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY, 1);
+
+    pEventHistogram     = c89thread_test_find_wait_histogram(pHistograms, count, "c89thread_test_event", NULL);
+    pSemaphoreHistogram = c89thread_test_find_wait_histogram(pHistograms, count, NULL, &sem);
+
+    if (result == c89thrd_success) {
+        if (attemptCount > C89THREAD_TEST_MAX_CONTENTION_ATTEMPTS) {
+            printf("%s: No wait on the event was recorded as at least %ums.\n", pTest->name, C89THREAD_TEST_WAIT_HISTOGRAM_WAIT_MILLISECONDS);
+            result = c89thrd_error;
+        } else if (pEventHistogram == NULL || pEventHistogram->count != attemptCount) {
+            printf("%s: Expecting %u waits on the named event.\n", pTest->name, attemptCount);
+            result = c89thrd_error;
+        }
+    }
+
+    if (pSemaphoreHistogram == NULL || pSemaphoreHistogram->count != 100) {
+        printf("%s: Expecting 100 waits on the semaphore.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    /* Everything was reset by the last snapshot. */
+    count = c89thread_wait_histogram_snapshot(pHistograms, C89THREAD_TEST_WAIT_HISTOGRAM_CAPACITY, 0);
+
+    pEventHistogram     = c89thread_test_find_wait_histogram(pHistograms, count, "c89thread_test_event", NULL);
+    pSemaphoreHistogram = c89thread_test_find_wait_histogram(pHistograms, count, NULL, &sem);
+
+    if ((pEventHistogram != NULL && pEventHistogram->count != 0) || (pSemaphoreHistogram != NULL && pSemaphoreHistogram->count != 0)) {
+        printf("%s: Histograms were not reset.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89thread_profile_set_name(&state.evnt, NULL);
+    c89sem_destroy(&sem);
+    c89evnt_destroy(&state.evnt);
+    c89evnt_destroy(&state.startEvent);
+    free(pHistograms);
+
+    return result;
+}
+#endif
+
+int c89thread_test_c89thread_wait_histogram(c89thread_test* pTest)
+{
+    #if defined(C89THREAD_PROFILE)
+    {
+        return c89thread_test_c89thread_wait_histogram_enabled(pTest);
+    }
+    #else
+    {
+        /* Nothing to test when the profiler isn't compiled in. */
+        (void)pTest;
+        return c89thrd_success;
+    }
+    #endif
 }
-/* END test_c89mtx_basic_plain */
+/* END test_c89thread_profile */
 
-/* BEG test_c89mtx_basic_recursive */
-int c89thread_test_c89mtx_basic_recursive(c89thread_test* pTest)
+/* BEG test_c89thread_hooks */
+#if defined(C89THREAD_ENABLE_HOOKS)
+typedef struct
 {
-    int result;
-    
-    /* First just do the basic mutex test. */
-    result = c89thread_test_c89mtx_basic(pTest, c89mtx_recursive);
-    if (result != c89thrd_success) {
-        printf("%s: Basic recursive mutex test failed.\n", pTest->name);
-        return result;
+    c89mtx_t lock;              /* Taken by the hooks themselves, which must not call back into the hooks. */
+    const void* pObject;        /* The object we're interested in. */
+    int beforeBlockCount;
+    int afterBlockCount;
+    int acquiredCount;
+    int releasedCount;
+    int threadCreatedCount;
+    int threadExitedCount;
+} c89thread_test_hooks_state;
+
+static void c89thread_test_hooks_count(void* pUserData, const void* pObject, int* pCount)
+{
+    c89thread_test_hooks_state* pState = (c89thread_test_hooks_state*)pUserData;
+
+    c89mtx_lock(&pState->lock);
+    {
+        if (pObject == NULL || pObject == pState->pObject) {
+            *pCount += 1;
+        }
     }
+    c89mtx_unlock(&pState->lock);
+}
 
-    /* Now test recursive locking. */
+static void c89thread_test_hooks_on_before_block(void* pUserData, int objectType, const void* pObject)
+{
+    (void)objectType;
+    c89thread_test_hooks_count(pUserData, pObject, &((c89thread_test_hooks_state*)pUserData)->beforeBlockCount);
+}
+
+static void c89thread_test_hooks_on_after_block(void* pUserData, int objectType, const void* pObject, int result)
+{
+    (void)objectType;
+    (void)result;
+    c89thread_test_hooks_count(pUserData, pObject, &((c89thread_test_hooks_state*)pUserData)->afterBlockCount);
+}
+
+static void c89thread_test_hooks_on_acquired(void* pUserData, int objectType, const void* pObject)
+{
+    (void)objectType;
+    c89thread_test_hooks_count(pUserData, pObject, &((c89thread_test_hooks_state*)pUserData)->acquiredCount);
+}
+
+static void c89thread_test_hooks_on_released(void* pUserData, int objectType, const void* pObject)
+{
+    (void)objectType;
+    c89thread_test_hooks_count(pUserData, pObject, &((c89thread_test_hooks_state*)pUserData)->releasedCount);
+}
+
+static void c89thread_test_hooks_on_thread_created(void* pUserData)
+{
+    c89thread_test_hooks_count(pUserData, NULL, &((c89thread_test_hooks_state*)pUserData)->threadCreatedCount);
+}
+
+static void c89thread_test_hooks_on_thread_exited(void* pUserData)
+{
+    c89thread_test_hooks_count(pUserData, NULL, &((c89thread_test_hooks_state*)pUserData)->threadExitedCount);
+}
+
+static int c89thread_test_c89thread_hooks__is_contended(void* pUserData)
+{
+    /* The other thread has been joined so this doesn't need the lock. Taking it here would call back into the hooks. */
+    return ((c89thread_test_hooks_state*)pUserData)->beforeBlockCount > 0;
+}
+
+static int c89thread_test_c89thread_hooks_enabled(c89thread_test* pTest)
+{
+    c89thread_test_hooks_state state;
+    c89thread_hooks hooks;
+    c89mtx_t mutex;
+    c89evnt_t evnt;
+    unsigned int attemptCount;
+    int result = c89thrd_success;
+
+    memset(&state, 0, sizeof(state));
+    c89mtx_init(&state.lock, c89mtx_plain);
+    c89mtx_init(&mutex, c89mtx_plain);
+    c89evnt_init(&evnt);
+    state.pObject = &mutex;
+
+    memset(&hooks, 0, sizeof(hooks));
+    hooks.pUserData       = &state;
+    hooks.onBeforeBlock   = c89thread_test_hooks_on_before_block;
+    hooks.onAfterBlock    = c89thread_test_hooks_on_after_block;
+    hooks.onAcquired      = c89thread_test_hooks_on_acquired;
+    hooks.onReleased      = c89thread_test_hooks_on_released;
+    hooks.onThreadCreated = c89thread_test_hooks_on_thread_created;
+    hooks.onThreadExited  = c89thread_test_hooks_on_thread_exited;
+    c89thread_set_hooks(&hooks);
+
+    /* Hold the mutex while another thread tries to take it so it has to block. Only the last attempt blocks. */
+    attemptCount = c89thread_test_contend_mutex(&mutex, 1, c89thread_test_c89thread_hooks__is_contended, &state);
+    if (attemptCount == 0) {
+        printf("%s: Failed to contend the mutex.\n", pTest->name);
+        c89thread_set_hooks(NULL);
+        c89evnt_destroy(&evnt);
+        c89mtx_destroy(&mutex);
+        c89mtx_destroy(&state.lock);
+        return c89thrd_error;
+    }
+
+    /* An event wait always goes through the hooks, even if it doesn't need to block. The other thread has finished so we can switch objects without the lock. */
+    state.pObject = &evnt;
+
+    c89evnt_signal(&evnt);
+    c89evnt_wait(&evnt);
+
+    c89thread_set_hooks(NULL);
+
+    /* Nothing should be reported once the hooks are removed. */
+    c89mtx_lock(&mutex);
+    c89mtx_unlock(&mutex);
+
+    if (state.acquiredCount != (int)(attemptCount * 2) || state.releasedCount != (int)(attemptCount * 2)) {
+        printf("%s: Expecting the mutex to be acquired and released %u times. Got %d and %d.\n", pTest->name, attemptCount * 2, state.acquiredCount, state.releasedCount);
+        result = c89thrd_error;
+    }
+
+    /* One contended lock and one event wait. */
+    if (state.beforeBlockCount != 2 || state.afterBlockCount != 2) {
+        printf("%s: Expecting 2 blocking operations. Got %d before and %d after.\n", pTest->name, state.beforeBlockCount, state.afterBlockCount);
+        result = c89thrd_error;
+    }
+
+    if (state.threadCreatedCount < 1 || state.threadExitedCount < 1) {
+        printf("%s: Thread creation and exit were not reported.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    c89evnt_destroy(&evnt);
+    c89mtx_destroy(&mutex);
+    c89mtx_destroy(&state.lock);
+
+    return result;
+}
+#endif
+
+int c89thread_test_c89thread_hooks(c89thread_test* pTest)
+{
+    #if defined(C89THREAD_ENABLE_HOOKS)
     {
-        c89mtx_t recursiveMutex;
+        return c89thread_test_c89thread_hooks_enabled(pTest);
+    }
+    #else
+    {
+        /* Nothing to test when hooks aren't compiled in. */
+        (void)pTest;
+        return c89thrd_success;
+    }
+    #endif
+}
+/* END test_c89thread_hooks */
 
-        result = c89mtx_init(&recursiveMutex, c89mtx_recursive);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_init() failed.\n", pTest->name);
-            return result;
-        }
+/* BEG test_c89thread_trace */
+#if defined(C89THREAD_ENABLE_TRACE)
+typedef struct
+{
+    FILE* pFile;    /* The most recent dump. */
+    int result;
+} c89thread_test_trace_state;
 
-        result = c89mtx_lock(&recursiveMutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_lock() failed.\n", pTest->name);
-            c89mtx_destroy(&recursiveMutex);
-            return result;
-        }
+static int c89thread_test_c89thread_trace_contains(FILE* pFile, const char* pNeedle)
+{
+    char line[1024];
 
-        result = c89mtx_lock(&recursiveMutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_lock() failed.\n", pTest->name);
-            c89mtx_unlock(&recursiveMutex);
-            c89mtx_destroy(&recursiveMutex);
-            return result;
+    rewind(pFile);
+    while (fgets(line, sizeof(line), pFile) != NULL) {
+        if (strstr(line, pNeedle) != NULL) {
+            return 1;
         }
+    }
 
-        result = c89mtx_unlock(&recursiveMutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-            c89mtx_destroy(&recursiveMutex);
-            return result;
+    return 0;
+}
+
+static int c89thread_test_c89thread_trace_dump(c89thread_test_trace_state* pState)
+{
+    if (pState->pFile != NULL) {
+        fclose(pState->pFile);
+    }
+
+    pState->pFile = tmpfile();
+    if (pState->pFile == NULL) {
+        return c89thrd_error;
+    }
+
+    return c89thread_trace_dump(pState->pFile);
+}
+
+static int c89thread_test_c89thread_trace__is_contended(void* pUserData)
+{
+    c89thread_test_trace_state* pState = (c89thread_test_trace_state*)pUserData;
+
+    pState->result = c89thread_test_c89thread_trace_dump(pState);
+    if (pState->result != c89thrd_success) {
+        return 1;   /* Nothing more we can do. */
+    }
+
+    return c89thread_test_c89thread_trace_contains(pState->pFile, "\"mutex wait\"");
+}
+
+static int c89thread_test_c89thread_trace_check(c89thread_test* pTest, FILE* pFile, const char** ppExpected, size_t expectedCount)
+{
+    size_t iExpected;
+    int result = c89thrd_success;
+
+    for (iExpected = 0; iExpected < expectedCount; iExpected += 1) {
+        if (!c89thread_test_c89thread_trace_contains(pFile, ppExpected[iExpected])) {
+            printf("%s: The trace is missing %s.\n", pTest->name, ppExpected[iExpected]);
+            result = c89thrd_error;
         }
+    }
 
-        result = c89mtx_unlock(&recursiveMutex);
-        if (result != c89thrd_success) {
-            printf("%s: c89mtx_unlock() failed.\n", pTest->name);
-            c89mtx_destroy(&recursiveMutex);
-            return result;
+    return result;
+}
+
+static int c89thread_test_c89thread_trace_enabled(c89thread_test* pTest)
+{
+    const char* pExpectedAfterContention[] = {"\"traceEvents\"", "\"thread start\"", "\"thread exit\"", "\"mutex wait\"", "\"mutex hold\""};
+    const char* pExpectedAfterEvent[]      = {"\"traceEvents\"", "\"event wait\""};
+    c89thread_test_trace_state state;
+    c89mtx_t mutex;
+    c89evnt_t evnt;
+    unsigned int attemptCount;
+    int result = c89thrd_success;
+
+    if (c89thread_trace_dump(NULL) != c89thrd_error) {
+        printf("%s: Expecting an error when dumping to a NULL file.\n", pTest->name);
+        return c89thrd_error;
+    }
+
+    state.pFile = tmpfile();
+    if (state.pFile == NULL) {
+        /* Some environments don't allow temporary files. Not a failure of the trace. */
+        return c89thrd_success;
+    }
+
+    c89mtx_init(&mutex, c89mtx_plain);
+    c89evnt_init(&evnt);
+
+    /*
+    Hold the mutex while another thread tries to take it so it has to block. Each attempt dumps the
+    trace to see whether the wait was recorded. The other thread's buffer can be reused once it has
+    been dumped, so the thread events are checked in the same dump.
+    */
+    attemptCount = c89thread_test_contend_mutex(&mutex, 1, c89thread_test_c89thread_trace__is_contended, &state);
+    if (attemptCount == 0) {
+        printf("%s: Failed to contend the mutex.\n", pTest->name);
+        result = c89thrd_error;
+    } else if (state.result != c89thrd_success) {
+        printf("%s: Failed to dump the trace.\n", pTest->name);
+        result = c89thrd_error;
+    } else {
+        result = c89thread_test_c89thread_trace_check(pTest, state.pFile, pExpectedAfterContention, sizeof(pExpectedAfterContention) / sizeof(pExpectedAfterContention[0]));
+    }
+
+    if (result == c89thrd_success) {
+        c89evnt_signal(&evnt);
+        c89evnt_wait(&evnt);
+
+        if (c89thread_test_c89thread_trace_dump(&state) != c89thrd_success) {
+            printf("%s: Failed to dump the trace.\n", pTest->name);
+            result = c89thrd_error;
+        } else {
+            result = c89thread_test_c89thread_trace_check(pTest, state.pFile, pExpectedAfterEvent, sizeof(pExpectedAfterEvent) / sizeof(pExpectedAfterEvent[0]));
         }
+    }
 
-        c89mtx_destroy(&recursiveMutex);
+    if (state.pFile != NULL) {
+        fclose(state.pFile);
     }
 
-    return c89thrd_success;
+    c89evnt_destroy(&evnt);
+    c89mtx_destroy(&mutex);
+
+    return result;
 }
-/* END test_c89mtx_basic_recursive */
+#endif
 
-/* BEG test_c89mtx_timed_plain */
-int c89thread_test_c89mtx_timed_plain(c89thread_test* pTest)
+int c89thread_test_c89thread_trace(c89thread_test* pTest)
 {
-    return c89thread_test_c89mtx_timed(pTest, c89mtx_plain);
+    #if defined(C89THREAD_ENABLE_TRACE)
+    {
+        return c89thread_test_c89thread_trace_enabled(pTest);
+    }
+    #else
+    {
+        /* Nothing to test when tracing isn't compiled in. */
+        (void)pTest;
+        return c89thrd_success;
+    }
+    #endif
 }
-/* END test_c89mtx_timed_plain */
+/* END test_c89thread_trace */
 
-/* BEG test_c89mtx_timed_recursive */
-int c89thread_test_c89mtx_timed_recursive(c89thread_test* pTest)
+
+/* BEG test_c89thread_get_topology */
+int c89thread_test_c89thread_get_topology(c89thread_test* pTest)
 {
-    return c89thread_test_c89mtx_timed(pTest, c89mtx_recursive);
+    c89thread_topology topology;
+    unsigned int iCPU;
+    int result;
+
+    result = c89thread_get_topology(&topology, NULL);
+    if (result != c89thrd_success) {
+        printf("%s: c89thread_get_topology() failed.\n", pTest->name);
+        return result;
+    }
+
+    result = c89thrd_success;
+
+    if (topology.cpuCount == 0 || topology.coreCount == 0 || topology.coreCount > topology.cpuCount || topology.packageCount == 0 || topology.packageCount > topology.coreCount) {
+        printf("%s: Inconsistent counts. CPUs = %u, Cores = %u, Packages = %u.\n", pTest->name, topology.cpuCount, topology.coreCount, topology.packageCount);
+        result = c89thrd_error;
+    }
+
+    if (topology.l2Count == 0 || topology.l3Count == 0 || topology.numaNodeCount == 0) {
+        printf("%s: Missing cache or NUMA groups.\n", pTest->name);
+        result = c89thrd_error;
+    }
+
+    for (iCPU = 0; iCPU < topology.cpuCount; iCPU += 1) {
+        const c89thread_cpu_info* pCPU = &topology.pCPUs[iCPU];
+
+        if (pCPU->packageIndex >= topology.packageCount || pCPU->coreIndex >= topology.coreCount || pCPU->l2Index >= topology.l2Count || pCPU->l3Index >= topology.l3Count) {
+            printf("%s: CPU %u has an out of range index.\n", pTest->name, pCPU->id);
+            result = c89thrd_error;
+        }
+    }
+
+    c89thread_free_topology(&topology);
+    return result;
 }
-/* END test_c89mtx_timed_recursive */
+/* END test_c89thread_get_topology */
 
-/* BEG test_c89mtx_trylock_plain */
-int c89thread_test_c89mtx_trylock_plain(c89thread_test* pTest)
+
+/* BEG test_c89thread_get_usable_cpu_count */
+#if !defined(_WIN32)
+#include <sys/stat.h>   /* For mkdir(). */
+#include <unistd.h>     /* For rmdir(). */
+
+#define C89THREAD_TEST_ROOT "c89thread_test_root"
+
+static const char* g_c89threadTestRootDirectories[] =
 {
-    return c89thread_test_c89mtx_trylock(pTest, c89mtx_plain);
+    C89THREAD_TEST_ROOT,
+    C89THREAD_TEST_ROOT "/proc",
+    C89THREAD_TEST_ROOT "/proc/self",
+    C89THREAD_TEST_ROOT "/sys",
+    C89THREAD_TEST_ROOT "/sys/fs",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/test",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct"
+};
+
+static const char* g_c89threadTestRootFiles[] =
+{
+    C89THREAD_TEST_ROOT "/proc/self/status",
+    C89THREAD_TEST_ROOT "/proc/self/cgroup",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu.max",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/test/cpu.max",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_quota_us",
+    C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_period_us"
+};
+
+static int c89thread_test_write_file(const char* pFilePath, const char* pContent)
+{
+    FILE* pFile;
+
+    pFile = fopen(pFilePath, "wb");
+    if (pFile == NULL) {
+        return c89thrd_error;
+    }
+
+    fwrite(pContent, 1, strlen(pContent), pFile);
+    fclose(pFile);
+
+    return c89thrd_success;
 }
-/* END test_c89mtx_trylock_plain */
 
-/* BEG test_c89mtx_trylock_recursive */
-int c89thread_test_c89mtx_trylock_recursive(c89thread_test* pTest)
+static void c89thread_test_remove_root(void)
 {
-    return c89thread_test_c89mtx_trylock(pTest, c89mtx_recursive);
+    size_t i;
+
+    for (i = 0; i < sizeof(g_c89threadTestRootFiles) / sizeof(g_c89threadTestRootFiles[0]); i += 1) {
+        remove(g_c89threadTestRootFiles[i]);
+    }
+
+    for (i = sizeof(g_c89threadTestRootDirectories) / sizeof(g_c89threadTestRootDirectories[0]); i > 0; i -= 1) {
+        rmdir(g_c89threadTestRootDirectories[i - 1]);
+    }
 }
-/* END test_c89mtx_trylock_recursive */
 
-/* END test_c89mtx */
+static int c89thread_test_check_usable_cpu_count(c89thread_test* pTest, const char* pDescription, int expected)
+{
+    int count = c89thread_get_usable_cpu_count_from_root(C89THREAD_TEST_ROOT);
+    if (count != expected) {
+        printf("%s: %s: Expected %d CPUs, got %d.\n", pTest->name, pDescription, expected, count);
+        return c89thrd_error;
+    }
+
+    return c89thrd_success;
+}
+#endif
+
+int c89thread_test_c89thread_get_usable_cpu_count(c89thread_test* pTest)
+{
+    int result = c89thrd_success;
+    int count;
+
+    count = c89thread_get_usable_cpu_count();
+    if (count < 1 || count > c89thread_get_logical_cpu_count()) {
+        printf("%s: Usable CPU count of %d is out of range.\n", pTest->name, count);
+        return c89thrd_error;
+    }
+
+    #if !defined(_WIN32)
+    {
+        size_t i;
+
+        c89thread_test_remove_root();
+
+        for (i = 0; i < sizeof(g_c89threadTestRootDirectories) / sizeof(g_c89threadTestRootDirectories[0]); i += 1) {
+            if (mkdir(g_c89threadTestRootDirectories[i], 0755) != 0) {
+                printf("%s: Failed to create %s.\n", pTest->name, g_c89threadTestRootDirectories[i]);
+                c89thread_test_remove_root();
+                return c89thrd_error;
+            }
+        }
+
+        /* cgroup v2 with the quota on our own cgroup. */
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/proc/self/status", "Name:\ttest\nCpus_allowed:\tffff\nCpus_allowed_list:\t0-15\nMems_allowed_list:\t0\n");
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/proc/self/cgroup", "0::/test\n");
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu.max", "max 100000\n");
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/test/cpu.max", "250000 100000\n");
+        if (c89thread_test_check_usable_cpu_count(pTest, "cgroup v2", 3) != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        /* A parent with a tighter quota wins. */
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu.max", "150000 100000\n");
+        if (c89thread_test_check_usable_cpu_count(pTest, "cgroup v2 parent", 2) != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        /* cgroup v1 without a cgroup namespace, where our path does not exist and the quota is on the mount point. */
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/proc/self/cgroup", "12:cpuset:/\n4:cpu,cpuacct:/docker/abc\n1:name=systemd:/docker/abc\n");
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_quota_us", "800000\n");
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_period_us", "100000\n");
+        if (c89thread_test_check_usable_cpu_count(pTest, "cgroup v1", 8) != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        /* An affinity mask smaller than the quota. */
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/proc/self/status", "Name:\ttest\nCpus_allowed_list:\t0-1,4\n");
+        if (c89thread_test_check_usable_cpu_count(pTest, "affinity", 3) != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        /* No quota. */
+        c89thread_test_write_file(C89THREAD_TEST_ROOT "/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_quota_us", "-1\n");
+        if (c89thread_test_check_usable_cpu_count(pTest, "unlimited", 3) != c89thrd_success) {
+            result = c89thrd_error;
+        }
+
+        c89thread_test_remove_root();
+    }
+    #endif
+
+    return result;
+}
+/* END test_c89thread_get_usable_cpu_count */
 
 
 int main(int argc, char** argv)
@@ -823,6 +3583,16 @@ int main(int argc, char** argv)
     c89thread_test test_c89thrd_exit;
     c89thread_test test_c89thrd_yield;
     c89thread_test test_c89thrd_sleep;
+    c89thread_test test_c89thrd_sleep_precise;
+    c89thread_test test_c89thrd_sleep_until;
+    c89thread_test test_c89periodic;
+    c89thread_test test_c89thrd_affinity;
+    c89thread_test test_c89thrd_stack;
+    c89thread_test test_c89thrd_name;
+    c89thread_test test_c89thrd_priority;
+    c89thread_test test_c89thrd_noalloc;
+    c89thread_test test_c89thrd_cache;
+    c89thread_test test_c89thrd_timedjoin;
     c89thread_test test_c89mtx;
     c89thread_test test_c89mtx_basic;
     c89thread_test test_c89mtx_basic_plain;
@@ -833,9 +3603,34 @@ int main(int argc, char** argv)
     c89thread_test test_c89mtx_trylock;
     c89thread_test test_c89mtx_trylock_plain;
     c89thread_test test_c89mtx_trylock_recursive;
+    c89thread_test test_c89mtx_profile;
     c89thread_test test_c89cnd;
     c89thread_test test_c89sem;
     c89thread_test test_c89evnt;
+    c89thread_test test_c89barrier;
+    c89thread_test test_c89barrier_flat;
+    c89thread_test test_c89barrier_tree;
+    c89thread_test test_c89latch;
+    c89thread_test test_c89latch_count_down;
+    c89thread_test test_c89latch_arrive_and_wait;
+    c89thread_test test_c89latch_over_count;
+    c89thread_test test_c89timespec;
+    c89thread_test test_c89timespec_monotonic;
+    c89thread_test test_c89timespec_for;
+    c89thread_test test_c89thread_ticks;
+    c89thread_test test_c89timespec_cached;
+    c89thread_test test_c89timer;
+    c89thread_test test_c89timer_schedule;
+    c89thread_test test_c89timer_schedule_at;
+    c89thread_test test_c89timer_cancel;
+    c89thread_test test_c89timer_idle;
+    c89thread_test test_c89thread_profile;
+    c89thread_test test_c89thread_wait_histogram;
+    c89thread_test test_c89thread_hooks;
+    c89thread_test test_c89thread_trace;
+    c89thread_test test_c89thread_cpu;
+    c89thread_test test_c89thread_get_topology;
+    c89thread_test test_c89thread_get_usable_cpu_count;
     int result;
 
     (void)argc;
@@ -853,6 +3648,16 @@ int main(int argc, char** argv)
     c89thread_test_init(&test_c89thrd_exit,             "c89thrd_exit",             c89thread_test_c89thrd_exit,             NULL, &test_c89thrd);
     c89thread_test_init(&test_c89thrd_yield,            "c89thrd_yield",            c89thread_test_c89thrd_yield,            NULL, &test_c89thrd);
     c89thread_test_init(&test_c89thrd_sleep,            "c89thrd_sleep",            c89thread_test_c89thrd_sleep,            NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_sleep_precise,    "c89thrd_sleep_precise",    c89thread_test_c89thrd_sleep_precise,    NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_sleep_until,      "c89thrd_sleep_until",      c89thread_test_c89thrd_sleep_until,      NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89periodic,              "c89periodic",              c89thread_test_c89periodic,              NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_affinity,         "c89thrd_affinity",         c89thread_test_c89thrd_affinity,         NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_stack,            "c89thrd_stack",            c89thread_test_c89thrd_stack,            NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_name,             "c89thrd_name",             c89thread_test_c89thrd_name,             NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_priority,         "c89thrd_priority",         c89thread_test_c89thrd_priority,         NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_noalloc,          "c89thrd_noalloc",          c89thread_test_c89thrd_noalloc,          NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_cache,            "c89thrd_cache",            c89thread_test_c89thrd_cache,            NULL, &test_c89thrd);
+    c89thread_test_init(&test_c89thrd_timedjoin,        "c89thrd_timedjoin",        c89thread_test_c89thrd_timedjoin,        NULL, &test_c89thrd);
 
     /* Mutex. */
     c89thread_test_init(&test_c89mtx,                   "c89mtx",                   NULL,                                    NULL, &test_root);
@@ -865,6 +3670,7 @@ int main(int argc, char** argv)
     c89thread_test_init(&test_c89mtx_trylock,           "c89mtx_trylock",           NULL,                                    NULL, &test_c89mtx);
     c89thread_test_init(&test_c89mtx_trylock_plain,     "c89mtx_trylock_plain",     c89thread_test_c89mtx_trylock_plain,     NULL, &test_c89mtx_trylock);
     c89thread_test_init(&test_c89mtx_trylock_recursive, "c89mtx_trylock_recursive", c89thread_test_c89mtx_trylock_recursive, NULL, &test_c89mtx_trylock);
+    c89thread_test_init(&test_c89mtx_profile,           "c89mtx_profile",           c89thread_test_c89mtx_profile,           NULL, &test_c89mtx);
 
     /* Condition Variable. */
     c89thread_test_init(&test_c89cnd,                   "c89cnd",                   NULL,                                    NULL, &test_root);
@@ -875,6 +3681,46 @@ int main(int argc, char** argv)
     /* Event. */
     c89thread_test_init(&test_c89evnt,                   "c89evnt",                 NULL,                                    NULL, &test_root);
 
+    /* Barrier. */
+    c89thread_test_init(&test_c89barrier,               "c89barrier",               NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89barrier_flat,          "c89barrier_flat",          c89thread_test_c89barrier_flat,          NULL, &test_c89barrier);
+    c89thread_test_init(&test_c89barrier_tree,          "c89barrier_tree",          c89thread_test_c89barrier_tree,          NULL, &test_c89barrier);
+
+    /* Latch. */
+    c89thread_test_init(&test_c89latch,                 "c89latch",                 NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89latch_count_down,      "c89latch_count_down",      c89thread_test_c89latch_count_down,      NULL, &test_c89latch);
+    c89thread_test_init(&test_c89latch_arrive_and_wait, "c89latch_arrive_and_wait", c89thread_test_c89latch_arrive_and_wait, NULL, &test_c89latch);
+    c89thread_test_init(&test_c89latch_over_count,      "c89latch_over_count",      c89thread_test_c89latch_over_count,      NULL, &test_c89latch);
+
+    /* Time. */
+    c89thread_test_init(&test_c89timespec,              "c89timespec",              NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89timespec_monotonic,    "c89timespec_monotonic",    c89thread_test_c89timespec_monotonic,    NULL, &test_c89timespec);
+    c89thread_test_init(&test_c89timespec_for,          "c89timespec_for",          c89thread_test_c89timespec_for,          NULL, &test_c89timespec);
+    c89thread_test_init(&test_c89thread_ticks,          "c89thread_ticks",          c89thread_test_c89thread_ticks,          NULL, &test_c89timespec);
+    c89thread_test_init(&test_c89timespec_cached,       "c89timespec_cached",       c89thread_test_c89timespec_cached,       NULL, &test_c89timespec);
+
+    /* Timer. */
+    c89thread_test_init(&test_c89timer,                 "c89timer",                 NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89timer_schedule,        "c89timer_schedule",        c89thread_test_c89timer_schedule,        NULL, &test_c89timer);
+    c89thread_test_init(&test_c89timer_schedule_at,     "c89timer_schedule_at",     c89thread_test_c89timer_schedule_at,     NULL, &test_c89timer);
+    c89thread_test_init(&test_c89timer_cancel,          "c89timer_cancel",          c89thread_test_c89timer_cancel,          NULL, &test_c89timer);
+    c89thread_test_init(&test_c89timer_idle,            "c89timer_idle",            c89thread_test_c89timer_idle,            NULL, &test_c89timer);
+
+    /* Profiling. */
+    c89thread_test_init(&test_c89thread_profile,        "c89thread_profile",        NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89thread_wait_histogram, "c89thread_wait_histogram", c89thread_test_c89thread_wait_histogram, NULL, &test_c89thread_profile);
+
+    /* Hooks. */
+    c89thread_test_init(&test_c89thread_hooks,          "c89thread_hooks",          c89thread_test_c89thread_hooks,          NULL, &test_root);
+
+    /* Tracing. */
+    c89thread_test_init(&test_c89thread_trace,          "c89thread_trace",          c89thread_test_c89thread_trace,          NULL, &test_root);
+
+    /* CPU. */
+    c89thread_test_init(&test_c89thread_cpu,            "c89thread_cpu",            NULL,                                    NULL, &test_root);
+    c89thread_test_init(&test_c89thread_get_topology,   "c89thread_get_topology",   c89thread_test_c89thread_get_topology,   NULL, &test_c89thread_cpu);
+    c89thread_test_init(&test_c89thread_get_usable_cpu_count, "c89thread_get_usable_cpu_count", c89thread_test_c89thread_get_usable_cpu_count, NULL, &test_c89thread_cpu);
+
     result = c89thread_test_run(&test_root);
 
     /* Print the test summary. */